@@ -209,6 +209,7 @@ boolean df_post_connect(freerdp* instance)
 
 	df_keyboard_init();
 
+	cache_register_callbacks(instance->update);
 	pointer_cache_register_callbacks(instance->update);
 	df_register_graphics(instance->context->graphics);
 
@@ -1020,6 +1020,8 @@ boolean mac_pre_connect(freerdp *inst)
     int  len;
     int  i;
     
+    /* input is sent from the run loop, not from a loop calling freerdp_get_fds() */
+    inst->settings->input_batching = false;
     inst->settings->offscreen_bitmap_cache = false;
     inst->settings->glyph_cache = true;
     inst->settings->glyphSupportLevel = GLYPH_SUPPORT_FULL;
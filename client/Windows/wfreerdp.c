@@ -308,6 +308,7 @@ boolean wf_post_connect(freerdp* instance)
 		wfi->hdc->hwnd->count = 32;
 		wfi->hdc->hwnd->cinvalid = (HGDI_RGN) xmalloc(sizeof(GDI_RGN) * wfi->hdc->hwnd->count);
 		wfi->hdc->hwnd->ninvalid = 0;
+		wfi->hdc->hwnd->maxinvalid = GDI_MAX_INVALID_RECTS;
 
 		wfi->image = wf_image_new(wfi, 64, 64, 32, NULL);
 		wfi->image->_bitmap.data = NULL;
@@ -375,6 +376,7 @@ boolean wf_post_connect(freerdp* instance)
 		instance->update->EndPaint = wf_hw_end_paint;
 	}
 
+	cache_register_callbacks(instance->update);
 	pointer_cache_register_callbacks(instance->update);
 
 	if (wfi->sw_gdi != TRUE)
@@ -823,6 +823,11 @@ boolean xf_event_process(freerdp* instance, XEvent* event)
 	rdpRail* rail = ((rdpContext*) xfi->context)->rail;
 	rdpWindow* window;
 
+#ifdef WITH_XSHM
+	if (xf_shm_completion(xfi, event))
+		return true;
+#endif
+
 	if (xfi->remote_app)
 	{
 		window = window_list_get_by_extra_id(
@@ -33,6 +33,7 @@
 #include <freerdp/codec/bitmap.h>
 
 #include "xf_gdi.h"
+#include "xf_graphics.h"
 
 static const uint8 xf_rop2_table[] =
 {
@@ -296,10 +297,12 @@ void xf_gdi_set_bounds(rdpContext* context, rdpBounds* bounds)
 		clip.width = bounds->right - bounds->left + 1;
 		clip.height = bounds->bottom - bounds->top + 1;
 		XSetClipRectangles(xfi->display, xfi->gc, 0, 0, &clip, 1, YXBanded);
+		xf_render_set_clip(xfi, &clip);
 	}
 	else
 	{
 		XSetClipMask(xfi->display, xfi->gc, None);
+		xf_render_set_clip(xfi, NULL);
 	}
 }
 
@@ -879,6 +882,54 @@ void xf_gdi_ellipse_cb(rdpContext* context, ELLIPSE_CB_ORDER* ellipse_cb)
 	printf("EllipseCB\n");
 }
 
+/**
+ * Copy the rectangles of a region from the backstore to the window, with
+ * a single XCopyArea of their bounding box clipped to the rectangles.
+ */
+
+static void xf_gdi_surface_update_region(xfInfo* xfi, HGDI_WND region)
+{
+	int i;
+	int x1, y1, x2, y2;
+	XRectangle* rects;
+	HGDI_RGN cinvalid = region->cinvalid;
+
+	if (region->ninvalid < 1)
+		return;
+
+	rects = (XRectangle*) xmalloc(sizeof(XRectangle) * region->ninvalid);
+
+	x1 = cinvalid[0].x;
+	y1 = cinvalid[0].y;
+	x2 = x1 + cinvalid[0].w;
+	y2 = y1 + cinvalid[0].h;
+
+	for (i = 0; i < region->ninvalid; i++)
+	{
+		rects[i].x = cinvalid[i].x;
+		rects[i].y = cinvalid[i].y;
+		rects[i].width = cinvalid[i].w;
+		rects[i].height = cinvalid[i].h;
+
+		x1 = MIN(x1, cinvalid[i].x);
+		y1 = MIN(y1, cinvalid[i].y);
+		x2 = MAX(x2, cinvalid[i].x + cinvalid[i].w);
+		y2 = MAX(y2, cinvalid[i].y + cinvalid[i].h);
+
+		gdi_InvalidateRegion(xfi->hdc, cinvalid[i].x, cinvalid[i].y, cinvalid[i].w, cinvalid[i].h);
+	}
+
+	XSetFunction(xfi->display, xfi->gc, GXcopy);
+	XSetFillStyle(xfi->display, xfi->gc, FillSolid);
+
+	/* the region is kept disjoint and sorted by top then left edge */
+	XSetClipRectangles(xfi->display, xfi->gc, 0, 0, rects, region->ninvalid, YXSorted);
+	XCopyArea(xfi->display, xfi->primary, xfi->drawable, xfi->gc, x1, y1, x2 - x1, y2 - y1, x1, y1);
+	XSetClipMask(xfi->display, xfi->gc, None);
+
+	xfree(rects);
+}
+
 void xf_gdi_surface_frame_marker(rdpContext* context, SURFACE_FRAME_MARKER* surface_frame_marker)
 {
 	xfInfo* xfi = ((xfContext*) context)->xfi;
@@ -887,26 +938,17 @@ void xf_gdi_surface_frame_marker(rdpContext* context, SURFACE_FRAME_MARKER* surf
 	{
 		case SURFACECMD_FRAMEACTION_BEGIN:
 			xfi->frame_begin = true;
-			xfi->frame_x1 = 0;
-			xfi->frame_y1 = 0;
-			xfi->frame_x2 = 0;
-			xfi->frame_y2 = 0;
 			break;
 
 		case SURFACECMD_FRAMEACTION_END:
 			xfi->frame_begin = false;
-			if (xfi->frame_x2 > xfi->frame_x1 && xfi->frame_y2 > xfi->frame_y1)
-			{
-				XSetFunction(xfi->display, xfi->gc, GXcopy);
-				XSetFillStyle(xfi->display, xfi->gc, FillSolid);
 
-				XCopyArea(xfi->display, xfi->primary, xfi->drawable, xfi->gc,
-					xfi->frame_x1, xfi->frame_y1,
-					xfi->frame_x2 - xfi->frame_x1, xfi->frame_y2 - xfi->frame_y1,
-					xfi->frame_x1, xfi->frame_y1);
-				gdi_InvalidateRegion(xfi->hdc, xfi->frame_x1, xfi->frame_y1,
-					xfi->frame_x2 - xfi->frame_x1, xfi->frame_y2 - xfi->frame_y1);
-			}
+			/* the region of a skipped frame is presented with the next one */
+			if (xf_frame_outdated(xfi))
+				break;
+
+			xf_gdi_surface_update_region(xfi, &xfi->frame);
+			xfi->frame.ninvalid = 0;
 			break;
 	}
 }
@@ -917,20 +959,7 @@ static void xf_gdi_surface_update_frame(xfInfo* xfi, uint16 tx, uint16 ty, uint1
 	{
 		if (xfi->frame_begin)
 		{
-			if (xfi->frame_x2 > xfi->frame_x1 && xfi->frame_y2 > xfi->frame_y1)
-			{
-				xfi->frame_x1 = MIN(xfi->frame_x1, tx);
-				xfi->frame_y1 = MIN(xfi->frame_y1, ty);
-				xfi->frame_x2 = MAX(xfi->frame_x2, tx + width);
-				xfi->frame_y2 = MAX(xfi->frame_y2, ty + height);
-			}
-			else
-			{
-				xfi->frame_x1 = tx;
-				xfi->frame_y1 = ty;
-				xfi->frame_x2 = tx + width;
-				xfi->frame_y2 = ty + height;
-			}
+			gdi_UnionWndRgn(&xfi->frame, tx, ty, width, height);
 		}
 		else
 		{
@@ -945,9 +974,291 @@ static void xf_gdi_surface_update_frame(xfInfo* xfi, uint16 tx, uint16 ty, uint1
 	}
 }
 
+/**
+ * (Re)create the shared memory staging image for surface bits.
+ * It is only used with a 32bpp visual, the layout the codecs decode to.
+ */
+
+void xf_gdi_shm_init(xfInfo* xfi)
+{
+#ifdef WITH_XSHM
+	xf_gdi_shm_free(xfi);
+
+	if (xfi->depth != 24 || xfi->bpp != 32)
+		return;
+
+	xfi->shm_image = xf_shm_image_new(xfi, xfi->width, xfi->height);
+
+	if (xfi->shm_image != NULL && xfi->shm_image->image->bits_per_pixel != 32)
+		xf_gdi_shm_free(xfi);
+#endif
+}
+
+void xf_gdi_shm_free(xfInfo* xfi)
+{
+#ifdef WITH_XSHM
+	if (xfi->shm_image != NULL)
+	{
+		xf_shm_image_free(xfi, xfi->shm_image);
+		xfi->shm_image = NULL;
+	}
+#endif
+}
+
+/**
+ * Compute the bounding box of the updated rectangles of a RemoteFX message.
+ */
+
+static boolean xf_gdi_rfx_bounds(RFX_MESSAGE* message, int left, int top, int* x, int* y, int* width, int* height)
+{
+	int i;
+	int x1, y1, x2, y2;
+
+	if (message->num_rects < 1)
+		return false;
+
+	x1 = message->rects[0].x;
+	y1 = message->rects[0].y;
+	x2 = x1 + message->rects[0].width;
+	y2 = y1 + message->rects[0].height;
+
+	for (i = 1; i < message->num_rects; i++)
+	{
+		x1 = MIN(x1, message->rects[i].x);
+		y1 = MIN(y1, message->rects[i].y);
+		x2 = MAX(x2, message->rects[i].x + message->rects[i].width);
+		y2 = MAX(y2, message->rects[i].y + message->rects[i].height);
+	}
+
+	*x = x1 + left;
+	*y = y1 + top;
+	*width = x2 - x1;
+	*height = y2 - y1;
+
+	return true;
+}
+
+/**
+ * Assemble the tiles of a RemoteFX message into one image covering their
+ * bounding box and upload it with one XPutImage per row of tiles, instead of
+ * one image and one request per tile. The gc clips to the updated rects.
+ */
+
+static void xf_gdi_put_tiles(xfInfo* xfi, RFX_MESSAGE* message, int left, int top)
+{
+	int i, y;
+	int x1, y1, x2, y2;
+	int bx1, bx2, by;
+	int width, height;
+	int scanline;
+	uint8* src;
+	uint8* dst;
+	RFX_TILE* tile;
+	XImage* image;
+
+	if (message->num_tiles < 1)
+		return;
+
+	x1 = message->tiles[0]->x;
+	y1 = message->tiles[0]->y;
+	x2 = x1 + 64;
+	y2 = y1 + 64;
+
+	for (i = 1; i < message->num_tiles; i++)
+	{
+		x1 = MIN(x1, message->tiles[i]->x);
+		y1 = MIN(y1, message->tiles[i]->y);
+		x2 = MAX(x2, message->tiles[i]->x + 64);
+		y2 = MAX(y2, message->tiles[i]->y + 64);
+	}
+
+	width = x2 - x1;
+	height = y2 - y1;
+	scanline = width * 4;
+
+	xfi->bmp_codec_rfx = (uint8*) xrealloc(xfi->bmp_codec_rfx, scanline * height);
+
+	for (i = 0; i < message->num_tiles; i++)
+	{
+		tile = message->tiles[i];
+		src = tile->data;
+		dst = &xfi->bmp_codec_rfx[(tile->y - y1) * scanline + (tile->x - x1) * 4];
+
+		for (y = 0; y < 64; y++)
+		{
+			memcpy(dst, src, 64 * 4);
+			src += 64 * 4;
+			dst += scanline;
+		}
+	}
+
+	image = XCreateImage(xfi->display, xfi->visual, 24, ZPixmap, 0,
+			(char*) xfi->bmp_codec_rfx, width, height, 32, 0);
+
+	for (by = 0; by < height; by += 64)
+	{
+		bx1 = width;
+		bx2 = 0;
+
+		for (i = 0; i < message->num_tiles; i++)
+		{
+			tile = message->tiles[i];
+
+			if (tile->y - y1 == by)
+			{
+				bx1 = MIN(bx1, tile->x - x1);
+				bx2 = MAX(bx2, tile->x - x1 + 64);
+			}
+		}
+
+		if (bx2 > bx1)
+		{
+			XPutImage(xfi->display, xfi->primary, xfi->gc, image, bx1, by,
+					left + x1 + bx1, top + y1 + by, bx2 - bx1, 64);
+		}
+	}
+
+	XFree(image);
+}
+
+/**
+ * Copy the updated rects of a RemoteFX message from the backstore to the
+ * window. With the gc clipped to the rects, this takes a single XCopyArea.
+ */
+
+static void xf_gdi_surface_update_rects(xfInfo* xfi, RFX_MESSAGE* message, int left, int top)
+{
+	int i;
+	int x, y;
+	int width, height;
+
+	if (xfi->remote_app || xfi->frame_begin)
+	{
+		for (i = 0; i < message->num_rects; i++)
+		{
+			xf_gdi_surface_update_frame(xfi, message->rects[i].x + left, message->rects[i].y + top,
+					message->rects[i].width, message->rects[i].height);
+		}
+
+		return;
+	}
+
+	if (!xf_gdi_rfx_bounds(message, left, top, &x, &y, &width, &height))
+		return;
+
+	XCopyArea(xfi->display, xfi->primary, xfi->drawable, xfi->gc, x, y, width, height, x, y);
+
+	for (i = 0; i < message->num_rects; i++)
+	{
+		gdi_InvalidateRegion(xfi->hdc, message->rects[i].x + left, message->rects[i].y + top,
+				message->rects[i].width, message->rects[i].height);
+	}
+}
+
+#ifdef WITH_XSHM
+
+/**
+ * Copy the tiles of a RemoteFX message into the staging image and draw the
+ * updated rectangles to the primary surface.
+ */
+
+static boolean xf_gdi_shm_put_tiles(xfInfo* xfi, RFX_MESSAGE* message, int left, int top)
+{
+	int i, y;
+	int tx, ty;
+	int width, height;
+	uint8* src;
+	uint8* dst;
+	XImage* image;
+	xfShmImage* shm = xfi->shm_image;
+
+	if (shm == NULL)
+		return false;
+
+	image = shm->image;
+	xf_shm_wait(xfi, shm);
+
+	for (i = 0; i < message->num_tiles; i++)
+	{
+		tx = message->tiles[i]->x + left;
+		ty = message->tiles[i]->y + top;
+		width = MIN(64, image->width - tx);
+		height = MIN(64, image->height - ty);
+
+		if (width <= 0 || height <= 0)
+			continue;
+
+		src = message->tiles[i]->data;
+		dst = (uint8*) &image->data[ty * image->bytes_per_line + tx * 4];
+
+		for (y = 0; y < height; y++)
+		{
+			memcpy(dst, src, width * 4);
+			src += 64 * 4;
+			dst += image->bytes_per_line;
+		}
+	}
+
+	/* the gc clips to the rects, so their bounds go out in one request */
+	if (xf_gdi_rfx_bounds(message, left, top, &tx, &ty, &width, &height))
+	{
+		width = MIN(width, image->width - tx);
+		height = MIN(height, image->height - ty);
+
+		if (width > 0 && height > 0)
+			xf_shm_put_image(xfi, shm, xfi->primary, xfi->gc, tx, ty, width, height);
+	}
+
+	return true;
+}
+
+/**
+ * Copy a bottom-up 32bpp bitmap into the staging image and draw it to the
+ * primary surface. This replaces the flip into a temporary buffer.
+ */
+
+static boolean xf_gdi_shm_put_flipped(xfInfo* xfi, uint8* data, int x, int y, int width, int height)
+{
+	int i;
+	uint8* src;
+	uint8* dst;
+	XImage* image;
+	xfShmImage* shm = xfi->shm_image;
+
+	if (shm == NULL)
+		return false;
+
+	image = shm->image;
+
+	if (x + width > image->width || y + height > image->height)
+		return false;
+
+	xf_shm_wait(xfi, shm);
+
+	src = &data[(height - 1) * width * 4];
+	dst = (uint8*) &image->data[y * image->bytes_per_line + x * 4];
+
+	for (i = 0; i < height; i++)
+	{
+		memcpy(dst, src, width * 4);
+		src -= width * 4;
+		dst += image->bytes_per_line;
+	}
+
+	xf_shm_put_image(xfi, shm, xfi->primary, xfi->gc, x, y, width, height);
+
+	return true;
+}
+
+#else
+
+#define xf_gdi_shm_put_tiles(_xfi, _message, _left, _top) false
+#define xf_gdi_shm_put_flipped(_xfi, _data, _x, _y, _width, _height) false
+
+#endif /* WITH_XSHM */
+
 void xf_gdi_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* surface_bits_command)
 {
-	int i, tx, ty;
 	XImage* image;
 	RFX_MESSAGE* message;
 	xfInfo* xfi = ((xfContext*) context)->xfi;
@@ -967,26 +1278,16 @@ void xf_gdi_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* surface_bits
 				(XRectangle*) message->rects, message->num_rects, YXBanded);
 
 		/* Draw the tiles to primary surface, each is 64x64. */
-		for (i = 0; i < message->num_tiles; i++)
+		if (!xf_gdi_shm_put_tiles(xfi, message,
+				surface_bits_command->destLeft, surface_bits_command->destTop))
 		{
-			image = XCreateImage(xfi->display, xfi->visual, 24, ZPixmap, 0,
-				(char*) message->tiles[i]->data, 64, 64, 32, 0);
-
-			tx = message->tiles[i]->x + surface_bits_command->destLeft;
-			ty = message->tiles[i]->y + surface_bits_command->destTop;
-
-			XPutImage(xfi->display, xfi->primary, xfi->gc, image, 0, 0, tx, ty, 64, 64);
-			XFree(image);
+			xf_gdi_put_tiles(xfi, message,
+				surface_bits_command->destLeft, surface_bits_command->destTop);
 		}
 
 		/* Copy the updated region from backstore to the window. */
-		for (i = 0; i < message->num_rects; i++)
-		{
-			tx = message->rects[i].x + surface_bits_command->destLeft;
-			ty = message->rects[i].y + surface_bits_command->destTop;
-
-			xf_gdi_surface_update_frame(xfi, tx, ty, message->rects[i].width, message->rects[i].height);
-		}
+		xf_gdi_surface_update_rects(xfi, message,
+				surface_bits_command->destLeft, surface_bits_command->destTop);
 
 		XSetClipMask(xfi->display, xfi->gc, None);
 		rfx_message_free(rfx_context, message);
@@ -998,19 +1299,24 @@ void xf_gdi_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* surface_bits
 		XSetFunction(xfi->display, xfi->gc, GXcopy);
 		XSetFillStyle(xfi->display, xfi->gc, FillSolid);
 
-		xfi->bmp_codec_nsc = (uint8*) xrealloc(xfi->bmp_codec_nsc,
-				surface_bits_command->width * surface_bits_command->height * 4);
+		if (!xf_gdi_shm_put_flipped(xfi, nsc_context->bmpdata,
+				surface_bits_command->destLeft, surface_bits_command->destTop,
+				surface_bits_command->width, surface_bits_command->height))
+		{
+			xfi->bmp_codec_nsc = (uint8*) xrealloc(xfi->bmp_codec_nsc,
+					surface_bits_command->width * surface_bits_command->height * 4);
 
-		freerdp_image_flip(nsc_context->bmpdata, xfi->bmp_codec_nsc,
-				surface_bits_command->width, surface_bits_command->height, 32);
+			freerdp_image_flip(nsc_context->bmpdata, xfi->bmp_codec_nsc,
+					surface_bits_command->width, surface_bits_command->height, 32);
 
-		image = XCreateImage(xfi->display, xfi->visual, 24, ZPixmap, 0,
-			(char*) xfi->bmp_codec_nsc, surface_bits_command->width, surface_bits_command->height, 32, 0);
+			image = XCreateImage(xfi->display, xfi->visual, 24, ZPixmap, 0,
+				(char*) xfi->bmp_codec_nsc, surface_bits_command->width, surface_bits_command->height, 32, 0);
 
-		XPutImage(xfi->display, xfi->primary, xfi->gc, image, 0, 0,
-				surface_bits_command->destLeft, surface_bits_command->destTop,
-				surface_bits_command->width, surface_bits_command->height);
-		XFree(image);
+			XPutImage(xfi->display, xfi->primary, xfi->gc, image, 0, 0,
+					surface_bits_command->destLeft, surface_bits_command->destTop,
+					surface_bits_command->width, surface_bits_command->height);
+			XFree(image);
+		}
 
 		xf_gdi_surface_update_frame(xfi,
 			surface_bits_command->destLeft, surface_bits_command->destTop,
@@ -1026,19 +1332,24 @@ void xf_gdi_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* surface_bits
 		/* Validate that the data received is large enough */
 		if( surface_bits_command->width * surface_bits_command->height * surface_bits_command->bpp / 8 <= surface_bits_command->bitmapDataLength )
 		{
-			xfi->bmp_codec_none = (uint8*) xrealloc(xfi->bmp_codec_none,
-					surface_bits_command->width * surface_bits_command->height * 4);
+			if (!xf_gdi_shm_put_flipped(xfi, surface_bits_command->bitmapData,
+					surface_bits_command->destLeft, surface_bits_command->destTop,
+					surface_bits_command->width, surface_bits_command->height))
+			{
+				xfi->bmp_codec_none = (uint8*) xrealloc(xfi->bmp_codec_none,
+						surface_bits_command->width * surface_bits_command->height * 4);
 
-			freerdp_image_flip(surface_bits_command->bitmapData, xfi->bmp_codec_none,
-					surface_bits_command->width, surface_bits_command->height, 32);
+				freerdp_image_flip(surface_bits_command->bitmapData, xfi->bmp_codec_none,
+						surface_bits_command->width, surface_bits_command->height, 32);
 
-			image = XCreateImage(xfi->display, xfi->visual, 24, ZPixmap, 0,
-				(char*) xfi->bmp_codec_none, surface_bits_command->width, surface_bits_command->height, 32, 0);
+				image = XCreateImage(xfi->display, xfi->visual, 24, ZPixmap, 0,
+					(char*) xfi->bmp_codec_none, surface_bits_command->width, surface_bits_command->height, 32, 0);
 
-			XPutImage(xfi->display, xfi->primary, xfi->gc, image, 0, 0,
-					surface_bits_command->destLeft, surface_bits_command->destTop,
-					surface_bits_command->width, surface_bits_command->height);
-			XFree(image);
+				XPutImage(xfi->display, xfi->primary, xfi->gc, image, 0, 0,
+						surface_bits_command->destLeft, surface_bits_command->destTop,
+						surface_bits_command->width, surface_bits_command->height);
+				XFree(image);
+			}
 
 			xf_gdi_surface_update_frame(xfi,
 				surface_bits_command->destLeft, surface_bits_command->destTop,
@@ -24,6 +24,8 @@
 
 #include "xfreerdp.h"
 
+void xf_gdi_shm_init(xfInfo* xfi);
+void xf_gdi_shm_free(xfInfo* xfi);
 void xf_gdi_register_update_callbacks(rdpUpdate* update);
 
 #endif /* __XF_GDI_H */
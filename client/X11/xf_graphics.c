@@ -31,6 +31,7 @@
 #include <freerdp/codec/bitmap.h>
 #include <freerdp/codec/rfx.h>
 #include <freerdp/codec/jpeg.h>
+#include <freerdp/utils/memory.h>
 
 #include "xf_graphics.h"
 
@@ -79,6 +80,8 @@ void xf_Bitmap_Free(rdpContext* context, rdpBitmap* bitmap)
 {
 	xfInfo* xfi = ((xfContext*) context)->xfi;
 
+	xf_render_release_picture(xfi, ((xfBitmap*) bitmap)->pixmap);
+
 	if (((xfBitmap*) bitmap)->pixmap != 0)
 		XFreePixmap(xfi->display, ((xfBitmap*) bitmap)->pixmap);
 }
@@ -272,6 +275,262 @@ void xf_Pointer_SetDefault(rdpContext* context)
 		XUndefineCursor(xfi->display, xfi->window->handle);
 }
 
+/* XRender Glyphs */
+
+/**
+ * Set up text rendering through XRender. Cached glyphs are uploaded into a
+ * glyph set, and the glyphs of a text order are queued and drawn with a
+ * single request when the order ends, instead of four requests per glyph.
+ */
+
+void xf_render_init(xfInfo* xfi)
+{
+#ifdef WITH_XRENDER
+	int event_base;
+	int error_base;
+	XGCValues gcv;
+	XRenderPictureAttributes attributes;
+
+	xfi->use_xrender = false;
+
+	if (!XRenderQueryExtension(xfi->display, &event_base, &error_base))
+		return;
+
+	xfi->glyph_format = XRenderFindStandardFormat(xfi->display, PictStandardA1);
+	xfi->drawing_format = XRenderFindVisualFormat(xfi->display, xfi->visual);
+
+	if (xfi->glyph_format == NULL || xfi->drawing_format == NULL)
+		return;
+
+	xfi->glyph_set = XRenderCreateGlyphSet(xfi->display, xfi->glyph_format);
+
+	/* a repeating 1x1 picture of the text color is the source of the glyphs */
+	memset(&gcv, 0, sizeof(gcv));
+	xfi->glyph_pen = XCreatePixmap(xfi->display, xfi->drawable, 1, 1, xfi->depth);
+	xfi->glyph_pen_gc = XCreateGC(xfi->display, xfi->glyph_pen, GCGraphicsExposures, &gcv);
+
+	attributes.repeat = True;
+	xfi->glyph_pen_picture = XRenderCreatePicture(xfi->display, xfi->glyph_pen,
+			xfi->drawing_format, CPRepeat, &attributes);
+
+	XSetForeground(xfi->display, xfi->glyph_pen_gc, 0);
+	XFillRectangle(xfi->display, xfi->glyph_pen, xfi->glyph_pen_gc, 0, 0, 1, 1);
+	xfi->glyph_pen_color = 0;
+
+	xfi->use_xrender = true;
+#endif
+}
+
+/**
+ * Free the glyph set. Called once the glyph cache is gone.
+ */
+
+void xf_render_free(xfInfo* xfi)
+{
+#ifdef WITH_XRENDER
+	if (!xfi->use_xrender)
+		return;
+
+	xf_render_release_picture(xfi, xfi->glyph_drawable);
+
+	XRenderFreePicture(xfi->display, xfi->glyph_pen_picture);
+	XFreeGC(xfi->display, xfi->glyph_pen_gc);
+	XFreePixmap(xfi->display, xfi->glyph_pen);
+	XRenderFreeGlyphSet(xfi->display, xfi->glyph_set);
+
+	xfree(xfi->glyph_ids);
+	xfree(xfi->glyph_elts);
+	xfi->glyph_ids = NULL;
+	xfi->glyph_elts = NULL;
+	xfi->glyph_count = xfi->glyph_max = 0;
+
+	xfi->use_xrender = false;
+#endif
+}
+
+/**
+ * Drop the picture kept for drawing glyphs when its drawable goes away.
+ */
+
+void xf_render_release_picture(xfInfo* xfi, Drawable drawable)
+{
+#ifdef WITH_XRENDER
+	if (xfi->glyph_picture != 0 && xfi->glyph_drawable == drawable)
+	{
+		XRenderFreePicture(xfi->display, xfi->glyph_picture);
+		xfi->glyph_picture = 0;
+		xfi->glyph_drawable = 0;
+	}
+#endif
+}
+
+/**
+ * Clip glyphs to the bounds of the current order, or drop the clip when
+ * clip is NULL. The glyph picture is separate from the GC, so it does not
+ * see the clip rectangles set on the GC.
+ */
+
+void xf_render_set_clip(xfInfo* xfi, XRectangle* clip)
+{
+#ifdef WITH_XRENDER
+	XRenderPictureAttributes attributes;
+
+	if (!xfi->use_xrender)
+		return;
+
+	if (clip != NULL)
+	{
+		xfi->glyph_clip = *clip;
+		xfi->glyph_clipped = true;
+	}
+	else
+	{
+		if (!xfi->glyph_clipped)
+			return;
+
+		xfi->glyph_clipped = false;
+	}
+
+	if (xfi->glyph_picture == 0)
+		return;
+
+	if (xfi->glyph_clipped)
+	{
+		XRenderSetPictureClipRectangles(xfi->display, xfi->glyph_picture, 0, 0, &xfi->glyph_clip, 1);
+	}
+	else
+	{
+		attributes.clip_mask = None;
+		XRenderChangePicture(xfi->display, xfi->glyph_picture, CPClipMask, &attributes);
+	}
+#endif
+}
+
+#ifdef WITH_XRENDER
+
+static uint8 xf_glyph_reverse_bits(uint8 bits)
+{
+	bits = ((bits & 0xF0) >> 4) | ((bits & 0x0F) << 4);
+	bits = ((bits & 0xCC) >> 2) | ((bits & 0x33) << 2);
+	bits = ((bits & 0xAA) >> 1) | ((bits & 0x55) << 1);
+	return bits;
+}
+
+/**
+ * Upload a glyph into the glyph set. A1 glyph rows are padded to 32 bits
+ * and use the bit order of the X server, while RDP glyphs are MSB first.
+ */
+
+static void xf_render_add_glyph(xfInfo* xfi, xfGlyph* xf_glyph)
+{
+	int x, y;
+	uint8* data;
+	int scanline;
+	int stride;
+	XGlyphInfo info;
+	boolean lsb_first;
+	rdpGlyph* glyph = (rdpGlyph*) xf_glyph;
+
+	scanline = (glyph->cx + 7) / 8;
+	stride = ((glyph->cx + 31) / 32) * 4;
+	lsb_first = (BitmapBitOrder(xfi->display) == LSBFirst) ? true : false;
+
+	data = (uint8*) xzalloc(stride * glyph->cy);
+
+	for (y = 0; y < glyph->cy; y++)
+	{
+		for (x = 0; x < scanline; x++)
+		{
+			data[y * stride + x] = lsb_first ?
+				xf_glyph_reverse_bits(glyph->aj[y * scanline + x]) : glyph->aj[y * scanline + x];
+		}
+	}
+
+	info.x = 0;
+	info.y = 0;
+	info.width = glyph->cx;
+	info.height = glyph->cy;
+	info.xOff = 0;
+	info.yOff = 0;
+
+	xf_glyph->id = ++xfi->glyph_id;
+	XRenderAddGlyphs(xfi->display, xfi->glyph_set, &xf_glyph->id, &info, 1, (char*) data, stride * glyph->cy);
+
+	xfree(data);
+}
+
+static void xf_render_queue_glyph(xfInfo* xfi, xfGlyph* xf_glyph, int x, int y)
+{
+	if (xfi->glyph_count >= xfi->glyph_max)
+	{
+		xfi->glyph_max = (xfi->glyph_max > 0) ? xfi->glyph_max * 2 : 64;
+		xfi->glyph_ids = (unsigned int*) xrealloc(xfi->glyph_ids, xfi->glyph_max * sizeof(unsigned int));
+		xfi->glyph_elts = (XGlyphElt32*) xrealloc(xfi->glyph_elts, xfi->glyph_max * sizeof(XGlyphElt32));
+	}
+
+	/* absolute positions for now, made relative when flushing */
+	xfi->glyph_ids[xfi->glyph_count] = (unsigned int) xf_glyph->id;
+	xfi->glyph_elts[xfi->glyph_count].xOff = x;
+	xfi->glyph_elts[xfi->glyph_count].yOff = y;
+	xfi->glyph_count++;
+}
+
+/**
+ * Draw the queued glyphs with one XRenderCompositeText32 request. Glyphs
+ * have no advance, so each element moves the pen to the next glyph.
+ */
+
+static void xf_render_flush_glyphs(xfInfo* xfi)
+{
+	int i;
+	int x, y;
+	int next_x, next_y;
+
+	if (xfi->glyph_count < 1)
+		return;
+
+	if (xfi->glyph_pen_color != xfi->glyph_color)
+	{
+		XSetForeground(xfi->display, xfi->glyph_pen_gc, xfi->glyph_color);
+		XFillRectangle(xfi->display, xfi->glyph_pen, xfi->glyph_pen_gc, 0, 0, 1, 1);
+		xfi->glyph_pen_color = xfi->glyph_color;
+	}
+
+	if (xfi->glyph_picture == 0 || xfi->glyph_drawable != xfi->drawing)
+	{
+		xf_render_release_picture(xfi, xfi->glyph_drawable);
+		xfi->glyph_picture = XRenderCreatePicture(xfi->display, xfi->drawing, xfi->drawing_format, 0, NULL);
+		xfi->glyph_drawable = xfi->drawing;
+
+		if (xfi->glyph_clipped)
+			XRenderSetPictureClipRectangles(xfi->display, xfi->glyph_picture, 0, 0, &xfi->glyph_clip, 1);
+	}
+
+	x = y = 0;
+
+	for (i = 0; i < xfi->glyph_count; i++)
+	{
+		next_x = xfi->glyph_elts[i].xOff;
+		next_y = xfi->glyph_elts[i].yOff;
+
+		xfi->glyph_elts[i].glyphset = xfi->glyph_set;
+		xfi->glyph_elts[i].chars = &xfi->glyph_ids[i];
+		xfi->glyph_elts[i].nchars = 1;
+		xfi->glyph_elts[i].xOff = next_x - x;
+		xfi->glyph_elts[i].yOff = next_y - y;
+
+		x = next_x;
+		y = next_y;
+	}
+
+	XRenderCompositeText32(xfi->display, PictOpOver, xfi->glyph_pen_picture, xfi->glyph_picture,
+			NULL, 0, 0, 0, 0, xfi->glyph_elts, xfi->glyph_count);
+
+	xfi->glyph_count = 0;
+}
+
+#endif /* WITH_XRENDER */
+
 /* Glyph Class */
 
 void xf_Glyph_New(rdpContext* context, rdpGlyph* glyph)
@@ -284,6 +543,17 @@ void xf_Glyph_New(rdpContext* context, rdpGlyph* glyph)
 	xf_glyph = (xfGlyph*) glyph;
 	xfi = ((xfContext*) context)->xfi;
 
+#ifdef WITH_XRENDER
+	xf_glyph->id = 0;
+
+	if (xfi->use_xrender)
+	{
+		xf_glyph->pixmap = 0;
+		xf_render_add_glyph(xfi, xf_glyph);
+		return;
+	}
+#endif
+
 	scanline = (glyph->cx + 7) / 8;
 
 	xf_glyph->pixmap = XCreatePixmap(xfi->display, xfi->drawing, glyph->cx, glyph->cy, 1);
@@ -303,6 +573,11 @@ void xf_Glyph_Free(rdpContext* context, rdpGlyph* glyph)
 {
 	xfInfo* xfi = ((xfContext*) context)->xfi;
 
+#ifdef WITH_XRENDER
+	if (((xfGlyph*) glyph)->id != 0 && xfi->use_xrender)
+		XRenderFreeGlyphs(xfi->display, xfi->glyph_set, &((xfGlyph*) glyph)->id, 1);
+#endif
+
 	if (((xfGlyph*) glyph)->pixmap != 0)
 		XFreePixmap(xfi->display, ((xfGlyph*) glyph)->pixmap);
 }
@@ -314,6 +589,14 @@ void xf_Glyph_Draw(rdpContext* context, rdpGlyph* glyph, int x, int y)
 
 	xf_glyph = (xfGlyph*) glyph;
 
+#ifdef WITH_XRENDER
+	if (xf_glyph->id != 0)
+	{
+		xf_render_queue_glyph(xfi, xf_glyph, x, y);
+		return;
+	}
+#endif
+
 	XSetStipple(xfi->display, xfi->gc, xf_glyph->pixmap);
 	XSetTSOrigin(xfi->display, xfi->gc, x, y);
 	XFillRectangle(xfi->display, xfi->drawing, xfi->gc, x, y, glyph->cx, glyph->cy);
@@ -341,12 +624,20 @@ void xf_Glyph_BeginDraw(rdpContext* context, int x, int y, int width, int height
 	XSetForeground(xfi->display, xfi->gc, bgcolor);
 	XSetBackground(xfi->display, xfi->gc, fgcolor);
 	XSetFillStyle(xfi->display, xfi->gc, FillStippled);
+
+#ifdef WITH_XRENDER
+	xfi->glyph_color = bgcolor;
+#endif
 }
 
 void xf_Glyph_EndDraw(rdpContext* context, int x, int y, int width, int height, uint32 bgcolor, uint32 fgcolor)
 {
 	xfInfo* xfi = ((xfContext*) context)->xfi;
 
+#ifdef WITH_XRENDER
+	xf_render_flush_glyphs(xfi);
+#endif
+
 	if (xfi->drawing == xfi->primary)
 	{
 		if (xfi->remote_app != true)
@@ -22,6 +22,10 @@
 
 #include "xfreerdp.h"
 
+void xf_render_init(xfInfo* xfi);
+void xf_render_free(xfInfo* xfi);
+void xf_render_release_picture(xfInfo* xfi, Drawable drawable);
+void xf_render_set_clip(xfInfo* xfi, XRectangle* clip);
 void xf_register_graphics(rdpGraphics* graphics);
 
 #endif /* __XF_GRAPHICS_H */
@@ -0,0 +1,209 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * X11 Shared Memory Images
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <freerdp/utils/memory.h>
+
+#include "xf_shm.h"
+
+#ifdef WITH_XSHM
+
+static boolean xf_shm_attach_failed;
+
+static int xf_shm_error_handler(Display* display, XErrorEvent* event)
+{
+	xf_shm_attach_failed = true;
+	return 0;
+}
+
+/**
+ * Check whether the display supports MIT-SHM images.
+ * Attaching a segment can still fail later on (e.g. for a remote display),
+ * in which case xf_shm_image_new() returns NULL and XPutImage is used.
+ */
+
+boolean xf_shm_init(xfInfo* xfi)
+{
+	int major, minor;
+	Bool pixmaps;
+
+	xfi->use_xshm = false;
+
+	if (XShmQueryExtension(xfi->display) == False)
+		return false;
+
+	if (XShmQueryVersion(xfi->display, &major, &minor, &pixmaps) == False)
+		return false;
+
+	xfi->xshm_completion_event = XShmGetEventBase(xfi->display) + ShmCompletion;
+	xfi->use_xshm = true;
+
+	return true;
+}
+
+/**
+ * Create a shared memory image in the format of the X server visual.
+ * The segment is marked for removal once attached, so it goes away with
+ * the last process detaching from it.
+ */
+
+xfShmImage* xf_shm_image_new(xfInfo* xfi, int width, int height)
+{
+	xfShmImage* shm;
+	int (*handler)(Display*, XErrorEvent*);
+
+	if (!xfi->use_xshm)
+		return NULL;
+
+	shm = xnew(xfShmImage);
+	shm->info.shmid = -1;
+	shm->info.shmaddr = (char*) -1;
+
+	shm->image = XShmCreateImage(xfi->display, xfi->visual, xfi->depth,
+			ZPixmap, NULL, &(shm->info), width, height);
+
+	if (shm->image == NULL)
+	{
+		xfree(shm);
+		return NULL;
+	}
+
+	shm->info.shmid = shmget(IPC_PRIVATE, shm->image->bytes_per_line * shm->image->height, IPC_CREAT | 0600);
+
+	if (shm->info.shmid != -1)
+		shm->info.shmaddr = shmat(shm->info.shmid, 0, 0);
+
+	if (shm->info.shmaddr == ((char*) -1))
+	{
+		if (shm->info.shmid != -1)
+			shmctl(shm->info.shmid, IPC_RMID, 0);
+
+		XDestroyImage(shm->image);
+		xfree(shm);
+		return NULL;
+	}
+
+	shm->info.readOnly = False;
+	shm->image->data = shm->info.shmaddr;
+
+	XSync(xfi->display, False);
+	xf_shm_attach_failed = false;
+	handler = XSetErrorHandler(xf_shm_error_handler);
+
+	XShmAttach(xfi->display, &(shm->info));
+	XSync(xfi->display, False);
+
+	XSetErrorHandler(handler);
+	shmctl(shm->info.shmid, IPC_RMID, 0);
+
+	if (xf_shm_attach_failed)
+	{
+		printf("XShmAttach failed, falling back to XPutImage\n");
+		xfi->use_xshm = false;
+		shmdt(shm->info.shmaddr);
+		shm->image->data = NULL;
+		XDestroyImage(shm->image);
+		xfree(shm);
+		return NULL;
+	}
+
+	return shm;
+}
+
+void xf_shm_image_free(xfInfo* xfi, xfShmImage* shm)
+{
+	if (shm == NULL)
+		return;
+
+	xf_shm_wait(xfi, shm);
+
+	XShmDetach(xfi->display, &(shm->info));
+	XSync(xfi->display, False);
+	shmdt(shm->info.shmaddr);
+
+	shm->image->data = NULL;
+	XDestroyImage(shm->image);
+	xfree(shm);
+}
+
+/**
+ * Queue a rectangle of a shared memory image for drawing.
+ * The X server reads the pixels asynchronously, so the image must not be
+ * written to before xf_shm_wait() has seen the completion event.
+ */
+
+void xf_shm_put_image(xfInfo* xfi, xfShmImage* shm, Drawable drawable, GC gc, int x, int y, int width, int height)
+{
+	XShmPutImage(xfi->display, drawable, gc, shm->image, x, y, x, y, width, height, True);
+	shm->pending++;
+}
+
+static Bool xf_shm_completion_predicate(Display* display, XEvent* event, XPointer arg)
+{
+	xfInfo* xfi = (xfInfo*) arg;
+
+	if (event->type != xfi->xshm_completion_event)
+		return False;
+
+	return (((XShmCompletionEvent*) event)->shmseg == xfi->shm_image->info.shmseg) ? True : False;
+}
+
+void xf_shm_wait(xfInfo* xfi, xfShmImage* shm)
+{
+	XEvent event;
+
+	while (shm->pending > 0)
+	{
+		if (xfi->shm_image != shm)
+		{
+			/* only the current image is matched by the predicate */
+			XSync(xfi->display, False);
+			shm->pending = 0;
+			break;
+		}
+
+		XIfEvent(xfi->display, &event, xf_shm_completion_predicate, (XPointer) xfi);
+		shm->pending--;
+	}
+}
+
+/**
+ * Account for a completion event picked up by the main event loop.
+ */
+
+boolean xf_shm_completion(xfInfo* xfi, XEvent* event)
+{
+	xfShmImage* shm = xfi->shm_image;
+
+	if (!xfi->use_xshm || event->type != xfi->xshm_completion_event)
+		return false;
+
+	if (shm != NULL && shm->pending > 0 &&
+			((XShmCompletionEvent*) event)->shmseg == shm->info.shmseg)
+		shm->pending--;
+
+	return true;
+}
+
+#endif /* WITH_XSHM */
@@ -0,0 +1,49 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * X11 Shared Memory Images
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __XF_SHM_H
+#define __XF_SHM_H
+
+#ifdef WITH_XSHM
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+
+typedef struct xf_shm_image xfShmImage;
+
+#include "xfreerdp.h"
+
+struct xf_shm_image
+{
+	XImage* image;
+	XShmSegmentInfo info;
+	int pending;
+};
+
+boolean xf_shm_init(xfInfo* xfi);
+xfShmImage* xf_shm_image_new(xfInfo* xfi, int width, int height);
+void xf_shm_image_free(xfInfo* xfi, xfShmImage* shm);
+void xf_shm_put_image(xfInfo* xfi, xfShmImage* shm, Drawable drawable, GC gc, int x, int y, int width, int height);
+void xf_shm_wait(xfInfo* xfi, xfShmImage* shm);
+boolean xf_shm_completion(xfInfo* xfi, XEvent* event);
+
+#endif /* WITH_XSHM */
+
+#endif /* __XF_SHM_H */
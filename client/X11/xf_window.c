@@ -868,8 +868,7 @@ void xf_UpdateWindowArea(xfInfo* xfi, xfWindow* window, int x, int y, int width,
 	
 	if (xfi->sw_gdi)
 	{
-		XPutImage(xfi->display, xfi->primary, window->gc, xfi->image,
-			ax, ay, ax, ay, width, height);
+		xf_sw_put_image(xfi, window->gc, ax, ay, width, height);
 	}
 
 	XCopyArea(xfi->display, xfi->primary, window->handle, window->gc,
@@ -96,9 +96,147 @@ void xf_context_free(freerdp* instance, rdpContext* context)
 
 }
 
+/**
+ * Create the image used to present the software GDI primary surface.
+ * With XShm, the primary surface bitmap is moved into the shared memory
+ * segment so that GDI and the codecs draw straight into what the X server
+ * reads from, otherwise the image wraps the GDI buffer for XPutImage.
+ */
+
+static void xf_sw_create_image(xfInfo* xfi, rdpGdi* gdi)
+{
+#ifdef WITH_XSHM
+	xfShmImage* shm;
+	HGDI_BITMAP bitmap;
+
+	shm = xf_shm_image_new(xfi, gdi->width, gdi->height);
+
+	if (shm != NULL)
+	{
+		bitmap = gdi->primary->bitmap;
+
+		if ((shm->image->bits_per_pixel == bitmap->bitsPerPixel) &&
+				(shm->image->bytes_per_line == bitmap->width * bitmap->bytesPerPixel))
+		{
+			memcpy(shm->image->data, bitmap->data, shm->image->bytes_per_line * shm->image->height);
+			xfree(bitmap->data);
+
+			bitmap->data = (uint8*) shm->image->data;
+			gdi->primary_buffer = bitmap->data;
+			xfi->primary_buffer = bitmap->data;
+
+			xfi->shm_image = shm;
+			xfi->image = shm->image;
+			return;
+		}
+
+		xf_shm_image_free(xfi, shm);
+	}
+#endif
+
+	xfi->primary_buffer = gdi->primary_buffer;
+	xfi->image = XCreateImage(xfi->display, xfi->visual, xfi->depth, ZPixmap, 0,
+			(char*) gdi->primary_buffer, gdi->width, gdi->height, xfi->scanline_pad, 0);
+}
+
+/**
+ * Release the image of the software GDI primary surface. A shared memory
+ * primary surface is taken away from GDI, which would otherwise free() it.
+ */
+
+static void xf_sw_free_image(xfInfo* xfi, rdpGdi* gdi)
+{
+#ifdef WITH_XSHM
+	if (xfi->shm_image != NULL)
+	{
+		xf_shm_wait(xfi, xfi->shm_image);
+
+		gdi->primary->bitmap->data = NULL;
+		gdi->primary_buffer = NULL;
+		xfi->primary_buffer = NULL;
+
+		xf_shm_image_free(xfi, xfi->shm_image);
+		xfi->shm_image = NULL;
+		xfi->image = NULL;
+		return;
+	}
+#endif
+
+	if (xfi->image)
+	{
+		xfi->image->data = NULL;
+		XDestroyImage(xfi->image);
+		xfi->image = NULL;
+	}
+
+	xf_gdi_shm_free(xfi);
+}
+
+/**
+ * Draw a rectangle of the software GDI primary surface to the primary pixmap.
+ */
+
+void xf_sw_put_image(xfInfo* xfi, GC gc, int x, int y, int width, int height)
+{
+#ifdef WITH_XSHM
+	if (xfi->shm_image != NULL)
+	{
+		xf_shm_put_image(xfi, xfi->shm_image, xfi->primary, gc, x, y, width, height);
+		return;
+	}
+#endif
+
+	XPutImage(xfi->display, xfi->primary, gc, xfi->image, x, y, x, y, width, height);
+}
+
+/**
+ * Tell whether the frame being completed is already outdated: when updates
+ * are executed asynchronously and newer frames are queued behind it, the
+ * frame is only decoded into the backing store and its invalid region is
+ * presented together with the next one, so that a client which falls behind
+ * catches up instead of drawing every intermediate frame.
+ */
+
+boolean xf_frame_outdated(xfInfo* xfi)
+{
+	if (xfi->queue == NULL)
+		return false;
+
+	return (freerdp_message_queue_pending_frames(xfi->queue) > 0);
+}
+
+static void xf_sw_surface_frame_marker(rdpContext* context, SURFACE_FRAME_MARKER* surface_frame_marker)
+{
+	xfInfo* xfi = ((xfContext*) context)->xfi;
+
+	switch (surface_frame_marker->frameAction)
+	{
+		case SURFACECMD_FRAMEACTION_BEGIN:
+			xfi->frame_begin = true;
+			break;
+
+		case SURFACECMD_FRAMEACTION_END:
+			xfi->frame_begin = false;
+			xfi->frame_skip = xf_frame_outdated(xfi);
+			break;
+	}
+}
+
 void xf_sw_begin_paint(rdpContext* context)
 {
 	rdpGdi* gdi = context->gdi;
+	xfInfo* xfi = ((xfContext*) context)->xfi;
+
+#ifdef WITH_XSHM
+	/* the X server may still be reading the previous frame */
+	if (xfi->shm_image != NULL)
+		xf_shm_wait(xfi, xfi->shm_image);
+#endif
+
+	/* the invalid region of a surface frame spans several updates */
+	if (xfi->frame_begin || xfi->frame_skip)
+		return;
+
 	gdi->primary->hdc->hwnd->invalid->null = 1;
 	gdi->primary->hdc->hwnd->ninvalid = 0;
 }
@@ -113,6 +251,9 @@ void xf_sw_end_paint(rdpContext* context)
 	xfi = ((xfContext*) context)->xfi;
 	gdi = context->gdi;
 
+	if (xfi->frame_begin || xfi->frame_skip)
+		return;
+
 	if (xfi->remote_app != true)
 	{
 		if (xfi->complex_regions != true)
@@ -125,7 +266,7 @@ void xf_sw_end_paint(rdpContext* context)
 			w = gdi->primary->hdc->hwnd->invalid->w;
 			h = gdi->primary->hdc->hwnd->invalid->h;
 
-			XPutImage(xfi->display, xfi->primary, xfi->gc, xfi->image, x, y, x, y, w, h);
+			xf_sw_put_image(xfi, xfi->gc, x, y, w, h);
 			XCopyArea(xfi->display, xfi->primary, xfi->window->handle, xfi->gc, x, y, w, h, x, y);
 		}
 		else
@@ -147,7 +288,7 @@ void xf_sw_end_paint(rdpContext* context)
 				w = cinvalid[i].w;
 				h = cinvalid[i].h;
 
-				XPutImage(xfi->display, xfi->primary, xfi->gc, xfi->image, x, y, x, y, w, h);
+				xf_sw_put_image(xfi, xfi->gc, x, y, w, h);
 				XCopyArea(xfi->display, xfi->primary, xfi->window->handle, xfi->gc, x, y, w, h, x, y);
 			}
 
@@ -178,16 +319,63 @@ void xf_sw_desktop_resize(rdpContext* context)
 
 	if (xfi->fullscreen != true)
 	{
+		boolean same;
 		rdpGdi* gdi = context->gdi;
-		gdi_resize(gdi, xfi->width, xfi->height);
+#ifdef WITH_XSHM
+		xfShmImage* shm = xfi->shm_image;
+#endif
+
+		xfi->width = settings->width;
+		xfi->height = settings->height;
+
+		if (xfi->window)
+			xf_ResizeDesktopWindow(xfi, xfi->window, settings->width, settings->height);
+
+		if (xfi->primary)
+		{
+			same = (xfi->primary == xfi->drawing) ? true : false;
+
+			xf_render_release_picture(xfi, xfi->primary);
+			XFreePixmap(xfi->display, xfi->primary);
+
+			xfi->primary = XCreatePixmap(xfi->display, xfi->drawable,
+					xfi->width, xfi->height, xfi->depth);
+
+			if (same)
+				xfi->drawing = xfi->primary;
+		}
+
+		if ((gdi->width == xfi->width) && (gdi->height == xfi->height))
+			return;
 
-		if (xfi->image)
+#ifdef WITH_XSHM
+		/*
+		 * The shared memory segment holds the primary surface: detach it so
+		 * that gdi_resize() allocates a new buffer, and only release the old
+		 * segment once GDI no longer references it.
+		 */
+		if (shm != NULL)
 		{
-			xfi->image->data = NULL;
-			XDestroyImage(xfi->image);
-			xfi->image = XCreateImage(xfi->display, xfi->visual, xfi->depth, ZPixmap, 0,
-					(char*) gdi->primary_buffer, gdi->width, gdi->height, xfi->scanline_pad, 0);
+			xf_shm_wait(xfi, shm);
+
+			gdi->primary->bitmap->data = NULL;
+			gdi->primary_buffer = NULL;
+			xfi->primary_buffer = NULL;
+
+			xfi->shm_image = NULL;
+			xfi->image = NULL;
 		}
+#endif
+
+		xf_sw_free_image(xfi, gdi);
+		gdi_resize(gdi, xfi->width, xfi->height);
+
+#ifdef WITH_XSHM
+		if (shm != NULL)
+			xf_shm_image_free(xfi, shm);
+#endif
+
+		xf_sw_create_image(xfi, gdi);
 	}
 }
 
@@ -209,15 +397,23 @@ void xf_hw_end_paint(rdpContext* context)
 
 	if (xfi->remote_app)
 	{
+		int i;
+		HGDI_RGN cinvalid;
+
 		if (xfi->hdc->hwnd->invalid->null)
 			return;
 
-		x = xfi->hdc->hwnd->invalid->x;
-		y = xfi->hdc->hwnd->invalid->y;
-		w = xfi->hdc->hwnd->invalid->w;
-		h = xfi->hdc->hwnd->invalid->h;
+		cinvalid = xfi->hdc->hwnd->cinvalid;
 
-		xf_rail_paint(xfi, context->rail, x, y, x + w - 1, y + h - 1);
+		for (i = 0; i < xfi->hdc->hwnd->ninvalid; i++)
+		{
+			x = cinvalid[i].x;
+			y = cinvalid[i].y;
+			w = cinvalid[i].w;
+			h = cinvalid[i].h;
+
+			xf_rail_paint(xfi, context->rail, x, y, x + w - 1, y + h - 1);
+		}
 	}
 }
 
@@ -242,6 +438,7 @@ void xf_hw_desktop_resize(rdpContext* context)
 		{
 			same = (xfi->primary == xfi->drawing) ? true : false;
 
+			xf_render_release_picture(xfi, xfi->primary);
 			XFreePixmap(xfi->display, xfi->primary);
 
 			xfi->primary = XCreatePixmap(xfi->display, xfi->drawable,
@@ -250,6 +447,8 @@ void xf_hw_desktop_resize(rdpContext* context)
 			if (same)
 				xfi->drawing = xfi->primary;
 		}
+
+		xf_gdi_shm_init(xfi);
 	}
 	else
 	{
@@ -607,6 +806,7 @@ boolean xf_pre_connect(freerdp* instance)
 	xfi->big_endian = (ImageByteOrder(xfi->display) == MSBFirst);
 
 	xfi->mouse_motion = settings->mouse_motion;
+	xfi->async_update = settings->async_update;
 	xfi->complex_regions = true;
 	xfi->decorations = settings->decorations;
 	xfi->fullscreen = settings->fullscreen;
@@ -754,16 +954,36 @@ boolean xf_post_connect(freerdp* instance)
 	XFillRectangle(xfi->display, xfi->primary, xfi->gc, 0, 0, xfi->width, xfi->height);
 	XFlush(xfi->display);
 
-	xfi->image = XCreateImage(xfi->display, xfi->visual, xfi->depth, ZPixmap, 0,
-			(char*) xfi->primary_buffer, xfi->width, xfi->height, xfi->scanline_pad, 0);
+#ifdef WITH_XSHM
+	xf_shm_init(xfi);
+#endif
+
+	if (xfi->sw_gdi)
+	{
+		xf_sw_create_image(xfi, instance->context->gdi);
+	}
+	else
+	{
+		xfi->image = XCreateImage(xfi->display, xfi->visual, xfi->depth, ZPixmap, 0,
+				(char*) xfi->primary_buffer, xfi->width, xfi->height, xfi->scanline_pad, 0);
+
+		xf_gdi_shm_init(xfi);
+	}
 
 	xfi->bmp_codec_none = (uint8*) xmalloc(64 * 64 * 4);
 
+	xfi->frame.count = GDI_MAX_INVALID_RECTS;
+	xfi->frame.cinvalid = (HGDI_RGN) xmalloc(sizeof(GDI_RGN) * xfi->frame.count);
+	xfi->frame.ninvalid = 0;
+	xfi->frame.maxinvalid = GDI_MAX_INVALID_RECTS;
+	xfi->frame.invalid = NULL;
+
 	if (xfi->sw_gdi)
 	{
 		instance->update->BeginPaint = xf_sw_begin_paint;
 		instance->update->EndPaint = xf_sw_end_paint;
 		instance->update->DesktopResize = xf_sw_desktop_resize;
+		instance->update->SurfaceFrameMarker = xf_sw_surface_frame_marker;
 	}
 	else
 	{
@@ -772,10 +992,12 @@ boolean xf_post_connect(freerdp* instance)
 		instance->update->DesktopResize = xf_hw_desktop_resize;
 	}
 
+	cache_register_callbacks(instance->update);
 	pointer_cache_register_callbacks(instance->update);
 
 	if (xfi->sw_gdi != true)
 	{
+		xf_render_init(xfi);
 		glyph_cache_register_callbacks(instance->update);
 		brush_cache_register_callbacks(instance->update);
 		bitmap_cache_register_callbacks(instance->update);
@@ -1037,6 +1259,8 @@ void xf_window_free(xfInfo* xfi)
 		xfi->image = NULL;
 	}
 
+	xf_gdi_shm_free(xfi);
+
 	if (context != NULL)
 	{
 			cache_free(context->cache);
@@ -1046,6 +1270,8 @@ void xf_window_free(xfInfo* xfi)
 			context->rail = NULL;
 	}
 
+	xf_render_free(xfi);
+
 	if (xfi->rfx_context) 
 	{
 		rfx_context_free(xfi->rfx_context);
@@ -1072,12 +1298,168 @@ void xf_free(xfInfo* xfi)
 	xf_window_free(xfi);
 
 	xfree(xfi->bmp_codec_none);
+	xfree(xfi->bmp_codec_rfx);
+	xfree(xfi->frame.cinvalid);
 
 	XCloseDisplay(xfi->display);
 
 	xfree(xfi);
 }
 
+/**
+ * Network thread of the asynchronous update mode. It reads and decodes the
+ * incoming PDUs while the main thread, which owns the X connection, executes
+ * the queued updates. The thread mutex keeps the two threads from using the
+ * connection at the same time, including the executed updates which send
+ * PDUs, such as frame acknowledgements.
+ */
+
+static void* xf_network_thread_func(void* arg)
+{
+	int i;
+	int fds;
+	int max_fds;
+	int rcount;
+	int wcount;
+	void* rfds[32];
+	void* wfds[32];
+	fd_set rfds_set;
+	boolean status;
+	xfInfo* xfi = (xfInfo*) arg;
+	freerdp* instance = xfi->instance;
+	freerdp_thread* thread = xfi->network_thread;
+
+	memset(rfds, 0, sizeof(rfds));
+	memset(wfds, 0, sizeof(wfds));
+
+	while (true)
+	{
+		/* stop reading while the main thread is behind */
+		freerdp_message_queue_wait(xfi->queue, thread->signals[0]);
+
+		if (freerdp_thread_is_stopped(thread))
+			break;
+
+		rcount = 0;
+		wcount = 0;
+
+		freerdp_thread_lock(thread);
+		status = freerdp_get_fds(instance, rfds, &rcount, wfds, &wcount);
+		freerdp_thread_unlock(thread);
+
+		if (status != true)
+		{
+			printf("Failed to get FreeRDP file descriptor\n");
+			break;
+		}
+
+		wait_obj_get_fds(thread->signals[0], rfds, &rcount);
+
+		max_fds = 0;
+		FD_ZERO(&rfds_set);
+
+		for (i = 0; i < rcount; i++)
+		{
+			fds = (int)(long)(rfds[i]);
+
+			if (fds > max_fds)
+				max_fds = fds;
+
+			FD_SET(fds, &rfds_set);
+		}
+
+		if (select(max_fds + 1, &rfds_set, NULL, NULL, NULL) == -1)
+		{
+			/* these are not really errors */
+			if (!((errno == EAGAIN) ||
+				(errno == EWOULDBLOCK) ||
+				(errno == EINPROGRESS) ||
+				(errno == EINTR))) /* signal occurred */
+			{
+				printf("xf_network_thread_func: select failed\n");
+				break;
+			}
+		}
+
+		if (freerdp_thread_is_stopped(thread))
+			break;
+
+		freerdp_thread_lock(thread);
+		status = freerdp_check_fds(instance);
+		freerdp_thread_unlock(thread);
+
+		if (status != true)
+		{
+			printf("Failed to check FreeRDP file descriptor\n");
+			break;
+		}
+	}
+
+	/* wake up the main loop, which notices that the thread is gone */
+	freerdp_thread_signal(thread);
+	freerdp_thread_quit(thread);
+
+	return NULL;
+}
+
+static void xf_network_thread_start(xfInfo* xfi)
+{
+	xfi->queue = freerdp_message_queue_new(xfi->instance->update, MESSAGE_QUEUE_DEFAULT_SIZE);
+	xfi->network_thread = freerdp_thread_new();
+	freerdp_thread_start(xfi->network_thread, xf_network_thread_func, xfi);
+}
+
+static void xf_network_thread_stop(xfInfo* xfi)
+{
+	if (xfi->network_thread == NULL)
+		return;
+
+	freerdp_thread_stop(xfi->network_thread);
+	freerdp_thread_free(xfi->network_thread);
+	xfi->network_thread = NULL;
+
+	freerdp_message_queue_free(xfi->queue);
+	xfi->queue = NULL;
+}
+
+/**
+ * Process X events and channels, which both send PDUs. With asynchronous
+ * updates, the network thread is held off meanwhile, and the input events
+ * are flushed before it is let go.
+ */
+
+static boolean xf_process_events(xfInfo* xfi, rdpChannels* channels)
+{
+	boolean status = true;
+	freerdp* instance = xfi->instance;
+
+	if (xfi->network_thread != NULL)
+		freerdp_thread_lock(xfi->network_thread);
+
+	if (xf_process_x_events(instance) != true)
+	{
+		printf("Closed from X\n");
+		status = false;
+	}
+	else if (freerdp_channels_check_fds(channels, instance) != true)
+	{
+		printf("Failed to check channel manager file descriptor\n");
+		status = false;
+	}
+	else
+	{
+		xf_process_channel_event(channels, instance);
+	}
+
+	if (xfi->network_thread != NULL)
+	{
+		freerdp_input_flush(instance->input);
+		freerdp_thread_unlock(xfi->network_thread);
+	}
+
+	return status;
+}
+
 /** Main loop for the rdp connection.
  *  It will be run from the thread's entry point (thread_func()).
  *  It initiates the connection, and will continue to run until the session ends,
@@ -1123,12 +1505,20 @@ int xfreerdp_run(freerdp* instance)
 	xfi = ((xfContext*) instance->context)->xfi;
 	channels = instance->context->channels;
 
+	if (xfi->async_update)
+		xf_network_thread_start(xfi);
+
 	while (!xfi->disconnect && !freerdp_shall_disconnect(instance))
 	{
 		rcount = 0;
 		wcount = 0;
 
-		if (freerdp_get_fds(instance, rfds, &rcount, wfds, &wcount) != true)
+		if (xfi->network_thread != NULL)
+		{
+			freerdp_message_queue_get_fds(xfi->queue, rfds, &rcount);
+			wait_obj_get_fds(xfi->network_thread->signals[1], rfds, &rcount);
+		}
+		else if (freerdp_get_fds(instance, rfds, &rcount, wfds, &wcount) != true)
 		{
 			printf("Failed to get FreeRDP file descriptor\n");
 			ret = XF_EXIT_CONN_FAILED;
@@ -1167,6 +1557,9 @@ int xfreerdp_run(freerdp* instance)
 		timeout.tv_sec = 5;
 		select_status = select(max_fds + 1, &rfds_set, &wfds_set, NULL, &timeout);
 
+		/* the caches are only used from this thread */
+		cache_check_idle(instance->context->cache);
+
 		if (select_status == 0)
 		{
 			//freerdp_send_keep_alive(instance);
@@ -1185,24 +1578,26 @@ int xfreerdp_run(freerdp* instance)
 			}
 		}
 
-		if (freerdp_check_fds(instance) != true)
+		if (xfi->network_thread != NULL)
 		{
-			printf("Failed to check FreeRDP file descriptor\n");
-			break;
+			if (!freerdp_thread_is_running(xfi->network_thread))
+				break;
+
+			freerdp_thread_lock(xfi->network_thread);
+			freerdp_message_queue_check_fds(xfi->queue);
+			freerdp_thread_unlock(xfi->network_thread);
 		}
-		if (xf_process_x_events(instance) != true)
+		else if (freerdp_check_fds(instance) != true)
 		{
-			printf("Closed from X\n");
+			printf("Failed to check FreeRDP file descriptor\n");
 			break;
 		}
-		if (freerdp_channels_check_fds(channels, instance) != true)
-		{
-			printf("Failed to check channel manager file descriptor\n");
+		if (xf_process_events(xfi, channels) != true)
 			break;
-		}
-		xf_process_channel_event(channels, instance);
 	}
 
+	xf_network_thread_stop(xfi);
+
 	FILE *fin = fopen("/tmp/tsmf.tid", "rt");
 	if(fin)
 	{
@@ -1234,6 +1629,10 @@ int xfreerdp_run(freerdp* instance)
 	freerdp_channels_close(channels, instance);
 	freerdp_channels_free(channels);
 	freerdp_disconnect(instance);
+
+	if (xfi->sw_gdi && instance->context->gdi)
+		xf_sw_free_image(xfi, instance->context->gdi);
+
 	gdi_free(instance);
 	xf_free(xfi);
 
@@ -31,9 +31,16 @@
 #include <freerdp/gdi/region.h>
 #include <freerdp/rail/rail.h>
 #include <freerdp/cache/cache.h>
+#include <freerdp/message.h>
+#include <freerdp/utils/thread.h>
+
+#ifdef WITH_XRENDER
+#include <X11/extensions/Xrender.h>
+#endif
 
 typedef struct xf_info xfInfo;
 
+#include "xf_shm.h"
 #include "xf_window.h"
 #include "xf_monitor.h"
 
@@ -64,6 +71,9 @@ struct xf_glyph
 {
 	rdpGlyph glyph;
 	Pixmap pixmap;
+#ifdef WITH_XRENDER
+	Glyph id;
+#endif
 };
 typedef struct xf_glyph xfGlyph;
 
@@ -119,11 +129,40 @@ struct xf_info
 	boolean sw_gdi;
 	uint8* primary_buffer;
 
+	boolean use_xshm;
+#ifdef WITH_XSHM
+	int xshm_completion_event;
+	xfShmImage* shm_image;
+#endif
+
+	boolean use_xrender;
+#ifdef WITH_XRENDER
+	Glyph glyph_id;
+	GlyphSet glyph_set;
+	XRenderPictFormat* glyph_format;
+	XRenderPictFormat* drawing_format;
+	GC glyph_pen_gc;
+	Pixmap glyph_pen;
+	Picture glyph_pen_picture;
+	uint32 glyph_pen_color;
+	uint32 glyph_color;
+	Picture glyph_picture;
+	Drawable glyph_drawable;
+	boolean glyph_clipped;
+	XRectangle glyph_clip;
+	int glyph_count;
+	int glyph_max;
+	unsigned int* glyph_ids;
+	XGlyphElt32* glyph_elts;
+#endif
+
 	boolean frame_begin;
-	uint16 frame_x1;
-	uint16 frame_y1;
-	uint16 frame_x2;
-	uint16 frame_y2;
+	boolean frame_skip;
+	GDI_WND frame;
+
+	boolean async_update;
+	rdpMessageQueue* queue;
+	freerdp_thread* network_thread;
 
 	boolean focused;
 	boolean mouse_active;
@@ -138,6 +177,7 @@ struct xf_info
 	VIRTUAL_SCREEN vscreen;
 	uint8* bmp_codec_none;
 	uint8* bmp_codec_nsc;
+	uint8* bmp_codec_rfx;
 	void* rfx_context;
 	void* nsc_context;
 	void* xv_context;
@@ -169,6 +209,8 @@ struct xf_info
 };
 
 void xf_create_window(xfInfo* xfi);
+void xf_sw_put_image(xfInfo* xfi, GC gc, int x, int y, int width, int height);
+boolean xf_frame_outdated(xfInfo* xfi);
 void xf_toggle_fullscreen(xfInfo* xfi);
 boolean xf_post_connect(freerdp* instance);
 
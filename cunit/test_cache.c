@@ -0,0 +1,1155 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Cache Unit Tests
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <freerdp/freerdp.h>
+#include <freerdp/peer.h>
+#include <freerdp/constants.h>
+#include <freerdp/graphics.h>
+#include <freerdp/utils/memory.h>
+#include <freerdp/cache/cache.h>
+#include <freerdp/cache/server_bitmap.h>
+#include <freerdp/cache/server_pointer.h>
+
+#include "test_cache.h"
+#include "libfreerdp-core/activation.h"
+
+int init_cache_suite(void)
+{
+	return 0;
+}
+
+int clean_cache_suite(void)
+{
+	return 0;
+}
+
+int add_cache_suite(void)
+{
+	add_test_suite(cache);
+
+	add_test_function(server_bitmap_cache_hash);
+	add_test_function(server_bitmap_cache_lru);
+	add_test_function(server_bitmap_cache_cells);
+	add_test_function(server_pointer_cache);
+	add_test_function(server_pointer_cache_color);
+	add_test_function(bitmap_cache_lru);
+	add_test_function(bitmap_cache_shared_budget);
+	add_test_function(bitmap_cache_budget_share);
+	add_test_function(cache_lazy_allocation);
+	add_test_function(cache_release);
+	add_test_function(cache_check_idle);
+	add_test_function(cache_reset_state);
+	add_test_function(persistent_cache_file);
+	add_test_function(persistent_cache_invalid_file);
+	add_test_function(persistent_key_list);
+
+	return 0;
+}
+
+/* a server peer whose orders are recorded instead of sent */
+
+static int memblt_count;
+static int cache_bitmap_v2_count;
+static MEMBLT_ORDER last_memblt;
+static CACHE_BITMAP_V2_ORDER last_cache_bitmap_v2;
+
+static void test_peer_memblt(rdpContext* context, MEMBLT_ORDER* memblt)
+{
+	memblt_count++;
+	memcpy(&last_memblt, memblt, sizeof(MEMBLT_ORDER));
+}
+
+static void test_peer_cache_bitmap_v2(rdpContext* context, CACHE_BITMAP_V2_ORDER* cache_bitmap_v2)
+{
+	cache_bitmap_v2_count++;
+	memcpy(&last_cache_bitmap_v2, cache_bitmap_v2, sizeof(CACHE_BITMAP_V2_ORDER));
+}
+
+static int pointer_new_count;
+static int pointer_color_count;
+static int pointer_cached_count;
+static int pointer_system_count;
+static uint32 last_pointer_index;
+static uint32 last_pointer_system;
+static uint8 last_pointer_xor[32 * 32 * 3];
+static uint8 last_pointer_and[32 * 32 / 8];
+
+static void test_peer_pointer_new(rdpContext* context, POINTER_NEW_UPDATE* pointer_new)
+{
+	pointer_new_count++;
+	last_pointer_index = pointer_new->colorPtrAttr.cacheIndex;
+}
+
+static void test_peer_pointer_color(rdpContext* context, POINTER_COLOR_UPDATE* pointer_color)
+{
+	pointer_color_count++;
+	last_pointer_index = pointer_color->cacheIndex;
+
+	if (pointer_color->lengthXorMask <= sizeof(last_pointer_xor))
+		memcpy(last_pointer_xor, pointer_color->xorMaskData, pointer_color->lengthXorMask);
+
+	if (pointer_color->lengthAndMask <= sizeof(last_pointer_and))
+		memcpy(last_pointer_and, pointer_color->andMaskData, pointer_color->lengthAndMask);
+}
+
+static void test_peer_pointer_cached(rdpContext* context, POINTER_CACHED_UPDATE* pointer_cached)
+{
+	pointer_cached_count++;
+	last_pointer_index = pointer_cached->cacheIndex;
+}
+
+static void test_peer_pointer_system(rdpContext* context, POINTER_SYSTEM_UPDATE* pointer_system)
+{
+	pointer_system_count++;
+	last_pointer_system = pointer_system->type;
+}
+
+static rdpContext* test_peer_new(int numCells, uint32 numEntries)
+{
+	int i;
+	rdpContext* context;
+	freerdp_peer* peer;
+
+	context = xnew(rdpContext);
+	peer = xnew(freerdp_peer);
+
+	peer->context = context;
+	peer->settings = settings_new(NULL);
+	peer->update = xnew(rdpUpdate);
+	peer->update->primary = xnew(rdpPrimaryUpdate);
+	peer->update->secondary = xnew(rdpSecondaryUpdate);
+	peer->update->pointer = xnew(rdpPointerUpdate);
+	peer->update->primary->MemBlt = test_peer_memblt;
+	peer->update->secondary->CacheBitmapV2 = test_peer_cache_bitmap_v2;
+	peer->update->pointer->PointerNew = test_peer_pointer_new;
+	peer->update->pointer->PointerColor = test_peer_pointer_color;
+	peer->update->pointer->PointerCached = test_peer_pointer_cached;
+	peer->update->pointer->PointerSystem = test_peer_pointer_system;
+
+	peer->settings->bitmapCacheV2NumCells = numCells;
+
+	for (i = 0; i < numCells; i++)
+		peer->settings->bitmapCacheV2CellInfo[i].numEntries = numEntries;
+
+	context->peer = peer;
+
+	memblt_count = 0;
+	cache_bitmap_v2_count = 0;
+	pointer_new_count = 0;
+	pointer_color_count = 0;
+	pointer_cached_count = 0;
+	pointer_system_count = 0;
+
+	return context;
+}
+
+static void test_peer_free(rdpContext* context)
+{
+	freerdp_peer* peer = context->peer;
+
+	xfree(peer->update->primary);
+	xfree(peer->update->secondary);
+	xfree(peer->update->pointer);
+	xfree(peer->update);
+	settings_free(peer->settings);
+	xfree(peer);
+	xfree(context);
+}
+
+static void test_fill_bitmap(uint8* data, int length, uint8 seed)
+{
+	int i;
+
+	for (i = 0; i < length; i++)
+		data[i] = (uint8) (seed + i * 7);
+}
+
+void test_server_bitmap_cache_hash(void)
+{
+	int y;
+	uint8 a[16 * 16 * 2];
+	uint8 b[16 * 16 * 2];
+	uint8 padded[16 * 24 * 2];
+	rdpContext* context;
+	rdpServerBitmapCache* cache;
+
+	context = test_peer_new(3, 8);
+	cache = server_bitmap_cache_new(context);
+
+	test_fill_bitmap(a, sizeof(a), 1);
+	memcpy(b, a, sizeof(b));
+	b[sizeof(b) - 1] ^= 0xFF;
+
+	/* a new bitmap is sent to the cache, then drawn */
+	CU_ASSERT(server_bitmap_cache_draw(cache, 0, 0, 16, 16, a, 16 * 2, 16) == true);
+	CU_ASSERT(cache_bitmap_v2_count == 1);
+	CU_ASSERT(memblt_count == 1);
+	CU_ASSERT(cache->misses == 1);
+
+	/* the same pixels are drawn from the cache alone */
+	CU_ASSERT(server_bitmap_cache_draw(cache, 32, 32, 16, 16, a, 16 * 2, 16) == true);
+	CU_ASSERT(cache_bitmap_v2_count == 1);
+	CU_ASSERT(memblt_count == 2);
+	CU_ASSERT(cache->hits == 1);
+	CU_ASSERT(last_memblt.nLeftRect == 32);
+	CU_ASSERT(last_memblt.cacheIndex == last_cache_bitmap_v2.cacheIndex);
+
+	/* a single different byte is a different bitmap */
+	CU_ASSERT(server_bitmap_cache_draw(cache, 0, 0, 16, 16, b, 16 * 2, 16) == true);
+	CU_ASSERT(cache_bitmap_v2_count == 2);
+	CU_ASSERT(cache->misses == 2);
+
+	/* the padding of the source scanlines is not part of the bitmap */
+	memset(padded, 0xEE, sizeof(padded));
+
+	for (y = 0; y < 16; y++)
+		memcpy(&padded[y * 24 * 2], &a[y * 16 * 2], 16 * 2);
+
+	CU_ASSERT(server_bitmap_cache_draw(cache, 0, 0, 16, 16, padded, 24 * 2, 16) == true);
+	CU_ASSERT(cache_bitmap_v2_count == 2);
+	CU_ASSERT(cache->hits == 2);
+
+	server_bitmap_cache_free(cache);
+	test_peer_free(context);
+}
+
+void test_server_bitmap_cache_lru(void)
+{
+	uint16 index_a;
+	uint16 index_b;
+	uint8 a[16 * 16 * 2];
+	uint8 b[16 * 16 * 2];
+	uint8 c[16 * 16 * 2];
+	rdpContext* context;
+	rdpServerBitmapCache* cache;
+
+	/* two entries per cell */
+	context = test_peer_new(3, 2);
+	cache = server_bitmap_cache_new(context);
+
+	test_fill_bitmap(a, sizeof(a), 1);
+	test_fill_bitmap(b, sizeof(b), 2);
+	test_fill_bitmap(c, sizeof(c), 3);
+
+	server_bitmap_cache_draw(cache, 0, 0, 16, 16, a, 16 * 2, 16);
+	index_a = last_cache_bitmap_v2.cacheIndex;
+	server_bitmap_cache_draw(cache, 0, 0, 16, 16, b, 16 * 2, 16);
+	index_b = last_cache_bitmap_v2.cacheIndex;
+	CU_ASSERT(index_a != index_b);
+
+	/* drawing a makes b the least recently used entry */
+	server_bitmap_cache_draw(cache, 0, 0, 16, 16, a, 16 * 2, 16);
+	CU_ASSERT(cache_bitmap_v2_count == 2);
+
+	/* c replaces b */
+	server_bitmap_cache_draw(cache, 0, 0, 16, 16, c, 16 * 2, 16);
+	CU_ASSERT(cache_bitmap_v2_count == 3);
+	CU_ASSERT(last_cache_bitmap_v2.cacheIndex == index_b);
+
+	/* a is still cached, b has to be sent again and replaces c */
+	server_bitmap_cache_draw(cache, 0, 0, 16, 16, a, 16 * 2, 16);
+	CU_ASSERT(cache_bitmap_v2_count == 3);
+	server_bitmap_cache_draw(cache, 0, 0, 16, 16, b, 16 * 2, 16);
+	CU_ASSERT(cache_bitmap_v2_count == 4);
+	CU_ASSERT(last_cache_bitmap_v2.cacheIndex == index_b);
+
+	/* then c replaces a, the least recently used */
+	server_bitmap_cache_draw(cache, 0, 0, 16, 16, c, 16 * 2, 16);
+	CU_ASSERT(last_cache_bitmap_v2.cacheIndex == index_a);
+
+	/* nothing is cached after a reset */
+	server_bitmap_cache_reset(cache);
+	server_bitmap_cache_draw(cache, 0, 0, 16, 16, b, 16 * 2, 16);
+	CU_ASSERT(cache_bitmap_v2_count == 6);
+	CU_ASSERT(cache->misses == 1);
+
+	server_bitmap_cache_free(cache);
+	test_peer_free(context);
+}
+
+void test_server_bitmap_cache_cells(void)
+{
+	uint8* data;
+	rdpContext* context;
+	rdpServerBitmapCache* cache;
+
+	context = test_peer_new(5, 4);
+	cache = server_bitmap_cache_new(context);
+	data = (uint8*) xzalloc(256 * 256 * 4);
+
+	/* bitmaps go to the smallest cell they fit in, widths padded to 4 pixels */
+	server_bitmap_cache_draw(cache, 0, 0, 16, 16, data, 16 * 4, 32);
+	CU_ASSERT(last_cache_bitmap_v2.cacheId == 0);
+
+	server_bitmap_cache_draw(cache, 0, 0, 17, 15, data, 17 * 4, 32);
+	CU_ASSERT(last_cache_bitmap_v2.cacheId == 1);
+
+	server_bitmap_cache_draw(cache, 0, 0, 64, 64, data, 64 * 4, 32);
+	CU_ASSERT(last_cache_bitmap_v2.cacheId == 2);
+
+	/* the fifth cell can only hold small enough 8bpp bitmaps */
+	server_bitmap_cache_draw(cache, 0, 0, 160, 160, data, 160, 8);
+	CU_ASSERT(last_cache_bitmap_v2.cacheId == 4);
+	CU_ASSERT(memblt_count == 4);
+
+	/* the order length of a secondary order is read as signed 16-bit */
+	CU_ASSERT(server_bitmap_cache_draw(cache, 0, 0, 128, 128, data, 128 * 2, 16) == false);
+	CU_ASSERT(server_bitmap_cache_draw(cache, 0, 0, 90, 90, data, 90 * 4, 32) == false);
+	CU_ASSERT(memblt_count == 4);
+
+	xfree(data);
+	server_bitmap_cache_free(cache);
+	test_peer_free(context);
+}
+
+static void test_pointer_init(POINTER_NEW_UPDATE* pointer_new, uint8* xor_mask, uint8* and_mask, uint8 seed)
+{
+	memset(pointer_new, 0, sizeof(POINTER_NEW_UPDATE));
+	test_fill_bitmap(xor_mask, 32 * 32 * 4, seed);
+	memset(and_mask, 0, 32 * 32 / 8);
+
+	pointer_new->xorBpp = 32;
+	pointer_new->colorPtrAttr.width = 32;
+	pointer_new->colorPtrAttr.height = 32;
+	pointer_new->colorPtrAttr.lengthXorMask = 32 * 32 * 4;
+	pointer_new->colorPtrAttr.xorMaskData = xor_mask;
+	pointer_new->colorPtrAttr.lengthAndMask = 32 * 32 / 8;
+	pointer_new->colorPtrAttr.andMaskData = and_mask;
+}
+
+void test_server_pointer_cache(void)
+{
+	uint32 index_a;
+	uint8 and_mask[32 * 32 / 8];
+	uint8 xor_a[32 * 32 * 4];
+	uint8 xor_b[32 * 32 * 4];
+	uint8 xor_c[32 * 32 * 4];
+	POINTER_NEW_UPDATE a, b, c;
+	rdpContext* context;
+	rdpServerPointerCache* cache;
+
+	context = test_peer_new(0, 0);
+	context->peer->settings->pointer_cache_size = 2;
+	cache = server_pointer_cache_new(context);
+
+	test_pointer_init(&a, xor_a, and_mask, 1);
+	test_pointer_init(&b, xor_b, and_mask, 2);
+	test_pointer_init(&c, xor_c, and_mask, 3);
+
+	server_pointer_cache_set(cache, &a);
+	index_a = last_pointer_index;
+	CU_ASSERT(pointer_new_count == 1);
+
+	/* the shape in use is not sent again */
+	server_pointer_cache_set(cache, &a);
+	CU_ASSERT(pointer_new_count == 1);
+	CU_ASSERT(pointer_cached_count == 0);
+
+	server_pointer_cache_set(cache, &b);
+	CU_ASSERT(pointer_new_count == 2);
+	CU_ASSERT(last_pointer_index != index_a);
+
+	/* a cached shape is selected by its index */
+	server_pointer_cache_set(cache, &a);
+	CU_ASSERT(pointer_cached_count == 1);
+	CU_ASSERT(last_pointer_index == index_a);
+
+	/* c replaces b, the least recently used */
+	server_pointer_cache_set(cache, &c);
+	CU_ASSERT(pointer_new_count == 3);
+	CU_ASSERT(last_pointer_index != index_a);
+	CU_ASSERT(cache->hits == 2);
+	CU_ASSERT(cache->misses == 3);
+
+	server_pointer_cache_free(cache);
+	test_peer_free(context);
+}
+
+void test_server_pointer_cache_color(void)
+{
+	uint8 and_mask[32 * 32 / 8];
+	uint8 xor_a[32 * 32 * 4];
+	POINTER_NEW_UPDATE a;
+	rdpContext* context;
+	rdpServerPointerCache* cache;
+
+	context = test_peer_new(0, 0);
+	context->peer->settings->pointer_cache_size = 2;
+	context->peer->settings->new_pointer = false;
+	cache = server_pointer_cache_new(context);
+
+	test_pointer_init(&a, xor_a, and_mask, 1);
+
+	/* the first pixel is transparent, the second opaque */
+	xor_a[0] = 0x11; xor_a[1] = 0x22; xor_a[2] = 0x33; xor_a[3] = 0x00;
+	xor_a[4] = 0x44; xor_a[5] = 0x55; xor_a[6] = 0x66; xor_a[7] = 0xFF;
+
+	/* without new pointer support, 32 bpp shapes go out as 24 bpp color pointers */
+	server_pointer_cache_set(cache, &a);
+	CU_ASSERT(pointer_new_count == 0);
+	CU_ASSERT(pointer_color_count == 1);
+	CU_ASSERT((last_pointer_and[0] & 0xC0) == 0x80);
+	CU_ASSERT(last_pointer_xor[0] == 0 && last_pointer_xor[1] == 0 && last_pointer_xor[2] == 0);
+	CU_ASSERT(last_pointer_xor[3] == 0x44 && last_pointer_xor[4] == 0x55 && last_pointer_xor[5] == 0x66);
+
+	/* shapes which cannot be converted fall back to the default system pointer */
+	a.xorBpp = 8;
+	server_pointer_cache_set(cache, &a);
+	CU_ASSERT(pointer_color_count == 1);
+	CU_ASSERT(pointer_system_count == 1);
+	CU_ASSERT(last_pointer_system == SYSPTR_DEFAULT);
+
+	server_pointer_cache_free(cache);
+	test_peer_free(context);
+}
+
+/* a client whose bitmaps hold a copy of the data they are decoded from */
+
+static void test_bitmap_new(rdpContext* context, rdpBitmap* bitmap)
+{
+
+}
+
+static void test_bitmap_free(rdpContext* context, rdpBitmap* bitmap)
+{
+
+}
+
+static void test_bitmap_decompress(rdpContext* context, rdpBitmap* bitmap,
+		uint8* data, int width, int height, int bpp, int length, boolean compressed, int codec_id)
+{
+	bitmap->length = width * height * 4;
+	bitmap->data = (uint8*) xzalloc(bitmap->length);
+	memcpy(bitmap->data, data, MIN(length, (int) bitmap->length));
+}
+
+static void test_bitmap_set_surface(rdpContext* context, rdpBitmap* bitmap, boolean primary)
+{
+
+}
+
+static rdpContext* test_client_new(uint32 bitmap_cache_budget, rdpCacheBudget* budget)
+{
+	freerdp* instance;
+	rdpContext* context;
+	rdpBitmap bitmap;
+
+	instance = xnew(freerdp);
+	context = xnew(rdpContext);
+
+	instance->context = context;
+	context->instance = instance;
+
+	instance->update = xnew(rdpUpdate);
+	instance->update->context = context;
+	instance->update->primary = xnew(rdpPrimaryUpdate);
+	instance->update->secondary = xnew(rdpSecondaryUpdate);
+
+	memset(&bitmap, 0, sizeof(rdpBitmap));
+	bitmap.size = sizeof(rdpBitmap);
+	bitmap.New = test_bitmap_new;
+	bitmap.Free = test_bitmap_free;
+	bitmap.Decompress = test_bitmap_decompress;
+	bitmap.SetSurface = test_bitmap_set_surface;
+
+	context->graphics = graphics_new(context);
+	graphics_register_bitmap(context->graphics, &bitmap);
+
+	instance->settings = settings_new(instance);
+	instance->settings->bitmap_cache_budget = bitmap_cache_budget;
+	instance->settings->cache_budget = budget;
+
+	context->cache = cache_new(instance->settings);
+	bitmap_cache_register_callbacks(instance->update);
+
+	return context;
+}
+
+static void test_client_free(rdpContext* context)
+{
+	freerdp* instance = context->instance;
+
+	cache_free(context->cache);
+	graphics_free(context->graphics);
+	settings_free(instance->settings);
+	xfree(instance->update->primary);
+	xfree(instance->update->secondary);
+	xfree(instance->update);
+	xfree(instance);
+	xfree(context);
+}
+
+/* send a 16x16 bitmap, 1 KB once decoded, to the first bitmap cell */
+
+static void test_client_cache_bitmap(rdpContext* context, uint32 index, uint8* data)
+{
+	CACHE_BITMAP_V2_ORDER cache_bitmap_v2;
+
+	memset(&cache_bitmap_v2, 0, sizeof(CACHE_BITMAP_V2_ORDER));
+	cache_bitmap_v2.cacheId = 0;
+	cache_bitmap_v2.cacheIndex = index;
+	cache_bitmap_v2.bitmapBpp = 32;
+	cache_bitmap_v2.bitmapWidth = 16;
+	cache_bitmap_v2.bitmapHeight = 16;
+	cache_bitmap_v2.bitmapLength = 16 * 16 * 4;
+	cache_bitmap_v2.bitmapDataStream = data;
+
+	context->instance->update->secondary->CacheBitmapV2(context, &cache_bitmap_v2);
+}
+
+void test_bitmap_cache_lru(void)
+{
+	int i;
+	uint8 data[3][16 * 16 * 4];
+	rdpBitmap* bitmap;
+	rdpContext* context;
+	rdpBitmapCache* bitmap_cache;
+	CACHE_STATS stats;
+
+	/* room for two decoded bitmaps */
+	context = test_client_new(2, NULL);
+	bitmap_cache = context->cache->bitmap;
+
+	for (i = 0; i < 3; i++)
+	{
+		test_fill_bitmap(data[i], sizeof(data[i]), i);
+		test_client_cache_bitmap(context, i, data[i]);
+	}
+
+	/* the least recently used bitmap was evicted */
+	bitmap_cache_get_stats(bitmap_cache, &stats);
+	CU_ASSERT(stats.entries == 2);
+	CU_ASSERT(stats.bytes == 2048);
+	CU_ASSERT(stats.limit == 2048);
+	CU_ASSERT(stats.evictions == 1);
+	CU_ASSERT(bitmap_cache->cells[0].entries[0] == NULL);
+
+	/* and is decoded again from the data kept for it */
+	bitmap = bitmap_cache_get(bitmap_cache, 0, 0);
+	CU_ASSERT(bitmap != NULL);
+
+	if (bitmap != NULL)
+		CU_ASSERT(memcmp(bitmap->data, data[0], sizeof(data[0])) == 0);
+
+	/* which evicts the next least recently used one */
+	bitmap_cache_get_stats(bitmap_cache, &stats);
+	CU_ASSERT(stats.misses == 1);
+	CU_ASSERT(stats.evictions == 2);
+	CU_ASSERT(stats.entries == 2);
+	CU_ASSERT(bitmap_cache->cells[0].entries[1] == NULL);
+
+	CU_ASSERT(bitmap_cache_get(bitmap_cache, 0, 2) != NULL);
+	bitmap_cache_get_stats(bitmap_cache, &stats);
+	CU_ASSERT(stats.hits == 1);
+	CU_ASSERT(stats.evictions == 2);
+
+	/* replacing a bitmap frees the previous one */
+	test_client_cache_bitmap(context, 2, data[1]);
+	bitmap_cache_get_stats(bitmap_cache, &stats);
+	CU_ASSERT(stats.entries == 2);
+	CU_ASSERT(stats.bytes == 2048);
+
+	bitmap = bitmap_cache_get(bitmap_cache, 0, 2);
+	CU_ASSERT(bitmap != NULL);
+
+	if (bitmap != NULL)
+		CU_ASSERT(memcmp(bitmap->data, data[1], sizeof(data[1])) == 0);
+
+	test_client_free(context);
+}
+
+void test_bitmap_cache_shared_budget(void)
+{
+	int i;
+	uint8 data[16 * 16 * 4];
+	rdpBitmap* bitmap;
+	rdpContext* context1;
+	rdpContext* context2;
+	rdpCacheBudget* budget;
+	CACHE_STATS stats;
+
+	/* room for three decoded bitmaps across both sessions */
+	budget = cache_budget_new(3072);
+	context1 = test_client_new(0, budget);
+	context2 = test_client_new(0, budget);
+
+	test_fill_bitmap(data, sizeof(data), 0);
+
+	for (i = 0; i < 2; i++)
+		test_client_cache_bitmap(context1, i, data);
+
+	CU_ASSERT(cache_budget_get_used(budget) == 2048);
+
+	/* the session going over the budget evicts its own bitmaps */
+	for (i = 0; i < 2; i++)
+		test_client_cache_bitmap(context2, i, data);
+
+	CU_ASSERT(cache_budget_get_used(budget) == 3072);
+
+	bitmap_cache_get_stats(context1->cache->bitmap, &stats);
+	CU_ASSERT(stats.entries == 2);
+	CU_ASSERT(stats.evictions == 0);
+
+	bitmap_cache_get_stats(context2->cache->bitmap, &stats);
+	CU_ASSERT(stats.entries == 1);
+	CU_ASSERT(stats.evictions == 1);
+
+	/* offscreen bitmaps cannot be evicted, and are not charged to the budget */
+	bitmap = Bitmap_Alloc(context1);
+	Bitmap_SetDimensions(context1, bitmap, 64, 64);
+	offscreen_cache_put(context1->cache->offscreen, 0, bitmap);
+
+	CU_ASSERT(cache_budget_get_used(budget) == 3072);
+	CU_ASSERT(bitmap_cache_get(context1->cache->bitmap, 0, 0) != NULL);
+	CU_ASSERT(bitmap_cache_get(context1->cache->bitmap, 0, 1) != NULL);
+
+	bitmap_cache_get_stats(context1->cache->bitmap, &stats);
+	CU_ASSERT(stats.evictions == 0);
+
+	/* freeing a session gives its share back */
+	test_client_free(context1);
+	CU_ASSERT(cache_budget_get_used(budget) == 1024);
+
+	test_client_free(context2);
+	CU_ASSERT(cache_budget_get_used(budget) == 0);
+
+	cache_budget_free(budget);
+}
+
+void test_bitmap_cache_budget_share(void)
+{
+	int i;
+	uint8 data[16 * 16 * 4];
+	rdpBitmap* bitmap;
+	rdpContext* context1;
+	rdpContext* context2;
+	rdpCacheBudget* budget;
+	CACHE_STATS stats;
+
+	/* a share of two decoded bitmaps for each session */
+	budget = cache_budget_new(4096);
+	context1 = test_client_new(0, budget);
+	context2 = test_client_new(0, budget);
+
+	/* the first session exceeds the budget with bitmaps it cannot decode again */
+	for (i = 0; i < 5; i++)
+	{
+		bitmap = Bitmap_Alloc(context1);
+		bitmap->length = 1024;
+		bitmap_cache_put(context1->cache->bitmap, 0, i, bitmap);
+	}
+
+	CU_ASSERT(cache_budget_get_used(budget) == 5120);
+
+	bitmap_cache_get_stats(context1->cache->bitmap, &stats);
+	CU_ASSERT(stats.entries == 5);
+	CU_ASSERT(stats.evictions == 0);
+
+	/* the second session only evicts what goes over its share */
+	test_fill_bitmap(data, sizeof(data), 0);
+
+	for (i = 0; i < 3; i++)
+		test_client_cache_bitmap(context2, i, data);
+
+	bitmap_cache_get_stats(context2->cache->bitmap, &stats);
+	CU_ASSERT(stats.entries == 2);
+	CU_ASSERT(stats.bytes == 2048);
+	CU_ASSERT(stats.evictions == 1);
+	CU_ASSERT(context2->cache->bitmap->cells[0].entries[0] == NULL);
+
+	CU_ASSERT(cache_budget_get_used(budget) == 7168);
+
+	test_client_free(context1);
+	test_client_free(context2);
+	CU_ASSERT(cache_budget_get_used(budget) == 0);
+
+	cache_budget_free(budget);
+}
+
+void test_cache_lazy_allocation(void)
+{
+	int i;
+	uint8 data[16 * 16 * 4];
+	uint32 color_table[256];
+	rdpContext* context;
+	rdpCache* cache;
+
+	context = test_client_new(0, NULL);
+	cache = context->cache;
+
+	/* nothing is allocated before the server stores something */
+	for (i = 0; i < 10; i++)
+		CU_ASSERT(cache->glyph->glyphCache[i].entries == NULL);
+
+	for (i = 0; i < (int) cache->bitmap->maxCells; i++)
+		CU_ASSERT(cache->bitmap->cells[i].entries == NULL);
+
+	CU_ASSERT(cache->glyph->fragCache.entries == NULL);
+	CU_ASSERT(cache->brush->entries == NULL);
+	CU_ASSERT(cache->brush->monoEntries == NULL);
+	CU_ASSERT(cache->palette->entries == NULL);
+	CU_ASSERT(cache->offscreen->entries == NULL);
+
+	/* only the tables which are stored into are allocated */
+	test_fill_bitmap(data, sizeof(data), 0);
+	test_client_cache_bitmap(context, 0, data);
+	CU_ASSERT(cache->bitmap->cells[0].entries != NULL);
+	CU_ASSERT(cache->bitmap->cells[1].entries == NULL);
+
+	brush_cache_put(cache->brush, 3, xmalloc(8 * 8), 8);
+	CU_ASSERT(cache->brush->entries != NULL);
+	CU_ASSERT(cache->brush->monoEntries == NULL);
+
+	palette_cache_put(cache->palette, 2, color_table);
+	CU_ASSERT(cache->palette->entries != NULL);
+	CU_ASSERT(palette_cache_get(cache->palette, 2) == color_table);
+
+	glyph_cache_fragment_put(cache->glyph, 5, 4, xmalloc(4));
+	CU_ASSERT(cache->glyph->fragCache.entries != NULL);
+	CU_ASSERT(cache->glyph->glyphCache[0].entries == NULL);
+
+	test_client_free(context);
+}
+
+void test_cache_release(void)
+{
+	uint32 bpp;
+	uint8 data[16 * 16 * 4];
+	uint32 color_table[256];
+	rdpContext* context;
+	rdpCache* cache;
+	CACHE_STATS stats;
+
+	context = test_client_new(64, NULL);
+	cache = context->cache;
+
+	/* tables left holding nothing are freed, the others kept */
+	brush_cache_put(cache->brush, 0, xmalloc(8 * 8), 8);
+	brush_cache_put(cache->brush, 0, NULL, 8);
+	brush_cache_put(cache->brush, 1, xmalloc(8), 1);
+	brush_cache_release(cache->brush);
+	CU_ASSERT(cache->brush->entries == NULL);
+	CU_ASSERT(cache->brush->monoEntries != NULL);
+	bpp = 1;
+	CU_ASSERT(brush_cache_get(cache->brush, 1, &bpp) != NULL);
+
+	palette_cache_put(cache->palette, 0, color_table);
+	palette_cache_release(cache->palette);
+	CU_ASSERT(cache->palette->entries != NULL);
+	palette_cache_put(cache->palette, 0, NULL);
+	palette_cache_release(cache->palette);
+	CU_ASSERT(cache->palette->entries == NULL);
+
+	glyph_cache_fragment_put(cache->glyph, 5, 4, xmalloc(4));
+	glyph_cache_release(cache->glyph);
+	CU_ASSERT(cache->glyph->fragCache.entries != NULL);
+	glyph_cache_fragment_put(cache->glyph, 5, 0, NULL);
+	glyph_cache_release(cache->glyph);
+	CU_ASSERT(cache->glyph->fragCache.entries == NULL);
+
+	/* decoded bitmaps are freed, and decoded again from the data kept */
+	test_fill_bitmap(data, sizeof(data), 0);
+	test_client_cache_bitmap(context, 0, data);
+	bitmap_cache_release(cache->bitmap);
+	bitmap_cache_get_stats(cache->bitmap, &stats);
+	CU_ASSERT(stats.entries == 0);
+	CU_ASSERT(stats.bytes == 0);
+	CU_ASSERT(cache->bitmap->cells[0].entries != NULL);
+	CU_ASSERT(cache->bitmap->cells[0].entries[0] == NULL);
+
+	CU_ASSERT(bitmap_cache_get(cache->bitmap, 0, 0) != NULL);
+	CU_ASSERT(memcmp(bitmap_cache_get(cache->bitmap, 0, 0)->data, data, sizeof(data)) == 0);
+
+	/* a cell holding nothing at all is freed */
+	bitmap_cache_put(cache->bitmap, 0, 0, NULL);
+	bitmap_cache_release(cache->bitmap);
+	CU_ASSERT(cache->bitmap->cells[0].entries == NULL);
+
+	test_client_free(context);
+}
+
+void test_cache_check_idle(void)
+{
+	uint32 bpp;
+	rdpContext* context;
+	rdpCache* cache;
+
+	context = test_client_new(0, NULL);
+	cache = context->cache;
+
+	/* an empty brush table, which a release would free */
+	brush_cache_put(cache->brush, 0, xmalloc(8 * 8), 8);
+	brush_cache_put(cache->brush, 0, NULL, 8);
+	CU_ASSERT(cache->brush->entries != NULL);
+
+	/* nothing is released without an idle timeout */
+	context->instance->settings->cache_idle_timeout = 0;
+	cache->brush_idle.since -= 3600;
+	cache_check_idle(cache);
+	CU_ASSERT(cache->brush->entries != NULL);
+
+	/* a cache which was used is not idle, the period starts again */
+	context->instance->settings->cache_idle_timeout = 60;
+	cache_check_idle(cache);
+	CU_ASSERT(cache->brush->entries != NULL);
+
+	/* nor before the timeout */
+	cache_check_idle(cache);
+	CU_ASSERT(cache->brush->entries != NULL);
+
+	cache->brush_idle.since -= 30;
+	bpp = 8;
+	brush_cache_get(cache->brush, 0, &bpp);
+	cache->brush_idle.since -= 60;
+	cache_check_idle(cache);
+	CU_ASSERT(cache->brush->entries != NULL);
+
+	/* a cache left unused for the timeout is released */
+	cache->brush_idle.since -= 60;
+	cache_check_idle(cache);
+	CU_ASSERT(cache->brush->entries == NULL);
+
+	test_client_free(context);
+}
+
+void test_cache_reset_state(void)
+{
+	uint8 data[16 * 16 * 4];
+	rdpContext* context;
+	rdpUpdate* update;
+	rdpCache* cache;
+	CACHE_STATS stats;
+
+	context = test_client_new(64, NULL);
+	update = context->instance->update;
+	cache = context->cache;
+
+	cache_register_callbacks(update);
+	CU_ASSERT(update->ResetState != NULL);
+
+	test_fill_bitmap(data, sizeof(data), 0);
+	test_client_cache_bitmap(context, 0, data);
+	brush_cache_put(cache->brush, 0, xmalloc(8 * 8), 8);
+	glyph_cache_fragment_put(cache->glyph, 5, 4, xmalloc(4));
+
+	/* what was cached during the previous activation is gone */
+	IFCALL(update->ResetState, context);
+
+	bitmap_cache_get_stats(cache->bitmap, &stats);
+	CU_ASSERT(stats.entries == 0);
+	CU_ASSERT(stats.bytes == 0);
+	CU_ASSERT(cache->bitmap->cells[0].entries == NULL);
+	CU_ASSERT(cache->brush->entries == NULL);
+	CU_ASSERT(cache->glyph->fragCache.entries == NULL);
+
+	/* and the tables are allocated again when used */
+	test_client_cache_bitmap(context, 0, data);
+	CU_ASSERT(bitmap_cache_get(cache->bitmap, 0, 0) != NULL);
+
+	test_client_free(context);
+}
+
+#define TEST_PERSISTENT_FILE	"test_persistent_cache.bmc"
+
+static rdpSettings* test_persistent_settings_new(void)
+{
+	rdpSettings* settings;
+
+	settings = settings_new(NULL);
+	settings->bitmap_cache_persist_file = xstrdup(TEST_PERSISTENT_FILE);
+	settings->bitmapCacheV2NumCells = 2;
+	settings->bitmapCacheV2CellInfo[0].numEntries = 4;
+	settings->bitmapCacheV2CellInfo[0].persistent = true;
+	settings->bitmapCacheV2CellInfo[1].numEntries = 4;
+	settings->bitmapCacheV2CellInfo[1].persistent = true;
+
+	return settings;
+}
+
+static void test_persistent_entry_init(PERSISTENT_CACHE_ENTRY* entry, uint32 key, uint8* data, uint32 length)
+{
+	memset(entry, 0, sizeof(PERSISTENT_CACHE_ENTRY));
+	entry->key1 = key;
+	entry->key2 = ~key;
+	entry->width = 16;
+	entry->height = 8;
+	entry->bpp = 16;
+	entry->compressed = true;
+	entry->length = length;
+	entry->data = data;
+}
+
+void test_persistent_cache_file(void)
+{
+	FILE* fp;
+	uint8 header[12 + 2 * 4 + 24];
+	uint8 data[3][64];
+	rdpSettings* settings;
+	rdpPersistentCache* persistent;
+	PERSISTENT_CACHE_ENTRY entry;
+	PERSISTENT_CACHE_ENTRY* cached;
+	STREAM _s, *s;
+	uint32 value;
+	int i;
+
+	remove(TEST_PERSISTENT_FILE);
+
+	for (i = 0; i < 3; i++)
+		test_fill_bitmap(data[i], sizeof(data[i]), i);
+
+	settings = test_persistent_settings_new();
+	persistent = persistent_cache_new(settings);
+	CU_ASSERT(settings->bitmapCacheV2CellInfo[0].numPersistentKeys == 0);
+
+	/* bitmaps at indices 1 and 3 of the first cell, 0 of the second */
+	test_persistent_entry_init(&entry, 0x1001, data[0], sizeof(data[0]));
+	persistent_cache_put(persistent, 0, 1, &entry);
+	test_persistent_entry_init(&entry, 0x1003, data[1], 32);
+	persistent_cache_put(persistent, 0, 3, &entry);
+	test_persistent_entry_init(&entry, 0x2000, data[2], sizeof(data[2]));
+	persistent_cache_put(persistent, 1, 0, &entry);
+
+	/* the data is copied */
+	cached = persistent_cache_get(persistent, 0, 1);
+	CU_ASSERT(cached != NULL);
+	CU_ASSERT(cached->data != data[0]);
+	CU_ASSERT(persistent_cache_get(persistent, 0, 0) == NULL);
+	CU_ASSERT(persistent_cache_get(persistent, 0, 4) == NULL);
+	CU_ASSERT(persistent_cache_get(persistent, 2, 0) == NULL);
+
+	CU_ASSERT(persistent_cache_save(persistent) == true);
+
+	/* header, entry counts and the first record */
+	fp = fopen(TEST_PERSISTENT_FILE, "rb");
+	CU_ASSERT(fp != NULL);
+
+	if (fp != NULL)
+	{
+		CU_ASSERT(fread(header, sizeof(header), 1, fp) == 1);
+		fclose(fp);
+
+		s = &_s;
+		s->p = s->data = header;
+		s->size = sizeof(header);
+
+		stream_read_uint32(s, value);
+		CU_ASSERT(memcmp(header, "FBMC", 4) == 0);
+		stream_read_uint32(s, value);
+		CU_ASSERT(value == 1);
+		stream_read_uint32(s, value);
+		CU_ASSERT(value == 2);
+		stream_read_uint32(s, value);
+		CU_ASSERT(value == 2);
+		stream_read_uint32(s, value);
+		CU_ASSERT(value == 1);
+
+		stream_read_uint32(s, value);
+		CU_ASSERT(value == 0x1001);
+		stream_read_uint32(s, value);
+		CU_ASSERT(value == ~0x1001);
+		stream_seek(s, 12);
+		stream_read_uint32(s, value);
+		CU_ASSERT(value == 12 + 2 * 4 + 3 * 24);
+	}
+
+	persistent_cache_free(persistent);
+	settings_free(settings);
+
+	/* loading the file compacts each cell to its first indices */
+	settings = test_persistent_settings_new();
+	persistent = persistent_cache_new(settings);
+
+	cached = persistent_cache_get(persistent, 0, 0);
+	CU_ASSERT(cached != NULL);
+
+	if (cached != NULL)
+	{
+		CU_ASSERT(cached->key1 == 0x1001);
+		CU_ASSERT(cached->key2 == ~0x1001);
+		CU_ASSERT(cached->width == 16);
+		CU_ASSERT(cached->height == 8);
+		CU_ASSERT(cached->bpp == 16);
+		CU_ASSERT(cached->compressed == true);
+		CU_ASSERT(cached->length == sizeof(data[0]));
+		CU_ASSERT(memcmp(cached->data, data[0], sizeof(data[0])) == 0);
+	}
+
+	cached = persistent_cache_get(persistent, 0, 1);
+	CU_ASSERT(cached != NULL);
+
+	if (cached != NULL)
+	{
+		CU_ASSERT(cached->key1 == 0x1003);
+		CU_ASSERT(cached->length == 32);
+		CU_ASSERT(memcmp(cached->data, data[1], 32) == 0);
+	}
+
+	CU_ASSERT(persistent_cache_get(persistent, 0, 2) == NULL);
+	CU_ASSERT(persistent_cache_get(persistent, 1, 0) != NULL);
+
+	/* the keys are announced for the persistent key list */
+	CU_ASSERT(settings->bitmapCacheV2CellInfo[0].numPersistentKeys == 2);
+	CU_ASSERT(settings->bitmapCacheV2CellInfo[1].numPersistentKeys == 1);
+	CU_ASSERT(settings->bitmapCacheV2CellInfo[0].persistentKeys[1] == (((uint64) (uint32) ~0x1003 << 32) | 0x1003));
+
+	/* removing an entry leaves the mapped data alone */
+	persistent_cache_put(persistent, 0, 0, NULL);
+	CU_ASSERT(persistent_cache_get(persistent, 0, 0) == NULL);
+
+	persistent_cache_free(persistent);
+	settings_free(settings);
+
+	remove(TEST_PERSISTENT_FILE);
+}
+
+void test_persistent_cache_invalid_file(void)
+{
+	FILE* fp;
+	uint8 garbage[64];
+	rdpSettings* settings;
+	rdpPersistentCache* persistent;
+
+	memset(garbage, 0x55, sizeof(garbage));
+
+	fp = fopen(TEST_PERSISTENT_FILE, "wb");
+	CU_ASSERT(fp != NULL);
+
+	if (fp == NULL)
+		return;
+
+	fwrite(garbage, sizeof(garbage), 1, fp);
+	fclose(fp);
+
+	settings = test_persistent_settings_new();
+	persistent = persistent_cache_new(settings);
+
+	CU_ASSERT(persistent_cache_load(persistent) == false);
+	CU_ASSERT(persistent_cache_get(persistent, 0, 0) == NULL);
+	CU_ASSERT(settings->bitmapCacheV2CellInfo[0].numPersistentKeys == 0);
+
+	persistent_cache_free(persistent);
+	settings_free(settings);
+
+	remove(TEST_PERSISTENT_FILE);
+}
+
+static void test_persistent_keys_init(rdpSettings* settings, int id, uint32 numEntries, uint32 numKeys)
+{
+	uint32 i;
+	BITMAP_CACHE_V2_CELL_INFO* cellInfo = &settings->bitmapCacheV2CellInfo[id];
+
+	cellInfo->numEntries = numEntries;
+	cellInfo->persistent = true;
+	cellInfo->numPersistentKeys = numKeys;
+	cellInfo->persistentKeys = (uint64*) xmalloc(sizeof(uint64) * numKeys);
+
+	for (i = 0; i < numKeys; i++)
+		cellInfo->persistentKeys[i] = ((uint64) (id + 1) << 32) | i;
+}
+
+void test_persistent_key_list(void)
+{
+	int i;
+	uint32 j;
+	STREAM* s;
+	boolean last;
+	uint8 flags;
+	uint32 key1, key2;
+	uint16 count[5];
+	uint16 total[5];
+	uint32 next[5] = { 0, 0, 0, 0, 0 };
+	uint32 first[5] = { 0, 0, 0, 0, 0 };
+	rdpSettings* settings;
+	int pdus;
+
+	settings = settings_new(NULL);
+	settings->persistent_bitmap_cache = true;
+	settings->bitmapCacheV2NumCells = 3;
+
+	/* 200 + 100 keys, and only 10 of the 20 keys of the last cell fit in it */
+	test_persistent_keys_init(settings, 0, 600, 200);
+	test_persistent_keys_init(settings, 1, 600, 100);
+	test_persistent_keys_init(settings, 2, 10, 20);
+
+	s = stream_new(32 + 169 * 8);
+	pdus = 0;
+
+	do
+	{
+		stream_set_pos(s, 0);
+		last = rdp_write_client_persistent_key_list_pdu(s, settings, first);
+		stream_set_pos(s, 0);
+
+		for (i = 0; i < 5; i++)
+			stream_read_uint16(s, count[i]);
+
+		for (i = 0; i < 5; i++)
+			stream_read_uint16(s, total[i]);
+
+		stream_read_uint8(s, flags);
+		stream_seek(s, 3);
+
+		CU_ASSERT(total[0] == 200 && total[1] == 100 && total[2] == 10);
+		CU_ASSERT(total[3] == 0 && total[4] == 0);
+		CU_ASSERT(count[0] + count[1] + count[2] <= 169);
+		CU_ASSERT(((flags & 0x01) != 0) == (pdus == 0));
+		CU_ASSERT(((flags & 0x02) != 0) == last);
+
+		/* the keys of each cell follow each other in cache index order */
+		for (i = 0; i < 5; i++)
+		{
+			for (j = 0; j < count[i]; j++)
+			{
+				stream_read_uint32(s, key1);
+				stream_read_uint32(s, key2);
+
+				CU_ASSERT(key1 == next[i]);
+				CU_ASSERT(key2 == (uint32) (i + 1));
+				next[i]++;
+			}
+		}
+
+		pdus++;
+	}
+	while (!last && pdus < 10);
+
+	CU_ASSERT(pdus == 2);
+	CU_ASSERT(next[0] == 200 && next[1] == 100 && next[2] == 10);
+
+	/* a short list fits in a single PDU, first and last */
+	memset(first, 0, sizeof(first));
+	settings->bitmapCacheV2NumCells = 1;
+	settings->bitmapCacheV2CellInfo[0].numPersistentKeys = 169;
+
+	stream_set_pos(s, 0);
+	CU_ASSERT(rdp_write_client_persistent_key_list_pdu(s, settings, first) == true);
+	CU_ASSERT(stream_get_pos(s) == 24 + 169 * 8);
+	CU_ASSERT(s->data[20] == 0x03);
+
+	stream_free(s);
+
+	for (i = 0; i < 3; i++)
+	{
+		xfree(settings->bitmapCacheV2CellInfo[i].persistentKeys);
+		settings->bitmapCacheV2CellInfo[i].persistentKeys = NULL;
+	}
+
+	settings_free(settings);
+}
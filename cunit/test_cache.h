@@ -0,0 +1,38 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Cache Unit Tests
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "test_freerdp.h"
+
+int init_cache_suite(void);
+int clean_cache_suite(void);
+int add_cache_suite(void);
+
+void test_server_bitmap_cache_hash(void);
+void test_server_bitmap_cache_lru(void);
+void test_server_bitmap_cache_cells(void);
+void test_server_pointer_cache(void);
+void test_server_pointer_cache_color(void);
+void test_bitmap_cache_lru(void);
+void test_bitmap_cache_shared_budget(void);
+void test_bitmap_cache_budget_share(void);
+void test_cache_lazy_allocation(void);
+void test_cache_release(void);
+void test_cache_check_idle(void);
+void test_cache_reset_state(void);
+void test_persistent_cache_file(void);
+void test_persistent_cache_invalid_file(void);
+void test_persistent_key_list(void);
@@ -25,6 +25,7 @@
 #include "test_mcs.h"
 #include "test_color.h"
 #include "test_bitmap.h"
+#include "test_cache.h"
 #include "test_gdi.h"
 #include "test_list.h"
 #include "test_sspi.h"
@@ -41,6 +42,9 @@
 #include "test_freerdp.h"
 #include "test_rail.h"
 #include "test_pcap.h"
+#include "test_reactor.h"
+#include "test_input.h"
+#include "test_motion.h"
 #include "test_mppc.h"
 #include "test_mppc_enc.h"
 
@@ -124,15 +128,18 @@ const static test_suite suites[] =
 {
 	{ "ber", add_ber_suite },
 	{ "bitmap", add_bitmap_suite },
+	{ "cache", add_cache_suite },
 	{ "channels", add_channels_suite },
 	{ "cliprdr", add_cliprdr_suite },
 	{ "color", add_color_suite },
 	{ "drdynvc", add_drdynvc_suite },
 	{ "gcc", add_gcc_suite },
 	{ "gdi", add_gdi_suite },
+	{ "input", add_input_suite },
 	{ "license", add_license_suite },
 	{ "list", add_list_suite },
 	{ "mcs", add_mcs_suite },
+	{ "motion", add_motion_suite },
 	{ "mppc", add_mppc_suite },
 	{ "mppc_enc", add_mppc_enc_suite },
 	{ "ntlm", add_ntlm_suite },
@@ -140,6 +147,7 @@ const static test_suite suites[] =
 	{ "pcap", add_pcap_suite },
 	{ "per", add_per_suite },
 	{ "rail", add_rail_suite },
+	{ "reactor", add_reactor_suite },
 	{ "rfx", add_rfx_suite },
 	{ "nsc", add_nsc_suite },
 	{ "sspi", add_sspi_suite },
@@ -74,6 +74,8 @@ int add_gdi_suite(void)
 	add_test_function(gdi_BitBlt_8bpp);
 	add_test_function(gdi_ClipCoords);
 	add_test_function(gdi_InvalidateRegion);
+	add_test_function(gdi_UnionWndRgn);
+	add_test_function(gdi_GlyphRun);
 
 	return 0;
 }
@@ -2871,6 +2873,8 @@ void test_gdi_InvalidateRegion(void)
 	
 	hdc->hwnd->count = 16;
 	hdc->hwnd->cinvalid = (HGDI_RGN) malloc(sizeof(GDI_RGN) * hdc->hwnd->count);
+	hdc->hwnd->ninvalid = 0;
+	hdc->hwnd->maxinvalid = GDI_MAX_INVALID_RECTS;
 
 	rgn1 = gdi_CreateRectRgn(0, 0, 0, 0);
 	rgn2 = gdi_CreateRectRgn(0, 0, 0, 0);
@@ -2989,3 +2993,158 @@ void test_gdi_InvalidateRegion(void)
 	gdi_InvalidateRegion(hdc, rgn1->x, rgn1->y, rgn1->w, rgn1->h);
 	CU_ASSERT(gdi_EqualRgn(invalid, rgn2) == 1);
 }
+
+void test_gdi_UnionWndRgn(void)
+{
+	int i;
+	int area;
+	GDI_WND wnd;
+	HGDI_RGN rgn;
+
+	wnd.count = 4;
+	wnd.ninvalid = 0;
+	wnd.maxinvalid = 4;
+	wnd.invalid = NULL;
+	wnd.cinvalid = (HGDI_RGN) malloc(sizeof(GDI_RGN) * wnd.count);
+
+	/* overlapping rectangles are kept disjoint */
+	gdi_UnionWndRgn(&wnd, 0, 0, 100, 100);
+	gdi_UnionWndRgn(&wnd, 50, 50, 100, 100);
+
+	area = 0;
+
+	for (i = 0; i < wnd.ninvalid; i++)
+		area += wnd.cinvalid[i].w * wnd.cinvalid[i].h;
+
+	CU_ASSERT(area == 100 * 100 * 2 - 50 * 50);
+
+	for (i = 1; i < wnd.ninvalid; i++)
+		CU_ASSERT(wnd.cinvalid[i - 1].y <= wnd.cinvalid[i].y);
+
+	/* a contained rectangle changes nothing */
+	i = wnd.ninvalid;
+	gdi_UnionWndRgn(&wnd, 10, 10, 20, 20);
+	CU_ASSERT(wnd.ninvalid == i);
+
+	/* adjacent rectangles are coalesced */
+	wnd.ninvalid = 0;
+	gdi_UnionWndRgn(&wnd, 0, 0, 64, 64);
+	gdi_UnionWndRgn(&wnd, 64, 0, 64, 64);
+	gdi_UnionWndRgn(&wnd, 0, 64, 128, 64);
+	CU_ASSERT(wnd.ninvalid == 1);
+	rgn = &wnd.cinvalid[0];
+	CU_ASSERT(rgn->x == 0 && rgn->y == 0 && rgn->w == 128 && rgn->h == 128);
+
+	/* subtracting from the middle leaves four bands */
+	gdi_SubtractWndRgn(&wnd, 32, 32, 64, 64);
+	CU_ASSERT(wnd.ninvalid == 4);
+
+	area = 0;
+
+	for (i = 0; i < wnd.ninvalid; i++)
+		area += wnd.cinvalid[i].w * wnd.cinvalid[i].h;
+
+	CU_ASSERT(area == 128 * 128 - 64 * 64);
+
+	/* intersecting clips every rectangle */
+	gdi_IntersectWndRgn(&wnd, 0, 0, 128, 32);
+	CU_ASSERT(wnd.ninvalid == 1);
+	rgn = &wnd.cinvalid[0];
+	CU_ASSERT(rgn->x == 0 && rgn->y == 0 && rgn->w == 128 && rgn->h == 32);
+
+	/* the rectangle count is capped by merging the closest rectangles */
+	wnd.ninvalid = 0;
+
+	for (i = 0; i < 8; i++)
+		gdi_UnionWndRgn(&wnd, i * 20, (i % 2) * 20, 10, 10);
+
+	CU_ASSERT(wnd.ninvalid <= wnd.maxinvalid);
+
+	for (i = 0; i < 8; i++)
+	{
+		gdi_IntersectWndRgn(&wnd, 0, 0, 1024, 768);
+		CU_ASSERT(wnd.ninvalid <= wnd.maxinvalid);
+	}
+
+	free(wnd.cinvalid);
+}
+
+void test_gdi_GlyphRun(void)
+{
+	int x, y;
+	HGDI_DC hdc;
+	HGDI_BITMAP bmp;
+	HGDI_RGN invalid;
+	GDI_COLOR color;
+	GDI_COLOR pixel;
+	GDI_GLYPH_MASK masks[2];
+	uint8 data[4 * 4];
+	int badPixels = 0;
+
+	hdc = gdi_GetDC();
+	hdc->bytesPerPixel = 4;
+	hdc->bitsPerPixel = 32;
+	bmp = gdi_CreateCompatibleBitmap(hdc, 16, 16);
+	memset(bmp->data, 0, 16 * 16 * 4);
+	gdi_SelectObject(hdc, (HGDIOBJECT) bmp);
+	gdi_SetClipRgn(hdc, 0, 0, 8, 16);
+
+	hdc->hwnd = (HGDI_WND) malloc(sizeof(GDI_WND));
+	hdc->hwnd->invalid = gdi_CreateRectRgn(0, 0, 0, 0);
+	hdc->hwnd->invalid->null = 1;
+	invalid = hdc->hwnd->invalid;
+
+	hdc->hwnd->count = 16;
+	hdc->hwnd->cinvalid = (HGDI_RGN) malloc(sizeof(GDI_RGN) * hdc->hwnd->count);
+	hdc->hwnd->ninvalid = 0;
+	hdc->hwnd->maxinvalid = GDI_MAX_INVALID_RECTS;
+
+	/* a 4x4 glyph with its diagonal set */
+	memset(data, 0, sizeof(data));
+
+	for (x = 0; x < 4; x++)
+		data[x * 4 + x] = 0xFF;
+
+	/* the second glyph is partly clipped out */
+	masks[0].x = 1;
+	masks[0].y = 2;
+	masks[1].x = 6;
+	masks[1].y = 2;
+
+	for (x = 0; x < 2; x++)
+	{
+		masks[x].width = 4;
+		masks[x].height = 4;
+		masks[x].data = data;
+	}
+
+	color = (GDI_COLOR) ARGB32(0xFF, 0xAA, 0xBB, 0xCC);
+	gdi_GlyphRun(hdc, masks, 2, color);
+
+	for (y = 0; y < 16; y++)
+	{
+		for (x = 0; x < 16; x++)
+		{
+			boolean set;
+
+			set = ((x >= 1 && x < 5 && x - 1 == y - 2) ||
+				(x >= 6 && x < 8 && x - 6 == y - 2)) ? true : false;
+
+			pixel = gdi_get_color_32bpp(hdc, gdi_GetPixel(hdc, x, y));
+
+			if ((pixel == color) != set)
+				badPixels++;
+		}
+	}
+
+	CU_ASSERT(badPixels == 0);
+
+	/* the area drawn to is invalidated once, within the clipping region */
+	CU_ASSERT(invalid->null == 0);
+	CU_ASSERT(invalid->x == 1 && invalid->y == 2);
+	CU_ASSERT(invalid->w == 7 && invalid->h == 4);
+
+	/* nothing is drawn outside of the clipping region */
+	masks[0].x = 10;
+	CU_ASSERT(gdi_GlyphRun(hdc, masks, 1, color) == 0);
+}
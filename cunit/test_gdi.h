@@ -45,3 +45,5 @@ void test_gdi_BitBlt_16bpp(void);
 void test_gdi_BitBlt_8bpp(void);
 void test_gdi_ClipCoords(void);
 void test_gdi_InvalidateRegion(void);
+void test_gdi_UnionWndRgn(void);
+void test_gdi_GlyphRun(void);
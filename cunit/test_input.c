@@ -0,0 +1,271 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Input Unit Tests
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <freerdp/freerdp.h>
+#include <freerdp/utils/memory.h>
+#include <freerdp/utils/stream.h>
+
+#include "test_input.h"
+#include "libfreerdp-core/input.h"
+#include "libfreerdp-core/fastpath.h"
+#include "server/X11/xf_batch.h"
+
+int init_input_suite(void)
+{
+	return 0;
+}
+
+int clean_input_suite(void)
+{
+	return 0;
+}
+
+int add_input_suite(void)
+{
+	add_test_suite(input);
+
+	add_test_function(input_fastpath_batching);
+	add_test_function(input_recv_bracketing);
+	add_test_function(input_server_batch);
+
+	return 0;
+}
+
+/* the events a server receives, in order */
+
+#define TEST_INPUT_BEGIN	1
+#define TEST_INPUT_END		2
+#define TEST_INPUT_KEYBOARD	3
+#define TEST_INPUT_MOUSE	4
+
+struct test_input_event
+{
+	int type;
+	uint16 flags;
+	uint16 x;
+	uint16 y;
+};
+typedef struct test_input_event testInputEvent;
+
+static testInputEvent test_events[32];
+static int test_num_events;
+
+static void test_input_record(int type, uint16 flags, uint16 x, uint16 y)
+{
+	if (test_num_events >= (int) (sizeof(test_events) / sizeof(test_events[0])))
+		return;
+
+	test_events[test_num_events].type = type;
+	test_events[test_num_events].flags = flags;
+	test_events[test_num_events].x = x;
+	test_events[test_num_events].y = y;
+	test_num_events++;
+}
+
+static void test_input_begin(rdpInput* input)
+{
+	test_input_record(TEST_INPUT_BEGIN, 0, 0, 0);
+}
+
+static void test_input_end(rdpInput* input)
+{
+	test_input_record(TEST_INPUT_END, 0, 0, 0);
+}
+
+static void test_input_keyboard_event(rdpInput* input, uint16 flags, uint16 code)
+{
+	test_input_record(TEST_INPUT_KEYBOARD, flags, code, 0);
+}
+
+static void test_input_mouse_event(rdpInput* input, uint16 flags, uint16 x, uint16 y)
+{
+	test_input_record(TEST_INPUT_MOUSE, flags, x, y);
+}
+
+static boolean test_input_event_is(int index, int type, uint16 flags, uint16 x, uint16 y)
+{
+	if (index >= test_num_events)
+		return false;
+
+	return (test_events[index].type == type && test_events[index].flags == flags &&
+			test_events[index].x == x && test_events[index].y == y) ? true : false;
+}
+
+static rdpRdp* test_server_new(void)
+{
+	rdpRdp* rdp;
+
+	rdp = xnew(rdpRdp);
+	rdp->input = input_new(rdp);
+	rdp->input->BeginInput = test_input_begin;
+	rdp->input->EndInput = test_input_end;
+	rdp->input->KeyboardEvent = test_input_keyboard_event;
+	rdp->input->MouseEvent = test_input_mouse_event;
+	rdp->fastpath = fastpath_new(rdp);
+
+	test_num_events = 0;
+
+	return rdp;
+}
+
+static void test_server_free(rdpRdp* rdp)
+{
+	fastpath_free(rdp->fastpath);
+	input_free(rdp->input);
+	xfree(rdp);
+}
+
+void test_input_fastpath_batching(void)
+{
+	STREAM* s;
+	int length;
+	rdpRdp* client;
+	rdpRdp* server;
+	rdpInput* input;
+	rdpContext* context;
+
+	client = xnew(rdpRdp);
+	client->settings = settings_new(NULL);
+	client->settings->input_batching = true;
+	client->fastpath = fastpath_new(client);
+
+	context = xnew(rdpContext);
+	context->rdp = client;
+	input = input_new(client);
+	input->context = context;
+
+	/* consecutive moves collapse into the last one */
+	input_send_fastpath_mouse_event(input, PTR_FLAGS_MOVE, 10, 10);
+	input_send_fastpath_mouse_event(input, PTR_FLAGS_MOVE, 20, 20);
+	input_send_fastpath_mouse_event(input, PTR_FLAGS_MOVE, 30, 30);
+	CU_ASSERT(client->fastpath->numberInputEvents == 1);
+
+	/* a button event is queued on its own, and is never merged into */
+	input_send_fastpath_mouse_event(input, PTR_FLAGS_BUTTON1 | PTR_FLAGS_DOWN, 30, 30);
+	input_send_fastpath_mouse_event(input, PTR_FLAGS_MOVE, 40, 40);
+	input_send_fastpath_mouse_event(input, PTR_FLAGS_MOVE, 50, 50);
+	CU_ASSERT(client->fastpath->numberInputEvents == 3);
+
+	/* neither is a keyboard event */
+	input_send_fastpath_keyboard_event(input, KBD_FLAGS_DOWN, 0x1E);
+	input_send_fastpath_mouse_event(input, PTR_FLAGS_MOVE, 60, 60);
+	CU_ASSERT(client->fastpath->numberInputEvents == 5);
+
+	/* the server gets the queued events as one PDU, bracketed as a batch */
+	length = stream_get_pos(client->fastpath->inputEvents);
+	s = stream_new(length);
+	stream_write(s, stream_get_head(client->fastpath->inputEvents), length);
+	stream_set_pos(s, 0);
+
+	server = test_server_new();
+	server->fastpath->numberEvents = client->fastpath->numberInputEvents;
+
+	CU_ASSERT(fastpath_recv_inputs(server->fastpath, s) == true);
+	CU_ASSERT(test_num_events == 7);
+	CU_ASSERT(test_input_event_is(0, TEST_INPUT_BEGIN, 0, 0, 0));
+	CU_ASSERT(test_input_event_is(1, TEST_INPUT_MOUSE, PTR_FLAGS_MOVE, 30, 30));
+	CU_ASSERT(test_input_event_is(2, TEST_INPUT_MOUSE, PTR_FLAGS_BUTTON1 | PTR_FLAGS_DOWN, 30, 30));
+	CU_ASSERT(test_input_event_is(3, TEST_INPUT_MOUSE, PTR_FLAGS_MOVE, 50, 50));
+	CU_ASSERT(test_input_event_is(4, TEST_INPUT_KEYBOARD, KBD_FLAGS_DOWN, 0x1E, 0));
+	CU_ASSERT(test_input_event_is(5, TEST_INPUT_MOUSE, PTR_FLAGS_MOVE, 60, 60));
+	CU_ASSERT(test_input_event_is(6, TEST_INPUT_END, 0, 0, 0));
+
+	stream_free(s);
+	test_server_free(server);
+
+	input_free(input);
+	xfree(context);
+	fastpath_free(client->fastpath);
+	settings_free(client->settings);
+	xfree(client);
+}
+
+/* a slow-path input PDU with a mouse move and a button press */
+
+static uint8 test_input_pdu[] =
+	"\x02\x00\x00\x00"
+	"\x00\x00\x00\x00\x01\x80\x00\x08\x10\x00\x20\x00"
+	"\x00\x00\x00\x00\x01\x80\x00\x90\x10\x00\x20\x00";
+
+void test_input_recv_bracketing(void)
+{
+	STREAM* s;
+	rdpRdp* server;
+
+	server = test_server_new();
+
+	s = stream_new(0);
+	stream_attach(s, test_input_pdu, sizeof(test_input_pdu) - 1);
+
+	CU_ASSERT(input_recv(server->input, s) == true);
+	CU_ASSERT(test_num_events == 4);
+	CU_ASSERT(test_input_event_is(0, TEST_INPUT_BEGIN, 0, 0, 0));
+	CU_ASSERT(test_input_event_is(1, TEST_INPUT_MOUSE, PTR_FLAGS_MOVE, 16, 32));
+	CU_ASSERT(test_input_event_is(2, TEST_INPUT_MOUSE, PTR_FLAGS_BUTTON1 | PTR_FLAGS_DOWN, 16, 32));
+	CU_ASSERT(test_input_event_is(3, TEST_INPUT_END, 0, 0, 0));
+
+	/* a batch cut short by a truncated event is still ended */
+	test_num_events = 0;
+	stream_attach(s, test_input_pdu, sizeof(test_input_pdu) - 1);
+	s->data[0] = 3;
+
+	CU_ASSERT(input_recv(server->input, s) == false);
+	CU_ASSERT(test_num_events == 4);
+	CU_ASSERT(test_input_event_is(0, TEST_INPUT_BEGIN, 0, 0, 0));
+	CU_ASSERT(test_input_event_is(3, TEST_INPUT_END, 0, 0, 0));
+
+	s->data[0] = 2;
+
+	stream_detach(s);
+	stream_free(s);
+	test_server_free(server);
+}
+
+void test_input_server_batch(void)
+{
+	int x, y;
+	xfInputBatch batch;
+
+	memset(&batch, 0, sizeof(xfInputBatch));
+
+	/* outside of a batch, motions are injected right away */
+	CU_ASSERT(xf_batch_motion(&batch, 1, 1) == false);
+	CU_ASSERT(xf_batch_take_motion(&batch, &x, &y) == false);
+
+	/* within a batch, only the last of consecutive motions is injected */
+	xf_batch_begin(&batch);
+	CU_ASSERT(xf_batch_motion(&batch, 10, 10) == true);
+	CU_ASSERT(xf_batch_motion(&batch, 20, 20) == true);
+	CU_ASSERT(xf_batch_motion(&batch, 30, 40) == true);
+
+	/* before a button or key event, which takes the motion held back */
+	CU_ASSERT(xf_batch_take_motion(&batch, &x, &y) == true);
+	CU_ASSERT(x == 30 && y == 40);
+	CU_ASSERT(xf_batch_take_motion(&batch, &x, &y) == false);
+
+	/* a motion following it is held back again, until the end of the batch */
+	CU_ASSERT(xf_batch_motion(&batch, 50, 60) == true);
+	CU_ASSERT(xf_batch_take_motion(&batch, &x, &y) == true);
+	CU_ASSERT(x == 50 && y == 60);
+	xf_batch_end(&batch);
+
+	CU_ASSERT(batch.active == false);
+	CU_ASSERT(xf_batch_motion(&batch, 70, 80) == false);
+}
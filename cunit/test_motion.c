@@ -0,0 +1,200 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Motion Detection Unit Tests
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <freerdp/freerdp.h>
+#include <freerdp/utils/memory.h>
+
+#include "test_motion.h"
+#include "server/X11/xf_motion.h"
+
+#define TEST_WIDTH	256
+#define TEST_HEIGHT	256
+#define TEST_SCANLINE	(TEST_WIDTH * 4)
+
+int init_motion_suite(void)
+{
+	return 0;
+}
+
+int clean_motion_suite(void)
+{
+	return 0;
+}
+
+int add_motion_suite(void)
+{
+	add_test_suite(motion);
+
+	add_test_function(motion_detect_scroll);
+	add_test_function(motion_detect_none);
+
+	return 0;
+}
+
+/* a pixel which differs from row to row and from column to column */
+
+static uint32 test_pixel(int x, int y)
+{
+	return ((uint32) x * 2654435761U) ^ ((uint32) y * 40503U) ^ 0x5A5A5A5A;
+}
+
+static void test_fill_screen(uint8* data)
+{
+	int x, y;
+
+	for (y = 0; y < TEST_HEIGHT; y++)
+	{
+		for (x = 0; x < TEST_WIDTH; x++)
+			((uint32*) data)[y * TEST_WIDTH + x] = test_pixel(x, y);
+	}
+}
+
+static xfMotion* test_motion_new(uint8* screen)
+{
+	xfMotion* motion;
+	RFX_RECT rect;
+
+	motion = xf_motion_new(TEST_WIDTH, TEST_HEIGHT);
+
+	rect.x = 0;
+	rect.y = 0;
+	rect.width = TEST_WIDTH;
+	rect.height = TEST_HEIGHT;
+
+	xf_motion_update(motion, screen, TEST_SCANLINE, 0, &rect, 1);
+
+	return motion;
+}
+
+void test_motion_detect_scroll(void)
+{
+	int x, y;
+	int dy;
+	int top;
+	uint8* screen;
+	uint8* frame;
+	xfMotion* motion;
+	RFX_RECT bounds;
+	RFX_RECT dest;
+
+	screen = (uint8*) xmalloc(TEST_SCANLINE * TEST_HEIGHT);
+	test_fill_screen(screen);
+	motion = test_motion_new(screen);
+
+	/**
+	 * The frame holds the rows from top on. Right of a static side bar, the
+	 * content scrolls up by 16 rows and new rows are exposed at the bottom.
+	 */
+
+	top = 32;
+	frame = (uint8*) xmalloc(TEST_SCANLINE * (TEST_HEIGHT - top));
+
+	for (y = top; y < TEST_HEIGHT; y++)
+	{
+		for (x = 0; x < TEST_WIDTH; x++)
+		{
+			if (x < 32)
+				((uint32*) frame)[(y - top) * TEST_WIDTH + x] = test_pixel(x, y);
+			else if (y < TEST_HEIGHT - 16)
+				((uint32*) frame)[(y - top) * TEST_WIDTH + x] = test_pixel(x, y + 16);
+			else
+				((uint32*) frame)[(y - top) * TEST_WIDTH + x] = test_pixel(x + 1000, y);
+		}
+	}
+
+	bounds.x = 0;
+	bounds.y = top;
+	bounds.width = TEST_WIDTH;
+	bounds.height = TEST_HEIGHT - top;
+
+	CU_ASSERT(xf_motion_detect(motion, frame, TEST_SCANLINE, top, &bounds, &dest, &dy) == true);
+	CU_ASSERT(dy == -16);
+
+	/* the blit covers the scrolled area only, from 16 rows below */
+	CU_ASSERT(dest.x == 32);
+	CU_ASSERT(dest.y == top);
+	CU_ASSERT(dest.width == TEST_WIDTH - 32);
+	CU_ASSERT(dest.height == TEST_HEIGHT - 16 - top);
+	CU_ASSERT(dest.y - dy == top + 16);
+
+	/* the area is the reference shifted indeed */
+	for (y = dest.y; y < dest.y + dest.height; y++)
+	{
+		if (memcmp(&frame[(y - top) * TEST_SCANLINE + dest.x * 4],
+				&screen[(y - dy) * TEST_SCANLINE + dest.x * 4], dest.width * 4) != 0)
+		{
+			CU_FAIL("scrolled area does not match the reference");
+			break;
+		}
+	}
+
+	xfree(frame);
+	xfree(screen);
+	xf_motion_free(motion);
+}
+
+void test_motion_detect_none(void)
+{
+	int x, y;
+	int dy;
+	uint8* screen;
+	uint8* frame;
+	xfMotion* motion;
+	RFX_RECT bounds;
+	RFX_RECT dest;
+
+	screen = (uint8*) xmalloc(TEST_SCANLINE * TEST_HEIGHT);
+	test_fill_screen(screen);
+	motion = test_motion_new(screen);
+
+	frame = (uint8*) xmalloc(TEST_SCANLINE * TEST_HEIGHT);
+
+	for (y = 0; y < TEST_HEIGHT; y++)
+	{
+		for (x = 0; x < TEST_WIDTH; x++)
+			((uint32*) frame)[y * TEST_WIDTH + x] = test_pixel(x + 1000, y);
+	}
+
+	bounds.x = 0;
+	bounds.y = 0;
+	bounds.width = TEST_WIDTH;
+	bounds.height = TEST_HEIGHT;
+
+	/* new content is not a shift of the reference */
+	CU_ASSERT(xf_motion_detect(motion, frame, TEST_SCANLINE, 0, &bounds, &dest, &dy) == false);
+
+	/* an unchanged frame is not a shift either */
+	CU_ASSERT(xf_motion_detect(motion, screen, TEST_SCANLINE, 0, &bounds, &dest, &dy) == false);
+
+	/* nor is anything below the minimum size worth a blit */
+	test_fill_screen(frame);
+	memmove(frame, frame + 16 * TEST_SCANLINE, (TEST_HEIGHT - 16) * TEST_SCANLINE);
+
+	bounds.height = XF_MOTION_MIN_ROWS - 1;
+	CU_ASSERT(xf_motion_detect(motion, frame, TEST_SCANLINE, 0, &bounds, &dest, &dy) == false);
+
+	bounds.height = TEST_HEIGHT;
+	CU_ASSERT(xf_motion_detect(motion, frame, TEST_SCANLINE, 0, &bounds, &dest, &dy) == true);
+	CU_ASSERT(dy == -16);
+
+	xfree(frame);
+	xfree(screen);
+	xf_motion_free(motion);
+}
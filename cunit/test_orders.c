@@ -17,7 +17,11 @@
  * limitations under the License.
  */
 
+#include <sys/select.h>
+
 #include <freerdp/freerdp.h>
+#include <freerdp/message.h>
+#include <freerdp/utils/memory.h>
 #include <freerdp/utils/hexdump.h>
 #include <freerdp/utils/stream.h>
 
@@ -65,6 +69,16 @@ int add_orders_suite(void)
 	add_test_function(read_switch_surface_order);
 
 	add_test_function(update_recv_orders);
+	add_test_function(update_recv_orders_queued);
+	add_test_function(update_recv_orders_requeued);
+	add_test_function(update_recv_frames_queued);
+
+	add_test_function(write_scrblt_order);
+	add_test_function(write_multi_opaque_rect_order);
+	add_test_function(write_glyph_index_order);
+	add_test_function(write_primary_orders);
+	add_test_function(write_cache_bitmap_v2_order);
+	add_test_function(write_cache_bitmap_v3_order);
 
 	return 0;
 }
@@ -770,3 +784,582 @@ void test_update_recv_orders(void)
 	free(update->context);
 }
 
+void test_update_recv_orders_queued(void)
+{
+	rdpRdp* rdp;
+	STREAM _s, *s;
+	freerdp instance;
+	rdpUpdate* update;
+	rdpMessageQueue* queue;
+
+	s = &_s;
+	rdp = rdp_new(NULL);
+	update = update_new(rdp);
+
+	update->context = malloc(sizeof(rdpContext));
+	update->context->rdp = rdp;
+	update->context->instance = &instance;
+	instance.update = update;
+
+	opaque_rect_count = 0;
+	polyline_count = 0;
+
+	update->primary->OpaqueRect = test_opaque_rect;
+	update->primary->Polyline = test_polyline;
+
+	queue = freerdp_message_queue_new(update, 0);
+
+	s->p = s->data = orders_update_1;
+	s->size = sizeof(orders_update_1);
+
+	update_recv(update, s);
+
+	CU_ASSERT(opaque_rect_count == 0);
+	CU_ASSERT(polyline_count == 0);
+
+	freerdp_message_queue_check_fds(queue);
+
+	CU_ASSERT(opaque_rect_count == 5);
+	CU_ASSERT(polyline_count == 2);
+
+	freerdp_message_queue_free(queue);
+
+	CU_ASSERT(update->primary->OpaqueRect == test_opaque_rect);
+	CU_ASSERT(update->primary->Polyline == test_polyline);
+
+	free(update->context);
+}
+
+int requeue_count;
+rdpUpdate* requeue_update;
+
+void test_opaque_rect_requeue(rdpContext* context, OPAQUE_RECT_ORDER* opaque_rect)
+{
+	opaque_rect_count++;
+
+	/* goes through the queue again, like an update received meanwhile */
+	if (requeue_count-- > 0)
+		requeue_update->primary->OpaqueRect(context, opaque_rect);
+}
+
+static boolean test_queue_is_set(rdpMessageQueue* queue)
+{
+	int rcount = 0;
+	void* rfds[4];
+	fd_set rfds_set;
+	struct timeval tv;
+
+	freerdp_message_queue_get_fds(queue, rfds, &rcount);
+
+	FD_ZERO(&rfds_set);
+	FD_SET((int) (long) rfds[0], &rfds_set);
+	tv.tv_sec = 0;
+	tv.tv_usec = 0;
+
+	return (select((int) (long) rfds[0] + 1, &rfds_set, NULL, NULL, &tv) > 0) ? true : false;
+}
+
+void test_update_recv_orders_requeued(void)
+{
+	rdpRdp* rdp;
+	freerdp instance;
+	rdpUpdate* update;
+	rdpMessageQueue* queue;
+	OPAQUE_RECT_ORDER opaque_rect;
+
+	rdp = rdp_new(NULL);
+	update = update_new(rdp);
+
+	update->context = malloc(sizeof(rdpContext));
+	update->context->rdp = rdp;
+	update->context->instance = &instance;
+	instance.update = update;
+
+	opaque_rect_count = 0;
+	requeue_count = 2;
+	requeue_update = update;
+
+	update->primary->OpaqueRect = test_opaque_rect_requeue;
+
+	queue = freerdp_message_queue_new(update, 0);
+	memset(&opaque_rect, 0, sizeof(OPAQUE_RECT_ORDER));
+
+	update->primary->OpaqueRect(update->context, &opaque_rect);
+	CU_ASSERT(test_queue_is_set(queue) == true);
+
+	/* only the messages pending on entry are executed */
+	freerdp_message_queue_check_fds(queue);
+	CU_ASSERT(opaque_rect_count == 1);
+	CU_ASSERT(test_queue_is_set(queue) == true);
+
+	freerdp_message_queue_check_fds(queue);
+	CU_ASSERT(opaque_rect_count == 2);
+
+	freerdp_message_queue_check_fds(queue);
+	CU_ASSERT(opaque_rect_count == 3);
+	CU_ASSERT(test_queue_is_set(queue) == false);
+
+	freerdp_message_queue_free(queue);
+
+	free(update->context);
+}
+
+rdpMessageQueue* frame_queue;
+int frame_pending[4];
+int frame_marker_count;
+
+void test_surface_frame_marker(rdpContext* context, SURFACE_FRAME_MARKER* surface_frame_marker)
+{
+	frame_pending[frame_marker_count++] = freerdp_message_queue_pending_frames(frame_queue);
+}
+
+void test_update_recv_frames_queued(void)
+{
+	int i;
+	rdpRdp* rdp;
+	freerdp instance;
+	rdpUpdate* update;
+	SURFACE_FRAME_MARKER marker;
+
+	rdp = rdp_new(NULL);
+	update = update_new(rdp);
+
+	update->context = malloc(sizeof(rdpContext));
+	update->context->rdp = rdp;
+	update->context->instance = &instance;
+	instance.update = update;
+
+	frame_marker_count = 0;
+	update->SurfaceFrameMarker = test_surface_frame_marker;
+
+	frame_queue = freerdp_message_queue_new(update, 0);
+
+	for (i = 0; i < 4; i++)
+	{
+		marker.frameAction = (i % 2) ? SURFACECMD_FRAMEACTION_END : SURFACECMD_FRAMEACTION_BEGIN;
+		marker.frameId = i / 2;
+		update->SurfaceFrameMarker(update->context, &marker);
+	}
+
+	CU_ASSERT(freerdp_message_queue_pending_frames(frame_queue) == 2);
+
+	freerdp_message_queue_check_fds(frame_queue);
+
+	CU_ASSERT(frame_marker_count == 4);
+	CU_ASSERT(frame_pending[0] == 2);
+	CU_ASSERT(frame_pending[1] == 1);
+	CU_ASSERT(frame_pending[2] == 1);
+	CU_ASSERT(frame_pending[3] == 0);
+	CU_ASSERT(freerdp_message_queue_pending_frames(frame_queue) == 0);
+
+	freerdp_message_queue_free(frame_queue);
+
+	free(update->context);
+}
+
+
+void test_write_scrblt_order(void)
+{
+	STREAM* s;
+	SCRBLT_ORDER scrblt;
+	SCRBLT_ORDER previous;
+	SCRBLT_ORDER received;
+
+	s = stream_new(64);
+
+	memset(&previous, 0, sizeof(SCRBLT_ORDER));
+	memset(&received, 0, sizeof(SCRBLT_ORDER));
+
+	scrblt.nLeftRect = 7;
+	scrblt.nTopRect = 410;
+	scrblt.nWidth = 731;
+	scrblt.nHeight = 10;
+	scrblt.bRop = 0xCC;
+	scrblt.nXSrc = 7;
+	scrblt.nYSrc = 430;
+
+	orderInfo->fieldFlags = 0x7F;
+	orderInfo->deltaCoordinates = false;
+
+	update_write_scrblt_order(s, orderInfo, &scrblt, &previous);
+	CU_ASSERT(stream_get_pos(s) == 13);
+
+	stream_set_pos(s, 0);
+	update_read_scrblt_order(s, orderInfo, &received);
+	CU_ASSERT(memcmp(&scrblt, &received, sizeof(SCRBLT_ORDER)) == 0);
+
+	/* only the moved coordinates, as one byte deltas */
+	previous = scrblt;
+	scrblt.nTopRect -= 20;
+	scrblt.nYSrc += 100;
+
+	orderInfo->fieldFlags = ORDER_FIELD_02 | ORDER_FIELD_07;
+	orderInfo->deltaCoordinates = true;
+
+	stream_set_pos(s, 0);
+	update_write_scrblt_order(s, orderInfo, &scrblt, &previous);
+	CU_ASSERT(stream_get_pos(s) == 2);
+
+	stream_set_pos(s, 0);
+	update_read_scrblt_order(s, orderInfo, &received);
+	CU_ASSERT(memcmp(&scrblt, &received, sizeof(SCRBLT_ORDER)) == 0);
+
+	stream_free(s);
+}
+
+void test_write_multi_opaque_rect_order(void)
+{
+	STREAM* s;
+	MULTI_OPAQUE_RECT_ORDER multi_opaque_rect;
+	MULTI_OPAQUE_RECT_ORDER previous;
+	MULTI_OPAQUE_RECT_ORDER received;
+
+	s = stream_new(512);
+
+	memset(&multi_opaque_rect, 0, sizeof(MULTI_OPAQUE_RECT_ORDER));
+	memset(&previous, 0, sizeof(MULTI_OPAQUE_RECT_ORDER));
+	memset(&received, 0, sizeof(MULTI_OPAQUE_RECT_ORDER));
+
+	multi_opaque_rect.nLeftRect = 0;
+	multi_opaque_rect.nTopRect = 0;
+	multi_opaque_rect.nWidth = 1024;
+	multi_opaque_rect.nHeight = 768;
+	multi_opaque_rect.color = 0x00FF8000;
+	multi_opaque_rect.numRectangles = 4;
+
+	multi_opaque_rect.rectangles[1].left = 10;
+	multi_opaque_rect.rectangles[1].top = 20;
+	multi_opaque_rect.rectangles[1].width = 300;
+	multi_opaque_rect.rectangles[1].height = 2;
+
+	multi_opaque_rect.rectangles[2].left = 10;
+	multi_opaque_rect.rectangles[2].top = 30;
+	multi_opaque_rect.rectangles[2].width = 300;
+	multi_opaque_rect.rectangles[2].height = 2;
+
+	multi_opaque_rect.rectangles[3].left = 5;
+	multi_opaque_rect.rectangles[3].top = 1000;
+	multi_opaque_rect.rectangles[3].width = 8;
+	multi_opaque_rect.rectangles[3].height = 8;
+
+	multi_opaque_rect.rectangles[4].left = 900;
+	multi_opaque_rect.rectangles[4].top = 12;
+	multi_opaque_rect.rectangles[4].width = 8;
+	multi_opaque_rect.rectangles[4].height = 700;
+
+	orderInfo->fieldFlags = 0x01FF;
+	orderInfo->deltaCoordinates = false;
+
+	update_write_multi_opaque_rect_order(s, orderInfo, &multi_opaque_rect, &previous);
+
+	stream_set_pos(s, 0);
+	update_read_multi_opaque_rect_order(s, orderInfo, &received);
+
+	CU_ASSERT(received.nWidth == 1024);
+	CU_ASSERT(received.nHeight == 768);
+	CU_ASSERT(received.color == 0x00FF8000);
+	CU_ASSERT(received.numRectangles == 4);
+	CU_ASSERT(received.cbData == multi_opaque_rect.cbData);
+	CU_ASSERT(memcmp(&received.rectangles[1], &multi_opaque_rect.rectangles[1], sizeof(DELTA_RECT) * 4) == 0);
+
+	stream_free(s);
+}
+
+void test_write_glyph_index_order(void)
+{
+	STREAM* s;
+	GLYPH_INDEX_ORDER glyph_index;
+	GLYPH_INDEX_ORDER previous;
+	GLYPH_INDEX_ORDER received;
+
+	s = stream_new(512);
+
+	memset(&glyph_index, 0, sizeof(GLYPH_INDEX_ORDER));
+	memset(&previous, 0, sizeof(GLYPH_INDEX_ORDER));
+	memset(&received, 0, sizeof(GLYPH_INDEX_ORDER));
+
+	glyph_index.cacheId = 7;
+	glyph_index.flAccel = 3;
+	glyph_index.fOpRedundant = 1;
+	glyph_index.backColor = 0x00FFFFFF;
+	glyph_index.foreColor = 0x00102030;
+	glyph_index.bkLeft = 100;
+	glyph_index.bkTop = 200;
+	glyph_index.bkRight = 180;
+	glyph_index.bkBottom = 213;
+	glyph_index.brush.style = 3;
+	glyph_index.brush.hatch = 0xAA;
+	glyph_index.brush.p8x8[1] = 0x55;
+	glyph_index.brush.p8x8[7] = 0x11;
+	glyph_index.x = 100;
+	glyph_index.y = 210;
+	glyph_index.cbData = 6;
+	memcpy(glyph_index.data, "\x01\x00\x02\x08\x03\x07", 6);
+
+	orderInfo->fieldFlags = 0x3FFFFF;
+	orderInfo->deltaCoordinates = false;
+
+	update_write_glyph_index_order(s, orderInfo, &glyph_index, &previous);
+
+	stream_set_pos(s, 0);
+	update_read_glyph_index_order(s, orderInfo, &received);
+
+	CU_ASSERT(received.cacheId == 7);
+	CU_ASSERT(received.flAccel == 3);
+	CU_ASSERT(received.fOpRedundant == 1);
+	CU_ASSERT(received.backColor == 0x00FFFFFF);
+	CU_ASSERT(received.foreColor == 0x00102030);
+	CU_ASSERT(received.bkRight == 180);
+	CU_ASSERT(received.bkBottom == 213);
+	CU_ASSERT(received.brush.style == 3);
+	CU_ASSERT(received.brush.hatch == 0xAA);
+	CU_ASSERT(received.brush.data[1] == 0x55);
+	CU_ASSERT(received.brush.data[7] == 0x11);
+	CU_ASSERT(received.x == 100);
+	CU_ASSERT(received.y == 210);
+	CU_ASSERT(received.cbData == 6);
+	CU_ASSERT(memcmp(received.data, glyph_index.data, 6) == 0);
+
+	stream_free(s);
+}
+
+void test_write_cache_bitmap_v2_order(void)
+{
+	STREAM* s;
+	uint16 flags;
+	uint8 data[16 * 16 * 2];
+	CACHE_BITMAP_V2_ORDER cache_bitmap_v2;
+	CACHE_BITMAP_V2_ORDER received;
+
+	s = stream_new(64);
+	memset(data, 0x5A, sizeof(data));
+
+	memset(&cache_bitmap_v2, 0, sizeof(CACHE_BITMAP_V2_ORDER));
+	memset(&received, 0, sizeof(CACHE_BITMAP_V2_ORDER));
+
+	cache_bitmap_v2.cacheId = 4;
+	cache_bitmap_v2.cacheIndex = 300;
+	cache_bitmap_v2.bitmapBpp = 16;
+	cache_bitmap_v2.bitmapWidth = 16;
+	cache_bitmap_v2.bitmapHeight = 16;
+	cache_bitmap_v2.bitmapLength = sizeof(data);
+	cache_bitmap_v2.bitmapDataStream = data;
+	cache_bitmap_v2.flags = CBR2_HEIGHT_SAME_AS_WIDTH | CBR2_PERSISTENT_KEY_PRESENT;
+	cache_bitmap_v2.key1 = 0x12345678;
+	cache_bitmap_v2.key2 = 0x9ABCDEF0;
+
+	update_write_cache_bitmap_v2_order(s, &cache_bitmap_v2, false, &flags);
+	CU_ASSERT(stream_get_pos(s) == 8 + 1 + 2 + 2 + sizeof(data));
+
+	stream_set_pos(s, 0);
+	update_read_cache_bitmap_v2_order(s, &received, false, flags);
+
+	CU_ASSERT(received.cacheId == 4);
+	CU_ASSERT(received.cacheIndex == 300);
+	CU_ASSERT(received.bitmapBpp == 16);
+	CU_ASSERT(received.bitmapWidth == 16);
+	CU_ASSERT(received.bitmapHeight == 16);
+	CU_ASSERT(received.bitmapLength == sizeof(data));
+	CU_ASSERT(received.key1 == 0x12345678);
+	CU_ASSERT(received.key2 == 0x9ABCDEF0);
+	CU_ASSERT(memcmp(received.bitmapDataStream, data, sizeof(data)) == 0);
+
+	stream_free(s);
+}
+
+void test_write_cache_bitmap_v3_order(void)
+{
+	STREAM* s;
+	uint16 flags;
+	uint8 data[24];
+	CACHE_BITMAP_V3_ORDER cache_bitmap_v3;
+	CACHE_BITMAP_V3_ORDER received;
+
+	s = stream_new(64);
+	memset(data, 0xA5, sizeof(data));
+
+	memset(&cache_bitmap_v3, 0, sizeof(CACHE_BITMAP_V3_ORDER));
+	memset(&received, 0, sizeof(CACHE_BITMAP_V3_ORDER));
+
+	cache_bitmap_v3.cacheId = 2;
+	cache_bitmap_v3.cacheIndex = 1000;
+	cache_bitmap_v3.bpp = 32;
+	cache_bitmap_v3.key1 = 0x01020304;
+	cache_bitmap_v3.key2 = 0x05060708;
+	cache_bitmap_v3.bitmapData.bpp = 32;
+	cache_bitmap_v3.bitmapData.codecID = 3;
+	cache_bitmap_v3.bitmapData.width = 64;
+	cache_bitmap_v3.bitmapData.height = 32;
+	cache_bitmap_v3.bitmapData.length = sizeof(data);
+	cache_bitmap_v3.bitmapData.data = data;
+
+	update_write_cache_bitmap_v3_order(s, &cache_bitmap_v3, false, &flags);
+
+	stream_set_pos(s, 0);
+	update_read_cache_bitmap_v3_order(s, &received, false, flags);
+
+	CU_ASSERT(received.cacheId == 2);
+	CU_ASSERT(received.cacheIndex == 1000);
+	CU_ASSERT(received.bpp == 32);
+	CU_ASSERT(received.key1 == 0x01020304);
+	CU_ASSERT(received.key2 == 0x05060708);
+	CU_ASSERT(received.bitmapData.bpp == 32);
+	CU_ASSERT(received.bitmapData.codecID == 3);
+	CU_ASSERT(received.bitmapData.width == 64);
+	CU_ASSERT(received.bitmapData.height == 32);
+	CU_ASSERT(received.bitmapData.length == sizeof(data));
+	CU_ASSERT(memcmp(received.bitmapData.data, data, sizeof(data)) == 0);
+
+	xfree(received.bitmapData.data);
+	stream_free(s);
+}
+
+OPAQUE_RECT_ORDER received_opaque_rect;
+LINE_TO_ORDER received_line_to;
+MEMBLT_ORDER received_memblt;
+rdpBounds received_bounds;
+int received_bounded;
+
+void test_write_opaque_rect(rdpContext* context, OPAQUE_RECT_ORDER* opaque_rect)
+{
+	received_opaque_rect = *opaque_rect;
+}
+
+void test_write_line_to(rdpContext* context, LINE_TO_ORDER* line_to)
+{
+	received_line_to = *line_to;
+}
+
+void test_write_memblt(rdpContext* context, MEMBLT_ORDER* memblt)
+{
+	received_memblt = *memblt;
+}
+
+void test_write_set_bounds(rdpContext* context, rdpBounds* bounds)
+{
+	if (bounds != NULL)
+	{
+		received_bounds = *bounds;
+		received_bounded = 1;
+	}
+}
+
+void test_write_primary_orders(void)
+{
+	rdpRdp* rdp;
+	STREAM* s;
+	rdpUpdate* update;
+	rdpPrimaryUpdate* sent;
+	rdpBounds bounds;
+	OPAQUE_RECT_ORDER opaque_rect;
+	LINE_TO_ORDER line_to;
+	MEMBLT_ORDER memblt;
+
+	s = stream_new(512);
+	rdp = rdp_new(NULL);
+	update = update_new(rdp);
+
+	update->context = malloc(sizeof(rdpContext));
+	update->context->rdp = rdp;
+
+	update->primary->OpaqueRect = test_write_opaque_rect;
+	update->primary->LineTo = test_write_line_to;
+	update->primary->MemBlt = test_write_memblt;
+	update->SetBounds = test_write_set_bounds;
+
+	sent = (rdpPrimaryUpdate*) malloc(sizeof(rdpPrimaryUpdate));
+	memset(sent, 0, sizeof(rdpPrimaryUpdate));
+	sent->order_info.orderType = ORDER_TYPE_PATBLT;
+	update->primary->order_info.orderType = ORDER_TYPE_PATBLT;
+
+	memset(&opaque_rect, 0, sizeof(OPAQUE_RECT_ORDER));
+	opaque_rect.nLeftRect = 500;
+	opaque_rect.nTopRect = 300;
+	opaque_rect.nWidth = 64;
+	opaque_rect.nHeight = 16;
+	opaque_rect.color = 0x00336699;
+
+	CU_ASSERT(update_write_primary_order(s, sent, ORDER_TYPE_OPAQUE_RECT, &opaque_rect, NULL) == true);
+
+	stream_set_pos(s, 0);
+	CU_ASSERT(update_recv_order(update, s) == true);
+	CU_ASSERT(memcmp(&received_opaque_rect, &opaque_rect, sizeof(OPAQUE_RECT_ORDER)) == 0);
+
+	/* order types which cannot be encoded are refused without output */
+	stream_set_pos(s, 0);
+	CU_ASSERT(update_write_primary_order(s, sent, ORDER_TYPE_POLYLINE, &opaque_rect, NULL) == false);
+	CU_ASSERT(stream_get_pos(s) == 0);
+	CU_ASSERT(sent->order_info.orderType == ORDER_TYPE_OPAQUE_RECT);
+
+	/* a small move only sends one byte deltas for the changed coordinates */
+	stream_set_pos(s, 0);
+	opaque_rect.nTopRect += 16;
+	update_write_primary_order(s, sent, ORDER_TYPE_OPAQUE_RECT, &opaque_rect, NULL);
+	CU_ASSERT(stream_get_pos(s) == 3);
+
+	stream_set_pos(s, 0);
+	CU_ASSERT(update_recv_order(update, s) == true);
+	CU_ASSERT(memcmp(&received_opaque_rect, &opaque_rect, sizeof(OPAQUE_RECT_ORDER)) == 0);
+
+	/* a change of order type */
+	memset(&line_to, 0, sizeof(LINE_TO_ORDER));
+	line_to.backMode = BACKMODE_TRANSPARENT;
+	line_to.nXStart = 10;
+	line_to.nYStart = 700;
+	line_to.nXEnd = 1000;
+	line_to.nYEnd = 700;
+	line_to.bRop2 = 13;
+	line_to.penWidth = 1;
+	line_to.penColor = 0x00FF0000;
+
+	stream_set_pos(s, 0);
+	update_write_primary_order(s, sent, ORDER_TYPE_LINE_TO, &line_to, NULL);
+
+	stream_set_pos(s, 0);
+	CU_ASSERT(update_recv_order(update, s) == true);
+	CU_ASSERT(memcmp(&received_line_to, &line_to, sizeof(LINE_TO_ORDER)) == 0);
+
+	/* bounds, then the same bounds again */
+	bounds.left = 100;
+	bounds.top = 100;
+	bounds.right = 899;
+	bounds.bottom = 699;
+
+	memset(&memblt, 0, sizeof(MEMBLT_ORDER));
+	memblt.cacheId = 1;
+	memblt.colorIndex = 0;
+	memblt.nLeftRect = 64;
+	memblt.nTopRect = 64;
+	memblt.nWidth = 64;
+	memblt.nHeight = 64;
+	memblt.bRop = 0xCC;
+	memblt.cacheIndex = 300;
+
+	stream_set_pos(s, 0);
+	update_write_primary_order(s, sent, ORDER_TYPE_MEMBLT, &memblt, &bounds);
+
+	received_bounded = 0;
+	stream_set_pos(s, 0);
+	CU_ASSERT(update_recv_order(update, s) == true);
+	CU_ASSERT(memcmp(&received_memblt, &memblt, sizeof(MEMBLT_ORDER)) == 0);
+	CU_ASSERT(received_bounded == 1);
+	CU_ASSERT(memcmp(&received_bounds, &bounds, sizeof(rdpBounds)) == 0);
+
+	memblt.nLeftRect += 64;
+	memblt.cacheIndex++;
+
+	stream_set_pos(s, 0);
+	update_write_primary_order(s, sent, ORDER_TYPE_MEMBLT, &memblt, &bounds);
+	CU_ASSERT((stream_get_head(s)[0] & ORDER_ZERO_BOUNDS_DELTAS) != 0);
+
+	received_bounded = 0;
+	stream_set_pos(s, 0);
+	CU_ASSERT(update_recv_order(update, s) == true);
+	CU_ASSERT(memcmp(&received_memblt, &memblt, sizeof(MEMBLT_ORDER)) == 0);
+	CU_ASSERT(received_bounded == 1);
+	CU_ASSERT(memcmp(&received_bounds, &bounds, sizeof(rdpBounds)) == 0);
+
+	free(sent);
+	free(update->context);
+	stream_free(s);
+}
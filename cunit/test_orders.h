@@ -45,4 +45,14 @@ void test_read_create_offscreen_bitmap_order(void);
 void test_read_switch_surface_order(void);
 
 void test_update_recv_orders(void);
+void test_update_recv_orders_queued(void);
+void test_update_recv_orders_requeued(void);
+void test_update_recv_frames_queued(void);
+
+void test_write_scrblt_order(void);
+void test_write_multi_opaque_rect_order(void);
+void test_write_glyph_index_order(void);
+void test_write_primary_orders(void);
+void test_write_cache_bitmap_v2_order(void);
+void test_write_cache_bitmap_v3_order(void);
 
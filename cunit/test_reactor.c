@@ -0,0 +1,218 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Reactor Unit Tests
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/select.h>
+#include <freerdp/freerdp.h>
+#include <freerdp/reactor.h>
+
+#include "test_reactor.h"
+
+int init_reactor_suite(void)
+{
+	return 0;
+}
+
+int clean_reactor_suite(void)
+{
+	return 0;
+}
+
+int add_reactor_suite(void)
+{
+	add_test_suite(reactor);
+
+	add_test_function(reactor_source);
+	add_test_function(reactor_fd_reuse);
+
+	return 0;
+}
+
+/**
+ * A source reading a pipe. Each dispatch is reported on a second pipe, for
+ * the test to wait on, and may replace the pipe by a new one given the
+ * number of the descriptor it closes.
+ */
+
+struct test_source
+{
+	int fds[2];
+	int notify[2];
+	int checks;
+	boolean fail;
+	boolean reopen;
+	boolean closed;
+};
+typedef struct test_source testSource;
+
+static boolean test_source_get_fds(void* data, void** rfds, int* rcount, void** wfds, int* wcount)
+{
+	testSource* source = (testSource*) data;
+
+	rfds[*rcount] = (void*)(long) source->fds[0];
+	(*rcount)++;
+
+	return true;
+}
+
+static boolean test_source_check_fds(void* data)
+{
+	int fds[2];
+	uint8 byte = 0;
+	testSource* source = (testSource*) data;
+
+	while (read(source->fds[0], &byte, 1) > 0);
+
+	source->checks++;
+
+	if (source->reopen && (pipe(fds) == 0))
+	{
+		/* the new pipe takes over the number of the old read end */
+		dup2(fds[0], source->fds[0]);
+		close(fds[0]);
+		close(source->fds[1]);
+
+		fcntl(source->fds[0], F_SETFL, O_NONBLOCK);
+		source->fds[1] = fds[1];
+		source->reopen = false;
+	}
+
+	if (write(source->notify[1], &byte, 1) != 1)
+		return false;
+
+	return (source->fail != true);
+}
+
+static void test_source_closed(void* data)
+{
+	testSource* source = (testSource*) data;
+
+	source->closed = true;
+}
+
+static void test_source_init(testSource* source)
+{
+	memset(source, 0, sizeof(testSource));
+
+	CU_ASSERT(pipe(source->fds) == 0);
+	CU_ASSERT(pipe(source->notify) == 0);
+
+	fcntl(source->fds[0], F_SETFL, O_NONBLOCK);
+}
+
+static void test_source_uninit(testSource* source)
+{
+	close(source->fds[0]);
+	close(source->fds[1]);
+	close(source->notify[0]);
+	close(source->notify[1]);
+}
+
+/* make the source readable and wait for it to be dispatched */
+
+static boolean test_source_signal(testSource* source)
+{
+	fd_set rfds;
+	uint8 byte = 0;
+	struct timeval timeout;
+
+	if (write(source->fds[1], &byte, 1) != 1)
+		return false;
+
+	FD_ZERO(&rfds);
+	FD_SET(source->notify[0], &rfds);
+	timeout.tv_sec = 2;
+	timeout.tv_usec = 0;
+
+	if (select(source->notify[0] + 1, &rfds, NULL, NULL, &timeout) != 1)
+		return false;
+
+	return (read(source->notify[0], &byte, 1) == 1);
+}
+
+void test_reactor_source(void)
+{
+	testSource source;
+	rdpReactor* reactor;
+
+	test_source_init(&source);
+
+	reactor = freerdp_reactor_new(1);
+	CU_ASSERT(reactor != NULL);
+
+	if (reactor == NULL)
+		return;
+
+	CU_ASSERT(freerdp_reactor_add_source(reactor, &source,
+			test_source_get_fds, test_source_check_fds, test_source_closed) == true);
+	CU_ASSERT(freerdp_reactor_start(reactor) == true);
+
+	/* the source is dispatched again once re-armed */
+	CU_ASSERT(test_source_signal(&source) == true);
+	CU_ASSERT(test_source_signal(&source) == true);
+	CU_ASSERT(source.checks == 2);
+	CU_ASSERT(source.closed == false);
+
+	/* a failing source is removed and closed */
+	source.fail = true;
+	CU_ASSERT(test_source_signal(&source) == true);
+	freerdp_reactor_stop(reactor);
+	CU_ASSERT(source.checks == 3);
+	CU_ASSERT(source.closed == true);
+
+	freerdp_reactor_free(reactor);
+	test_source_uninit(&source);
+}
+
+void test_reactor_fd_reuse(void)
+{
+	int fd;
+	testSource source;
+	rdpReactor* reactor;
+
+	test_source_init(&source);
+
+	reactor = freerdp_reactor_new(1);
+	CU_ASSERT(reactor != NULL);
+
+	if (reactor == NULL)
+		return;
+
+	CU_ASSERT(freerdp_reactor_add_source(reactor, &source,
+			test_source_get_fds, test_source_check_fds, test_source_closed) == true);
+	CU_ASSERT(freerdp_reactor_start(reactor) == true);
+
+	/* the first dispatch replaces the pipe, keeping the descriptor number */
+	fd = source.fds[0];
+	source.reopen = true;
+	CU_ASSERT(test_source_signal(&source) == true);
+	CU_ASSERT(source.fds[0] == fd);
+
+	/* the new pipe is watched although its number did not change */
+	CU_ASSERT(test_source_signal(&source) == true);
+	CU_ASSERT(test_source_signal(&source) == true);
+	CU_ASSERT(source.checks == 3);
+
+	freerdp_reactor_free(reactor);
+	CU_ASSERT(source.closed == true);
+
+	test_source_uninit(&source);
+}
@@ -182,6 +182,7 @@ int add_rfx_suite(void)
 	add_test_function(decode);
 	add_test_function(encode);
 	add_test_function(message);
+	add_test_function(message_region);
 
 	return 0;
 }
@@ -408,3 +409,37 @@ void test_message(void)
 	rfx_context_free(context);
 	free(rgb_data);
 }
+
+void test_message_region(void)
+{
+	RFX_CONTEXT* context;
+	STREAM* s;
+	uint8* data;
+	RFX_MESSAGE* message;
+	RFX_RECT rects[2] = { { 10, 10, 20, 20 }, { 200, 200, 50, 50 } };
+
+	data = (uint8*) xzalloc(256 * 256 * 3);
+
+	context = rfx_context_new();
+	context->mode = RLGR3;
+	context->width = 256;
+	context->height = 256;
+	rfx_context_set_pixel_format(context, RDP_PIXEL_FORMAT_R8G8B8);
+
+	s = stream_new(65536);
+	rfx_compose_message(context, s, rects, 2, data, 256, 256, 256 * 3);
+	stream_seal(s);
+	stream_set_pos(s, 0);
+
+	/* only the two tiles touched by the rectangles are encoded */
+	message = rfx_process_message(context, s->p, s->size);
+	CU_ASSERT(message->num_rects == 2);
+	CU_ASSERT(message->num_tiles == 2);
+	CU_ASSERT(message->tiles[0]->x == 0 && message->tiles[0]->y == 0);
+	CU_ASSERT(message->tiles[1]->x == 192 && message->tiles[1]->y == 192);
+
+	rfx_message_free(context, message);
+	stream_free(s);
+	rfx_context_free(context);
+	xfree(data);
+}
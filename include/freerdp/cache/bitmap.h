@@ -25,16 +25,43 @@
 #include <freerdp/update.h>
 #include <freerdp/freerdp.h>
 #include <freerdp/utils/stream.h>
+#include <freerdp/cache/budget.h>
+#include <freerdp/cache/persistent.h>
 
+typedef struct _BITMAP_V2_ENTRY BITMAP_V2_ENTRY;
 typedef struct _BITMAP_V2_CELL BITMAP_V2_CELL;
 typedef struct rdp_bitmap_cache rdpBitmapCache;
 
 #include <freerdp/cache/cache.h>
 
+/**
+ * With a memory budget, the data each bitmap was received with is kept
+ * along with it, and the decoded bitmaps are linked in least recently used
+ * order. Above the budget, the decoded form of the coldest bitmaps is freed,
+ * and decoded again from this data when the server uses them next.
+ */
+
+struct _BITMAP_V2_ENTRY
+{
+	uint32 id;
+	uint32 index;
+	uint32 size;
+	uint8* data;
+	uint32 length;
+	uint16 width;
+	uint16 height;
+	uint8 bpp;
+	boolean compressed;
+	uint32 codecId;
+	BITMAP_V2_ENTRY* prev;
+	BITMAP_V2_ENTRY* next;
+};
+
 struct _BITMAP_V2_CELL
 {
 	uint32 number;
 	rdpBitmap** entries;
+	BITMAP_V2_ENTRY* info;
 };
 
 struct rdp_bitmap_cache
@@ -54,6 +81,15 @@ struct rdp_bitmap_cache
 	/* internal */
 
 	rdpBitmap* bitmap;
+	rdpPersistentCache* persistent;
+
+	uint32 uses;
+	uint64 limit;
+	CACHE_STATS stats;
+	rdpCacheBudget* budget;
+	BITMAP_V2_ENTRY* lru_head;
+	BITMAP_V2_ENTRY* lru_tail;
+
 	rdpUpdate* update;
 	rdpContext* context;
 	rdpSettings* settings;
@@ -61,6 +97,9 @@ struct rdp_bitmap_cache
 
 FREERDP_API rdpBitmap* bitmap_cache_get(rdpBitmapCache* bitmap_cache, uint32 id, uint32 index);
 FREERDP_API void bitmap_cache_put(rdpBitmapCache* bitmap_cache, uint32 id, uint32 index, rdpBitmap* bitmap);
+FREERDP_API void bitmap_cache_release(rdpBitmapCache* bitmap_cache);
+FREERDP_API void bitmap_cache_reset(rdpBitmapCache* bitmap_cache);
+FREERDP_API void bitmap_cache_get_stats(rdpBitmapCache* bitmap_cache, CACHE_STATS* stats);
 
 FREERDP_API void bitmap_cache_register_callbacks(rdpUpdate* update);
 
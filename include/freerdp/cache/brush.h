@@ -53,11 +53,14 @@ struct rdp_brush_cache
 
 	/* internal */
 
+	uint32 uses;
 	rdpSettings* settings;
 };
 
 FREERDP_API void* brush_cache_get(rdpBrushCache* brush, uint32 index, uint32* bpp);
 FREERDP_API void brush_cache_put(rdpBrushCache* brush, uint32 index, void* entry, uint32 bpp);
+FREERDP_API void brush_cache_release(rdpBrushCache* brush);
+FREERDP_API void brush_cache_reset(rdpBrushCache* brush);
 
 FREERDP_API void brush_cache_register_callbacks(rdpUpdate* update);
 
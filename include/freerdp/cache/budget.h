@@ -0,0 +1,67 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Cache Memory Budget
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CACHE_BUDGET_H
+#define __CACHE_BUDGET_H
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+#include <freerdp/utils/mutex.h>
+
+/**
+ * A cache budget counts the bytes held by the bitmap caches of every session
+ * it is shared by. A process hosting many sessions creates one and sets it as
+ * the cache_budget of the settings of each of them before their caches are
+ * created: while the budget is exceeded, each session holding more than its
+ * share of it, the limit divided by the number of sessions, drops the decoded
+ * form of its least recently used bitmaps. The offscreen and glyph caches cannot
+ * drop entries the server still refers to, so they are not charged to it and
+ * are bounded by their own budgets instead.
+ */
+
+typedef struct _CACHE_STATS CACHE_STATS;
+typedef struct rdp_cache_budget rdpCacheBudget;
+
+struct _CACHE_STATS
+{
+	uint32 hits;
+	uint32 misses;
+	uint32 evictions;
+	uint32 entries;
+	uint64 bytes;
+	uint64 limit;
+};
+
+struct rdp_cache_budget
+{
+	uint64 limit;
+	uint64 used;
+	uint32 sessions;
+	freerdp_mutex mutex;
+};
+
+FREERDP_API void cache_budget_charge(rdpCacheBudget* budget, uint64 bytes);
+FREERDP_API void cache_budget_release(rdpCacheBudget* budget, uint64 bytes);
+FREERDP_API void cache_budget_join(rdpCacheBudget* budget);
+FREERDP_API void cache_budget_leave(rdpCacheBudget* budget);
+FREERDP_API boolean cache_budget_over_share(rdpCacheBudget* budget, uint64 bytes);
+FREERDP_API uint64 cache_budget_get_used(rdpCacheBudget* budget);
+
+FREERDP_API rdpCacheBudget* cache_budget_new(uint64 limit);
+FREERDP_API void cache_budget_free(rdpCacheBudget* budget);
+
+#endif /* __CACHE_BUDGET_H */
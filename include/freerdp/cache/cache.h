@@ -33,6 +33,16 @@
 #include <freerdp/cache/offscreen.h>
 #include <freerdp/cache/palette.h>
 
+#include <time.h>
+
+typedef struct _CACHE_IDLE CACHE_IDLE;
+
+struct _CACHE_IDLE
+{
+	uint32 uses;
+	time_t since;
+};
+
 struct rdp_cache
 {
 	rdpGlyphCache* glyph; /* 0 */
@@ -46,8 +56,20 @@ struct rdp_cache
 	/* internal */
 
 	rdpSettings* settings;
+
+	CACHE_IDLE glyph_idle;
+	CACHE_IDLE brush_idle;
+	CACHE_IDLE pointer_idle;
+	CACHE_IDLE bitmap_idle;
+	CACHE_IDLE offscreen_idle;
+	CACHE_IDLE palette_idle;
+	CACHE_IDLE nine_grid_idle;
 };
 
+FREERDP_API void cache_reset(rdpCache* cache);
+FREERDP_API void cache_check_idle(rdpCache* cache);
+FREERDP_API void cache_register_callbacks(rdpUpdate* update);
+
 FREERDP_API rdpCache* cache_new(rdpSettings* settings);
 FREERDP_API void cache_free(rdpCache* cache);
 
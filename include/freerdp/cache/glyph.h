@@ -24,6 +24,7 @@
 #include <freerdp/types.h>
 #include <freerdp/update.h>
 #include <freerdp/utils/stream.h>
+#include <freerdp/cache/budget.h>
 
 typedef struct _GLYPH_CACHE GLYPH_CACHE;
 typedef struct _FRAGMENT_CACHE_ENTRY FRAGMENT_CACHE_ENTRY;
@@ -55,16 +56,23 @@ struct rdp_glyph_cache
 	FRAGMENT_CACHE fragCache;
 	GLYPH_CACHE glyphCache[10];
 
+	uint32 uses;
+	CACHE_STATS stats;
+
 	rdpContext* context;
 	rdpSettings* settings;
 };
 
 FREERDP_API rdpGlyph* glyph_cache_get(rdpGlyphCache* glyph_cache, uint32 id, uint32 index);
 FREERDP_API void glyph_cache_put(rdpGlyphCache* glyph_cache, uint32 id, uint32 index, rdpGlyph* entry);
+FREERDP_API void glyph_cache_get_stats(rdpGlyphCache* glyph_cache, CACHE_STATS* stats);
 
 FREERDP_API void* glyph_cache_fragment_get(rdpGlyphCache* glyph, uint32 index, uint32* count);
 FREERDP_API void glyph_cache_fragment_put(rdpGlyphCache* glyph, uint32 index, uint32 count, void* entry);
 
+FREERDP_API void glyph_cache_release(rdpGlyphCache* glyph);
+FREERDP_API void glyph_cache_reset(rdpGlyphCache* glyph);
+
 FREERDP_API void glyph_cache_register_callbacks(rdpUpdate* update);
 
 FREERDP_API rdpGlyphCache* glyph_cache_new(rdpSettings* settings);
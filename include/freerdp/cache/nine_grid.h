@@ -49,11 +49,14 @@ struct rdp_nine_grid_cache
 
 	/* internal */
 
+	uint32 uses;
 	rdpSettings* settings;
 };
 
 FREERDP_API void* nine_grid_cache_get(rdpNineGridCache* nine_grid, uint32 index);
 FREERDP_API void nine_grid_cache_put(rdpNineGridCache* nine_grid, uint32 index, void* entry);
+FREERDP_API void nine_grid_cache_release(rdpNineGridCache* nine_grid);
+FREERDP_API void nine_grid_cache_reset(rdpNineGridCache* nine_grid);
 
 FREERDP_API void nine_grid_cache_register_callbacks(rdpUpdate* update);
 
@@ -25,6 +25,7 @@
 #include <freerdp/update.h>
 #include <freerdp/freerdp.h>
 #include <freerdp/utils/stream.h>
+#include <freerdp/cache/budget.h>
 
 typedef struct rdp_offscreen_cache rdpOffscreenCache;
 
@@ -39,6 +40,9 @@ struct rdp_offscreen_cache
 
 	/* internal */
 
+	uint32 uses;
+	CACHE_STATS stats;
+
 	rdpUpdate* update;
 	rdpSettings* settings;
 };
@@ -46,6 +50,9 @@ struct rdp_offscreen_cache
 FREERDP_API rdpBitmap* offscreen_cache_get(rdpOffscreenCache* offscreen_cache, uint32 index);
 FREERDP_API void offscreen_cache_put(rdpOffscreenCache* offscreen_cache, uint32 index, rdpBitmap* bitmap);
 FREERDP_API void offscreen_cache_delete(rdpOffscreenCache* offscreen, uint32 index);
+FREERDP_API void offscreen_cache_release(rdpOffscreenCache* offscreen);
+FREERDP_API void offscreen_cache_reset(rdpOffscreenCache* offscreen);
+FREERDP_API void offscreen_cache_get_stats(rdpOffscreenCache* offscreen_cache, CACHE_STATS* stats);
 
 FREERDP_API void offscreen_cache_register_callbacks(rdpUpdate* update);
 
@@ -43,11 +43,14 @@ struct rdp_palette_cache
 
 	/* internal */
 
+	uint32 uses;
 	rdpSettings* settings;
 };
 
 FREERDP_API void* palette_cache_get(rdpPaletteCache* palette, uint32 index);
 FREERDP_API void palette_cache_put(rdpPaletteCache* palette, uint32 index, void* entry);
+FREERDP_API void palette_cache_release(rdpPaletteCache* palette);
+FREERDP_API void palette_cache_reset(rdpPaletteCache* palette);
 
 FREERDP_API void palette_cache_register_callbacks(rdpUpdate* update);
 
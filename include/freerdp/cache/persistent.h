@@ -0,0 +1,82 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Persistent Bitmap Cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __PERSISTENT_CACHE_H
+#define __PERSISTENT_CACHE_H
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+#include <freerdp/settings.h>
+
+/**
+ * The persistent cache keeps the bitmaps the server stored in persistent
+ * bitmap cache v2 cells on disk, one file per host, along with their 64-bit
+ * keys. The keys found in the file are announced in the settings so that
+ * they can be sent in the persistent key list PDU, and the bitmaps they
+ * stand for are read from the mapped file only when the server uses them.
+ *
+ * The cache is written back when it is freed. The entries of each cell are
+ * then stored from index 0 without gaps, which is the order in which the
+ * server assigns the keys of the list to cache indices on the next connection.
+ */
+
+typedef struct _PERSISTENT_CACHE_ENTRY PERSISTENT_CACHE_ENTRY;
+typedef struct _PERSISTENT_CACHE_CELL PERSISTENT_CACHE_CELL;
+typedef struct rdp_persistent_cache rdpPersistentCache;
+
+struct _PERSISTENT_CACHE_ENTRY
+{
+	uint32 key1;
+	uint32 key2;
+	uint16 width;
+	uint16 height;
+	uint8 bpp;
+	boolean compressed;
+	uint32 length;
+	uint8* data;
+};
+
+struct _PERSISTENT_CACHE_CELL
+{
+	uint32 number;
+	PERSISTENT_CACHE_ENTRY* entries;
+};
+
+struct rdp_persistent_cache
+{
+	uint32 maxCells; /* 0 */
+	PERSISTENT_CACHE_CELL* cells; /* 1 */
+	uint32 paddingA[16 - 2]; /* 2 */
+
+	/* internal */
+
+	char* file;
+	uint8* map;
+	uint32 mapSize;
+	rdpSettings* settings;
+};
+
+FREERDP_API PERSISTENT_CACHE_ENTRY* persistent_cache_get(rdpPersistentCache* persistent_cache, uint32 id, uint32 index);
+FREERDP_API void persistent_cache_put(rdpPersistentCache* persistent_cache, uint32 id, uint32 index, PERSISTENT_CACHE_ENTRY* entry);
+
+FREERDP_API boolean persistent_cache_load(rdpPersistentCache* persistent_cache);
+FREERDP_API boolean persistent_cache_save(rdpPersistentCache* persistent_cache);
+
+FREERDP_API rdpPersistentCache* persistent_cache_new(rdpSettings* settings);
+FREERDP_API void persistent_cache_free(rdpPersistentCache* persistent_cache);
+
+#endif /* __PERSISTENT_CACHE_H */
@@ -38,12 +38,15 @@ struct rdp_pointer_cache
 
 	/* internal */
 
+	uint32 uses;
 	rdpUpdate* update;
 	rdpSettings* settings;
 };
 
 FREERDP_API rdpPointer* pointer_cache_get(rdpPointerCache* pointer_cache, uint32 index);
 FREERDP_API void pointer_cache_put(rdpPointerCache* pointer_cache, uint32 index, rdpPointer* pointer);
+FREERDP_API void pointer_cache_release(rdpPointerCache* pointer_cache);
+FREERDP_API void pointer_cache_reset(rdpPointerCache* pointer_cache);
 
 FREERDP_API void pointer_cache_register_callbacks(rdpUpdate* update);
 
@@ -0,0 +1,98 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Server Bitmap Cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SERVER_BITMAP_CACHE_H
+#define __SERVER_BITMAP_CACHE_H
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+#include <freerdp/update.h>
+#include <freerdp/freerdp.h>
+#include <freerdp/utils/stream.h>
+
+/**
+ * The server bitmap cache keeps track of what a client holds in its bitmap
+ * caches, with the geometry announced in the bitmap cache v2 capability set.
+ * Bitmaps drawn through it are hashed: a bitmap already cached is drawn with
+ * a MemBlt order alone, any other one is first sent with a CacheBitmapV2 or
+ * CacheBitmapV3 order, replacing the least recently used entry of its cell.
+ */
+
+typedef struct _SERVER_BITMAP_ENTRY SERVER_BITMAP_ENTRY;
+typedef struct _SERVER_BITMAP_CELL SERVER_BITMAP_CELL;
+typedef struct rdp_server_bitmap_cache rdpServerBitmapCache;
+
+typedef boolean (*pServerBitmapEncode)(rdpServerBitmapCache* cache, uint8* data,
+		int width, int height, int scanline, int bpp, STREAM* s);
+
+struct _SERVER_BITMAP_ENTRY
+{
+	uint32 key1;
+	uint32 key2;
+	uint16 cacheId;
+	uint16 cacheIndex;
+	boolean valid;
+	sint32 next;
+	sint32 lru_prev;
+	sint32 lru_next;
+};
+
+struct _SERVER_BITMAP_CELL
+{
+	uint32 number;
+	uint32 maxPixels;
+	boolean persistent;
+	sint32 first;
+	sint32 lru_head;
+	sint32 lru_tail;
+};
+
+struct rdp_server_bitmap_cache
+{
+	pServerBitmapEncode Encode; /* 0 */
+	uint32 paddingA[16 - 1]; /* 1 */
+
+	uint32 maxCells; /* 16 */
+	SERVER_BITMAP_CELL* cells; /* 17 */
+	uint32 hits; /* 18 */
+	uint32 misses; /* 19 */
+	uint32 paddingB[32 - 20]; /* 20 */
+
+	/* internal */
+
+	uint32 numEntries;
+	SERVER_BITMAP_ENTRY* entries;
+	uint32 hashMask;
+	sint32* buckets;
+
+	uint8* buffer;
+	uint32 bufferSize;
+	STREAM* encoded;
+
+	rdpUpdate* update;
+	rdpContext* context;
+	rdpSettings* settings;
+};
+
+FREERDP_API boolean server_bitmap_cache_draw(rdpServerBitmapCache* cache, sint32 x, sint32 y,
+		uint32 width, uint32 height, uint8* data, uint32 scanline, uint32 bpp);
+FREERDP_API void server_bitmap_cache_reset(rdpServerBitmapCache* cache);
+
+FREERDP_API rdpServerBitmapCache* server_bitmap_cache_new(rdpContext* context);
+FREERDP_API void server_bitmap_cache_free(rdpServerBitmapCache* cache);
+
+#endif /* __SERVER_BITMAP_CACHE_H */
@@ -0,0 +1,74 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Server Pointer Cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SERVER_POINTER_CACHE_H
+#define __SERVER_POINTER_CACHE_H
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+#include <freerdp/pointer.h>
+#include <freerdp/freerdp.h>
+
+/**
+ * The server pointer cache keeps track of the pointer shapes a client holds,
+ * in as many slots as the pointer capability set announces. A shape set
+ * through it is hashed: a shape already cached is sent as a cached pointer
+ * update, any other one replaces the least recently used slot. Setting the
+ * shape already in use sends nothing at all. Clients which do not support new
+ * pointer updates only get 24 bpp shapes.
+ */
+
+typedef struct _SERVER_POINTER_ENTRY SERVER_POINTER_ENTRY;
+typedef struct rdp_server_pointer_cache rdpServerPointerCache;
+
+struct _SERVER_POINTER_ENTRY
+{
+	uint32 key1;
+	uint32 key2;
+	boolean valid;
+	uint32 stamp;
+};
+
+struct rdp_server_pointer_cache
+{
+	uint32 cacheSize; /* 0 */
+	uint32 hits; /* 1 */
+	uint32 misses; /* 2 */
+	uint32 paddingA[16 - 3]; /* 3 */
+
+	/* internal */
+
+	uint32 clock;
+	sint32 current;
+	SERVER_POINTER_ENTRY* entries;
+
+	uint8* buffer;
+	uint32 bufferSize;
+
+	rdpUpdate* update;
+	rdpContext* context;
+	rdpSettings* settings;
+};
+
+FREERDP_API void server_pointer_cache_set(rdpServerPointerCache* cache, POINTER_NEW_UPDATE* pointer_new);
+FREERDP_API void server_pointer_cache_set_system(rdpServerPointerCache* cache, uint32 type);
+FREERDP_API void server_pointer_cache_reset(rdpServerPointerCache* cache);
+
+FREERDP_API rdpServerPointerCache* server_pointer_cache_new(rdpContext* context);
+FREERDP_API void server_pointer_cache_free(rdpServerPointerCache* cache);
+
+#endif /* __SERVER_POINTER_CACHE_H */
@@ -30,6 +30,9 @@
 #include <freerdp/types.h>
 #include <freerdp/utils/stream.h>
 
+#define TLS_SESSION_ID_CONTEXT		"FreeRDP"
+#define TLS_SESSION_CACHE_SIZE		1024
+
 typedef struct rdp_tls rdpTls;
 
 struct rdp_tls
@@ -43,6 +46,9 @@ struct rdp_tls
 };
 
 FREERDP_API boolean tls_connect(rdpTls* tls);
+FREERDP_API SSL_CTX* tls_server_context_new(const char* cert_file, const char* privatekey_file);
+FREERDP_API void tls_server_context_free(SSL_CTX* ctx);
+
 FREERDP_API boolean tls_accept(rdpTls* tls, const char* cert_file, const char* privatekey_file);
 FREERDP_API boolean tls_disconnect(rdpTls* tls);
 
@@ -207,12 +207,15 @@ struct _GDI_BRUSH
 typedef struct _GDI_BRUSH GDI_BRUSH;
 typedef GDI_BRUSH* HGDI_BRUSH;
 
+#define GDI_MAX_INVALID_RECTS	32
+
 struct _GDI_WND
 {
 	int count;
 	int ninvalid;
 	HGDI_RGN invalid;
 	HGDI_RGN cinvalid;
+	int maxinvalid; /* limit on ninvalid, 0 for none */
 };
 typedef struct _GDI_WND GDI_WND;
 typedef GDI_WND* HGDI_WND;
@@ -237,6 +240,17 @@ struct _GDI_DC
 typedef struct _GDI_DC GDI_DC;
 typedef GDI_DC* HGDI_DC;
 
+/* glyph expanded to one byte per pixel, 0xFF where the glyph is set */
+struct _GDI_GLYPH_MASK
+{
+	int x;
+	int y;
+	int width;
+	int height;
+	uint8* data;
+};
+typedef struct _GDI_GLYPH_MASK GDI_GLYPH_MASK;
+
 struct gdi_bitmap
 {
 	rdpBitmap _p;
@@ -249,11 +263,9 @@ typedef struct gdi_bitmap gdiBitmap;
 
 struct gdi_glyph
 {
-	rdpBitmap _p;
+	rdpGlyph _p;
 
-	HGDI_DC hdc;
-	HGDI_BITMAP bitmap;
-	HGDI_BITMAP org_bitmap;
+	uint8* mask;
 };
 typedef struct gdi_glyph gdiGlyph;
 
@@ -279,6 +291,10 @@ struct rdp_gdi
 	void* nsc_context;
 	gdiBitmap* tile;
 	gdiBitmap* image;
+
+	GDI_GLYPH_MASK* glyph_run;
+	int glyph_run_count;
+	int glyph_run_size;
 };
 
 FREERDP_API uint32 gdi_rop3_code(uint8 code);
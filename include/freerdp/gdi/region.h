@@ -40,6 +40,10 @@ FREERDP_API int gdi_SetRectRgn(HGDI_RGN hRgn, int nLeftRect, int nTopRect, int n
 FREERDP_API int gdi_EqualRgn(HGDI_RGN hSrcRgn1, HGDI_RGN hSrcRgn2);
 FREERDP_API int gdi_CopyRect(HGDI_RECT dst, HGDI_RECT src);
 FREERDP_API int gdi_PtInRect(HGDI_RECT rc, int x, int y);
+FREERDP_API int gdi_UnionWndRgn(HGDI_WND hwnd, int x, int y, int w, int h);
+FREERDP_API int gdi_IntersectWndRgn(HGDI_WND hwnd, int x, int y, int w, int h);
+FREERDP_API int gdi_SubtractWndRgn(HGDI_WND hwnd, int x, int y, int w, int h);
 FREERDP_API int gdi_InvalidateRegion(HGDI_DC hdc, int x, int y, int w, int h);
+FREERDP_API int gdi_ValidateRegion(HGDI_DC hdc, int x, int y, int w, int h);
 
 #endif /* __GDI_REGION_H */
@@ -25,10 +25,12 @@
 
 FREERDP_API int gdi_Ellipse(HGDI_DC hdc, int nLeftRect, int nTopRect, int nRightRect, int nBottomRect);
 FREERDP_API int gdi_FillRect(HGDI_DC hdc, HGDI_RECT rect, HGDI_BRUSH hbr);
+FREERDP_API int gdi_GlyphRun(HGDI_DC hdc, GDI_GLYPH_MASK* masks, int count, GDI_COLOR color);
 FREERDP_API int gdi_Polygon(HGDI_DC hdc, GDI_POINT *lpPoints, int nCount);
 FREERDP_API int gdi_PolyPolygon(HGDI_DC hdc, GDI_POINT *lpPoints, int *lpPolyCounts, int nCount);
 FREERDP_API int gdi_Rectangle(HGDI_DC hdc, int nLeftRect, int nTopRect, int nRightRect, int nBottomRect);
 
 typedef int (*p_FillRect)(HGDI_DC hdc, HGDI_RECT rect, HGDI_BRUSH hbr);
+typedef int (*p_GlyphRun)(HGDI_DC hdc, HGDI_RECT clip, GDI_GLYPH_MASK* masks, int count, GDI_COLOR color);
 
 #endif /* __GDI_SHAPE_H */
@@ -59,6 +59,8 @@ typedef void (*pKeyboardEvent)(rdpInput* input, uint16 flags, uint16 code);
 typedef void (*pUnicodeKeyboardEvent)(rdpInput* input, uint16 flags, uint16 code);
 typedef void (*pMouseEvent)(rdpInput* input, uint16 flags, uint16 x, uint16 y);
 typedef void (*pExtendedMouseEvent)(rdpInput* input, uint16 flags, uint16 x, uint16 y);
+typedef void (*pBeginInput)(rdpInput* input);
+typedef void (*pEndInput)(rdpInput* input);
 
 struct rdp_input
 {
@@ -71,7 +73,9 @@ struct rdp_input
 	pUnicodeKeyboardEvent UnicodeKeyboardEvent; /* 18 */
 	pMouseEvent MouseEvent; /* 19 */
 	pExtendedMouseEvent ExtendedMouseEvent; /* 20 */
-	uint32 paddingB[32 - 21]; /* 21 */
+	pBeginInput BeginInput; /* 21 */
+	pEndInput EndInput; /* 22 */
+	uint32 paddingB[32 - 23]; /* 23 */
 };
 
 FREERDP_API void freerdp_input_send_synchronize_event(rdpInput* input, uint32 flags);
@@ -79,6 +83,7 @@ FREERDP_API void freerdp_input_send_keyboard_event(rdpInput* input, uint16 flags
 FREERDP_API void freerdp_input_send_unicode_keyboard_event(rdpInput* input, uint16 flags, uint16 code);
 FREERDP_API void freerdp_input_send_mouse_event(rdpInput* input, uint16 flags, uint16 x, uint16 y);
 FREERDP_API void freerdp_input_send_extended_mouse_event(rdpInput* input, uint16 flags, uint16 x, uint16 y);
+FREERDP_API boolean freerdp_input_flush(rdpInput* input);
 
 #define freerdp_input_send_keyboard_event_2(input, down, rdp_scancode) \
 		freerdp_input_send_keyboard_event(input, \
@@ -0,0 +1,59 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol client.
+ * Update Message Queue
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * The message queue decouples the decoding of updates from their execution.
+ * Once attached to an rdpUpdate, every registered update, order, pointer and
+ * window callback is replaced by a proxy which copies its arguments into a
+ * message and queues it, so that freerdp_check_fds can run on a network
+ * thread while another thread executes the messages, in order, against the
+ * original callbacks with freerdp_message_queue_check_fds.
+ *
+ * The queue must be attached after all callbacks have been registered, and
+ * the executing thread must not call into the connection while the network
+ * thread is in freerdp_check_fds: the caller serializes both.
+ */
+
+#ifndef __FREERDP_MESSAGE_H
+#define __FREERDP_MESSAGE_H
+
+typedef struct rdp_message_queue rdpMessageQueue;
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+#include <freerdp/update.h>
+#include <freerdp/utils/wait_obj.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MESSAGE_QUEUE_DEFAULT_SIZE	1024
+
+FREERDP_API rdpMessageQueue* freerdp_message_queue_new(rdpUpdate* update, int max_size);
+FREERDP_API void freerdp_message_queue_free(rdpMessageQueue* queue);
+
+FREERDP_API void freerdp_message_queue_get_fds(rdpMessageQueue* queue, void** rfds, int* rcount);
+FREERDP_API boolean freerdp_message_queue_check_fds(rdpMessageQueue* queue);
+FREERDP_API int freerdp_message_queue_pending_frames(rdpMessageQueue* queue);
+FREERDP_API void freerdp_message_queue_wait(rdpMessageQueue* queue, struct wait_obj* abort);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FREERDP_MESSAGE_H */
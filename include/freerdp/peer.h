@@ -25,12 +25,14 @@
 #include <freerdp/settings.h>
 #include <freerdp/input.h>
 #include <freerdp/update.h>
+#include <freerdp/utils/mutex.h>
 
 typedef void (*psPeerContextNew)(freerdp_peer* client, rdpContext* context);
 typedef void (*psPeerContextFree)(freerdp_peer* client, rdpContext* context);
 
 typedef boolean (*psPeerInitialize)(freerdp_peer* client);
 typedef boolean (*psPeerGetFileDescriptor)(freerdp_peer* client, void** rfds, int* rcount);
+typedef boolean (*psPeerGetWriteFileDescriptor)(freerdp_peer* client, void** wfds, int* wcount);
 typedef boolean (*psPeerCheckFileDescriptor)(freerdp_peer* client);
 typedef boolean (*psPeerClose)(freerdp_peer* client);
 typedef void (*psPeerDisconnect)(freerdp_peer* client);
@@ -38,6 +40,13 @@ typedef boolean (*psPeerCapabilities)(freerdp_peer* client);
 typedef boolean (*psPeerPostConnect)(freerdp_peer* client);
 typedef boolean (*psPeerActivate)(freerdp_peer* client);
 
+typedef uint32 (*psPeerGetFramesInFlight)(freerdp_peer* client);
+
+typedef boolean (*psPeerIsWriteBlocked)(freerdp_peer* client);
+typedef int (*psPeerDrainSendQueue)(freerdp_peer* client);
+typedef uint32 (*psPeerGetSendQueueDepth)(freerdp_peer* client);
+typedef void (*psPeerSendQueueWatermark)(freerdp_peer* client, uint32 depth);
+
 typedef int (*psPeerSendChannelData)(freerdp_peer* client, int channelId, uint8* data, int size);
 typedef int (*psPeerReceiveChannelData)(freerdp_peer* client, int channelId, uint8* data, int size, int flags, int total_size);
 
@@ -46,6 +55,7 @@ struct rdp_freerdp_peer
 	rdpContext* context;
 	int sockfd;
 	char hostname[50];
+	void* listener;
 
 	rdpInput* input;
 	rdpUpdate* update;
@@ -57,6 +67,7 @@ struct rdp_freerdp_peer
 
 	psPeerInitialize Initialize;
 	psPeerGetFileDescriptor GetFileDescriptor;
+	psPeerGetWriteFileDescriptor GetWriteFileDescriptor;
 	psPeerCheckFileDescriptor CheckFileDescriptor;
 	psPeerClose Close;
 	psPeerDisconnect Disconnect;
@@ -65,10 +76,23 @@ struct rdp_freerdp_peer
 	psPeerPostConnect PostConnect;
 	psPeerActivate Activate;
 
+	psPeerGetFramesInFlight GetFramesInFlight;
+
+	psPeerIsWriteBlocked IsWriteBlocked;
+	psPeerDrainSendQueue DrainSendQueue;
+	psPeerGetSendQueueDepth GetSendQueueDepth;
+	psPeerSendQueueWatermark SendQueueHigh;
+	psPeerSendQueueWatermark SendQueueLow;
+
 	psPeerSendChannelData SendChannelData;
 	psPeerReceiveChannelData ReceiveChannelData;
 
+	/* written on the receive and send paths, read from any thread */
+	freerdp_mutex frame_mutex;
 	uint32 ack_frame_id;
+	uint32 last_frame_id;
+	uint32 send_queue_low_watermark;
+	uint32 send_queue_high_watermark;
 	boolean local;
 	boolean activated;
 };
@@ -0,0 +1,80 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol client.
+ * Server Event Loop
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * The reactor is an optional event loop for servers hosting many sessions.
+ * Instead of one thread per peer, each polling its own file descriptors,
+ * listeners, peers and any other file descriptor sources (such as the
+ * WTSVirtualChannelManager of a peer) are registered with a reactor, which
+ * dispatches them on a small fixed pool of threads.
+ *
+ * A source is never dispatched by two threads at the same time, so the
+ * callbacks of one source do not need locking against each other. Sources
+ * sharing state, like a peer and its virtual channel manager, should be
+ * registered as a single source.
+ *
+ * The reactor is built on epoll and is only available where sys/epoll.h is.
+ */
+
+#ifndef __FREERDP_REACTOR_H
+#define __FREERDP_REACTOR_H
+
+typedef struct rdp_reactor rdpReactor;
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+#include <freerdp/listener.h>
+#include <freerdp/peer.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define REACTOR_DEFAULT_THREADS		4
+#define REACTOR_MAX_SOURCE_FDS		32
+
+typedef boolean (*psReactorGetFileDescriptor)(void* data, void** rfds, int* rcount, void** wfds, int* wcount);
+typedef boolean (*psReactorCheckFileDescriptor)(void* data);
+typedef void (*psReactorSourceClosed)(void* data);
+
+typedef boolean (*psReactorPeerGetFileDescriptor)(freerdp_peer* client, void** rfds, int* rcount);
+typedef boolean (*psReactorPeerCheckFileDescriptor)(freerdp_peer* client);
+typedef void (*psReactorPeerClosed)(freerdp_peer* client);
+
+FREERDP_API rdpReactor* freerdp_reactor_new(int num_threads);
+FREERDP_API void freerdp_reactor_free(rdpReactor* reactor);
+
+FREERDP_API boolean freerdp_reactor_start(rdpReactor* reactor);
+FREERDP_API void freerdp_reactor_stop(rdpReactor* reactor);
+
+FREERDP_API boolean freerdp_reactor_add_source(rdpReactor* reactor, void* data,
+		psReactorGetFileDescriptor GetFileDescriptor,
+		psReactorCheckFileDescriptor CheckFileDescriptor,
+		psReactorSourceClosed Closed);
+
+FREERDP_API boolean freerdp_reactor_add_listener(rdpReactor* reactor, freerdp_listener* instance);
+
+FREERDP_API boolean freerdp_reactor_add_peer(rdpReactor* reactor, freerdp_peer* client,
+		psReactorPeerGetFileDescriptor GetFileDescriptor,
+		psReactorPeerCheckFileDescriptor CheckFileDescriptor,
+		psReactorPeerClosed Closed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FREERDP_REACTOR_H */
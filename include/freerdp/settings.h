@@ -213,6 +213,8 @@ struct _BITMAP_CACHE_V2_CELL_INFO
 {
 	uint32 numEntries;
 	boolean persistent;
+	uint32 numPersistentKeys;
+	uint64* persistentKeys;
 };
 typedef struct _BITMAP_CACHE_V2_CELL_INFO BITMAP_CACHE_V2_CELL_INFO;
 
@@ -311,7 +313,8 @@ struct rdp_settings
 	ALIGN64 boolean mouse_motion; /* 86 */
 	ALIGN64 char* window_title; /* 87 */
 	ALIGN64 uint64 parent_window_xid; /* 88 */
-	uint64 paddingD[112 - 89]; /* 89 */
+	ALIGN64 boolean async_update; /* 89 */
+	uint64 paddingD[112 - 90]; /* 90 */
 
 	/* Internal Parameters */
 	ALIGN64 char* home_path; /* 112 */
@@ -376,7 +379,8 @@ struct rdp_settings
 	ALIGN64 boolean disable_theming; /* 230 */
 	ALIGN64 uint32 connection_type; /* 231 */
 	ALIGN64 uint32 multifrag_max_request_size; /* 232 */
-	uint64 paddingK[248 - 233]; /* 233 */
+	ALIGN64 boolean input_batching; /* 233 */
+	uint64 paddingK[248 - 234]; /* 234 */
 
 	/* Certificate */
 	ALIGN64 char* cert_file; /* 248 */
@@ -390,7 +394,8 @@ struct rdp_settings
 	ALIGN64 char* rdp_key_file; /* 256 */
 	ALIGN64 rdpKey* server_key; /* 257 */
 	ALIGN64 char* certificate_name; /* 258 */
-	uint64 paddingL[280 - 259]; /* 259 */
+	ALIGN64 void* tls_context; /* 259 */
+	uint64 paddingL[280 - 260]; /* 260 */
 
 	/* Codecs */
 	ALIGN64 boolean rfx_codec; /* 280 */
@@ -424,7 +429,8 @@ struct rdp_settings
 	ALIGN64 boolean large_pointer; /* 320 */
 	ALIGN64 boolean color_pointer; /* 321 */
 	ALIGN64 uint32 pointer_cache_size; /* 322 */
-	uint64 paddingP[328 - 323]; /* 323 */
+	ALIGN64 boolean new_pointer; /* 323 */
+	uint64 paddingP[328 - 324]; /* 324 */
 
 	/* Bitmap Cache */
 	ALIGN64 boolean bitmap_cache; /* 328 */
@@ -432,20 +438,27 @@ struct rdp_settings
 	ALIGN64 boolean persistent_bitmap_cache; /* 330 */
 	ALIGN64 uint32 bitmapCacheV2NumCells; /* 331 */
 	ALIGN64 BITMAP_CACHE_V2_CELL_INFO* bitmapCacheV2CellInfo; /* 332 */
-	uint64 paddingQ[344 - 333]; /* 333 */
+	ALIGN64 boolean bitmap_cache_persist_enabled; /* 333 */
+	ALIGN64 char* bitmap_cache_persist_file; /* 334 */
+	ALIGN64 uint32 bitmap_cache_budget; /* 335 */
+	ALIGN64 struct rdp_cache_budget* cache_budget; /* 336 */
+	ALIGN64 uint32 cache_idle_timeout; /* 337 */
+	uint64 paddingQ[344 - 338]; /* 338 */
 
 	/* Offscreen Bitmap Cache */
 	ALIGN64 boolean offscreen_bitmap_cache; /* 344 */
 	ALIGN64 uint32 offscreen_bitmap_cache_size; /* 345 */
 	ALIGN64 uint32 offscreen_bitmap_cache_entries; /* 346 */
-	uint64 paddingR[352 - 347]; /* 347 */
+	ALIGN64 uint32 offscreen_bitmap_cache_budget; /* 347 */
+	uint64 paddingR[352 - 348]; /* 348 */
 
 	/* Glyph Cache */
 	ALIGN64 boolean glyph_cache; /* 352 */
 	ALIGN64 uint32 glyphSupportLevel; /* 353 */
 	ALIGN64 GLYPH_CACHE_DEFINITION* glyphCache; /* 354 */
 	ALIGN64 GLYPH_CACHE_DEFINITION* fragCache; /* 355 */
-	uint64 paddingS[360 - 356]; /* 356 */
+	ALIGN64 uint32 glyph_cache_budget; /* 356 */
+	uint64 paddingS[360 - 357]; /* 357 */
 
 	/* Draw Nine Grid */
 	ALIGN64 boolean draw_nine_grid; /* 360 */
@@ -140,6 +140,7 @@ typedef void (*pDesktopResize)(rdpContext* context);
 typedef void (*pBitmapUpdate)(rdpContext* context, BITMAP_UPDATE* bitmap);
 typedef void (*pPalette)(rdpContext* context, PALETTE_UPDATE* palette);
 typedef void (*pPlaySound)(rdpContext* context, PLAY_SOUND_UPDATE* play_sound);
+typedef void (*pResetState)(rdpContext* context);
 
 typedef void (*pRefreshRect)(rdpContext* context, uint8 count, RECTANGLE_16* areas);
 typedef void (*pSuppressOutput)(rdpContext* context, uint8 allow, RECTANGLE_16* area);
@@ -147,6 +148,7 @@ typedef void (*pSuppressOutput)(rdpContext* context, uint8 allow, RECTANGLE_16*
 typedef void (*pSurfaceCommand)(rdpContext* context, STREAM* s);
 typedef void (*pSurfaceBits)(rdpContext* context, SURFACE_BITS_COMMAND* surface_bits_command);
 typedef void (*pSurfaceFrameMarker)(rdpContext* context, SURFACE_FRAME_MARKER* surface_frame_marker);
+typedef void (*pSurfaceFrameAcknowledge)(rdpContext* context, uint32 frameId);
 
 struct rdp_update
 {
@@ -161,7 +163,8 @@ struct rdp_update
 	pBitmapUpdate BitmapUpdate; /* 21 */
 	pPalette Palette; /* 22 */
 	pPlaySound PlaySound; /* 23 */
-	uint32 paddingB[32 - 24]; /* 24 */
+	pResetState ResetState; /* 24 */
+	uint32 paddingB[32 - 25]; /* 25 */
 
 	rdpPointerUpdate* pointer; /* 32 */
 	rdpPrimaryUpdate* primary; /* 33 */
@@ -177,7 +180,8 @@ struct rdp_update
 	pSurfaceCommand SurfaceCommand; /* 64 */
 	pSurfaceBits SurfaceBits; /* 65 */
 	pSurfaceFrameMarker SurfaceFrameMarker; /* 66 */
-	uint32 paddingE[80 - 67]; /* 67 */
+	pSurfaceFrameAcknowledge SurfaceFrameAcknowledge; /* 67 */
+	uint32 paddingE[80 - 68]; /* 68 */
 
 	/* internal */
 
@@ -191,6 +195,11 @@ struct rdp_update
 
 	SURFACE_BITS_COMMAND surface_bits_command;
 	SURFACE_FRAME_MARKER surface_frame_marker;
+
+	boolean bounded;
+	rdpBounds bounds;
+
+	struct rdp_message_queue* queue;
 };
 
 #endif /* __UPDATE_API_H */
@@ -28,6 +28,324 @@
 
 #include <freerdp/cache/bitmap.h>
 
+static boolean bitmap_cache_check_index(rdpBitmapCache* bitmap_cache, uint32 id, uint32* index, const char* what)
+{
+	if (id >= bitmap_cache->maxCells)
+	{
+		printf("%s invalid bitmap cell id: %d\n", what, id);
+		return false;
+	}
+
+	if (*index == BITMAP_CACHE_WAITING_LIST_INDEX)
+	{
+		*index = bitmap_cache->cells[id].number;
+	}
+	else if (*index > bitmap_cache->cells[id].number)
+	{
+		printf("%s invalid bitmap index %d in cell id: %d\n", what, *index, id);
+		return false;
+	}
+
+	return true;
+}
+
+static void bitmap_cache_lru_unlink(rdpBitmapCache* bitmap_cache, BITMAP_V2_ENTRY* entry)
+{
+	if (entry->prev != NULL)
+		entry->prev->next = entry->next;
+	else if (bitmap_cache->lru_head == entry)
+		bitmap_cache->lru_head = entry->next;
+
+	if (entry->next != NULL)
+		entry->next->prev = entry->prev;
+	else if (bitmap_cache->lru_tail == entry)
+		bitmap_cache->lru_tail = entry->prev;
+
+	entry->prev = entry->next = NULL;
+}
+
+static void bitmap_cache_lru_push(rdpBitmapCache* bitmap_cache, BITMAP_V2_ENTRY* entry)
+{
+	entry->prev = NULL;
+	entry->next = bitmap_cache->lru_head;
+
+	if (bitmap_cache->lru_head != NULL)
+		bitmap_cache->lru_head->prev = entry;
+	else
+		bitmap_cache->lru_tail = entry;
+
+	bitmap_cache->lru_head = entry;
+}
+
+/**
+ * The tables of a cell are allocated when the first bitmap is stored in it,
+ * since many sessions use only some of the cells, or none at all.
+ */
+
+static boolean bitmap_cache_alloc_cell(rdpBitmapCache* bitmap_cache, uint32 id)
+{
+	int i;
+	BITMAP_V2_CELL* cell = &bitmap_cache->cells[id];
+
+	if (cell->entries != NULL)
+		return true;
+
+	/* allocate an extra entry for BITMAP_CACHE_WAITING_LIST_INDEX */
+	cell->entries = (rdpBitmap**) xzalloc(sizeof(rdpBitmap*) * (cell->number + 1));
+
+	if (cell->entries == NULL)
+		return false;
+
+	if (bitmap_cache->limit > 0 || bitmap_cache->budget != NULL)
+	{
+		cell->info = (BITMAP_V2_ENTRY*) xzalloc(sizeof(BITMAP_V2_ENTRY) * (cell->number + 1));
+
+		if (cell->info == NULL)
+		{
+			xfree(cell->entries);
+			cell->entries = NULL;
+			return false;
+		}
+
+		for (i = 0; i < (int) cell->number + 1; i++)
+		{
+			cell->info[i].id = id;
+			cell->info[i].index = i;
+		}
+	}
+
+	return true;
+}
+
+static void bitmap_cache_free_cell(rdpBitmapCache* bitmap_cache, uint32 id)
+{
+	BITMAP_V2_CELL* cell = &bitmap_cache->cells[id];
+
+	xfree(cell->entries);
+	xfree(cell->info);
+
+	cell->entries = NULL;
+	cell->info = NULL;
+}
+
+static boolean bitmap_cache_attach(rdpBitmapCache* bitmap_cache, uint32 id, uint32 index, rdpBitmap* bitmap)
+{
+	BITMAP_V2_CELL* cell = &bitmap_cache->cells[id];
+
+	if (bitmap == NULL)
+	{
+		if (cell->entries != NULL)
+			cell->entries[index] = NULL;
+
+		return true;
+	}
+
+	if (!bitmap_cache_alloc_cell(bitmap_cache, id))
+		return false;
+
+	cell->entries[index] = bitmap;
+
+	bitmap_cache->stats.entries++;
+	bitmap_cache->stats.bytes += bitmap->length;
+	cache_budget_charge(bitmap_cache->budget, bitmap->length);
+
+	if (cell->info != NULL)
+	{
+		cell->info[index].size = bitmap->length;
+		bitmap_cache_lru_push(bitmap_cache, &cell->info[index]);
+	}
+
+	return true;
+}
+
+/**
+ * Free the decoded bitmap at a cache index, leaving the data it can be
+ * decoded from in place.
+ */
+
+static void bitmap_cache_evict(rdpBitmapCache* bitmap_cache, uint32 id, uint32 index)
+{
+	rdpBitmap* bitmap;
+	BITMAP_V2_CELL* cell = &bitmap_cache->cells[id];
+
+	if (cell->entries == NULL)
+		return;
+
+	bitmap = cell->entries[index];
+
+	if (bitmap == NULL)
+		return;
+
+	bitmap_cache->stats.entries--;
+	bitmap_cache->stats.bytes -= bitmap->length;
+	cache_budget_release(bitmap_cache->budget, bitmap->length);
+
+	if (cell->info != NULL)
+		bitmap_cache_lru_unlink(bitmap_cache, &cell->info[index]);
+
+	Bitmap_Free(bitmap_cache->context, bitmap);
+	cell->entries[index] = NULL;
+}
+
+static void bitmap_cache_delete(rdpBitmapCache* bitmap_cache, uint32 id, uint32 index)
+{
+	BITMAP_V2_CELL* cell = &bitmap_cache->cells[id];
+
+	bitmap_cache_evict(bitmap_cache, id, index);
+
+	if (cell->info != NULL && cell->info[index].data != NULL)
+	{
+		xfree(cell->info[index].data);
+		cell->info[index].data = NULL;
+	}
+
+	if (bitmap_cache->persistent != NULL)
+		persistent_cache_put(bitmap_cache->persistent, id, index, NULL);
+}
+
+static boolean bitmap_cache_over_budget(rdpBitmapCache* bitmap_cache)
+{
+	if (bitmap_cache->limit > 0 && bitmap_cache->stats.bytes > bitmap_cache->limit)
+		return true;
+
+	return cache_budget_over_share(bitmap_cache->budget, bitmap_cache->stats.bytes);
+}
+
+static boolean bitmap_cache_can_restore(rdpBitmapCache* bitmap_cache, uint32 id, uint32 index)
+{
+	BITMAP_V2_CELL* cell = &bitmap_cache->cells[id];
+
+	if (cell->info != NULL && cell->info[index].data != NULL)
+		return true;
+
+	if (bitmap_cache->persistent == NULL)
+		return false;
+
+	return (persistent_cache_get(bitmap_cache->persistent, id, index) != NULL);
+}
+
+/**
+ * Evict the least recently used bitmaps which can be decoded again until the
+ * cache is back within its budget, or within its share of the shared one.
+ * The bitmap about to be used is kept.
+ */
+
+static void bitmap_cache_trim(rdpBitmapCache* bitmap_cache, rdpBitmap* keep)
+{
+	BITMAP_V2_ENTRY* prev;
+	BITMAP_V2_ENTRY* entry;
+
+	entry = bitmap_cache->lru_tail;
+
+	while (entry != NULL && bitmap_cache_over_budget(bitmap_cache))
+	{
+		prev = entry->prev;
+
+		if (bitmap_cache->cells[entry->id].entries[entry->index] != keep &&
+				bitmap_cache_can_restore(bitmap_cache, entry->id, entry->index))
+		{
+			bitmap_cache_evict(bitmap_cache, entry->id, entry->index);
+			bitmap_cache->stats.evictions++;
+		}
+
+		entry = prev;
+	}
+}
+
+/**
+ * Keep the data a bitmap was received with, for a budgeted cache to decode
+ * it again after evicting it.
+ */
+
+static void bitmap_cache_keep(rdpBitmapCache* bitmap_cache, uint32 id, uint32 index,
+		uint8* data, uint32 length, int bpp, boolean compressed, int codecId)
+{
+	rdpBitmap* bitmap;
+	BITMAP_V2_ENTRY* entry;
+
+	if (!bitmap_cache_check_index(bitmap_cache, id, &index, "keep"))
+		return;
+
+	if (bitmap_cache->cells[id].info == NULL || data == NULL || length < 1)
+		return;
+
+	bitmap = bitmap_cache->cells[id].entries[index];
+	entry = &bitmap_cache->cells[id].info[index];
+
+	entry->data = (uint8*) xmalloc(length);
+	memcpy(entry->data, data, length);
+	entry->length = length;
+	entry->width = (bitmap != NULL) ? bitmap->width : 0;
+	entry->height = (bitmap != NULL) ? bitmap->height : 0;
+	entry->bpp = bpp;
+	entry->compressed = compressed;
+	entry->codecId = codecId;
+
+	bitmap_cache_trim(bitmap_cache, bitmap);
+}
+
+static rdpBitmap* bitmap_cache_decode(rdpBitmapCache* bitmap_cache, uint8* data, uint32 length,
+		int width, int height, int bpp, boolean compressed, int codecId)
+{
+	rdpBitmap* bitmap;
+	rdpContext* context = bitmap_cache->context;
+
+	bitmap = Bitmap_Alloc(context);
+
+	Bitmap_SetDimensions(context, bitmap, width, height);
+
+	bitmap->Decompress(context, bitmap, data, width, height,
+			bpp, length, compressed, codecId);
+
+	bitmap->New(context, bitmap);
+
+	return bitmap;
+}
+
+/**
+ * Decode again a bitmap which was evicted, or which the persistent cache
+ * holds for a key announced at connection time.
+ */
+
+static rdpBitmap* bitmap_cache_restore(rdpBitmapCache* bitmap_cache, uint32 id, uint32 index)
+{
+	rdpBitmap* bitmap = NULL;
+	BITMAP_V2_ENTRY* entry = NULL;
+	PERSISTENT_CACHE_ENTRY* persistent = NULL;
+
+	if (bitmap_cache->cells[id].info != NULL)
+		entry = &bitmap_cache->cells[id].info[index];
+
+	if (entry != NULL && entry->data != NULL)
+	{
+		bitmap = bitmap_cache_decode(bitmap_cache, entry->data, entry->length,
+				entry->width, entry->height, entry->bpp, entry->compressed, entry->codecId);
+	}
+	else if (bitmap_cache->persistent != NULL)
+	{
+		persistent = persistent_cache_get(bitmap_cache->persistent, id, index);
+
+		if (persistent != NULL)
+		{
+			bitmap = bitmap_cache_decode(bitmap_cache, persistent->data, persistent->length,
+					persistent->width, persistent->height, persistent->bpp, persistent->compressed, CODEC_ID_NONE);
+		}
+	}
+
+	if (bitmap == NULL)
+		return NULL;
+
+	if (!bitmap_cache_attach(bitmap_cache, id, index, bitmap))
+	{
+		Bitmap_Free(bitmap_cache->context, bitmap);
+		return NULL;
+	}
+
+	bitmap_cache_trim(bitmap_cache, bitmap);
+
+	return bitmap;
+}
+
 void update_gdi_memblt(rdpContext* context, MEMBLT_ORDER* memblt)
 {
 	rdpBitmap* bitmap;
@@ -70,7 +388,6 @@ void update_gdi_mem3blt(rdpContext* context, MEM3BLT_ORDER* mem3blt)
 void update_gdi_cache_bitmap(rdpContext* context, CACHE_BITMAP_ORDER* cache_bitmap)
 {
 	rdpBitmap* bitmap;
-	rdpBitmap* prevBitmap;
 	rdpCache* cache = context->cache;
 
 	bitmap = Bitmap_Alloc(context);
@@ -84,18 +401,16 @@ void update_gdi_cache_bitmap(rdpContext* context, CACHE_BITMAP_ORDER* cache_bitm
 
 	bitmap->New(context, bitmap);
 
-	prevBitmap = bitmap_cache_get(cache->bitmap, cache_bitmap->cacheId, cache_bitmap->cacheIndex);
-
-	if (prevBitmap != NULL)
-		Bitmap_Free(context, prevBitmap);
-
 	bitmap_cache_put(cache->bitmap, cache_bitmap->cacheId, cache_bitmap->cacheIndex, bitmap);
+
+	bitmap_cache_keep(cache->bitmap, cache_bitmap->cacheId, cache_bitmap->cacheIndex,
+			cache_bitmap->bitmapDataStream, cache_bitmap->bitmapLength,
+			cache_bitmap->bitmapBpp, cache_bitmap->compressed, CODEC_ID_NONE);
 }
 
 void update_gdi_cache_bitmap_v2(rdpContext* context, CACHE_BITMAP_V2_ORDER* cache_bitmap_v2)
 {
 	rdpBitmap* bitmap;
-	rdpBitmap* prevBitmap;
 	rdpCache* cache = context->cache;
 
 	bitmap = Bitmap_Alloc(context);
@@ -115,18 +430,35 @@ void update_gdi_cache_bitmap_v2(rdpContext* context, CACHE_BITMAP_V2_ORDER* cach
 
 	bitmap->New(context, bitmap);
 
-	prevBitmap = bitmap_cache_get(cache->bitmap, cache_bitmap_v2->cacheId, cache_bitmap_v2->cacheIndex);
-
-	if (prevBitmap != NULL)
-		Bitmap_Free(context, prevBitmap);
-
 	bitmap_cache_put(cache->bitmap, cache_bitmap_v2->cacheId, cache_bitmap_v2->cacheIndex, bitmap);
+
+	if (cache->bitmap->persistent != NULL && (cache_bitmap_v2->flags & CBR2_PERSISTENT_KEY_PRESENT))
+	{
+		PERSISTENT_CACHE_ENTRY entry;
+
+		/* the persistent cache keeps the data already */
+		entry.key1 = cache_bitmap_v2->key1;
+		entry.key2 = cache_bitmap_v2->key2;
+		entry.width = cache_bitmap_v2->bitmapWidth;
+		entry.height = cache_bitmap_v2->bitmapHeight;
+		entry.bpp = cache_bitmap_v2->bitmapBpp;
+		entry.compressed = cache_bitmap_v2->compressed;
+		entry.length = cache_bitmap_v2->bitmapLength;
+		entry.data = cache_bitmap_v2->bitmapDataStream;
+
+		persistent_cache_put(cache->bitmap->persistent, cache_bitmap_v2->cacheId, cache_bitmap_v2->cacheIndex, &entry);
+	}
+	else
+	{
+		bitmap_cache_keep(cache->bitmap, cache_bitmap_v2->cacheId, cache_bitmap_v2->cacheIndex,
+				cache_bitmap_v2->bitmapDataStream, cache_bitmap_v2->bitmapLength,
+				cache_bitmap_v2->bitmapBpp, cache_bitmap_v2->compressed, CODEC_ID_NONE);
+	}
 }
 
 void update_gdi_cache_bitmap_v3(rdpContext* context, CACHE_BITMAP_V3_ORDER* cache_bitmap_v3)
 {
 	rdpBitmap* bitmap;
-	rdpBitmap* prevBitmap;
 	rdpCache* cache = context->cache;
 	BITMAP_DATA_EX* bitmapData = &cache_bitmap_v3->bitmapData;
 
@@ -147,12 +479,10 @@ void update_gdi_cache_bitmap_v3(rdpContext* context, CACHE_BITMAP_V3_ORDER* cach
 
 	bitmap->New(context, bitmap);
 
-	prevBitmap = bitmap_cache_get(cache->bitmap, cache_bitmap_v3->cacheId, cache_bitmap_v3->cacheIndex);
-
-	if (prevBitmap != NULL)
-		Bitmap_Free(context, prevBitmap);
-
 	bitmap_cache_put(cache->bitmap, cache_bitmap_v3->cacheId, cache_bitmap_v3->cacheIndex, bitmap);
+
+	bitmap_cache_keep(cache->bitmap, cache_bitmap_v3->cacheId, cache_bitmap_v3->cacheIndex,
+			bitmapData->data, bitmapData->length, bitmapData->bpp, true, bitmapData->codecID);
 }
 
 void update_gdi_bitmap_update(rdpContext* context, BITMAP_UPDATE* bitmap_update)
@@ -206,46 +536,141 @@ rdpBitmap* bitmap_cache_get(rdpBitmapCache* bitmap_cache, uint32 id, uint32 inde
 {
 	rdpBitmap* bitmap;
 
-	if (id > bitmap_cache->maxCells)
-	{
-		printf("get invalid bitmap cell id: %d\n", id);
+	if (!bitmap_cache_check_index(bitmap_cache, id, &index, "get"))
 		return NULL;
-	}
 
-	if (index == BITMAP_CACHE_WAITING_LIST_INDEX)
+	bitmap_cache->uses++;
+
+	if (bitmap_cache->cells[id].entries != NULL)
+		bitmap = bitmap_cache->cells[id].entries[index];
+	else
+		bitmap = NULL;
+
+	if (bitmap != NULL)
 	{
-		index = bitmap_cache->cells[id].number;
+		bitmap_cache->stats.hits++;
+
+		if (bitmap_cache->cells[id].info != NULL)
+		{
+			bitmap_cache_lru_unlink(bitmap_cache, &bitmap_cache->cells[id].info[index]);
+			bitmap_cache_lru_push(bitmap_cache, &bitmap_cache->cells[id].info[index]);
+		}
 	}
-	else if (index > bitmap_cache->cells[id].number)
+	else
 	{
-		printf("get invalid bitmap index %d in cell id: %d\n", index, id);
-		return NULL;
+		bitmap_cache->stats.misses++;
+		bitmap = bitmap_cache_restore(bitmap_cache, id, index);
 	}
 
-	bitmap = bitmap_cache->cells[id].entries[index];
-
 	return bitmap;
 }
 
+/**
+ * Store a bitmap at a cache index. The bitmap previously stored there is
+ * freed, along with the data it could be decoded from.
+ */
+
 void bitmap_cache_put(rdpBitmapCache* bitmap_cache, uint32 id, uint32 index, rdpBitmap* bitmap)
 {
-	if (id > bitmap_cache->maxCells)
+	if (!bitmap_cache_check_index(bitmap_cache, id, &index, "put"))
 	{
-		printf("put invalid bitmap cell id: %d\n", id);
+		if (bitmap != NULL)
+			Bitmap_Free(bitmap_cache->context, bitmap);
+
 		return;
 	}
 
-	if (index == BITMAP_CACHE_WAITING_LIST_INDEX)
+	bitmap_cache->uses++;
+
+	bitmap_cache_delete(bitmap_cache, id, index);
+
+	if (!bitmap_cache_attach(bitmap_cache, id, index, bitmap))
 	{
-		index = bitmap_cache->cells[id].number;
+		Bitmap_Free(bitmap_cache->context, bitmap);
+		return;
 	}
-	else if (index > bitmap_cache->cells[id].number)
+
+	bitmap_cache_trim(bitmap_cache, bitmap);
+}
+
+/**
+ * Free the decoded bitmaps which can be decoded again, and the tables of the
+ * cells which are left holding nothing.
+ */
+
+void bitmap_cache_release(rdpBitmapCache* bitmap_cache)
+{
+	int i, j;
+	boolean empty;
+	BITMAP_V2_CELL* cell;
+
+	for (i = 0; i < (int) bitmap_cache->maxCells; i++)
 	{
-		printf("put invalid bitmap index %d in cell id: %d\n", index, id);
-		return;
+		cell = &bitmap_cache->cells[i];
+
+		if (cell->entries == NULL)
+			continue;
+
+		empty = true;
+
+		for (j = 0; j < (int) cell->number + 1; j++)
+		{
+			if (cell->entries[j] != NULL && bitmap_cache_can_restore(bitmap_cache, i, j))
+			{
+				bitmap_cache_evict(bitmap_cache, i, j);
+				bitmap_cache->stats.evictions++;
+			}
+
+			if (cell->entries[j] != NULL || (cell->info != NULL && cell->info[j].data != NULL))
+				empty = false;
+		}
+
+		if (empty)
+			bitmap_cache_free_cell(bitmap_cache, i);
 	}
+}
 
-	bitmap_cache->cells[id].entries[index] = bitmap;
+/**
+ * Free all the bitmaps along with the tables of the cells. The persistent
+ * cache is left as it is.
+ */
+
+void bitmap_cache_reset(rdpBitmapCache* bitmap_cache)
+{
+	int i, j;
+	BITMAP_V2_CELL* cell;
+
+	for (i = 0; i < (int) bitmap_cache->maxCells; i++)
+	{
+		cell = &bitmap_cache->cells[i];
+
+		if (cell->entries == NULL)
+			continue;
+
+		for (j = 0; j < (int) cell->number + 1; j++)
+		{
+			if (cell->entries[j] != NULL)
+				Bitmap_Free(bitmap_cache->context, cell->entries[j]);
+
+			if (cell->info != NULL)
+				xfree(cell->info[j].data);
+		}
+
+		bitmap_cache_free_cell(bitmap_cache, i);
+	}
+
+	cache_budget_release(bitmap_cache->budget, bitmap_cache->stats.bytes);
+
+	bitmap_cache->stats.entries = 0;
+	bitmap_cache->stats.bytes = 0;
+	bitmap_cache->lru_head = NULL;
+	bitmap_cache->lru_tail = NULL;
+}
+
+void bitmap_cache_get_stats(rdpBitmapCache* bitmap_cache, CACHE_STATS* stats)
+{
+	memcpy(stats, &bitmap_cache->stats, sizeof(CACHE_STATS));
+	stats->limit = bitmap_cache->limit;
 }
 
 void bitmap_cache_register_callbacks(rdpUpdate* update)
@@ -293,14 +718,22 @@ rdpBitmapCache* bitmap_cache_new(rdpSettings* settings)
 		settings->bitmapCacheV2CellInfo[4].numEntries = 2048;
 		settings->bitmapCacheV2CellInfo[4].persistent = false;
 
+		if (settings->bitmap_cache_persist_enabled)
+		{
+			for (i = 0; i < (int) settings->bitmapCacheV2NumCells; i++)
+				settings->bitmapCacheV2CellInfo[i].persistent = true;
+
+			bitmap_cache->persistent = persistent_cache_new(settings);
+		}
+
+		bitmap_cache->limit = (uint64) settings->bitmap_cache_budget * 1024;
+		bitmap_cache->budget = settings->cache_budget;
+		cache_budget_join(bitmap_cache->budget);
+
 		bitmap_cache->cells = (BITMAP_V2_CELL*) xzalloc(sizeof(BITMAP_V2_CELL) * bitmap_cache->maxCells);
 
 		for (i = 0; i < (int) bitmap_cache->maxCells; i++)
-		{
 			bitmap_cache->cells[i].number = settings->bitmapCacheV2CellInfo[i].numEntries;
-			/* allocate an extra entry for BITMAP_CACHE_WAITING_LIST_INDEX */
-			bitmap_cache->cells[i].entries = (rdpBitmap**) xzalloc(sizeof(rdpBitmap*) * (bitmap_cache->cells[i].number + 1));
-		}
 	}
 
 	return bitmap_cache;
@@ -308,29 +741,16 @@ rdpBitmapCache* bitmap_cache_new(rdpSettings* settings)
 
 void bitmap_cache_free(rdpBitmapCache* bitmap_cache)
 {
-	int i, j;
-	rdpBitmap* bitmap;
-
 	if (bitmap_cache != NULL)
 	{
-		for (i = 0; i < (int) bitmap_cache->maxCells; i++)
-		{
-			for (j = 0; j < (int) bitmap_cache->cells[i].number + 1; j++)
-			{
-				bitmap = bitmap_cache->cells[i].entries[j];
-
-				if (bitmap != NULL)
-				{
-					Bitmap_Free(bitmap_cache->context, bitmap);
-				}
-			}
-
-			xfree(bitmap_cache->cells[i].entries);
-		}
+		bitmap_cache_reset(bitmap_cache);
 
 		if (bitmap_cache->bitmap != NULL)
 			Bitmap_Free(bitmap_cache->context, bitmap_cache->bitmap);
 
+		persistent_cache_free(bitmap_cache->persistent);
+		cache_budget_leave(bitmap_cache->budget);
+
 		xfree(bitmap_cache->cells);
 		xfree(bitmap_cache);
 	}
@@ -28,6 +28,56 @@
 
 #include <freerdp/cache/brush.h>
 
+/**
+ * The brush tables are allocated when the first brush of their kind is
+ * cached, since many sessions never send any.
+ */
+
+static BRUSH_ENTRY* brush_cache_table(rdpBrushCache* brush, uint32 bpp)
+{
+	if (bpp == 1)
+	{
+		if (brush->monoEntries == NULL)
+			brush->monoEntries = (BRUSH_ENTRY*) xzalloc(sizeof(BRUSH_ENTRY) * brush->maxMonoEntries);
+
+		return brush->monoEntries;
+	}
+
+	if (brush->entries == NULL)
+		brush->entries = (BRUSH_ENTRY*) xzalloc(sizeof(BRUSH_ENTRY) * brush->maxEntries);
+
+	return brush->entries;
+}
+
+static boolean brush_cache_table_empty(BRUSH_ENTRY* entries, uint32 count)
+{
+	int i;
+
+	for (i = 0; i < (int) count; i++)
+	{
+		if (entries[i].entry != NULL)
+			return false;
+	}
+
+	return true;
+}
+
+static void brush_cache_table_free(BRUSH_ENTRY* entries, uint32 count)
+{
+	int i;
+
+	if (entries == NULL)
+		return;
+
+	for (i = 0; i < (int) count; i++)
+	{
+		if (entries[i].entry != NULL)
+			xfree(entries[i].entry);
+	}
+
+	xfree(entries);
+}
+
 void update_gdi_patblt(rdpContext* context, PATBLT_ORDER* patblt)
 {
 	uint8 style;
@@ -78,7 +128,9 @@ void update_gdi_cache_brush(rdpContext* context, CACHE_BRUSH_ORDER* cache_brush)
 
 void* brush_cache_get(rdpBrushCache* brush, uint32 index, uint32* bpp)
 {
-	void* entry;
+	void* entry = NULL;
+
+	brush->uses++;
 
 	if (*bpp == 1)
 	{
@@ -88,8 +140,11 @@ void* brush_cache_get(rdpBrushCache* brush, uint32 index, uint32* bpp)
 			return NULL;
 		}
 
-		*bpp = brush->monoEntries[index].bpp;
-		entry = brush->monoEntries[index].entry;
+		if (brush->monoEntries != NULL)
+		{
+			*bpp = brush->monoEntries[index].bpp;
+			entry = brush->monoEntries[index].entry;
+		}
 	}
 	else
 	{
@@ -99,8 +154,11 @@ void* brush_cache_get(rdpBrushCache* brush, uint32 index, uint32* bpp)
 			return NULL;
 		}
 
-		*bpp = brush->entries[index].bpp;
-		entry = brush->entries[index].entry;
+		if (brush->entries != NULL)
+		{
+			*bpp = brush->entries[index].bpp;
+			entry = brush->entries[index].entry;
+		}
 	}
 
 	if (entry == NULL)
@@ -115,39 +173,60 @@ void* brush_cache_get(rdpBrushCache* brush, uint32 index, uint32* bpp)
 void brush_cache_put(rdpBrushCache* brush, uint32 index, void* entry, uint32 bpp)
 {
 	void* prevEntry;
+	BRUSH_ENTRY* entries;
 
-	if (bpp == 1)
+	brush->uses++;
+
+	if (index >= ((bpp == 1) ? brush->maxMonoEntries : brush->maxEntries))
 	{
-		if (index >= brush->maxMonoEntries)
-		{
-			printf("invalid brush (%d bpp) index: 0x%04X\n", bpp, index);
-			return;
-		}
+		printf("invalid brush (%d bpp) index: 0x%04X\n", bpp, index);
+		return;
+	}
+
+	entries = brush_cache_table(brush, bpp);
 
-		prevEntry = brush->monoEntries[index].entry;
+	if (entries == NULL)
+		return;
 
-		if (prevEntry != NULL)
-			xfree(prevEntry);
+	prevEntry = entries[index].entry;
 
-		brush->monoEntries[index].bpp = bpp;
-		brush->monoEntries[index].entry = entry;
+	if (prevEntry != NULL)
+		xfree(prevEntry);
+
+	entries[index].bpp = bpp;
+	entries[index].entry = entry;
+}
+
+/**
+ * Free the brush tables which hold no brush.
+ */
+
+void brush_cache_release(rdpBrushCache* brush)
+{
+	if (brush->entries != NULL && brush_cache_table_empty(brush->entries, brush->maxEntries))
+	{
+		xfree(brush->entries);
+		brush->entries = NULL;
 	}
-	else
+
+	if (brush->monoEntries != NULL && brush_cache_table_empty(brush->monoEntries, brush->maxMonoEntries))
 	{
-		if (index >= brush->maxEntries)
-		{
-			printf("invalid brush (%d bpp) index: 0x%04X\n", bpp, index);
-			return;
-		}
+		xfree(brush->monoEntries);
+		brush->monoEntries = NULL;
+	}
+}
 
-		prevEntry = brush->entries[index].entry;
+/**
+ * Free all the cached brushes along with their tables.
+ */
 
-		if (prevEntry != NULL)
-			xfree(prevEntry);
+void brush_cache_reset(rdpBrushCache* brush)
+{
+	brush_cache_table_free(brush->entries, brush->maxEntries);
+	brush_cache_table_free(brush->monoEntries, brush->maxMonoEntries);
 
-		brush->entries[index].bpp = bpp;
-		brush->entries[index].entry = entry;
-	}
+	brush->entries = NULL;
+	brush->monoEntries = NULL;
 }
 
 void brush_cache_register_callbacks(rdpUpdate* update)
@@ -176,9 +255,6 @@ rdpBrushCache* brush_cache_new(rdpSettings* settings)
 
 		brush->maxEntries = 64;
 		brush->maxMonoEntries = 64;
-
-		brush->entries = (BRUSH_ENTRY*) xzalloc(sizeof(BRUSH_ENTRY) * brush->maxEntries);
-		brush->monoEntries = (BRUSH_ENTRY*) xzalloc(sizeof(BRUSH_ENTRY) * brush->maxMonoEntries);
 	}
 
 	return brush;
@@ -186,32 +262,9 @@ rdpBrushCache* brush_cache_new(rdpSettings* settings)
 
 void brush_cache_free(rdpBrushCache* brush)
 {
-	int i;
-
 	if (brush != NULL)
 	{
-		if (brush->entries != NULL)
-		{
-			for (i = 0; i < (int) brush->maxEntries; i++)
-			{
-				if (brush->entries[i].entry != NULL)
-					xfree(brush->entries[i].entry);
-			}
-
-			xfree(brush->entries);
-		}
-
-		if (brush->monoEntries != NULL)
-		{
-			for (i = 0; i < (int) brush->maxMonoEntries; i++)
-			{
-				if (brush->monoEntries[i].entry != NULL)
-					xfree(brush->monoEntries[i].entry);
-			}
-
-			xfree(brush->monoEntries);
-		}
-
+		brush_cache_reset(brush);
 		xfree(brush);
 	}
 }
@@ -0,0 +1,128 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Cache Memory Budget
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <freerdp/utils/memory.h>
+
+#include <freerdp/cache/budget.h>
+
+void cache_budget_charge(rdpCacheBudget* budget, uint64 bytes)
+{
+	if (budget == NULL)
+		return;
+
+	freerdp_mutex_lock(budget->mutex);
+	budget->used += bytes;
+	freerdp_mutex_unlock(budget->mutex);
+}
+
+void cache_budget_release(rdpCacheBudget* budget, uint64 bytes)
+{
+	if (budget == NULL)
+		return;
+
+	freerdp_mutex_lock(budget->mutex);
+	budget->used = (budget->used > bytes) ? budget->used - bytes : 0;
+	freerdp_mutex_unlock(budget->mutex);
+}
+
+void cache_budget_join(rdpCacheBudget* budget)
+{
+	if (budget == NULL)
+		return;
+
+	freerdp_mutex_lock(budget->mutex);
+	budget->sessions++;
+	freerdp_mutex_unlock(budget->mutex);
+}
+
+void cache_budget_leave(rdpCacheBudget* budget)
+{
+	if (budget == NULL)
+		return;
+
+	freerdp_mutex_lock(budget->mutex);
+
+	if (budget->sessions > 0)
+		budget->sessions--;
+
+	freerdp_mutex_unlock(budget->mutex);
+}
+
+/**
+ * Whether a session holding bytes has to give some back: the budget is
+ * exceeded and the session holds more than its share of it. A session
+ * within its share keeps its bitmaps even if others cannot evict theirs.
+ */
+
+boolean cache_budget_over_share(rdpCacheBudget* budget, uint64 bytes)
+{
+	boolean over;
+
+	if (budget == NULL || budget->limit == 0)
+		return false;
+
+	freerdp_mutex_lock(budget->mutex);
+	over = (budget->used > budget->limit && bytes > budget->limit / MAX(budget->sessions, 1)) ? true : false;
+	freerdp_mutex_unlock(budget->mutex);
+
+	return over;
+}
+
+uint64 cache_budget_get_used(rdpCacheBudget* budget)
+{
+	uint64 used;
+
+	freerdp_mutex_lock(budget->mutex);
+	used = budget->used;
+	freerdp_mutex_unlock(budget->mutex);
+
+	return used;
+}
+
+/**
+ * Create a budget shared by several sessions.
+ * @param limit number of bytes above which cached bitmaps are evicted,
+ * 0 to only count them
+ */
+
+rdpCacheBudget* cache_budget_new(uint64 limit)
+{
+	rdpCacheBudget* budget;
+
+	budget = xnew(rdpCacheBudget);
+
+	if (budget != NULL)
+	{
+		budget->limit = limit;
+		budget->mutex = freerdp_mutex_new();
+	}
+
+	return budget;
+}
+
+void cache_budget_free(rdpCacheBudget* budget)
+{
+	if (budget != NULL)
+	{
+		freerdp_mutex_free(budget->mutex);
+		xfree(budget);
+	}
+}
@@ -26,8 +26,100 @@
 
 #include <freerdp/cache/cache.h>
 
+/**
+ * The caches allocate their tables when the server first stores something
+ * in them, so that sessions using only surface commands do not pay for the
+ * caches of drawing orders. A cache left unused for cache_idle_timeout
+ * seconds gives back what it can: the tables holding nothing, and the
+ * bitmaps which can be decoded again.
+ */
+
+static boolean cache_idle(CACHE_IDLE* idle, uint32 uses, time_t now, uint32 timeout)
+{
+	if (idle->uses != uses)
+	{
+		idle->uses = uses;
+		idle->since = now;
+		return false;
+	}
+
+	if (now - idle->since < (time_t) timeout)
+		return false;
+
+	/* count the next period from now on */
+	idle->since = now;
+
+	return true;
+}
+
+void cache_check_idle(rdpCache* cache)
+{
+	time_t now;
+	uint32 timeout;
+
+	timeout = cache->settings->cache_idle_timeout;
+
+	if (timeout == 0)
+		return;
+
+	now = time(NULL);
+
+	if (cache_idle(&cache->glyph_idle, cache->glyph->uses, now, timeout))
+		glyph_cache_release(cache->glyph);
+
+	if (cache_idle(&cache->brush_idle, cache->brush->uses, now, timeout))
+		brush_cache_release(cache->brush);
+
+	if (cache_idle(&cache->pointer_idle, cache->pointer->uses, now, timeout))
+		pointer_cache_release(cache->pointer);
+
+	if (cache_idle(&cache->bitmap_idle, cache->bitmap->uses, now, timeout))
+		bitmap_cache_release(cache->bitmap);
+
+	if (cache_idle(&cache->offscreen_idle, cache->offscreen->uses, now, timeout))
+		offscreen_cache_release(cache->offscreen);
+
+	if (cache_idle(&cache->palette_idle, cache->palette->uses, now, timeout))
+		palette_cache_release(cache->palette);
+
+	if (cache_idle(&cache->nine_grid_idle, cache->nine_grid->uses, now, timeout))
+		nine_grid_cache_release(cache->nine_grid);
+}
+
+/**
+ * Free everything the caches hold, as when the server no longer refers to
+ * any of it. The tables are allocated again on first use.
+ */
+
+void cache_reset(rdpCache* cache)
+{
+	glyph_cache_reset(cache->glyph);
+	brush_cache_reset(cache->brush);
+	pointer_cache_reset(cache->pointer);
+	bitmap_cache_reset(cache->bitmap);
+	offscreen_cache_reset(cache->offscreen);
+	palette_cache_reset(cache->palette);
+	nine_grid_cache_reset(cache->nine_grid);
+}
+
+static void update_gdi_reset_state(rdpContext* context)
+{
+	cache_reset(context->cache);
+}
+
+/**
+ * The server forgets what the caches hold when it deactivates and
+ * reactivates the session, so they start empty with each activation.
+ */
+
+void cache_register_callbacks(rdpUpdate* update)
+{
+	update->ResetState = update_gdi_reset_state;
+}
+
 rdpCache* cache_new(rdpSettings* settings)
 {
+	time_t now;
 	rdpCache* cache;
 
 	cache = (rdpCache*) xzalloc(sizeof(rdpCache));
@@ -42,6 +134,15 @@ rdpCache* cache_new(rdpSettings* settings)
 		cache->offscreen = offscreen_cache_new(settings);
 		cache->palette = palette_cache_new(settings);
 		cache->nine_grid = nine_grid_cache_new(settings);
+
+		now = time(NULL);
+		cache->glyph_idle.since = now;
+		cache->brush_idle.since = now;
+		cache->pointer_idle.since = now;
+		cache->bitmap_idle.since = now;
+		cache->offscreen_idle.since = now;
+		cache->palette_idle.since = now;
+		cache->nine_grid_idle.since = now;
 	}
 
 	return cache;
@@ -27,6 +27,71 @@
 
 #include <freerdp/cache/glyph.h>
 
+/**
+ * Glyphs are held as received, one bit per pixel, and decoded to about one
+ * byte per pixel.
+ */
+
+#define GLYPH_DECODED_RATIO	9
+
+static uint32 glyph_cache_glyph_size(rdpGlyph* glyph)
+{
+	return glyph->cb + glyph->cx * glyph->cy;
+}
+
+static void glyph_cache_free_glyph(rdpGlyphCache* glyph_cache, rdpGlyph* glyph)
+{
+	Glyph_Free(glyph_cache->context, glyph);
+	xfree(glyph->aj);
+	xfree(glyph);
+}
+
+static boolean glyph_cache_cell_empty(GLYPH_CACHE* cell)
+{
+	int i;
+
+	for (i = 0; i < (int) cell->number; i++)
+	{
+		if (cell->entries[i] != NULL)
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Glyphs cannot be decoded again once evicted, since the server only sends
+ * them once, so the glyph cache is kept within its budget by scaling down the
+ * number of entries of each cell announced in the glyph cache capability set.
+ */
+
+static void glyph_cache_apply_budget(rdpSettings* settings)
+{
+	int i;
+	uint64 total;
+	uint64 budget;
+	uint32 entries;
+
+	budget = (uint64) settings->glyph_cache_budget * 1024;
+
+	if (budget == 0)
+		return;
+
+	total = 0;
+
+	for (i = 0; i < 10; i++)
+		total += (uint64) settings->glyphCache[i].cacheEntries * settings->glyphCache[i].cacheMaximumCellSize * GLYPH_DECODED_RATIO;
+
+	if (total <= budget)
+		return;
+
+	for (i = 0; i < 10; i++)
+	{
+		entries = (uint32) ((settings->glyphCache[i].cacheEntries * budget) / total);
+		settings->glyphCache[i].cacheEntries = MAX(entries, 1);
+	}
+}
+
 void update_process_glyph(rdpContext* context, uint8* data, int* index,
 		int* x, int* y, uint32 cacheId, uint32 ulCharInc, uint32 flAccel)
 {
@@ -366,18 +431,28 @@ rdpGlyph* glyph_cache_get(rdpGlyphCache* glyph_cache, uint32 id, uint32 index)
 		return NULL;
 	}
 
-	if (index > glyph_cache->glyphCache[id].number)
+	if (index >= glyph_cache->glyphCache[id].number)
 	{
 		printf("invalid glyph cache index: %d in cache id: %d\n", index, id);
 		return NULL;
 	}
 
-	glyph = glyph_cache->glyphCache[id].entries[index];
+	glyph_cache->uses++;
+
+	if (glyph_cache->glyphCache[id].entries != NULL)
+		glyph = glyph_cache->glyphCache[id].entries[index];
+	else
+		glyph = NULL;
 
 	if (glyph == NULL)
 	{
+		glyph_cache->stats.misses++;
 		printf("invalid glyph at cache index: %d in cache id: %d\n", index, id);
 	}
+	else
+	{
+		glyph_cache->stats.hits++;
+	}
 
 	return glyph;
 }
@@ -392,30 +467,57 @@ void glyph_cache_put(rdpGlyphCache* glyph_cache, uint32 id, uint32 index, rdpGly
 		return;
 	}
 
-	if (index > glyph_cache->glyphCache[id].number)
+	if (index >= glyph_cache->glyphCache[id].number)
 	{
 		printf("invalid glyph cache index: %d in cache id: %d\n", index, id);
 		return;
 	}
 
+	glyph_cache->uses++;
+
+	/* the table of a cell is allocated when the first glyph is stored in it */
+	if (glyph_cache->glyphCache[id].entries == NULL)
+		glyph_cache->glyphCache[id].entries = (rdpGlyph**) xzalloc(sizeof(rdpGlyph*) * glyph_cache->glyphCache[id].number);
+
+	if (glyph_cache->glyphCache[id].entries == NULL)
+		return;
+
 	prevGlyph = glyph_cache->glyphCache[id].entries[index];
 
+	if (glyph != NULL)
+	{
+		glyph_cache->stats.entries++;
+		glyph_cache->stats.bytes += glyph_cache_glyph_size(glyph);
+	}
+
 	if (prevGlyph != NULL)
 	{
-		Glyph_Free(glyph_cache->context, prevGlyph);
-		xfree(prevGlyph->aj);
-		xfree(prevGlyph);
+		glyph_cache->stats.entries--;
+		glyph_cache->stats.bytes -= glyph_cache_glyph_size(prevGlyph);
+
+		glyph_cache_free_glyph(glyph_cache, prevGlyph);
 	}
 
 	glyph_cache->glyphCache[id].entries[index] = glyph;
 }
 
+void glyph_cache_get_stats(rdpGlyphCache* glyph_cache, CACHE_STATS* stats)
+{
+	memcpy(stats, &glyph_cache->stats, sizeof(CACHE_STATS));
+	stats->limit = (uint64) glyph_cache->settings->glyph_cache_budget * 1024;
+}
+
 void* glyph_cache_fragment_get(rdpGlyphCache* glyph_cache, uint32 index, uint32* size)
 {
-	void* fragment;
+	void* fragment = NULL;
 
-	fragment = glyph_cache->fragCache.entries[index].fragment;
-	*size = (uint8) glyph_cache->fragCache.entries[index].size;
+	glyph_cache->uses++;
+
+	if (glyph_cache->fragCache.entries != NULL)
+	{
+		fragment = glyph_cache->fragCache.entries[index].fragment;
+		*size = (uint8) glyph_cache->fragCache.entries[index].size;
+	}
 
 	if (fragment == NULL)
 	{
@@ -429,6 +531,14 @@ void glyph_cache_fragment_put(rdpGlyphCache* glyph_cache, uint32 index, uint32 s
 {
 	void* prevFragment;
 
+	glyph_cache->uses++;
+
+	if (glyph_cache->fragCache.entries == NULL)
+		glyph_cache->fragCache.entries = (FRAGMENT_CACHE_ENTRY*) xzalloc(sizeof(FRAGMENT_CACHE_ENTRY) * 256);
+
+	if (glyph_cache->fragCache.entries == NULL)
+		return;
+
 	prevFragment = glyph_cache->fragCache.entries[index].fragment;
 
 	glyph_cache->fragCache.entries[index].fragment = fragment;
@@ -440,6 +550,76 @@ void glyph_cache_fragment_put(rdpGlyphCache* glyph_cache, uint32 index, uint32 s
 	}
 }
 
+/**
+ * Free the tables of the glyph cells and of the fragment cache which hold
+ * nothing.
+ */
+
+void glyph_cache_release(rdpGlyphCache* glyph_cache)
+{
+	int i;
+
+	for (i = 0; i < 10; i++)
+	{
+		if (glyph_cache->glyphCache[i].entries != NULL && glyph_cache_cell_empty(&glyph_cache->glyphCache[i]))
+		{
+			xfree(glyph_cache->glyphCache[i].entries);
+			glyph_cache->glyphCache[i].entries = NULL;
+		}
+	}
+
+	if (glyph_cache->fragCache.entries != NULL)
+	{
+		for (i = 0; i < 256; i++)
+		{
+			if (glyph_cache->fragCache.entries[i].fragment != NULL)
+				return;
+		}
+
+		xfree(glyph_cache->fragCache.entries);
+		glyph_cache->fragCache.entries = NULL;
+	}
+}
+
+/**
+ * Free all the glyphs and fragments along with their tables.
+ */
+
+void glyph_cache_reset(rdpGlyphCache* glyph_cache)
+{
+	int i, j;
+	rdpGlyph* glyph;
+
+	for (i = 0; i < 10; i++)
+	{
+		if (glyph_cache->glyphCache[i].entries == NULL)
+			continue;
+
+		for (j = 0; j < (int) glyph_cache->glyphCache[i].number; j++)
+		{
+			glyph = glyph_cache->glyphCache[i].entries[j];
+
+			if (glyph != NULL)
+				glyph_cache_free_glyph(glyph_cache, glyph);
+		}
+
+		xfree(glyph_cache->glyphCache[i].entries);
+		glyph_cache->glyphCache[i].entries = NULL;
+	}
+
+	glyph_cache->stats.entries = 0;
+	glyph_cache->stats.bytes = 0;
+
+	if (glyph_cache->fragCache.entries != NULL)
+	{
+		for (i = 0; i < 256; i++)
+			xfree(glyph_cache->fragCache.entries[i].fragment);
+
+		xfree(glyph_cache->fragCache.entries);
+		glyph_cache->fragCache.entries = NULL;
+	}
+}
+
 void glyph_cache_register_callbacks(rdpUpdate* update)
 {
 	update->primary->GlyphIndex = update_gdi_glyph_index;
@@ -465,14 +645,13 @@ rdpGlyphCache* glyph_cache_new(rdpSettings* settings)
 		if (settings->glyph_cache)
 			settings->glyphSupportLevel = GLYPH_SUPPORT_FULL;
 
+		glyph_cache_apply_budget(settings);
+
 		for (i = 0; i < 10; i++)
 		{
 			glyph->glyphCache[i].number = settings->glyphCache[i].cacheEntries;
 			glyph->glyphCache[i].maxCellSize = settings->glyphCache[i].cacheMaximumCellSize;
-			glyph->glyphCache[i].entries = (rdpGlyph**) xzalloc(sizeof(rdpGlyph*) * glyph->glyphCache[i].number);
 		}
-
-		glyph->fragCache.entries = xzalloc(sizeof(FRAGMENT_CACHE_ENTRY) * 256);
 	}
 
 	return glyph;
@@ -482,36 +661,7 @@ void glyph_cache_free(rdpGlyphCache* glyph_cache)
 {
 	if (glyph_cache != NULL)
 	{
-		int i;
-		void* fragment;
-
-		for (i = 0; i < 10; i++)
-		{
-			int j;
-
-			for (j = 0; j < (int) glyph_cache->glyphCache[i].number; j++)
-			{
-				rdpGlyph* glyph;
-
-				glyph = glyph_cache->glyphCache[i].entries[j];
-
-				if (glyph != NULL)
-				{
-					Glyph_Free(glyph_cache->context, glyph);
-					xfree(glyph->aj);
-					xfree(glyph);
-				}
-			}
-			xfree(glyph_cache->glyphCache[i].entries);
-		}
-
-		for (i = 0; i < 255; i++)
-		{
-			fragment = glyph_cache->fragCache.entries[i].fragment;
-			xfree(fragment);
-		}
-
-		xfree(glyph_cache->fragCache.entries);
+		glyph_cache_reset(glyph_cache);
 		xfree(glyph_cache);
 	}
 }
@@ -53,7 +53,9 @@ void nine_grid_cache_register_callbacks(rdpUpdate* update)
 
 void* nine_grid_cache_get(rdpNineGridCache* nine_grid, uint32 index)
 {
-	void* entry;
+	void* entry = NULL;
+
+	nine_grid->uses++;
 
 	if (index >= nine_grid->maxEntries)
 	{
@@ -61,7 +63,8 @@ void* nine_grid_cache_get(rdpNineGridCache* nine_grid, uint32 index)
 		return NULL;
 	}
 
-	entry = nine_grid->entries[index].entry;
+	if (nine_grid->entries != NULL)
+		entry = nine_grid->entries[index].entry;
 
 	if (entry == NULL)
 	{
@@ -82,6 +85,15 @@ void nine_grid_cache_put(rdpNineGridCache* nine_grid, uint32 index, void* entry)
 		return;
 	}
 
+	nine_grid->uses++;
+
+	/* the table is allocated when the first NineGrid is cached */
+	if (nine_grid->entries == NULL)
+		nine_grid->entries = (NINE_GRID_ENTRY*) xzalloc(sizeof(NINE_GRID_ENTRY) * nine_grid->maxEntries);
+
+	if (nine_grid->entries == NULL)
+		return;
+
 	prevEntry = nine_grid->entries[index].entry;
 
 	if (prevEntry != NULL)
@@ -90,6 +102,44 @@ void nine_grid_cache_put(rdpNineGridCache* nine_grid, uint32 index, void* entry)
 	nine_grid->entries[index].entry = entry;
 }
 
+/**
+ * Free the NineGrid cache if it holds no NineGrid.
+ */
+
+void nine_grid_cache_release(rdpNineGridCache* nine_grid)
+{
+	int i;
+
+	if (nine_grid->entries == NULL)
+		return;
+
+	for (i = 0; i < (int) nine_grid->maxEntries; i++)
+	{
+		if (nine_grid->entries[i].entry != NULL)
+			return;
+	}
+
+	xfree(nine_grid->entries);
+	nine_grid->entries = NULL;
+}
+
+void nine_grid_cache_reset(rdpNineGridCache* nine_grid)
+{
+	int i;
+
+	if (nine_grid->entries != NULL)
+	{
+		for (i = 0; i < (int) nine_grid->maxEntries; i++)
+		{
+			if (nine_grid->entries[i].entry != NULL)
+				xfree(nine_grid->entries[i].entry);
+		}
+
+		xfree(nine_grid->entries);
+		nine_grid->entries = NULL;
+	}
+}
+
 rdpNineGridCache* nine_grid_cache_new(rdpSettings* settings)
 {
 	rdpNineGridCache* nine_grid;
@@ -105,8 +155,6 @@ rdpNineGridCache* nine_grid_cache_new(rdpSettings* settings)
 
 		nine_grid->settings->draw_nine_grid_cache_size = nine_grid->maxSize;
 		nine_grid->settings->draw_nine_grid_cache_entries = nine_grid->maxEntries;
-
-		nine_grid->entries = (NINE_GRID_ENTRY*) xzalloc(sizeof(NINE_GRID_ENTRY) * nine_grid->maxEntries);
 	}
 
 	return nine_grid;
@@ -114,21 +162,9 @@ rdpNineGridCache* nine_grid_cache_new(rdpSettings* settings)
 
 void nine_grid_cache_free(rdpNineGridCache* nine_grid)
 {
-	int i;
-
 	if (nine_grid != NULL)
 	{
-		if (nine_grid->entries != NULL)
-		{
-			for (i = 0; i < (int) nine_grid->maxEntries; i++)
-			{
-				if (nine_grid->entries[i].entry != NULL)
-					xfree(nine_grid->entries[i].entry);
-			}
-
-			xfree(nine_grid->entries);
-		}
-
+		nine_grid_cache_reset(nine_grid);
 		xfree(nine_grid);
 	}
 }
@@ -26,6 +26,18 @@
 
 #include <freerdp/cache/offscreen.h>
 
+/**
+ * Offscreen bitmaps are drawn to by the server and cannot be decoded again,
+ * so none of them is ever evicted: their budget is the size of the offscreen
+ * bitmap cache announced to the server, which keeps within it. They are not
+ * charged to the shared cache budget, which only evictable bitmaps can meet.
+ */
+
+static uint32 offscreen_cache_bitmap_size(rdpOffscreenCache* offscreen_cache, rdpBitmap* bitmap)
+{
+	return bitmap->width * bitmap->height * ((offscreen_cache->settings->color_depth + 7) / 8);
+}
+
 void update_gdi_create_offscreen_bitmap(rdpContext* context, CREATE_OFFSCREEN_BITMAP_ORDER* create_offscreen_bitmap)
 {
 	int i;
@@ -81,14 +93,19 @@ rdpBitmap* offscreen_cache_get(rdpOffscreenCache* offscreen_cache, uint32 index)
 		return NULL;
 	}
 
-	bitmap = offscreen_cache->entries[index];
+	offscreen_cache->uses++;
+
+	bitmap = (offscreen_cache->entries != NULL) ? offscreen_cache->entries[index] : NULL;
 
 	if (bitmap == NULL)
 	{
+		offscreen_cache->stats.misses++;
 		printf("invalid offscreen bitmap at index: 0x%04X\n", index);
 		return NULL;
 	}
 
+	offscreen_cache->stats.hits++;
+
 	return bitmap;
 }
 
@@ -100,8 +117,23 @@ void offscreen_cache_put(rdpOffscreenCache* offscreen, uint32 index, rdpBitmap*
 		return;
 	}
 
+	offscreen->uses++;
+
+	/* the table is allocated when the first offscreen bitmap is created */
+	if (offscreen->entries == NULL)
+		offscreen->entries = (rdpBitmap**) xzalloc(sizeof(rdpBitmap*) * offscreen->maxEntries);
+
+	if (offscreen->entries == NULL)
+		return;
+
 	offscreen_cache_delete(offscreen, index);
 	offscreen->entries[index] = bitmap;
+
+	if (bitmap != NULL)
+	{
+		offscreen->stats.entries++;
+		offscreen->stats.bytes += offscreen_cache_bitmap_size(offscreen, bitmap);
+	}
 }
 
 void offscreen_cache_delete(rdpOffscreenCache* offscreen, uint32 index)
@@ -114,14 +146,80 @@ void offscreen_cache_delete(rdpOffscreenCache* offscreen, uint32 index)
 		return;
 	}
 
+	if (offscreen->entries == NULL)
+		return;
+
 	prevBitmap = offscreen->entries[index];
 
 	if (prevBitmap != NULL)
+	{
+		offscreen->stats.entries--;
+		offscreen->stats.bytes -= offscreen_cache_bitmap_size(offscreen, prevBitmap);
+
 		Bitmap_Free(offscreen->update->context, prevBitmap);
+	}
 
 	offscreen->entries[index] = NULL;
 }
 
+/**
+ * Free the offscreen bitmap table if it holds no bitmap.
+ */
+
+void offscreen_cache_release(rdpOffscreenCache* offscreen)
+{
+	if (offscreen->entries != NULL && offscreen->stats.entries == 0)
+	{
+		xfree(offscreen->entries);
+		offscreen->entries = NULL;
+	}
+}
+
+static void offscreen_cache_free_entries(rdpOffscreenCache* offscreen)
+{
+	int i;
+	rdpBitmap* bitmap;
+
+	if (offscreen->entries == NULL)
+		return;
+
+	for (i = 0; i < (int) offscreen->maxEntries; i++)
+	{
+		bitmap = offscreen->entries[i];
+
+		if (bitmap != NULL)
+			Bitmap_Free(offscreen->update->context, bitmap);
+	}
+
+	offscreen->stats.entries = 0;
+	offscreen->stats.bytes = 0;
+
+	xfree(offscreen->entries);
+	offscreen->entries = NULL;
+}
+
+/**
+ * Free all the offscreen bitmaps along with their table, drawing to the
+ * screen again if an offscreen bitmap was the current surface.
+ */
+
+void offscreen_cache_reset(rdpOffscreenCache* offscreen)
+{
+	if (offscreen->currentSurface != SCREEN_BITMAP_SURFACE)
+	{
+		Bitmap_SetSurface(offscreen->update->context, NULL, true);
+		offscreen->currentSurface = SCREEN_BITMAP_SURFACE;
+	}
+
+	offscreen_cache_free_entries(offscreen);
+}
+
+void offscreen_cache_get_stats(rdpOffscreenCache* offscreen_cache, CACHE_STATS* stats)
+{
+	memcpy(stats, &offscreen_cache->stats, sizeof(CACHE_STATS));
+	stats->limit = (uint64) offscreen_cache->maxSize * 1024;
+}
+
 void offscreen_cache_register_callbacks(rdpUpdate* update)
 {
 	update->altsec->CreateOffscreenBitmap = update_gdi_create_offscreen_bitmap;
@@ -143,10 +241,11 @@ rdpOffscreenCache* offscreen_cache_new(rdpSettings* settings)
 		offscreen_cache->maxSize = 7680;
 		offscreen_cache->maxEntries = 2000;
 
+		if (settings->offscreen_bitmap_cache_budget > 0)
+			offscreen_cache->maxSize = MIN(offscreen_cache->maxSize, settings->offscreen_bitmap_cache_budget);
+
 		settings->offscreen_bitmap_cache_size = offscreen_cache->maxSize;
 		settings->offscreen_bitmap_cache_entries = offscreen_cache->maxEntries;
-
-		offscreen_cache->entries = (rdpBitmap**) xzalloc(sizeof(rdpBitmap*) * offscreen_cache->maxEntries);
 	}
 
 	return offscreen_cache;
@@ -154,20 +253,9 @@ rdpOffscreenCache* offscreen_cache_new(rdpSettings* settings)
 
 void offscreen_cache_free(rdpOffscreenCache* offscreen_cache)
 {
-	int i;
-	rdpBitmap* bitmap;
-
 	if (offscreen_cache != NULL)
 	{
-		for (i = 0; i < (int) offscreen_cache->maxEntries; i++)
-		{
-			bitmap = offscreen_cache->entries[i];
-
-			if (bitmap != NULL)
-				Bitmap_Free(offscreen_cache->update->context, bitmap);
-		}
-
-		xfree(offscreen_cache->entries);
+		offscreen_cache_free_entries(offscreen_cache);
 		xfree(offscreen_cache);
 	}
 }
@@ -34,7 +34,9 @@ void update_gdi_cache_color_table(rdpContext* context, CACHE_COLOR_TABLE_ORDER*
 
 void* palette_cache_get(rdpPaletteCache* palette_cache, uint32 index)
 {
-	void* entry;
+	void* entry = NULL;
+
+	palette_cache->uses++;
 
 	if (index >= palette_cache->maxEntries)
 	{
@@ -42,7 +44,8 @@ void* palette_cache_get(rdpPaletteCache* palette_cache, uint32 index)
 		return NULL;
 	}
 
-	entry = palette_cache->entries[index].entry;
+	if (palette_cache->entries != NULL)
+		entry = palette_cache->entries[index].entry;
 
 	if (entry == NULL)
 	{
@@ -61,7 +64,40 @@ void palette_cache_put(rdpPaletteCache* palette_cache, uint32 index, void* entry
 		return;
 	}
 
-	palette_cache->entries[index].entry = entry;
+	palette_cache->uses++;
+
+	/* the table is allocated when the first color table is cached */
+	if (palette_cache->entries == NULL)
+		palette_cache->entries = (PALETTE_TABLE_ENTRY*) xzalloc(sizeof(PALETTE_TABLE_ENTRY) * palette_cache->maxEntries);
+
+	if (palette_cache->entries != NULL)
+		palette_cache->entries[index].entry = entry;
+}
+
+/**
+ * Free the color table cache if it holds no color table.
+ */
+
+void palette_cache_release(rdpPaletteCache* palette_cache)
+{
+	int i;
+
+	if (palette_cache->entries == NULL)
+		return;
+
+	for (i = 0; i < (int) palette_cache->maxEntries; i++)
+	{
+		if (palette_cache->entries[i].entry != NULL)
+			return;
+	}
+
+	palette_cache_reset(palette_cache);
+}
+
+void palette_cache_reset(rdpPaletteCache* palette_cache)
+{
+	xfree(palette_cache->entries);
+	palette_cache->entries = NULL;
 }
 
 void palette_cache_register_callbacks(rdpUpdate* update)
@@ -79,7 +115,6 @@ rdpPaletteCache* palette_cache_new(rdpSettings* settings)
 	{
 		palette_cache->settings = settings;
 		palette_cache->maxEntries = 6;
-		palette_cache->entries = (PALETTE_TABLE_ENTRY*) xzalloc(sizeof(PALETTE_TABLE_ENTRY) * palette_cache->maxEntries);
 	}
 
 	return palette_cache;
@@ -0,0 +1,481 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Persistent Bitmap Cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include <freerdp/utils/file.h>
+#include <freerdp/utils/stream.h>
+#include <freerdp/utils/memory.h>
+
+#include <freerdp/cache/persistent.h>
+
+static const char persistent_cache_dir[] = "bmpcache";
+
+#define PERSISTENT_CACHE_SIGNATURE	0x434D4246 /* "FBMC" */
+#define PERSISTENT_CACHE_VERSION	1
+
+#define PERSISTENT_CACHE_HEADER_LENGTH	12
+#define PERSISTENT_CACHE_RECORD_LENGTH	24
+
+/**
+ * File layout, in little endian:
+ *
+ * signature (4 bytes), version (4 bytes), numCells (4 bytes)
+ * numEntries of each cell (4 bytes each)
+ * one record per entry, cell after cell, in cache index order:
+ *   key1 (4 bytes), key2 (4 bytes), width (2 bytes), height (2 bytes),
+ *   bpp (1 byte), compressed (1 byte), pad (2 bytes), length (4 bytes),
+ *   offset of the bitmap data from the start of the file (4 bytes)
+ * bitmap data, as received in the CacheBitmapV2 orders
+ */
+
+static boolean persistent_cache_is_mapped(rdpPersistentCache* persistent_cache, uint8* data)
+{
+	if (persistent_cache->map == NULL)
+		return false;
+
+	return ((data >= persistent_cache->map) && (data < persistent_cache->map + persistent_cache->mapSize));
+}
+
+static void persistent_cache_clear_entry(rdpPersistentCache* persistent_cache, PERSISTENT_CACHE_ENTRY* entry)
+{
+	if (entry->data != NULL && !persistent_cache_is_mapped(persistent_cache, entry->data))
+		xfree(entry->data);
+
+	memset(entry, 0, sizeof(PERSISTENT_CACHE_ENTRY));
+}
+
+PERSISTENT_CACHE_ENTRY* persistent_cache_get(rdpPersistentCache* persistent_cache, uint32 id, uint32 index)
+{
+	PERSISTENT_CACHE_ENTRY* entry;
+
+	if (id >= persistent_cache->maxCells || index >= persistent_cache->cells[id].number)
+		return NULL;
+
+	entry = &persistent_cache->cells[id].entries[index];
+
+	return (entry->data != NULL) ? entry : NULL;
+}
+
+/**
+ * Store a bitmap in a persistent cell, replacing the one at the same index.
+ * The bitmap data is copied. A NULL entry only removes the bitmap in place.
+ */
+
+void persistent_cache_put(rdpPersistentCache* persistent_cache, uint32 id, uint32 index, PERSISTENT_CACHE_ENTRY* entry)
+{
+	PERSISTENT_CACHE_ENTRY* cached;
+
+	if (id >= persistent_cache->maxCells || index >= persistent_cache->cells[id].number)
+		return;
+
+	cached = &persistent_cache->cells[id].entries[index];
+	persistent_cache_clear_entry(persistent_cache, cached);
+
+	if (entry == NULL || entry->data == NULL || entry->length < 1)
+		return;
+
+	memcpy(cached, entry, sizeof(PERSISTENT_CACHE_ENTRY));
+	cached->data = (uint8*) xmalloc(entry->length);
+	memcpy(cached->data, entry->data, entry->length);
+}
+
+static void persistent_cache_unmap(rdpPersistentCache* persistent_cache)
+{
+	if (persistent_cache->map == NULL)
+		return;
+
+#ifndef _WIN32
+	munmap(persistent_cache->map, persistent_cache->mapSize);
+#else
+	xfree(persistent_cache->map);
+#endif
+
+	persistent_cache->map = NULL;
+	persistent_cache->mapSize = 0;
+}
+
+static boolean persistent_cache_map(rdpPersistentCache* persistent_cache)
+{
+#ifndef _WIN32
+	int fd;
+	void* map;
+	struct stat stat_info;
+
+	fd = open(persistent_cache->file, O_RDONLY);
+
+	if (fd < 0)
+		return false;
+
+	if (fstat(fd, &stat_info) != 0 || stat_info.st_size < PERSISTENT_CACHE_HEADER_LENGTH)
+	{
+		close(fd);
+		return false;
+	}
+
+	map = mmap(NULL, stat_info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED)
+		return false;
+
+	persistent_cache->map = (uint8*) map;
+	persistent_cache->mapSize = (uint32) stat_info.st_size;
+#else
+	FILE* fp;
+	long size;
+
+	fp = fopen(persistent_cache->file, "rb");
+
+	if (fp == NULL)
+		return false;
+
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	if (size < PERSISTENT_CACHE_HEADER_LENGTH)
+	{
+		fclose(fp);
+		return false;
+	}
+
+	persistent_cache->map = (uint8*) xmalloc(size);
+	persistent_cache->mapSize = (uint32) size;
+
+	if (fread(persistent_cache->map, size, 1, fp) != 1)
+	{
+		fclose(fp);
+		persistent_cache_unmap(persistent_cache);
+		return false;
+	}
+
+	fclose(fp);
+#endif
+
+	return true;
+}
+
+/**
+ * Map the cache file and index the bitmaps it holds. Only the records are
+ * read, the bitmap data is left in the mapping until the server uses it.
+ */
+
+boolean persistent_cache_load(rdpPersistentCache* persistent_cache)
+{
+	uint32 i, j;
+	STREAM _s, *s;
+	uint32 offset;
+	uint32 version;
+	uint32 numCells;
+	uint32 signature;
+	uint32 numEntries[5];
+	PERSISTENT_CACHE_ENTRY entry;
+
+	if (!persistent_cache_map(persistent_cache))
+		return false;
+
+	s = &_s;
+	s->p = s->data = persistent_cache->map;
+	s->size = persistent_cache->mapSize;
+
+	stream_read_uint32(s, signature); /* signature (4 bytes) */
+	stream_read_uint32(s, version); /* version (4 bytes) */
+	stream_read_uint32(s, numCells); /* numCells (4 bytes) */
+
+	if (signature != PERSISTENT_CACHE_SIGNATURE || version != PERSISTENT_CACHE_VERSION ||
+			numCells > 5 || stream_get_left(s) < (int) (numCells * 4))
+	{
+		printf("persistent_cache_load: invalid cache file %s\n", persistent_cache->file);
+		persistent_cache_unmap(persistent_cache);
+		return false;
+	}
+
+	for (i = 0; i < numCells; i++)
+		stream_read_uint32(s, numEntries[i]); /* numEntries (4 bytes) */
+
+	for (i = 0; i < numCells; i++)
+	{
+		for (j = 0; j < numEntries[i]; j++)
+		{
+			if (stream_get_left(s) < PERSISTENT_CACHE_RECORD_LENGTH)
+				return true;
+
+			stream_read_uint32(s, entry.key1); /* key1 (4 bytes) */
+			stream_read_uint32(s, entry.key2); /* key2 (4 bytes) */
+			stream_read_uint16(s, entry.width); /* width (2 bytes) */
+			stream_read_uint16(s, entry.height); /* height (2 bytes) */
+			stream_read_uint8(s, entry.bpp); /* bpp (1 byte) */
+			stream_read_uint8(s, entry.compressed); /* compressed (1 byte) */
+			stream_seek_uint16(s); /* pad (2 bytes) */
+			stream_read_uint32(s, entry.length); /* length (4 bytes) */
+			stream_read_uint32(s, offset); /* offset (4 bytes) */
+
+			if (entry.length < 1 || offset >= persistent_cache->mapSize || entry.length > persistent_cache->mapSize - offset)
+				continue;
+
+			if (i >= persistent_cache->maxCells || j >= persistent_cache->cells[i].number)
+				continue;
+
+			entry.data = &persistent_cache->map[offset];
+			memcpy(&persistent_cache->cells[i].entries[j], &entry, sizeof(PERSISTENT_CACHE_ENTRY));
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Write the cache file, compacting the entries of each cell to its first
+ * indices. The file is written aside and renamed, as the current one may
+ * still be mapped.
+ */
+
+boolean persistent_cache_save(rdpPersistentCache* persistent_cache)
+{
+	FILE* fp;
+	STREAM* s;
+	char* file;
+	uint32 i, j;
+	uint32 offset;
+	uint32 numEntries[5];
+	PERSISTENT_CACHE_ENTRY* entry;
+
+	offset = PERSISTENT_CACHE_HEADER_LENGTH + persistent_cache->maxCells * 4;
+
+	for (i = 0; i < persistent_cache->maxCells; i++)
+	{
+		numEntries[i] = 0;
+
+		for (j = 0; j < persistent_cache->cells[i].number; j++)
+		{
+			if (persistent_cache->cells[i].entries[j].data != NULL)
+				numEntries[i]++;
+		}
+
+		offset += numEntries[i] * PERSISTENT_CACHE_RECORD_LENGTH;
+	}
+
+	s = stream_new(offset);
+
+	stream_write_uint32(s, PERSISTENT_CACHE_SIGNATURE); /* signature (4 bytes) */
+	stream_write_uint32(s, PERSISTENT_CACHE_VERSION); /* version (4 bytes) */
+	stream_write_uint32(s, persistent_cache->maxCells); /* numCells (4 bytes) */
+
+	for (i = 0; i < persistent_cache->maxCells; i++)
+		stream_write_uint32(s, numEntries[i]); /* numEntries (4 bytes) */
+
+	for (i = 0; i < persistent_cache->maxCells; i++)
+	{
+		for (j = 0; j < persistent_cache->cells[i].number; j++)
+		{
+			entry = &persistent_cache->cells[i].entries[j];
+
+			if (entry->data == NULL)
+				continue;
+
+			stream_write_uint32(s, entry->key1); /* key1 (4 bytes) */
+			stream_write_uint32(s, entry->key2); /* key2 (4 bytes) */
+			stream_write_uint16(s, entry->width); /* width (2 bytes) */
+			stream_write_uint16(s, entry->height); /* height (2 bytes) */
+			stream_write_uint8(s, entry->bpp); /* bpp (1 byte) */
+			stream_write_uint8(s, entry->compressed ? 1 : 0); /* compressed (1 byte) */
+			stream_write_uint16(s, 0); /* pad (2 bytes) */
+			stream_write_uint32(s, entry->length); /* length (4 bytes) */
+			stream_write_uint32(s, offset); /* offset (4 bytes) */
+
+			offset += entry->length;
+		}
+	}
+
+	file = (char*) xmalloc(strlen(persistent_cache->file) + 5);
+	sprintf(file, "%s.tmp", persistent_cache->file);
+
+	fp = fopen(file, "wb");
+
+	if (fp == NULL)
+	{
+		printf("persistent_cache_save: error opening [%s] for writing\n", file);
+		stream_free(s);
+		xfree(file);
+		return false;
+	}
+
+	fwrite(stream_get_head(s), stream_get_length(s), 1, fp);
+	stream_free(s);
+
+	for (i = 0; i < persistent_cache->maxCells; i++)
+	{
+		for (j = 0; j < persistent_cache->cells[i].number; j++)
+		{
+			entry = &persistent_cache->cells[i].entries[j];
+
+			if (entry->data != NULL)
+				fwrite(entry->data, entry->length, 1, fp);
+		}
+	}
+
+	fclose(fp);
+
+#ifdef _WIN32
+	remove(persistent_cache->file);
+#endif
+
+	if (rename(file, persistent_cache->file) != 0)
+	{
+		printf("persistent_cache_save: error renaming [%s]\n", file);
+		remove(file);
+		xfree(file);
+		return false;
+	}
+
+	xfree(file);
+
+	return true;
+}
+
+static char* persistent_cache_get_file(rdpSettings* settings)
+{
+	char* file;
+	char* name;
+	char* path;
+
+	if (settings->bitmap_cache_persist_file != NULL)
+		return xstrdup(settings->bitmap_cache_persist_file);
+
+	path = freerdp_construct_path(freerdp_get_config_path(settings), (char*) persistent_cache_dir);
+
+	if (freerdp_check_file_exists(path) == false)
+		freerdp_mkdir(path);
+
+	name = (char*) xmalloc(strlen(settings->hostname) + 16);
+	sprintf(name, "%s_%u.bmc", settings->hostname, settings->port);
+
+	file = freerdp_construct_path(path, name);
+
+	xfree(name);
+	xfree(path);
+
+	return file;
+}
+
+/**
+ * Announce the keys of the bitmaps available at the first indices of each
+ * cell, for the persistent key list PDU.
+ */
+
+static void persistent_cache_set_keys(rdpPersistentCache* persistent_cache)
+{
+	uint32 i, j;
+	PERSISTENT_CACHE_CELL* cell;
+	BITMAP_CACHE_V2_CELL_INFO* cellInfo;
+
+	for (i = 0; i < persistent_cache->maxCells; i++)
+	{
+		cell = &persistent_cache->cells[i];
+		cellInfo = &persistent_cache->settings->bitmapCacheV2CellInfo[i];
+
+		for (j = 0; j < cell->number; j++)
+		{
+			if (cell->entries[j].data == NULL)
+				break;
+		}
+
+		cellInfo->numPersistentKeys = j;
+		cellInfo->persistentKeys = (j > 0) ? (uint64*) xmalloc(sizeof(uint64) * j) : NULL;
+
+		for (j = 0; j < cellInfo->numPersistentKeys; j++)
+		{
+			cellInfo->persistentKeys[j] = ((uint64) cell->entries[j].key2 << 32) | cell->entries[j].key1;
+		}
+	}
+}
+
+rdpPersistentCache* persistent_cache_new(rdpSettings* settings)
+{
+	uint32 i;
+	rdpPersistentCache* persistent_cache;
+
+	persistent_cache = (rdpPersistentCache*) xzalloc(sizeof(rdpPersistentCache));
+
+	if (persistent_cache != NULL)
+	{
+		persistent_cache->settings = settings;
+		persistent_cache->maxCells = MIN(settings->bitmapCacheV2NumCells, 5);
+		persistent_cache->cells = (PERSISTENT_CACHE_CELL*) xzalloc(sizeof(PERSISTENT_CACHE_CELL) * persistent_cache->maxCells);
+
+		for (i = 0; i < persistent_cache->maxCells; i++)
+		{
+			if (settings->bitmapCacheV2CellInfo[i].persistent != true)
+				continue;
+
+			persistent_cache->cells[i].number = settings->bitmapCacheV2CellInfo[i].numEntries;
+			persistent_cache->cells[i].entries = (PERSISTENT_CACHE_ENTRY*)
+				xzalloc(sizeof(PERSISTENT_CACHE_ENTRY) * persistent_cache->cells[i].number);
+		}
+
+		persistent_cache->file = persistent_cache_get_file(settings);
+
+		persistent_cache_load(persistent_cache);
+		persistent_cache_set_keys(persistent_cache);
+	}
+
+	return persistent_cache;
+}
+
+void persistent_cache_free(rdpPersistentCache* persistent_cache)
+{
+	uint32 i, j;
+	BITMAP_CACHE_V2_CELL_INFO* cellInfo;
+
+	if (persistent_cache != NULL)
+	{
+		persistent_cache_save(persistent_cache);
+
+		for (i = 0; i < persistent_cache->maxCells; i++)
+		{
+			for (j = 0; j < persistent_cache->cells[i].number; j++)
+				persistent_cache_clear_entry(persistent_cache, &persistent_cache->cells[i].entries[j]);
+
+			xfree(persistent_cache->cells[i].entries);
+
+			cellInfo = &persistent_cache->settings->bitmapCacheV2CellInfo[i];
+			xfree(cellInfo->persistentKeys);
+			cellInfo->persistentKeys = NULL;
+			cellInfo->numPersistentKeys = 0;
+		}
+
+		persistent_cache_unmap(persistent_cache);
+
+		xfree(persistent_cache->cells);
+		xfree(persistent_cache->file);
+		xfree(persistent_cache);
+	}
+}
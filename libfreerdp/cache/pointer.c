@@ -119,6 +119,11 @@ rdpPointer* pointer_cache_get(rdpPointerCache* pointer_cache, uint32 index)
 		return NULL;
 	}
 
+	pointer_cache->uses++;
+
+	if (pointer_cache->entries == NULL)
+		return NULL;
+
 	pointer = pointer_cache->entries[index];
 
 	return pointer;
@@ -134,6 +139,15 @@ void pointer_cache_put(rdpPointerCache* pointer_cache, uint32 index, rdpPointer*
 		return;
 	}
 
+	pointer_cache->uses++;
+
+	/* the table is allocated when the first pointer is cached */
+	if (pointer_cache->entries == NULL)
+		pointer_cache->entries = (rdpPointer**) xzalloc(sizeof(rdpPointer*) * pointer_cache->cacheSize);
+
+	if (pointer_cache->entries == NULL)
+		return;
+
 	prevPointer = pointer_cache->entries[index];
 
 	if (prevPointer != NULL)
@@ -142,6 +156,47 @@ void pointer_cache_put(rdpPointerCache* pointer_cache, uint32 index, rdpPointer*
 	pointer_cache->entries[index] = pointer;
 }
 
+/**
+ * Free the pointer cache if it holds no pointer.
+ */
+
+void pointer_cache_release(rdpPointerCache* pointer_cache)
+{
+	int i;
+
+	if (pointer_cache->entries == NULL)
+		return;
+
+	for (i = 0; i < (int) pointer_cache->cacheSize; i++)
+	{
+		if (pointer_cache->entries[i] != NULL)
+			return;
+	}
+
+	xfree(pointer_cache->entries);
+	pointer_cache->entries = NULL;
+}
+
+void pointer_cache_reset(rdpPointerCache* pointer_cache)
+{
+	int i;
+	rdpPointer* pointer;
+
+	if (pointer_cache->entries == NULL)
+		return;
+
+	for (i = 0; i < (int) pointer_cache->cacheSize; i++)
+	{
+		pointer = pointer_cache->entries[i];
+
+		if (pointer != NULL)
+			Pointer_Free(pointer_cache->update->context, pointer);
+	}
+
+	xfree(pointer_cache->entries);
+	pointer_cache->entries = NULL;
+}
+
 void pointer_cache_register_callbacks(rdpUpdate* update)
 {
 	rdpPointerUpdate* pointer = update->pointer;
@@ -164,7 +219,6 @@ rdpPointerCache* pointer_cache_new(rdpSettings* settings)
 		pointer_cache->settings = settings;
 		pointer_cache->cacheSize = settings->pointer_cache_size;
 		pointer_cache->update = ((freerdp*) settings->instance)->update;
-		pointer_cache->entries = (rdpPointer**) xzalloc(sizeof(rdpPointer*) * pointer_cache->cacheSize);
 	}
 
 	return pointer_cache;
@@ -174,18 +228,7 @@ void pointer_cache_free(rdpPointerCache* pointer_cache)
 {
 	if (pointer_cache != NULL)
 	{
-		int i;
-		rdpPointer* pointer;
-
-		for (i = 0; i < (int) pointer_cache->cacheSize; i++)
-		{
-			pointer = pointer_cache->entries[i];
-
-			if (pointer != NULL)
-				Pointer_Free(pointer_cache->update->context, pointer);
-		}
-
-		xfree(pointer_cache->entries);
+		pointer_cache_reset(pointer_cache);
 		xfree(pointer_cache);
 	}
 }
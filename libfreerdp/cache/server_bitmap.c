@@ -0,0 +1,426 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Server Bitmap Cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <freerdp/peer.h>
+#include <freerdp/constants.h>
+#include <freerdp/utils/stream.h>
+#include <freerdp/utils/memory.h>
+
+#include <freerdp/cache/server_bitmap.h>
+
+/**
+ * Clients read the orderLength of secondary orders as a signed 16-bit value:
+ * keep the bitmap data below 0x7FFF bytes, less room for the CacheBitmapV2/V3
+ * fields that orderLength also covers.
+ */
+#define SERVER_BITMAP_ORDER_OVERHEAD	32
+#define SERVER_BITMAP_MAX_LENGTH	(0x7FFF - SERVER_BITMAP_ORDER_OVERHEAD)
+
+static void server_bitmap_cache_hash(uint8* data, uint32 width, uint32 height,
+		uint32 scanline, uint32 bpp, uint32* key1, uint32* key2)
+{
+	uint32 x, y;
+	uint32 length;
+	uint32 h1, h2;
+	uint8* row;
+
+	length = width * ((bpp + 7) / 8);
+
+	h1 = 2166136261U ^ (width << 16) ^ height;
+	h2 = 5381 + bpp;
+
+	for (y = 0; y < height; y++)
+	{
+		row = &data[y * scanline];
+
+		for (x = 0; x < length; x++)
+		{
+			h1 = (h1 ^ row[x]) * 16777619U;
+			h2 = ((h2 << 5) + h2) ^ row[x];
+		}
+	}
+
+	*key1 = h1;
+	*key2 = h2;
+}
+
+static void server_bitmap_cache_unlink(rdpServerBitmapCache* cache, sint32 index)
+{
+	SERVER_BITMAP_ENTRY* entry = &cache->entries[index];
+	SERVER_BITMAP_CELL* cell = &cache->cells[entry->cacheId];
+
+	if (entry->lru_prev >= 0)
+		cache->entries[entry->lru_prev].lru_next = entry->lru_next;
+	else
+		cell->lru_head = entry->lru_next;
+
+	if (entry->lru_next >= 0)
+		cache->entries[entry->lru_next].lru_prev = entry->lru_prev;
+	else
+		cell->lru_tail = entry->lru_prev;
+}
+
+static void server_bitmap_cache_touch(rdpServerBitmapCache* cache, sint32 index)
+{
+	SERVER_BITMAP_ENTRY* entry = &cache->entries[index];
+	SERVER_BITMAP_CELL* cell = &cache->cells[entry->cacheId];
+
+	if (cell->lru_head == index)
+		return;
+
+	server_bitmap_cache_unlink(cache, index);
+
+	entry->lru_prev = -1;
+	entry->lru_next = cell->lru_head;
+
+	if (cell->lru_head >= 0)
+		cache->entries[cell->lru_head].lru_prev = index;
+	else
+		cell->lru_tail = index;
+
+	cell->lru_head = index;
+}
+
+static sint32 server_bitmap_cache_find(rdpServerBitmapCache* cache, uint32 key1, uint32 key2)
+{
+	sint32 index;
+
+	index = cache->buckets[key1 & cache->hashMask];
+
+	while (index >= 0)
+	{
+		if ((cache->entries[index].key1 == key1) && (cache->entries[index].key2 == key2))
+			return index;
+
+		index = cache->entries[index].next;
+	}
+
+	return -1;
+}
+
+static void server_bitmap_cache_remove(rdpServerBitmapCache* cache, sint32 index)
+{
+	sint32* link;
+	SERVER_BITMAP_ENTRY* entry = &cache->entries[index];
+
+	link = &cache->buckets[entry->key1 & cache->hashMask];
+
+	while (*link >= 0)
+	{
+		if (*link == index)
+		{
+			*link = entry->next;
+			break;
+		}
+
+		link = &cache->entries[*link].next;
+	}
+
+	entry->valid = false;
+}
+
+/**
+ * Take the least recently used entry of the cell for a new bitmap.
+ */
+
+static sint32 server_bitmap_cache_evict(rdpServerBitmapCache* cache, uint32 cacheId, uint32 key1, uint32 key2)
+{
+	sint32 index;
+	SERVER_BITMAP_ENTRY* entry;
+
+	index = cache->cells[cacheId].lru_tail;
+	entry = &cache->entries[index];
+
+	if (entry->valid)
+		server_bitmap_cache_remove(cache, index);
+
+	entry->key1 = key1;
+	entry->key2 = key2;
+	entry->valid = true;
+	entry->next = cache->buckets[key1 & cache->hashMask];
+	cache->buckets[key1 & cache->hashMask] = index;
+
+	server_bitmap_cache_touch(cache, index);
+
+	return index;
+}
+
+static sint32 server_bitmap_cache_select_cell(rdpServerBitmapCache* cache, uint32 width, uint32 height)
+{
+	uint32 i;
+
+	for (i = 0; i < cache->maxCells; i++)
+	{
+		if ((cache->cells[i].number > 0) && (width * height <= cache->cells[i].maxPixels))
+			return i;
+	}
+
+	return -1;
+}
+
+static void server_bitmap_cache_send_v2(rdpServerBitmapCache* cache, SERVER_BITMAP_ENTRY* entry,
+		uint8* data, uint32 width, uint32 height, uint32 scanline, uint32 bpp)
+{
+	uint32 y;
+	uint32 length;
+	uint32 bitmapWidth;
+	uint32 bitmapScanline;
+	CACHE_BITMAP_V2_ORDER cache_bitmap_v2;
+
+	/* rows of uncompressed bitmaps are padded to four pixels, bottom-up */
+	bitmapWidth = (width + 3) & ~3;
+	bitmapScanline = bitmapWidth * ((bpp + 7) / 8);
+	length = bitmapScanline * height;
+
+	if (length > cache->bufferSize)
+	{
+		cache->bufferSize = length;
+		cache->buffer = (uint8*) xrealloc(cache->buffer, cache->bufferSize);
+	}
+
+	for (y = 0; y < height; y++)
+	{
+		memcpy(&cache->buffer[(height - y - 1) * bitmapScanline], &data[y * scanline], width * ((bpp + 7) / 8));
+		memset(&cache->buffer[(height - y - 1) * bitmapScanline + width * ((bpp + 7) / 8)], 0,
+				bitmapScanline - width * ((bpp + 7) / 8));
+	}
+
+	memset(&cache_bitmap_v2, 0, sizeof(CACHE_BITMAP_V2_ORDER));
+	cache_bitmap_v2.cacheId = entry->cacheId;
+	cache_bitmap_v2.cacheIndex = entry->cacheIndex;
+	cache_bitmap_v2.bitmapBpp = bpp;
+	cache_bitmap_v2.bitmapWidth = bitmapWidth;
+	cache_bitmap_v2.bitmapHeight = height;
+	cache_bitmap_v2.bitmapLength = length;
+	cache_bitmap_v2.bitmapDataStream = cache->buffer;
+	cache_bitmap_v2.compressed = false;
+
+	if (bitmapWidth == height)
+		cache_bitmap_v2.flags |= CBR2_HEIGHT_SAME_AS_WIDTH;
+
+	if (cache->cells[entry->cacheId].persistent)
+	{
+		cache_bitmap_v2.flags |= CBR2_PERSISTENT_KEY_PRESENT;
+		cache_bitmap_v2.key1 = entry->key1;
+		cache_bitmap_v2.key2 = entry->key2;
+	}
+
+	IFCALL(cache->update->secondary->CacheBitmapV2, cache->context, &cache_bitmap_v2);
+}
+
+static boolean server_bitmap_cache_send_v3(rdpServerBitmapCache* cache, SERVER_BITMAP_ENTRY* entry,
+		uint8* data, uint32 width, uint32 height, uint32 scanline, uint32 bpp)
+{
+	CACHE_BITMAP_V3_ORDER cache_bitmap_v3;
+
+	stream_set_pos(cache->encoded, 0);
+
+	if (!cache->Encode(cache, data, width, height, scanline, bpp, cache->encoded))
+		return false;
+
+	if (stream_get_pos(cache->encoded) > SERVER_BITMAP_MAX_LENGTH)
+		return false;
+
+	memset(&cache_bitmap_v3, 0, sizeof(CACHE_BITMAP_V3_ORDER));
+	cache_bitmap_v3.cacheId = entry->cacheId;
+	cache_bitmap_v3.cacheIndex = entry->cacheIndex;
+	cache_bitmap_v3.bpp = bpp;
+	cache_bitmap_v3.key1 = entry->key1;
+	cache_bitmap_v3.key2 = entry->key2;
+	cache_bitmap_v3.bitmapData.bpp = bpp;
+	cache_bitmap_v3.bitmapData.codecID = cache->settings->v3_codec_id;
+	cache_bitmap_v3.bitmapData.width = width;
+	cache_bitmap_v3.bitmapData.height = height;
+	cache_bitmap_v3.bitmapData.length = stream_get_pos(cache->encoded);
+	cache_bitmap_v3.bitmapData.data = stream_get_head(cache->encoded);
+
+	IFCALL(cache->update->secondary->CacheBitmapV3, cache->context, &cache_bitmap_v3);
+
+	return true;
+}
+
+/**
+ * Draw a bitmap at (x, y) from the client bitmap cache, sending it to the
+ * cache first if the client does not hold it already. The data is read in
+ * the client color depth, top-down with the given scanline.
+ *
+ * Returns false when the bitmap cannot be cached, too large for any cell or
+ * with the client not supporting bitmap caching, and has to be sent in some
+ * other way.
+ */
+
+boolean server_bitmap_cache_draw(rdpServerBitmapCache* cache, sint32 x, sint32 y,
+		uint32 width, uint32 height, uint8* data, uint32 scanline, uint32 bpp)
+{
+	sint32 index;
+	sint32 cacheId;
+	uint32 key1, key2;
+	boolean use_v3;
+	MEMBLT_ORDER memblt;
+	SERVER_BITMAP_ENTRY* entry;
+
+	if (cache->numEntries < 1)
+		return false;
+
+	if (!cache->settings->order_support[NEG_MEMBLT_INDEX] && !cache->settings->order_support[NEG_MEMBLT_V2_INDEX])
+		return false;
+
+	if (((width + 3) & ~3) * height * ((bpp + 7) / 8) > SERVER_BITMAP_MAX_LENGTH)
+		return false;
+
+	cacheId = server_bitmap_cache_select_cell(cache, (width + 3) & ~3, height);
+
+	if (cacheId < 0)
+		return false;
+
+	server_bitmap_cache_hash(data, width, height, scanline, bpp, &key1, &key2);
+
+	index = server_bitmap_cache_find(cache, key1, key2);
+
+	if (index >= 0)
+	{
+		cache->hits++;
+		server_bitmap_cache_touch(cache, index);
+	}
+	else
+	{
+		cache->misses++;
+		index = server_bitmap_cache_evict(cache, cacheId, key1, key2);
+
+		entry = &cache->entries[index];
+		use_v3 = (cache->Encode != NULL) && cache->settings->bitmap_cache_v3;
+
+		if (!use_v3 || !server_bitmap_cache_send_v3(cache, entry, data, width, height, scanline, bpp))
+			server_bitmap_cache_send_v2(cache, entry, data, width, height, scanline, bpp);
+	}
+
+	entry = &cache->entries[index];
+
+	memset(&memblt, 0, sizeof(MEMBLT_ORDER));
+	memblt.cacheId = entry->cacheId;
+	memblt.cacheIndex = entry->cacheIndex;
+	memblt.nLeftRect = x;
+	memblt.nTopRect = y;
+	memblt.nWidth = width;
+	memblt.nHeight = height;
+	memblt.bRop = 0xCC; /* SRCCOPY */
+
+	IFCALL(cache->update->primary->MemBlt, cache->context, &memblt);
+
+	return true;
+}
+
+/**
+ * Forget everything sent so far and size the cells after the geometry the
+ * client announced, for a new client or after a reactivation.
+ */
+
+void server_bitmap_cache_reset(rdpServerBitmapCache* cache)
+{
+	uint32 i, j;
+	uint32 hashSize;
+	sint32 index;
+	rdpSettings* settings = cache->settings;
+
+	xfree(cache->cells);
+	xfree(cache->entries);
+	xfree(cache->buckets);
+
+	cache->maxCells = settings->bitmapCacheV2NumCells;
+	cache->cells = (SERVER_BITMAP_CELL*) xzalloc(sizeof(SERVER_BITMAP_CELL) * (cache->maxCells + 1));
+	cache->numEntries = 0;
+
+	for (i = 0; i < cache->maxCells; i++)
+	{
+		/* the cells hold up to 16x16, 32x32, 64x64, 128x128 and 256x256 pixels */
+		cache->cells[i].number = MIN(settings->bitmapCacheV2CellInfo[i].numEntries, BITMAP_CACHE_WAITING_LIST_INDEX);
+		cache->cells[i].maxPixels = 256 << (2 * i);
+		cache->cells[i].persistent = settings->bitmapCacheV2CellInfo[i].persistent;
+		cache->cells[i].first = cache->numEntries;
+		cache->numEntries += cache->cells[i].number;
+	}
+
+	for (hashSize = 64; hashSize < cache->numEntries * 2; hashSize <<= 1);
+
+	cache->hashMask = hashSize - 1;
+	cache->buckets = (sint32*) xmalloc(sizeof(sint32) * hashSize);
+	memset(cache->buckets, 0xFF, sizeof(sint32) * hashSize);
+
+	cache->entries = (SERVER_BITMAP_ENTRY*) xzalloc(sizeof(SERVER_BITMAP_ENTRY) * (cache->numEntries + 1));
+
+	for (i = 0; i < cache->maxCells; i++)
+	{
+		SERVER_BITMAP_CELL* cell = &cache->cells[i];
+
+		cell->lru_head = (cell->number > 0) ? cell->first : -1;
+		cell->lru_tail = (cell->number > 0) ? cell->first + cell->number - 1 : -1;
+
+		for (j = 0; j < cell->number; j++)
+		{
+			index = cell->first + j;
+
+			cache->entries[index].cacheId = i;
+			cache->entries[index].cacheIndex = j;
+			cache->entries[index].next = -1;
+			cache->entries[index].lru_prev = (j > 0) ? index - 1 : -1;
+			cache->entries[index].lru_next = (j + 1 < cell->number) ? index + 1 : -1;
+		}
+	}
+
+	cache->hits = 0;
+	cache->misses = 0;
+}
+
+rdpServerBitmapCache* server_bitmap_cache_new(rdpContext* context)
+{
+	rdpServerBitmapCache* cache;
+
+	cache = xnew(rdpServerBitmapCache);
+
+	if (cache != NULL)
+	{
+		cache->context = context;
+		cache->update = context->peer->update;
+		cache->settings = context->peer->settings;
+		cache->encoded = stream_new(4096);
+
+		server_bitmap_cache_reset(cache);
+	}
+
+	return cache;
+}
+
+void server_bitmap_cache_free(rdpServerBitmapCache* cache)
+{
+	if (cache != NULL)
+	{
+		xfree(cache->cells);
+		xfree(cache->entries);
+		xfree(cache->buckets);
+		xfree(cache->buffer);
+		stream_free(cache->encoded);
+		xfree(cache);
+	}
+}
@@ -0,0 +1,281 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Server Pointer Cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <freerdp/peer.h>
+#include <freerdp/utils/memory.h>
+
+#include <freerdp/cache/server_pointer.h>
+
+static void server_pointer_cache_hash_data(uint8* data, uint32 length, uint32* h1, uint32* h2)
+{
+	uint32 i;
+
+	for (i = 0; i < length; i++)
+	{
+		*h1 = (*h1 ^ data[i]) * 16777619U;
+		*h2 = ((*h2 << 5) + *h2) ^ data[i];
+	}
+}
+
+static void server_pointer_cache_hash(POINTER_NEW_UPDATE* pointer_new, uint32* key1, uint32* key2)
+{
+	POINTER_COLOR_UPDATE* pointer_color = &pointer_new->colorPtrAttr;
+
+	*key1 = 2166136261U ^ (pointer_color->width << 16) ^ pointer_color->height;
+	*key2 = 5381 + (pointer_new->xorBpp << 16) + (pointer_color->xPos << 8) + pointer_color->yPos;
+
+	server_pointer_cache_hash_data(pointer_color->xorMaskData, pointer_color->lengthXorMask, key1, key2);
+	server_pointer_cache_hash_data(pointer_color->andMaskData, pointer_color->lengthAndMask, key1, key2);
+}
+
+/**
+ * Convert a 32 bpp pointer shape to 24 bpp for a color pointer update, for
+ * clients without new pointer support. Pixels less than half opaque become
+ * transparent in the AND mask.
+ */
+
+static boolean server_pointer_cache_convert(rdpServerPointerCache* cache,
+		POINTER_NEW_UPDATE* pointer_new, POINTER_COLOR_UPDATE* pointer_color)
+{
+	uint32 x, y;
+	uint8* src;
+	uint8* dst;
+	uint8* mask;
+	uint32 length;
+	uint32 xorScanline;
+	uint32 andScanline;
+	POINTER_COLOR_UPDATE* attr = &pointer_new->colorPtrAttr;
+
+	if (pointer_new->xorBpp != 32)
+		return false;
+
+	if (attr->lengthXorMask < attr->width * 4 * attr->height)
+		return false;
+
+	/* rows of both masks are padded to 16 bits */
+	xorScanline = ((attr->width * 3) + 1) & ~1;
+	andScanline = ((attr->width + 15) / 16) * 2;
+	length = (xorScanline + andScanline) * attr->height;
+
+	if (length > cache->bufferSize)
+	{
+		cache->bufferSize = length;
+		cache->buffer = (uint8*) xrealloc(cache->buffer, cache->bufferSize);
+	}
+
+	memset(cache->buffer, 0, length);
+	mask = &cache->buffer[xorScanline * attr->height];
+
+	if (attr->lengthAndMask >= andScanline * attr->height)
+		memcpy(mask, attr->andMaskData, andScanline * attr->height);
+
+	for (y = 0; y < attr->height; y++)
+	{
+		src = &attr->xorMaskData[y * attr->width * 4];
+		dst = &cache->buffer[y * xorScanline];
+
+		for (x = 0; x < attr->width; x++)
+		{
+			if (src[3] < 0x80)
+			{
+				mask[y * andScanline + x / 8] |= (0x80 >> (x % 8));
+				dst += 3;
+			}
+			else
+			{
+				*dst++ = src[0];
+				*dst++ = src[1];
+				*dst++ = src[2];
+			}
+
+			src += 4;
+		}
+	}
+
+	memcpy(pointer_color, attr, sizeof(POINTER_COLOR_UPDATE));
+	pointer_color->lengthXorMask = xorScanline * attr->height;
+	pointer_color->xorMaskData = cache->buffer;
+	pointer_color->lengthAndMask = andScanline * attr->height;
+	pointer_color->andMaskData = mask;
+
+	return true;
+}
+
+/**
+ * Set the pointer shape of the client. The cacheIndex of the pointer is
+ * picked here. Shapes of 24 bpp go out as color pointer updates, the others
+ * as new pointer updates. Clients without new pointer support get 32 bpp
+ * shapes converted to color pointer updates, and the default system pointer
+ * for any other depth.
+ */
+
+void server_pointer_cache_set(rdpServerPointerCache* cache, POINTER_NEW_UPDATE* pointer_new)
+{
+	uint32 i;
+	sint32 index;
+	uint32 key1, key2;
+	boolean convert;
+	SERVER_POINTER_ENTRY* entry;
+	POINTER_COLOR_UPDATE pointer_color;
+	POINTER_CACHED_UPDATE pointer_cached;
+	rdpPointerUpdate* pointer = cache->update->pointer;
+
+	server_pointer_cache_hash(pointer_new, &key1, &key2);
+
+	index = -1;
+
+	for (i = 0; i < cache->cacheSize; i++)
+	{
+		entry = &cache->entries[i];
+
+		if (entry->valid && (entry->key1 == key1) && (entry->key2 == key2))
+		{
+			index = i;
+			break;
+		}
+	}
+
+	if (index >= 0)
+	{
+		cache->hits++;
+		cache->entries[index].stamp = ++cache->clock;
+
+		if (index == cache->current)
+			return;
+
+		pointer_cached.cacheIndex = index;
+		IFCALL(pointer->PointerCached, cache->context, &pointer_cached);
+	}
+	else
+	{
+		convert = (pointer_new->xorBpp != 24) && !cache->settings->new_pointer;
+
+		if (convert && !server_pointer_cache_convert(cache, pointer_new, &pointer_color))
+		{
+			server_pointer_cache_set_system(cache, SYSPTR_DEFAULT);
+			return;
+		}
+
+		cache->misses++;
+
+		/* take a free slot, or the least recently used one */
+		index = 0;
+
+		for (i = 0; i < cache->cacheSize; i++)
+		{
+			entry = &cache->entries[i];
+
+			if (!entry->valid)
+			{
+				index = i;
+				break;
+			}
+
+			if (entry->stamp < cache->entries[index].stamp)
+				index = i;
+		}
+
+		if (cache->cacheSize > 0)
+		{
+			entry = &cache->entries[index];
+			entry->key1 = key1;
+			entry->key2 = key2;
+			entry->valid = true;
+			entry->stamp = ++cache->clock;
+		}
+
+		pointer_new->colorPtrAttr.cacheIndex = index;
+		pointer_color.cacheIndex = index;
+
+		if (pointer_new->xorBpp == 24)
+			IFCALL(pointer->PointerColor, cache->context, &pointer_new->colorPtrAttr);
+		else if (convert)
+			IFCALL(pointer->PointerColor, cache->context, &pointer_color);
+		else
+			IFCALL(pointer->PointerNew, cache->context, pointer_new);
+	}
+
+	cache->current = index;
+}
+
+/**
+ * Set one of the system pointers, SYSPTR_NULL or SYSPTR_DEFAULT.
+ */
+
+void server_pointer_cache_set_system(rdpServerPointerCache* cache, uint32 type)
+{
+	POINTER_SYSTEM_UPDATE pointer_system;
+
+	pointer_system.type = type;
+	IFCALL(cache->update->pointer->PointerSystem, cache->context, &pointer_system);
+
+	cache->current = -1;
+}
+
+/**
+ * Forget the shapes sent so far and size the cache after the pointer
+ * capability set of the client, for a new client or after a reactivation.
+ */
+
+void server_pointer_cache_reset(rdpServerPointerCache* cache)
+{
+	xfree(cache->entries);
+
+	cache->cacheSize = cache->settings->pointer_cache_size;
+	cache->entries = (SERVER_POINTER_ENTRY*) xzalloc(sizeof(SERVER_POINTER_ENTRY) * (cache->cacheSize + 1));
+
+	cache->clock = 0;
+	cache->current = -1;
+	cache->hits = 0;
+	cache->misses = 0;
+}
+
+rdpServerPointerCache* server_pointer_cache_new(rdpContext* context)
+{
+	rdpServerPointerCache* cache;
+
+	cache = xnew(rdpServerPointerCache);
+
+	if (cache != NULL)
+	{
+		cache->context = context;
+		cache->update = context->peer->update;
+		cache->settings = context->peer->settings;
+
+		server_pointer_cache_reset(cache);
+	}
+
+	return cache;
+}
+
+void server_pointer_cache_free(rdpServerPointerCache* cache)
+{
+	if (cache != NULL)
+	{
+		xfree(cache->entries);
+		xfree(cache->buffer);
+		xfree(cache);
+	}
+}
@@ -779,8 +779,31 @@ static void rfx_compose_message_tile(RFX_CONTEXT* context, STREAM* s,
 	stream_set_pos(s, end_pos);
 }
 
+static boolean rfx_tile_in_rects(int x, int y, int width, int height,
+	const RFX_RECT* rects, int num_rects)
+{
+	int i;
+
+	if (rects == NULL || num_rects < 1)
+		return true;
+
+	for (i = 0; i < num_rects; i++)
+	{
+		if ((x < rects[i].x + rects[i].width) && (rects[i].x < x + width) &&
+			(y < rects[i].y + rects[i].height) && (rects[i].y < y + height))
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * Tiles outside of the region rectangles would be clipped away by the
+ * decoder, so only the tiles intersecting at least one of them are encoded.
+ */
+
 static void rfx_compose_message_tileset(RFX_CONTEXT* context, STREAM* s,
-	uint8* image_data, int width, int height, int rowstride)
+	const RFX_RECT* rects, int num_rects, uint8* image_data, int width, int height, int rowstride)
 {
 	int size;
 	int start_pos, end_pos;
@@ -796,6 +819,8 @@ static void rfx_compose_message_tileset(RFX_CONTEXT* context, STREAM* s,
 	int numTilesY;
 	int xIdx;
 	int yIdx;
+	int tileWidth;
+	int tileHeight;
 	int tilesDataSize;
 
 	if (context->num_quants == 0)
@@ -817,7 +842,6 @@ static void rfx_compose_message_tileset(RFX_CONTEXT* context, STREAM* s,
 
 	numTilesX = (width + 63) / 64;
 	numTilesY = (height + 63) / 64;
-	numTiles = numTilesX * numTilesY;
 
 	size = 22 + numQuants * 5;
 	stream_check_size(s, size);
@@ -832,7 +856,7 @@ static void rfx_compose_message_tileset(RFX_CONTEXT* context, STREAM* s,
 	stream_write_uint16(s, context->properties); /* properties */
 	stream_write_uint8(s, numQuants); /* numQuants */
 	stream_write_uint8(s, 0x40); /* tileSize */
-	stream_write_uint16(s, numTiles); /* numTiles */
+	stream_seek_uint16(s); /* set numTiles later */
 	stream_seek_uint32(s); /* set tilesDataSize later */
 
 	quantValsPtr = quantVals;
@@ -844,16 +868,24 @@ static void rfx_compose_message_tileset(RFX_CONTEXT* context, STREAM* s,
 
 	DEBUG_RFX("width:%d height:%d rowstride:%d", width, height, rowstride);
 
+	numTiles = 0;
 	end_pos = stream_get_pos(s);
 	for (yIdx = 0; yIdx < numTilesY; yIdx++)
 	{
 		for (xIdx = 0; xIdx < numTilesX; xIdx++)
 		{
+			tileWidth = (xIdx < numTilesX - 1) ? 64 : width - xIdx * 64;
+			tileHeight = (yIdx < numTilesY - 1) ? 64 : height - yIdx * 64;
+
+			if (!rfx_tile_in_rects(xIdx * 64, yIdx * 64, tileWidth, tileHeight, rects, num_rects))
+				continue;
+
 			rfx_compose_message_tile(context, s,
 				image_data + yIdx * 64 * rowstride + xIdx * 8 * context->bits_per_pixel,
-				(xIdx < numTilesX - 1) ? 64 : width - xIdx * 64,
-				(yIdx < numTilesY - 1) ? 64 : height - yIdx * 64,
+				tileWidth, tileHeight,
 				rowstride, quantVals, quantIdxY, quantIdxCb, quantIdxCr, xIdx, yIdx);
+
+			numTiles++;
 		}
 	}
 	tilesDataSize = stream_get_pos(s) - end_pos;
@@ -862,7 +894,8 @@ static void rfx_compose_message_tileset(RFX_CONTEXT* context, STREAM* s,
 
 	stream_set_pos(s, start_pos + 2);
 	stream_write_uint32(s, size); /* CodecChannelT.blockLen */
-	stream_set_pos(s, start_pos + 18);
+	stream_set_pos(s, start_pos + 16);
+	stream_write_uint16(s, numTiles); /* numTiles */
 	stream_write_uint32(s, tilesDataSize);
 
 	stream_set_pos(s, end_pos);
@@ -883,7 +916,7 @@ static void rfx_compose_message_data(RFX_CONTEXT* context, STREAM* s,
 {
 	rfx_compose_message_frame_begin(context, s);
 	rfx_compose_message_region(context, s, rects, num_rects);
-	rfx_compose_message_tileset(context, s, image_data, width, height, rowstride);
+	rfx_compose_message_tileset(context, s, rects, num_rects, image_data, width, height, rowstride);
 	rfx_compose_message_frame_end(context, s);
 }
 
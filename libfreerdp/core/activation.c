@@ -182,33 +182,102 @@ void rdp_write_persistent_list_entry(STREAM* s, uint32 key1, uint32 key2)
 	stream_write_uint32(s, key2); /* key2 (4 bytes) */
 }
 
-void rdp_write_client_persistent_key_list_pdu(STREAM* s, rdpSettings* settings)
+static uint32 rdp_get_persistent_key_count(rdpSettings* settings, int id)
 {
-	stream_write_uint16(s, 0); /* numEntriesCache0 (2 bytes) */
-	stream_write_uint16(s, 0); /* numEntriesCache1 (2 bytes) */
-	stream_write_uint16(s, 0); /* numEntriesCache2 (2 bytes) */
-	stream_write_uint16(s, 0); /* numEntriesCache3 (2 bytes) */
-	stream_write_uint16(s, 0); /* numEntriesCache4 (2 bytes) */
-	stream_write_uint16(s, 0); /* totalEntriesCache0 (2 bytes) */
-	stream_write_uint16(s, 0); /* totalEntriesCache1 (2 bytes) */
-	stream_write_uint16(s, 0); /* totalEntriesCache2 (2 bytes) */
-	stream_write_uint16(s, 0); /* totalEntriesCache3 (2 bytes) */
-	stream_write_uint16(s, 0); /* totalEntriesCache4 (2 bytes) */
-	stream_write_uint8(s, PERSIST_FIRST_PDU | PERSIST_LAST_PDU); /* bBitMask (1 byte) */
+	BITMAP_CACHE_V2_CELL_INFO* cellInfo;
+
+	if (!settings->persistent_bitmap_cache || id >= (int) settings->bitmapCacheV2NumCells)
+		return 0;
+
+	cellInfo = &settings->bitmapCacheV2CellInfo[id];
+
+	if (!cellInfo->persistent || cellInfo->persistentKeys == NULL)
+		return 0;
+
+	return MIN(cellInfo->numPersistentKeys, cellInfo->numEntries);
+}
+
+/**
+ * Write a Persistent Key List PDU.\n
+ * The keys of each cell are listed in cache index order, and split across
+ * several PDUs of at most PERSIST_MAX_KEYS_PER_PDU entries.
+ * @msdn{cc240495}
+ * @param s stream
+ * @param settings settings
+ * @param first index of the next key to write in each of the 5 cells,
+ * advanced past the keys written
+ * @return true if this is the last PDU of the list
+ */
+
+boolean rdp_write_client_persistent_key_list_pdu(STREAM* s, rdpSettings* settings, uint32* first)
+{
+	int i;
+	uint32 j;
+	uint64 key;
+	uint8 flags;
+	uint32 left;
+	uint32 count[5];
+	uint32 total[5];
+
+	flags = PERSIST_FIRST_PDU | PERSIST_LAST_PDU;
+	left = PERSIST_MAX_KEYS_PER_PDU;
+
+	for (i = 0; i < 5; i++)
+	{
+		total[i] = rdp_get_persistent_key_count(settings, i);
+		count[i] = MIN(total[i] - first[i], left);
+		left -= count[i];
+
+		if (first[i] > 0)
+			flags &= ~PERSIST_FIRST_PDU;
+
+		if (first[i] + count[i] < total[i])
+			flags &= ~PERSIST_LAST_PDU;
+	}
+
+	for (i = 0; i < 5; i++)
+		stream_write_uint16(s, count[i]); /* numEntriesCacheX (2 bytes) */
+
+	for (i = 0; i < 5; i++)
+		stream_write_uint16(s, total[i]); /* totalEntriesCacheX (2 bytes) */
+
+	stream_write_uint8(s, flags); /* bBitMask (1 byte) */
 	stream_write_uint8(s, 0); /* pad1 (1 byte) */
 	stream_write_uint16(s, 0); /* pad3 (2 bytes) */
 
 	/* entries */
+
+	for (i = 0; i < 5; i++)
+	{
+		for (j = 0; j < count[i]; j++)
+		{
+			key = settings->bitmapCacheV2CellInfo[i].persistentKeys[first[i] + j];
+			rdp_write_persistent_list_entry(s, (uint32) key, (uint32) (key >> 32));
+		}
+
+		first[i] += count[i];
+	}
+
+	return (flags & PERSIST_LAST_PDU) ? true : false;
 }
 
 boolean rdp_send_client_persistent_key_list_pdu(rdpRdp* rdp)
 {
 	STREAM* s;
+	boolean last;
+	uint32 first[5] = { 0, 0, 0, 0, 0 };
 
-	s = rdp_data_pdu_init(rdp);
-	rdp_write_client_persistent_key_list_pdu(s, rdp->settings);
+	do
+	{
+		s = rdp_data_pdu_init(rdp);
+		last = rdp_write_client_persistent_key_list_pdu(s, rdp->settings, first);
 
-	return rdp_send_data_pdu(rdp, s, DATA_PDU_TYPE_BITMAP_CACHE_PERSISTENT_LIST, rdp->mcs->user_id);
+		if (!rdp_send_data_pdu(rdp, s, DATA_PDU_TYPE_BITMAP_CACHE_PERSISTENT_LIST, rdp->mcs->user_id))
+			return false;
+	}
+	while (!last);
+
+	return true;
 }
 
 boolean rdp_recv_client_font_list_pdu(STREAM* s)
@@ -35,6 +35,8 @@
 #define PERSIST_FIRST_PDU		0x01
 #define PERSIST_LAST_PDU		0x02
 
+#define PERSIST_MAX_KEYS_PER_PDU	169
+
 #define FONTLIST_FIRST			0x0001
 #define FONTLIST_LAST			0x0002
 
@@ -51,6 +53,7 @@ boolean rdp_recv_server_control_pdu(rdpRdp* rdp, STREAM* s);
 boolean rdp_send_server_control_cooperate_pdu(rdpRdp* rdp);
 boolean rdp_send_server_control_granted_pdu(rdpRdp* rdp);
 boolean rdp_send_client_control_pdu(rdpRdp* rdp, uint16 action);
+boolean rdp_write_client_persistent_key_list_pdu(STREAM* s, rdpSettings* settings, uint32* first);
 boolean rdp_send_client_persistent_key_list_pdu(rdpRdp* rdp);
 boolean rdp_recv_client_font_list_pdu(STREAM* s);
 boolean rdp_send_client_font_list_pdu(rdpRdp* rdp, uint16 flags);
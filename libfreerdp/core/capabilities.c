@@ -312,6 +312,9 @@ void rdp_read_order_capability_set(STREAM* s, uint16 length, rdpSettings* settin
 		if (orderSupport[i] == false)
 			settings->order_support[i] = false;
 	}
+
+	if (settings->server_mode && !(orderSupportExFlags & CACHE_BITMAP_V3_SUPPORT))
+		settings->bitmap_cache_v3 = false;
 }
 
 /**
@@ -518,14 +521,20 @@ void rdp_read_pointer_capability_set(STREAM* s, uint16 length, rdpSettings* sett
 
 	stream_read_uint16(s, colorPointerFlag); /* colorPointerFlag (2 bytes) */
 	stream_read_uint16(s, colorPointerCacheSize); /* colorPointerCacheSize (2 bytes) */
-	stream_read_uint16(s, pointerCacheSize); /* pointerCacheSize (2 bytes) */
+
+	/* pointerCacheSize is absent when the client does not support new pointer updates */
+	if (length > 8)
+		stream_read_uint16(s, pointerCacheSize); /* pointerCacheSize (2 bytes) */
+	else
+		pointerCacheSize = 0;
 
 	if (colorPointerFlag == false)
 		settings->color_pointer = false;
 
 	if (settings->server_mode)
 	{
-		settings->pointer_cache_size = pointerCacheSize;
+		settings->new_pointer = (length > 8) ? true : false;
+		settings->pointer_cache_size = (pointerCacheSize > 0) ? pointerCacheSize : colorPointerCacheSize;
 	}
 }
 
@@ -986,16 +995,38 @@ void rdp_write_bitmap_cache_cell_info(STREAM* s, BITMAP_CACHE_V2_CELL_INFO* cell
  * @param settings settings
  */
 
+void rdp_read_bitmap_cache_cell_info(STREAM* s, BITMAP_CACHE_V2_CELL_INFO* cellInfo)
+{
+	uint32 info;
+
+	stream_read_uint32(s, info);
+	cellInfo->numEntries = (info & 0x7FFFFFFF);
+	cellInfo->persistent = (info & 0x80000000) ? true : false;
+}
+
 void rdp_read_bitmap_cache_v2_capability_set(STREAM* s, uint16 length, rdpSettings* settings)
 {
+	uint8 numCellCaches;
+
 	stream_seek_uint16(s); /* cacheFlags (2 bytes) */
 	stream_seek_uint8(s); /* pad2 (1 byte) */
-	stream_seek_uint8(s); /* numCellCaches (1 byte) */
-	stream_seek(s, 4); /* bitmapCache0CellInfo (4 bytes) */
-	stream_seek(s, 4); /* bitmapCache1CellInfo (4 bytes) */
-	stream_seek(s, 4); /* bitmapCache2CellInfo (4 bytes) */
-	stream_seek(s, 4); /* bitmapCache3CellInfo (4 bytes) */
-	stream_seek(s, 4); /* bitmapCache4CellInfo (4 bytes) */
+	stream_read_uint8(s, numCellCaches); /* numCellCaches (1 byte) */
+
+	if (settings->server_mode)
+	{
+		/* the geometry of the client caches, for the server to fill them */
+		settings->bitmapCacheV2NumCells = MIN(numCellCaches, 5);
+		rdp_read_bitmap_cache_cell_info(s, &settings->bitmapCacheV2CellInfo[0]); /* bitmapCache0CellInfo (4 bytes) */
+		rdp_read_bitmap_cache_cell_info(s, &settings->bitmapCacheV2CellInfo[1]); /* bitmapCache1CellInfo (4 bytes) */
+		rdp_read_bitmap_cache_cell_info(s, &settings->bitmapCacheV2CellInfo[2]); /* bitmapCache2CellInfo (4 bytes) */
+		rdp_read_bitmap_cache_cell_info(s, &settings->bitmapCacheV2CellInfo[3]); /* bitmapCache3CellInfo (4 bytes) */
+		rdp_read_bitmap_cache_cell_info(s, &settings->bitmapCacheV2CellInfo[4]); /* bitmapCache4CellInfo (4 bytes) */
+	}
+	else
+	{
+		stream_seek(s, 20); /* bitmapCache0CellInfo to bitmapCache4CellInfo (20 bytes) */
+	}
+
 	stream_seek(s, 12); /* pad3 (12 bytes) */
 }
 
@@ -1653,7 +1684,12 @@ void rdp_read_frame_acknowledge_capability_set(STREAM* s, uint16 length, rdpSett
 
 void rdp_read_bitmap_cache_v3_codec_id_capability_set(STREAM* s, uint16 length, rdpSettings* settings)
 {
-	stream_seek_uint8(s); /* (1 byte) */
+	uint8 codecId;
+
+	stream_read_uint8(s, codecId); /* (1 byte) */
+
+	if (settings->server_mode)
+		settings->v3_codec_id = codecId;
 }
 
 void rdp_write_bitmap_cache_v3_codec_id_capability_set(STREAM* s, rdpSettings* settings)
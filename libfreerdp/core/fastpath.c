@@ -47,6 +47,9 @@
 
 #define FASTPATH_MAX_PACKET_SIZE 0x3FFF
 
+/* a batch of orders is sent once it could not take the largest order anymore */
+#define FASTPATH_MAX_ORDERS_LENGTH (FASTPATH_MAX_PACKET_SIZE - 512)
+
 #ifdef WITH_DEBUG_RDP
 static const char* const FASTPATH_UPDATETYPE_STRINGS[] =
 {
@@ -521,12 +524,19 @@ boolean fastpath_recv_inputs(rdpFastPath* fastpath, STREAM* s)
 		stream_read_uint8(s, fastpath->numberEvents); /* eventHeader (1 byte) */
 	}
 
+	IFCALL(fastpath->rdp->input->BeginInput, fastpath->rdp->input);
+
 	for (i = 0; i < fastpath->numberEvents; i++)
 	{
 		if (!fastpath_recv_input_event(fastpath, s))
+		{
+			IFCALL(fastpath->rdp->input->EndInput, fastpath->rdp->input);
 			return false;
+		}
 	}
 
+	IFCALL(fastpath->rdp->input->EndInput, fastpath->rdp->input);
+
 	return true;
 }
 
@@ -545,14 +555,14 @@ static uint32 fastpath_get_sec_bytes(rdpRdp* rdp)
 	return sec_bytes;
 }
 
-STREAM* fastpath_input_pdu_init(rdpFastPath* fastpath, uint8 eventFlags, uint8 eventCode)
+static STREAM* fastpath_input_pdu_init_header(rdpFastPath* fastpath, int size)
 {
 	rdpRdp *rdp;
 	STREAM* s;
 
 	rdp = fastpath->rdp;
 
-	s = transport_send_stream_init(rdp->transport, 256);
+	s = transport_send_stream_init(rdp->transport, size);
 	stream_seek(s, 3); /* fpInputHeader, length1 and length2 */
 	if (rdp->do_crypt) {
 		rdp->sec_flags |= SEC_ENCRYPT;
@@ -560,11 +570,24 @@ STREAM* fastpath_input_pdu_init(rdpFastPath* fastpath, uint8 eventFlags, uint8 e
 			rdp->sec_flags |= SEC_SECURE_CHECKSUM;
 	}
 	stream_seek(s, fastpath_get_sec_bytes(rdp));
+	return s;
+}
+
+STREAM* fastpath_input_pdu_init(rdpFastPath* fastpath, uint8 eventFlags, uint8 eventCode)
+{
+	STREAM* s;
+
+	s = fastpath_input_pdu_init_header(fastpath, 256);
 	stream_write_uint8(s, eventFlags | (eventCode << 5)); /* eventHeader (1 byte) */
 	return s;
 }
 
 boolean fastpath_send_input_pdu(rdpFastPath* fastpath, STREAM* s)
+{
+	return fastpath_send_multiple_input_pdu(fastpath, s, 1);
+}
+
+boolean fastpath_send_multiple_input_pdu(rdpFastPath* fastpath, STREAM* s, uint8 numberEvents)
 {
 	rdpRdp *rdp;
 	uint16 length;
@@ -581,7 +604,7 @@ boolean fastpath_send_input_pdu(rdpFastPath* fastpath, STREAM* s)
 	}
 
 	eventHeader = FASTPATH_INPUT_ACTION_FASTPATH;
-	eventHeader |= (1 << 2); /* numberEvents */
+	eventHeader |= (numberEvents << 2); /* numberEvents */
 	if (rdp->sec_flags & SEC_ENCRYPT)
 		eventHeader |= (FASTPATH_INPUT_ENCRYPTED << 6);
 	if (rdp->sec_flags & SEC_SECURE_CHECKSUM)
@@ -621,9 +644,89 @@ boolean fastpath_send_input_pdu(rdpFastPath* fastpath, STREAM* s)
 	return true;
 }
 
+/**
+ * Queue an input event instead of sending it in a PDU of its own. Queued
+ * events are sent together by fastpath_flush_input_events, which the client
+ * calls once per event loop iteration, up to 15 events per PDU.
+ */
+
+STREAM* fastpath_input_event_init(rdpFastPath* fastpath, uint8 eventFlags, uint8 eventCode)
+{
+	STREAM* s = fastpath->inputEvents;
+
+	if (fastpath->numberInputEvents >= FASTPATH_MAX_INPUT_EVENTS)
+		fastpath_flush_input_events(fastpath);
+
+	/* the largest input event is 7 bytes long */
+	stream_check_size(s, 8);
+
+	fastpath->lastInputEvent = stream_get_pos(s);
+	fastpath->numberInputEvents++;
+
+	stream_write_uint8(s, eventFlags | (eventCode << 5)); /* eventHeader (1 byte) */
+	return s;
+}
+
+/**
+ * Collapse a pointer move into the last queued event, if it is a pointer
+ * move as well. Only the final position of consecutive moves is sent.
+ */
+
+boolean fastpath_coalesce_mouse_move(rdpFastPath* fastpath, uint16 x, uint16 y)
+{
+	uint8* event;
+	uint16 pointerFlags;
+
+	if (fastpath->numberInputEvents < 1)
+		return false;
+
+	event = stream_get_head(fastpath->inputEvents) + fastpath->lastInputEvent;
+
+	if ((event[0] >> 5) != FASTPATH_INPUT_EVENT_MOUSE)
+		return false;
+
+	pointerFlags = event[1] | (event[2] << 8);
+
+	if (pointerFlags != PTR_FLAGS_MOVE)
+		return false;
+
+	event[3] = x & 0xFF; /* xPos (2 bytes) */
+	event[4] = (x >> 8) & 0xFF;
+	event[5] = y & 0xFF; /* yPos (2 bytes) */
+	event[6] = (y >> 8) & 0xFF;
+
+	return true;
+}
+
+boolean fastpath_flush_input_events(rdpFastPath* fastpath)
+{
+	STREAM* s;
+	int length;
+	uint8 numberEvents;
+
+	if (fastpath->numberInputEvents < 1)
+		return true;
+
+	length = stream_get_pos(fastpath->inputEvents);
+	numberEvents = fastpath->numberInputEvents;
+
+	fastpath->numberInputEvents = 0;
+	stream_set_pos(fastpath->inputEvents, 0);
+
+	s = fastpath_input_pdu_init_header(fastpath, length + 16);
+	stream_write(s, stream_get_head(fastpath->inputEvents), length);
+
+	return fastpath_send_multiple_input_pdu(fastpath, s, numberEvents);
+}
+
 STREAM* fastpath_update_pdu_init(rdpFastPath* fastpath)
 {
 	STREAM* s;
+
+	/* queued orders go out first, so that updates are never reordered */
+	if (fastpath->numberOrders > 0)
+		fastpath_flush_orders(fastpath);
+
 	s = transport_send_stream_init(fastpath->rdp->transport, FASTPATH_MAX_PACKET_SIZE);
 	stream_seek(s, 3); /* fpOutputHeader, length1 and length2 */
 	stream_seek(s, fastpath_get_sec_bytes(fastpath->rdp));
@@ -760,6 +863,48 @@ boolean fastpath_send_update_pdu(rdpFastPath* fastpath, uint8 updateCode, STREAM
 	return result;
 }
 
+/**
+ * Queue a drawing order instead of sending it in an update of its own. The
+ * orders queued are sent together by fastpath_flush_orders, before any other
+ * update, or as soon as the batch grows too large for a single packet.
+ */
+
+STREAM* fastpath_order_init(rdpFastPath* fastpath)
+{
+	if ((stream_get_pos(fastpath->updateOrders) >= FASTPATH_MAX_ORDERS_LENGTH) ||
+		(fastpath->numberOrders == 0xFFFF))
+	{
+		fastpath_flush_orders(fastpath);
+	}
+
+	fastpath->numberOrders++;
+
+	return fastpath->updateOrders;
+}
+
+boolean fastpath_flush_orders(rdpFastPath* fastpath)
+{
+	STREAM* s;
+	int length;
+	uint16 numberOrders;
+
+	if (fastpath->numberOrders < 1)
+		return true;
+
+	length = stream_get_pos(fastpath->updateOrders);
+	numberOrders = fastpath->numberOrders;
+
+	fastpath->numberOrders = 0;
+	stream_set_pos(fastpath->updateOrders, 0);
+
+	s = fastpath_update_pdu_init(fastpath);
+	stream_check_size(s, 2 + length);
+	stream_write_uint16(s, numberOrders); /* numberOrders (2 bytes) */
+	stream_write(s, stream_get_head(fastpath->updateOrders), length);
+
+	return fastpath_send_update_pdu(fastpath, FASTPATH_UPDATETYPE_ORDERS, s);
+}
+
 rdpFastPath* fastpath_new(rdpRdp* rdp)
 {
 	rdpFastPath* fastpath;
@@ -767,6 +912,8 @@ rdpFastPath* fastpath_new(rdpRdp* rdp)
 	fastpath = xnew(rdpFastPath);
 	fastpath->rdp = rdp;
 	fastpath->updateData = stream_new(4096);
+	fastpath->inputEvents = stream_new(FASTPATH_MAX_INPUT_EVENTS * 8);
+	fastpath->updateOrders = stream_new(4096);
 
 	return fastpath;
 }
@@ -774,5 +921,7 @@ rdpFastPath* fastpath_new(rdpRdp* rdp)
 void fastpath_free(rdpFastPath* fastpath)
 {
 	stream_free(fastpath->updateData);
+	stream_free(fastpath->inputEvents);
+	stream_free(fastpath->updateOrders);
 	xfree(fastpath);
 }
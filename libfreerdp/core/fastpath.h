@@ -94,12 +94,20 @@ enum FASTPATH_INPUT_KBDFLAGS
 	FASTPATH_INPUT_KBDFLAGS_EXTENDED = 0x02
 };
 
+#define FASTPATH_MAX_INPUT_EVENTS	15
+
 struct rdp_fastpath
 {
 	rdpRdp* rdp;
 	uint8 encryptionFlags;
 	uint8 numberEvents;
 	STREAM* updateData;
+	STREAM* inputEvents;
+	uint8 numberInputEvents;
+	uint32 lastInputEvent;
+	STREAM* updateOrders;
+	uint16 numberOrders;
+	boolean batchOrders;
 };
 
 uint16 fastpath_header_length(STREAM* s);
@@ -110,10 +118,18 @@ boolean fastpath_recv_inputs(rdpFastPath* fastpath, STREAM* s);
 
 STREAM* fastpath_input_pdu_init(rdpFastPath* fastpath, uint8 eventFlags, uint8 eventCode);
 boolean fastpath_send_input_pdu(rdpFastPath* fastpath, STREAM* s);
+boolean fastpath_send_multiple_input_pdu(rdpFastPath* fastpath, STREAM* s, uint8 numberEvents);
+
+STREAM* fastpath_input_event_init(rdpFastPath* fastpath, uint8 eventFlags, uint8 eventCode);
+boolean fastpath_coalesce_mouse_move(rdpFastPath* fastpath, uint16 x, uint16 y);
+boolean fastpath_flush_input_events(rdpFastPath* fastpath);
 
 STREAM* fastpath_update_pdu_init(rdpFastPath* fastpath);
 boolean fastpath_send_update_pdu(rdpFastPath* fastpath, uint8 updateCode, STREAM* s);
 
+STREAM* fastpath_order_init(rdpFastPath* fastpath);
+boolean fastpath_flush_orders(rdpFastPath* fastpath);
+
 boolean fastpath_send_surfcmd_frame_marker(rdpFastPath* fastpath, uint16 frameAction, uint32 frameId);
 
 rdpFastPath* fastpath_new(rdpRdp* rdp);
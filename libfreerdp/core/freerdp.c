@@ -158,6 +158,10 @@ boolean freerdp_get_fds(freerdp* instance, void** rfds, int* rcount, void** wfds
 	rdpRdp* rdp;
 
 	rdp = instance->context->rdp;
+
+	/* the client is about to wait, send the input events of this iteration */
+	input_flush(instance->input);
+
 	transport_get_fds(rdp->transport, rfds, rcount);
 
 	return true;
@@ -147,39 +147,55 @@ void input_send_extended_mouse_event(rdpInput* input, uint16 flags, uint16 x, ui
 	rdp_send_client_input_pdu(rdp, s);
 }
 
+static STREAM* input_fastpath_event_init(rdpInput* input, uint8 eventFlags, uint8 eventCode)
+{
+	rdpRdp* rdp = input->context->rdp;
+
+	if (rdp->settings->input_batching)
+		return fastpath_input_event_init(rdp->fastpath, eventFlags, eventCode);
+
+	return fastpath_input_pdu_init(rdp->fastpath, eventFlags, eventCode);
+}
+
+static void input_fastpath_event_send(rdpInput* input, STREAM* s)
+{
+	rdpRdp* rdp = input->context->rdp;
+
+	/* batched events are sent by input_flush */
+	if (!rdp->settings->input_batching)
+		fastpath_send_input_pdu(rdp->fastpath, s);
+}
+
 void input_send_fastpath_synchronize_event(rdpInput* input, uint32 flags)
 {
 	STREAM* s;
-	rdpRdp* rdp = input->context->rdp;
 
 	/* The FastPath Synchronization eventFlags has identical values as SlowPath */
-	s = fastpath_input_pdu_init(rdp->fastpath, (uint8) flags, FASTPATH_INPUT_EVENT_SYNC);
-	fastpath_send_input_pdu(rdp->fastpath, s);
+	s = input_fastpath_event_init(input, (uint8) flags, FASTPATH_INPUT_EVENT_SYNC);
+	input_fastpath_event_send(input, s);
 }
 
 void input_send_fastpath_keyboard_event(rdpInput* input, uint16 flags, uint16 code)
 {
 	STREAM* s;
 	uint8 eventFlags = 0;
-	rdpRdp* rdp = input->context->rdp;
 
 	eventFlags |= (flags & KBD_FLAGS_RELEASE) ? FASTPATH_INPUT_KBDFLAGS_RELEASE : 0;
 	eventFlags |= (flags & KBD_FLAGS_EXTENDED) ? FASTPATH_INPUT_KBDFLAGS_EXTENDED : 0;
-	s = fastpath_input_pdu_init(rdp->fastpath, eventFlags, FASTPATH_INPUT_EVENT_SCANCODE);
+	s = input_fastpath_event_init(input, eventFlags, FASTPATH_INPUT_EVENT_SCANCODE);
 	stream_write_uint8(s, code); /* keyCode (1 byte) */
-	fastpath_send_input_pdu(rdp->fastpath, s);
+	input_fastpath_event_send(input, s);
 }
 
 void input_send_fastpath_unicode_keyboard_event(rdpInput* input, uint16 flags, uint16 code)
 {
 	STREAM* s;
 	uint8 eventFlags = 0;
-	rdpRdp* rdp = input->context->rdp;
 
 	eventFlags |= (flags & KBD_FLAGS_RELEASE) ? FASTPATH_INPUT_KBDFLAGS_RELEASE : 0;
-	s = fastpath_input_pdu_init(rdp->fastpath, eventFlags, FASTPATH_INPUT_EVENT_UNICODE);
+	s = input_fastpath_event_init(input, eventFlags, FASTPATH_INPUT_EVENT_UNICODE);
 	stream_write_uint16(s, code); /* unicodeCode (2 bytes) */
-	fastpath_send_input_pdu(rdp->fastpath, s);
+	input_fastpath_event_send(input, s);
 }
 
 void input_send_fastpath_mouse_event(rdpInput* input, uint16 flags, uint16 x, uint16 y)
@@ -187,19 +203,24 @@ void input_send_fastpath_mouse_event(rdpInput* input, uint16 flags, uint16 x, ui
 	STREAM* s;
 	rdpRdp* rdp = input->context->rdp;
 
-	s = fastpath_input_pdu_init(rdp->fastpath, 0, FASTPATH_INPUT_EVENT_MOUSE);
+	if (rdp->settings->input_batching && (flags == PTR_FLAGS_MOVE))
+	{
+		if (fastpath_coalesce_mouse_move(rdp->fastpath, x, y))
+			return;
+	}
+
+	s = input_fastpath_event_init(input, 0, FASTPATH_INPUT_EVENT_MOUSE);
 	input_write_mouse_event(s, flags, x, y);
-	fastpath_send_input_pdu(rdp->fastpath, s);
+	input_fastpath_event_send(input, s);
 }
 
 void input_send_fastpath_extended_mouse_event(rdpInput* input, uint16 flags, uint16 x, uint16 y)
 {
 	STREAM* s;
-	rdpRdp* rdp = input->context->rdp;
 
-	s = fastpath_input_pdu_init(rdp->fastpath, 0, FASTPATH_INPUT_EVENT_MOUSEX);
+	s = input_fastpath_event_init(input, 0, FASTPATH_INPUT_EVENT_MOUSEX);
 	input_write_extended_mouse_event(s, flags, x, y);
-	fastpath_send_input_pdu(rdp->fastpath, s);
+	input_fastpath_event_send(input, s);
 }
 
 static boolean input_recv_sync_event(rdpInput* input, STREAM* s)
@@ -355,15 +376,30 @@ boolean input_recv(rdpInput* input, STREAM* s)
 	if (stream_get_left(s) < 6 * numberEvents)
 		return false;
 
+	/* the events of a PDU are bracketed, for servers to inject them at once */
+	IFCALL(input->BeginInput, input);
+
 	for (i = 0; i < numberEvents; i++)
 	{
 		if (!input_recv_event(input, s))
+		{
+			IFCALL(input->EndInput, input);
 			return false;
+		}
 	}
 
+	IFCALL(input->EndInput, input);
+
 	return true;
 }
 
+boolean input_flush(rdpInput* input)
+{
+	rdpRdp* rdp = input->context->rdp;
+
+	return fastpath_flush_input_events(rdp->fastpath);
+}
+
 void input_register_client_callbacks(rdpInput* input)
 {
 	rdpRdp* rdp = input->context->rdp;
@@ -411,6 +447,11 @@ void freerdp_input_send_extended_mouse_event(rdpInput* input, uint16 flags, uint
 	IFCALL(input->ExtendedMouseEvent, input, flags, x, y);
 }
 
+boolean freerdp_input_flush(rdpInput* input)
+{
+	return input_flush(input);
+}
+
 rdpInput* input_new(rdpRdp* rdp)
 {
 	rdpInput* input;
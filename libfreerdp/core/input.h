@@ -50,6 +50,7 @@ void input_send_fastpath_mouse_event(rdpInput* input, uint16 flags, uint16 x, ui
 void input_send_fastpath_extended_mouse_event(rdpInput* input, uint16 flags, uint16 x, uint16 y);
 
 boolean input_recv(rdpInput* input, STREAM* s);
+boolean input_flush(rdpInput* input);
 
 void input_register_client_callbacks(rdpInput* input);
 
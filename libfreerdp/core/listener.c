@@ -27,6 +27,7 @@
 #include <fcntl.h>
 
 #include <freerdp/utils/print.h>
+#include <freerdp/utils/memory.h>
 
 #ifndef _WIN32
 #include <netdb.h>
@@ -287,6 +288,7 @@ static boolean freerdp_listener_check_fds(freerdp_listener* instance)
 		}
 
 		client = freerdp_peer_new(peer_sockfd);
+		client->listener = (void*) listener;
 
 		sin_addr = NULL;
 		if (peer_addr.ss_family == AF_INET)
@@ -307,6 +309,47 @@ static boolean freerdp_listener_check_fds(freerdp_listener* instance)
 	return true;
 }
 
+/**
+ * Get the TLS context shared by all peers of this listener.
+ * The context is created from the certificate and private key files of the
+ * first peer asking for it, so that they are loaded only once. Peers using
+ * other files get NULL and fall back to a context of their own.
+ */
+
+SSL_CTX* freerdp_listener_get_tls_context(rdpListener* listener, const char* cert_file, const char* privatekey_file)
+{
+	SSL_CTX* ctx = NULL;
+
+	if (cert_file == NULL || privatekey_file == NULL)
+		return NULL;
+
+	freerdp_mutex_lock(listener->tls_mutex);
+
+	if (listener->tls_ctx == NULL)
+	{
+		listener->tls_ctx = tls_server_context_new(cert_file, privatekey_file);
+
+		if (listener->tls_ctx != NULL)
+		{
+			listener->cert_file = xstrdup(cert_file);
+			listener->privatekey_file = xstrdup(privatekey_file);
+		}
+	}
+
+	if (listener->tls_ctx != NULL)
+	{
+		if ((strcmp(listener->cert_file, cert_file) == 0) &&
+				(strcmp(listener->privatekey_file, privatekey_file) == 0))
+		{
+			ctx = listener->tls_ctx;
+		}
+	}
+
+	freerdp_mutex_unlock(listener->tls_mutex);
+
+	return ctx;
+}
+
 freerdp_listener* freerdp_listener_new(void)
 {
 	freerdp_listener* instance;
@@ -321,6 +364,7 @@ freerdp_listener* freerdp_listener_new(void)
 
 	listener = xnew(rdpListener);
 	listener->instance = instance;
+	listener->tls_mutex = freerdp_mutex_new();
 
 	instance->listener = (void*) listener;
 
@@ -332,6 +376,12 @@ void freerdp_listener_free(freerdp_listener* instance)
 	rdpListener* listener;
 
 	listener = (rdpListener*) instance->listener;
+
+	tls_server_context_free(listener->tls_ctx);
+	xfree(listener->cert_file);
+	xfree(listener->privatekey_file);
+	freerdp_mutex_free(listener->tls_mutex);
+
 	xfree(listener);
 
 	xfree(instance);
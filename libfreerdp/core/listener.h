@@ -24,6 +24,8 @@ typedef struct rdp_listener rdpListener;
 
 #include "rdp.h"
 #include <freerdp/listener.h>
+#include <freerdp/crypto/tls.h>
+#include <freerdp/utils/mutex.h>
 
 struct rdp_listener
 {
@@ -31,7 +33,14 @@ struct rdp_listener
 
  	int sockfds[5];
 	int num_sockfds;
+
+	SSL_CTX* tls_ctx;
+	char* cert_file;
+	char* privatekey_file;
+	freerdp_mutex tls_mutex;
 };
 
+SSL_CTX* freerdp_listener_get_tls_context(rdpListener* listener, const char* cert_file, const char* privatekey_file);
+
 #endif
 
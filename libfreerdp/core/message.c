@@ -0,0 +1,1418 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol client.
+ * Update Message Queue
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/message.h>
+#include <freerdp/utils/list.h>
+#include <freerdp/utils/mutex.h>
+#include <freerdp/utils/memory.h>
+#include <freerdp/utils/wait_obj.h>
+
+#include "surface.h"
+
+enum MESSAGE_ID
+{
+	MSG_BEGIN_PAINT,
+	MSG_END_PAINT,
+	MSG_SET_BOUNDS,
+	MSG_SYNCHRONIZE,
+	MSG_DESKTOP_RESIZE,
+	MSG_BITMAP_UPDATE,
+	MSG_PALETTE,
+	MSG_PLAY_SOUND,
+	MSG_RESET_STATE,
+	MSG_SURFACE_BITS,
+	MSG_SURFACE_FRAME_MARKER,
+
+	MSG_DSTBLT,
+	MSG_PATBLT,
+	MSG_SCRBLT,
+	MSG_OPAQUE_RECT,
+	MSG_DRAW_NINE_GRID,
+	MSG_MULTI_DSTBLT,
+	MSG_MULTI_PATBLT,
+	MSG_MULTI_SCRBLT,
+	MSG_MULTI_OPAQUE_RECT,
+	MSG_MULTI_DRAW_NINE_GRID,
+	MSG_LINE_TO,
+	MSG_POLYLINE,
+	MSG_MEMBLT,
+	MSG_MEM3BLT,
+	MSG_SAVE_BITMAP,
+	MSG_GLYPH_INDEX,
+	MSG_FAST_INDEX,
+	MSG_FAST_GLYPH,
+	MSG_POLYGON_SC,
+	MSG_POLYGON_CB,
+	MSG_ELLIPSE_SC,
+	MSG_ELLIPSE_CB,
+
+	MSG_CACHE_BITMAP,
+	MSG_CACHE_BITMAP_V2,
+	MSG_CACHE_BITMAP_V3,
+	MSG_CACHE_COLOR_TABLE,
+	MSG_CACHE_GLYPH,
+	MSG_CACHE_GLYPH_V2,
+	MSG_CACHE_BRUSH,
+
+	MSG_CREATE_OFFSCREEN_BITMAP,
+	MSG_SWITCH_SURFACE,
+	MSG_CREATE_NINE_GRID_BITMAP,
+	MSG_FRAME_MARKER,
+	MSG_STREAM_BITMAP_FIRST,
+	MSG_STREAM_BITMAP_NEXT,
+	MSG_DRAW_GDIPLUS_FIRST,
+	MSG_DRAW_GDIPLUS_NEXT,
+	MSG_DRAW_GDIPLUS_END,
+	MSG_DRAW_GDIPLUS_CACHE_FIRST,
+	MSG_DRAW_GDIPLUS_CACHE_NEXT,
+	MSG_DRAW_GDIPLUS_CACHE_END,
+
+	MSG_WINDOW_CREATE,
+	MSG_WINDOW_UPDATE,
+	MSG_WINDOW_ICON,
+	MSG_WINDOW_CACHED_ICON,
+	MSG_WINDOW_DELETE,
+	MSG_NOTIFY_ICON_CREATE,
+	MSG_NOTIFY_ICON_UPDATE,
+	MSG_NOTIFY_ICON_DELETE,
+	MSG_MONITORED_DESKTOP,
+	MSG_NON_MONITORED_DESKTOP,
+
+	MSG_POINTER_POSITION,
+	MSG_POINTER_SYSTEM,
+	MSG_POINTER_COLOR,
+	MSG_POINTER_NEW,
+	MSG_POINTER_CACHED
+};
+
+struct rdp_message
+{
+	uint32 id;
+	void* wParam;
+	void* lParam;
+};
+typedef struct rdp_message rdpMessage;
+
+struct rdp_message_queue
+{
+	rdpUpdate* update;
+
+	LIST* messages;
+	freerdp_mutex mutex;
+	struct wait_obj* event;
+	struct wait_obj* space;
+	int max_size;
+	int frames;
+
+	/* callbacks registered before the queue was attached */
+	rdpUpdate saved_update;
+	rdpPrimaryUpdate saved_primary;
+	rdpSecondaryUpdate saved_secondary;
+	rdpAltSecUpdate saved_altsec;
+	rdpWindowUpdate saved_window;
+	rdpPointerUpdate saved_pointer;
+};
+
+static void* message_dup(void* data, int size)
+{
+	void* copy;
+
+	if (data == NULL || size <= 0)
+		return NULL;
+
+	copy = xmalloc(size);
+	memcpy(copy, data, size);
+
+	return copy;
+}
+
+/**
+ * Queue a message. The receiving end is woken up when the queue stops being
+ * empty, and the space event is cleared when it reaches its maximum size.
+ */
+
+static boolean message_is_frame_end(rdpMessage* message)
+{
+	if (message->id != MSG_SURFACE_FRAME_MARKER || message->wParam == NULL)
+		return false;
+
+	return (((SURFACE_FRAME_MARKER*) message->wParam)->frameAction == SURFACECMD_FRAMEACTION_END);
+}
+
+static void message_post(rdpContext* context, uint32 id, void* wParam, void* lParam)
+{
+	rdpMessage* message;
+	rdpMessageQueue* queue = context->instance->update->queue;
+
+	message = xnew(rdpMessage);
+	message->id = id;
+	message->wParam = wParam;
+	message->lParam = lParam;
+
+	freerdp_mutex_lock(queue->mutex);
+
+	list_enqueue(queue->messages, message);
+
+	if (message_is_frame_end(message))
+		queue->frames++;
+
+	if (queue->messages->count == 1)
+		wait_obj_set(queue->event);
+
+	if (queue->messages->count == queue->max_size)
+		wait_obj_clear(queue->space);
+
+	freerdp_mutex_unlock(queue->mutex);
+}
+
+/**
+ * Orders reference their brush pattern either in the order itself or in the
+ * brush cache. In the first case, the copy has to point to its own pattern.
+ */
+
+static void message_copy_brush(rdpBrush* brush, rdpBrush* original)
+{
+	if (original->data == original->p8x8)
+		brush->data = brush->p8x8;
+}
+
+static void message_copy_unicode_string(RAIL_UNICODE_STRING* string, RAIL_UNICODE_STRING* original)
+{
+	string->string = (uint8*) message_dup(original->string, original->length);
+}
+
+/* Update */
+
+static void message_BeginPaint(rdpContext* context)
+{
+	message_post(context, MSG_BEGIN_PAINT, NULL, NULL);
+}
+
+static void message_EndPaint(rdpContext* context)
+{
+	message_post(context, MSG_END_PAINT, NULL, NULL);
+}
+
+static void message_SetBounds(rdpContext* context, rdpBounds* bounds)
+{
+	message_post(context, MSG_SET_BOUNDS, message_dup(bounds, sizeof(rdpBounds)), NULL);
+}
+
+static void message_Synchronize(rdpContext* context)
+{
+	message_post(context, MSG_SYNCHRONIZE, NULL, NULL);
+}
+
+/**
+ * The new desktop size is only carried by the settings, which are read when
+ * the message is executed. Nothing else changes them in between.
+ */
+
+static void message_DesktopResize(rdpContext* context)
+{
+	message_post(context, MSG_DESKTOP_RESIZE, NULL, NULL);
+}
+
+static void message_BitmapUpdate(rdpContext* context, BITMAP_UPDATE* bitmap)
+{
+	int i;
+	BITMAP_UPDATE* wParam;
+	BITMAP_DATA* bitmap_data;
+
+	wParam = (BITMAP_UPDATE*) message_dup(bitmap, sizeof(BITMAP_UPDATE));
+	wParam->count = bitmap->number;
+	wParam->rectangles = (BITMAP_DATA*) xzalloc(sizeof(BITMAP_DATA) * (bitmap->number + 1));
+
+	for (i = 0; i < (int) bitmap->number; i++)
+	{
+		bitmap_data = &wParam->rectangles[i];
+		memcpy(bitmap_data, &bitmap->rectangles[i], sizeof(BITMAP_DATA));
+		bitmap_data->bitmapDataStream = (uint8*) message_dup(bitmap_data->bitmapDataStream, bitmap_data->bitmapLength);
+	}
+
+	message_post(context, MSG_BITMAP_UPDATE, wParam, NULL);
+}
+
+static void message_Palette(rdpContext* context, PALETTE_UPDATE* palette)
+{
+	message_post(context, MSG_PALETTE, message_dup(palette, sizeof(PALETTE_UPDATE)), NULL);
+}
+
+static void message_PlaySound(rdpContext* context, PLAY_SOUND_UPDATE* play_sound)
+{
+	message_post(context, MSG_PLAY_SOUND, message_dup(play_sound, sizeof(PLAY_SOUND_UPDATE)), NULL);
+}
+
+static void message_ResetState(rdpContext* context)
+{
+	message_post(context, MSG_RESET_STATE, NULL, NULL);
+}
+
+static void message_SurfaceBits(rdpContext* context, SURFACE_BITS_COMMAND* surface_bits_command)
+{
+	SURFACE_BITS_COMMAND* wParam;
+
+	wParam = (SURFACE_BITS_COMMAND*) message_dup(surface_bits_command, sizeof(SURFACE_BITS_COMMAND));
+	wParam->bitmapData = (uint8*) message_dup(surface_bits_command->bitmapData, surface_bits_command->bitmapDataLength);
+
+	message_post(context, MSG_SURFACE_BITS, wParam, NULL);
+}
+
+static void message_SurfaceFrameMarker(rdpContext* context, SURFACE_FRAME_MARKER* surface_frame_marker)
+{
+	message_post(context, MSG_SURFACE_FRAME_MARKER, message_dup(surface_frame_marker, sizeof(SURFACE_FRAME_MARKER)), NULL);
+}
+
+/* Primary Update */
+
+static void message_DstBlt(rdpContext* context, DSTBLT_ORDER* dstblt)
+{
+	message_post(context, MSG_DSTBLT, message_dup(dstblt, sizeof(DSTBLT_ORDER)), NULL);
+}
+
+static void message_PatBlt(rdpContext* context, PATBLT_ORDER* patblt)
+{
+	PATBLT_ORDER* wParam;
+
+	wParam = (PATBLT_ORDER*) message_dup(patblt, sizeof(PATBLT_ORDER));
+	message_copy_brush(&wParam->brush, &patblt->brush);
+
+	message_post(context, MSG_PATBLT, wParam, NULL);
+}
+
+static void message_ScrBlt(rdpContext* context, SCRBLT_ORDER* scrblt)
+{
+	message_post(context, MSG_SCRBLT, message_dup(scrblt, sizeof(SCRBLT_ORDER)), NULL);
+}
+
+static void message_OpaqueRect(rdpContext* context, OPAQUE_RECT_ORDER* opaque_rect)
+{
+	message_post(context, MSG_OPAQUE_RECT, message_dup(opaque_rect, sizeof(OPAQUE_RECT_ORDER)), NULL);
+}
+
+static void message_DrawNineGrid(rdpContext* context, DRAW_NINE_GRID_ORDER* draw_nine_grid)
+{
+	message_post(context, MSG_DRAW_NINE_GRID, message_dup(draw_nine_grid, sizeof(DRAW_NINE_GRID_ORDER)), NULL);
+}
+
+static void message_MultiDstBlt(rdpContext* context, MULTI_DSTBLT_ORDER* multi_dstblt)
+{
+	message_post(context, MSG_MULTI_DSTBLT, message_dup(multi_dstblt, sizeof(MULTI_DSTBLT_ORDER)), NULL);
+}
+
+static void message_MultiPatBlt(rdpContext* context, MULTI_PATBLT_ORDER* multi_patblt)
+{
+	MULTI_PATBLT_ORDER* wParam;
+
+	wParam = (MULTI_PATBLT_ORDER*) message_dup(multi_patblt, sizeof(MULTI_PATBLT_ORDER));
+	message_copy_brush(&wParam->brush, &multi_patblt->brush);
+
+	message_post(context, MSG_MULTI_PATBLT, wParam, NULL);
+}
+
+static void message_MultiScrBlt(rdpContext* context, MULTI_SCRBLT_ORDER* multi_scrblt)
+{
+	message_post(context, MSG_MULTI_SCRBLT, message_dup(multi_scrblt, sizeof(MULTI_SCRBLT_ORDER)), NULL);
+}
+
+static void message_MultiOpaqueRect(rdpContext* context, MULTI_OPAQUE_RECT_ORDER* multi_opaque_rect)
+{
+	message_post(context, MSG_MULTI_OPAQUE_RECT, message_dup(multi_opaque_rect, sizeof(MULTI_OPAQUE_RECT_ORDER)), NULL);
+}
+
+static void message_MultiDrawNineGrid(rdpContext* context, MULTI_DRAW_NINE_GRID_ORDER* multi_draw_nine_grid)
+{
+	message_post(context, MSG_MULTI_DRAW_NINE_GRID, message_dup(multi_draw_nine_grid, sizeof(MULTI_DRAW_NINE_GRID_ORDER)), NULL);
+}
+
+static void message_LineTo(rdpContext* context, LINE_TO_ORDER* line_to)
+{
+	message_post(context, MSG_LINE_TO, message_dup(line_to, sizeof(LINE_TO_ORDER)), NULL);
+}
+
+static void message_Polyline(rdpContext* context, POLYLINE_ORDER* polyline)
+{
+	POLYLINE_ORDER* wParam;
+
+	wParam = (POLYLINE_ORDER*) message_dup(polyline, sizeof(POLYLINE_ORDER));
+	wParam->points = (DELTA_POINT*) message_dup(polyline->points, sizeof(DELTA_POINT) * polyline->numPoints);
+
+	message_post(context, MSG_POLYLINE, wParam, NULL);
+}
+
+static void message_MemBlt(rdpContext* context, MEMBLT_ORDER* memblt)
+{
+	message_post(context, MSG_MEMBLT, message_dup(memblt, sizeof(MEMBLT_ORDER)), NULL);
+}
+
+static void message_Mem3Blt(rdpContext* context, MEM3BLT_ORDER* mem3blt)
+{
+	MEM3BLT_ORDER* wParam;
+
+	wParam = (MEM3BLT_ORDER*) message_dup(mem3blt, sizeof(MEM3BLT_ORDER));
+	message_copy_brush(&wParam->brush, &mem3blt->brush);
+
+	message_post(context, MSG_MEM3BLT, wParam, NULL);
+}
+
+static void message_SaveBitmap(rdpContext* context, SAVE_BITMAP_ORDER* save_bitmap)
+{
+	message_post(context, MSG_SAVE_BITMAP, message_dup(save_bitmap, sizeof(SAVE_BITMAP_ORDER)), NULL);
+}
+
+static void message_GlyphIndex(rdpContext* context, GLYPH_INDEX_ORDER* glyph_index)
+{
+	GLYPH_INDEX_ORDER* wParam;
+
+	wParam = (GLYPH_INDEX_ORDER*) message_dup(glyph_index, sizeof(GLYPH_INDEX_ORDER));
+	message_copy_brush(&wParam->brush, &glyph_index->brush);
+
+	message_post(context, MSG_GLYPH_INDEX, wParam, NULL);
+}
+
+static void message_FastIndex(rdpContext* context, FAST_INDEX_ORDER* fast_index)
+{
+	message_post(context, MSG_FAST_INDEX, message_dup(fast_index, sizeof(FAST_INDEX_ORDER)), NULL);
+}
+
+static void message_FastGlyph(rdpContext* context, FAST_GLYPH_ORDER* fast_glyph)
+{
+	FAST_GLYPH_ORDER* wParam;
+
+	wParam = (FAST_GLYPH_ORDER*) message_dup(fast_glyph, sizeof(FAST_GLYPH_ORDER));
+
+	/* the glyph is handed over with the message, the parser allocates the next one */
+	fast_glyph->glyph_data = NULL;
+
+	message_post(context, MSG_FAST_GLYPH, wParam, NULL);
+}
+
+static void message_PolygonSC(rdpContext* context, POLYGON_SC_ORDER* polygon_sc)
+{
+	POLYGON_SC_ORDER* wParam;
+
+	wParam = (POLYGON_SC_ORDER*) message_dup(polygon_sc, sizeof(POLYGON_SC_ORDER));
+	wParam->points = (DELTA_POINT*) message_dup(polygon_sc->points, sizeof(DELTA_POINT) * polygon_sc->numPoints);
+
+	message_post(context, MSG_POLYGON_SC, wParam, NULL);
+}
+
+static void message_PolygonCB(rdpContext* context, POLYGON_CB_ORDER* polygon_cb)
+{
+	POLYGON_CB_ORDER* wParam;
+
+	wParam = (POLYGON_CB_ORDER*) message_dup(polygon_cb, sizeof(POLYGON_CB_ORDER));
+	wParam->points = (DELTA_POINT*) message_dup(polygon_cb->points, sizeof(DELTA_POINT) * polygon_cb->numPoints);
+	message_copy_brush(&wParam->brush, &polygon_cb->brush);
+
+	message_post(context, MSG_POLYGON_CB, wParam, NULL);
+}
+
+static void message_EllipseSC(rdpContext* context, ELLIPSE_SC_ORDER* ellipse_sc)
+{
+	message_post(context, MSG_ELLIPSE_SC, message_dup(ellipse_sc, sizeof(ELLIPSE_SC_ORDER)), NULL);
+}
+
+static void message_EllipseCB(rdpContext* context, ELLIPSE_CB_ORDER* ellipse_cb)
+{
+	ELLIPSE_CB_ORDER* wParam;
+
+	wParam = (ELLIPSE_CB_ORDER*) message_dup(ellipse_cb, sizeof(ELLIPSE_CB_ORDER));
+	message_copy_brush(&wParam->brush, &ellipse_cb->brush);
+
+	message_post(context, MSG_ELLIPSE_CB, wParam, NULL);
+}
+
+/* Secondary Update */
+
+static void message_CacheBitmap(rdpContext* context, CACHE_BITMAP_ORDER* cache_bitmap_order)
+{
+	CACHE_BITMAP_ORDER* wParam;
+
+	wParam = (CACHE_BITMAP_ORDER*) message_dup(cache_bitmap_order, sizeof(CACHE_BITMAP_ORDER));
+	wParam->bitmapDataStream = (uint8*) message_dup(cache_bitmap_order->bitmapDataStream, cache_bitmap_order->bitmapLength);
+
+	message_post(context, MSG_CACHE_BITMAP, wParam, NULL);
+}
+
+static void message_CacheBitmapV2(rdpContext* context, CACHE_BITMAP_V2_ORDER* cache_bitmap_v2_order)
+{
+	CACHE_BITMAP_V2_ORDER* wParam;
+
+	wParam = (CACHE_BITMAP_V2_ORDER*) message_dup(cache_bitmap_v2_order, sizeof(CACHE_BITMAP_V2_ORDER));
+	wParam->bitmapDataStream = (uint8*) message_dup(cache_bitmap_v2_order->bitmapDataStream, cache_bitmap_v2_order->bitmapLength);
+
+	message_post(context, MSG_CACHE_BITMAP_V2, wParam, NULL);
+}
+
+static void message_CacheBitmapV3(rdpContext* context, CACHE_BITMAP_V3_ORDER* cache_bitmap_v3_order)
+{
+	CACHE_BITMAP_V3_ORDER* wParam;
+	BITMAP_DATA_EX* bitmapData;
+
+	wParam = (CACHE_BITMAP_V3_ORDER*) message_dup(cache_bitmap_v3_order, sizeof(CACHE_BITMAP_V3_ORDER));
+	bitmapData = &cache_bitmap_v3_order->bitmapData;
+	wParam->bitmapData.data = (uint8*) message_dup(bitmapData->data, bitmapData->length);
+
+	message_post(context, MSG_CACHE_BITMAP_V3, wParam, NULL);
+}
+
+/**
+ * The palette cache keeps the color table it is given, so the copy is not
+ * released with the message.
+ */
+
+static void message_CacheColorTable(rdpContext* context, CACHE_COLOR_TABLE_ORDER* cache_color_table_order)
+{
+	CACHE_COLOR_TABLE_ORDER* wParam;
+
+	wParam = (CACHE_COLOR_TABLE_ORDER*) message_dup(cache_color_table_order, sizeof(CACHE_COLOR_TABLE_ORDER));
+	wParam->colorTable = (uint32*) message_dup(cache_color_table_order->colorTable, cache_color_table_order->numberColors * 4);
+
+	message_post(context, MSG_CACHE_COLOR_TABLE, wParam, NULL);
+}
+
+static void message_CacheGlyph(rdpContext* context, CACHE_GLYPH_ORDER* cache_glyph_order)
+{
+	int i;
+	CACHE_GLYPH_ORDER* wParam;
+
+	wParam = (CACHE_GLYPH_ORDER*) message_dup(cache_glyph_order, sizeof(CACHE_GLYPH_ORDER));
+
+	/* the glyphs are handed over with the message, the parser allocates new ones */
+	for (i = 0; i < (int) cache_glyph_order->cGlyphs; i++)
+		cache_glyph_order->glyphData[i] = NULL;
+
+	message_post(context, MSG_CACHE_GLYPH, wParam, NULL);
+}
+
+static void message_CacheGlyphV2(rdpContext* context, CACHE_GLYPH_V2_ORDER* cache_glyph_v2_order)
+{
+	int i;
+	CACHE_GLYPH_V2_ORDER* wParam;
+
+	wParam = (CACHE_GLYPH_V2_ORDER*) message_dup(cache_glyph_v2_order, sizeof(CACHE_GLYPH_V2_ORDER));
+
+	for (i = 0; i < (int) cache_glyph_v2_order->cGlyphs; i++)
+		cache_glyph_v2_order->glyphData[i] = NULL;
+
+	message_post(context, MSG_CACHE_GLYPH_V2, wParam, NULL);
+}
+
+static void message_CacheBrush(rdpContext* context, CACHE_BRUSH_ORDER* cache_brush_order)
+{
+	message_post(context, MSG_CACHE_BRUSH, message_dup(cache_brush_order, sizeof(CACHE_BRUSH_ORDER)), NULL);
+}
+
+/* Alternate Secondary Update */
+
+static void message_CreateOffscreenBitmap(rdpContext* context, CREATE_OFFSCREEN_BITMAP_ORDER* create_offscreen_bitmap)
+{
+	CREATE_OFFSCREEN_BITMAP_ORDER* wParam;
+	OFFSCREEN_DELETE_LIST* deleteList;
+
+	wParam = (CREATE_OFFSCREEN_BITMAP_ORDER*) message_dup(create_offscreen_bitmap, sizeof(CREATE_OFFSCREEN_BITMAP_ORDER));
+	deleteList = &create_offscreen_bitmap->deleteList;
+	wParam->deleteList.sIndices = deleteList->cIndices;
+	wParam->deleteList.indices = (uint16*) message_dup(deleteList->indices, deleteList->cIndices * 2);
+
+	message_post(context, MSG_CREATE_OFFSCREEN_BITMAP, wParam, NULL);
+}
+
+static void message_SwitchSurface(rdpContext* context, SWITCH_SURFACE_ORDER* switch_surface)
+{
+	message_post(context, MSG_SWITCH_SURFACE, message_dup(switch_surface, sizeof(SWITCH_SURFACE_ORDER)), NULL);
+}
+
+static void message_CreateNineGridBitmap(rdpContext* context, CREATE_NINE_GRID_BITMAP_ORDER* create_nine_grid_bitmap)
+{
+	message_post(context, MSG_CREATE_NINE_GRID_BITMAP, message_dup(create_nine_grid_bitmap, sizeof(CREATE_NINE_GRID_BITMAP_ORDER)), NULL);
+}
+
+static void message_FrameMarker(rdpContext* context, FRAME_MARKER_ORDER* frame_marker)
+{
+	message_post(context, MSG_FRAME_MARKER, message_dup(frame_marker, sizeof(FRAME_MARKER_ORDER)), NULL);
+}
+
+/**
+ * The payload of stream bitmap and GDI+ orders is skipped by the parser,
+ * so those orders are copied as they are.
+ */
+
+static void message_StreamBitmapFirst(rdpContext* context, STREAM_BITMAP_FIRST_ORDER* stream_bitmap_first)
+{
+	message_post(context, MSG_STREAM_BITMAP_FIRST, message_dup(stream_bitmap_first, sizeof(STREAM_BITMAP_FIRST_ORDER)), NULL);
+}
+
+static void message_StreamBitmapNext(rdpContext* context, STREAM_BITMAP_FIRST_ORDER* stream_bitmap_next)
+{
+	message_post(context, MSG_STREAM_BITMAP_NEXT, message_dup(stream_bitmap_next, sizeof(STREAM_BITMAP_FIRST_ORDER)), NULL);
+}
+
+static void message_DrawGdiPlusFirst(rdpContext* context, DRAW_GDIPLUS_FIRST_ORDER* draw_gdiplus_first)
+{
+	message_post(context, MSG_DRAW_GDIPLUS_FIRST, message_dup(draw_gdiplus_first, sizeof(DRAW_GDIPLUS_FIRST_ORDER)), NULL);
+}
+
+static void message_DrawGdiPlusNext(rdpContext* context, DRAW_GDIPLUS_NEXT_ORDER* draw_gdiplus_next)
+{
+	message_post(context, MSG_DRAW_GDIPLUS_NEXT, message_dup(draw_gdiplus_next, sizeof(DRAW_GDIPLUS_NEXT_ORDER)), NULL);
+}
+
+static void message_DrawGdiPlusEnd(rdpContext* context, DRAW_GDIPLUS_END_ORDER* draw_gdiplus_end)
+{
+	message_post(context, MSG_DRAW_GDIPLUS_END, message_dup(draw_gdiplus_end, sizeof(DRAW_GDIPLUS_END_ORDER)), NULL);
+}
+
+static void message_DrawGdiPlusCacheFirst(rdpContext* context, DRAW_GDIPLUS_CACHE_FIRST_ORDER* draw_gdiplus_cache_first)
+{
+	message_post(context, MSG_DRAW_GDIPLUS_CACHE_FIRST, message_dup(draw_gdiplus_cache_first, sizeof(DRAW_GDIPLUS_CACHE_FIRST_ORDER)), NULL);
+}
+
+static void message_DrawGdiPlusCacheNext(rdpContext* context, DRAW_GDIPLUS_CACHE_NEXT_ORDER* draw_gdiplus_cache_next)
+{
+	message_post(context, MSG_DRAW_GDIPLUS_CACHE_NEXT, message_dup(draw_gdiplus_cache_next, sizeof(DRAW_GDIPLUS_CACHE_NEXT_ORDER)), NULL);
+}
+
+static void message_DrawGdiPlusCacheEnd(rdpContext* context, DRAW_GDIPLUS_CACHE_END_ORDER* draw_gdiplus_cache_end)
+{
+	message_post(context, MSG_DRAW_GDIPLUS_CACHE_END, message_dup(draw_gdiplus_cache_end, sizeof(DRAW_GDIPLUS_CACHE_END_ORDER)), NULL);
+}
+
+/* Window Update */
+
+/**
+ * Window and visibility rectangles are allocated for every order and owned
+ * by the window list afterwards, only the title is copied.
+ */
+
+static WINDOW_STATE_ORDER* message_copy_window_state(WINDOW_STATE_ORDER* window_state)
+{
+	WINDOW_STATE_ORDER* copy;
+
+	copy = (WINDOW_STATE_ORDER*) message_dup(window_state, sizeof(WINDOW_STATE_ORDER));
+	message_copy_unicode_string(&copy->titleInfo, &window_state->titleInfo);
+
+	return copy;
+}
+
+static void message_WindowCreate(rdpContext* context, WINDOW_ORDER_INFO* orderInfo, WINDOW_STATE_ORDER* window_state)
+{
+	message_post(context, MSG_WINDOW_CREATE, message_dup(orderInfo, sizeof(WINDOW_ORDER_INFO)),
+			message_copy_window_state(window_state));
+}
+
+static void message_WindowUpdate(rdpContext* context, WINDOW_ORDER_INFO* orderInfo, WINDOW_STATE_ORDER* window_state)
+{
+	message_post(context, MSG_WINDOW_UPDATE, message_dup(orderInfo, sizeof(WINDOW_ORDER_INFO)),
+			message_copy_window_state(window_state));
+}
+
+static void message_WindowIcon(rdpContext* context, WINDOW_ORDER_INFO* orderInfo, WINDOW_ICON_ORDER* window_icon)
+{
+	message_post(context, MSG_WINDOW_ICON, message_dup(orderInfo, sizeof(WINDOW_ORDER_INFO)),
+			message_dup(window_icon, sizeof(WINDOW_ICON_ORDER)));
+}
+
+static void message_WindowCachedIcon(rdpContext* context, WINDOW_ORDER_INFO* orderInfo, WINDOW_CACHED_ICON_ORDER* window_cached_icon)
+{
+	message_post(context, MSG_WINDOW_CACHED_ICON, message_dup(orderInfo, sizeof(WINDOW_ORDER_INFO)),
+			message_dup(window_cached_icon, sizeof(WINDOW_CACHED_ICON_ORDER)));
+}
+
+static void message_WindowDelete(rdpContext* context, WINDOW_ORDER_INFO* orderInfo)
+{
+	message_post(context, MSG_WINDOW_DELETE, message_dup(orderInfo, sizeof(WINDOW_ORDER_INFO)), NULL);
+}
+
+static NOTIFY_ICON_STATE_ORDER* message_copy_notify_icon_state(NOTIFY_ICON_STATE_ORDER* notify_icon_state)
+{
+	NOTIFY_ICON_STATE_ORDER* copy;
+	ICON_INFO* icon = &notify_icon_state->icon;
+
+	copy = (NOTIFY_ICON_STATE_ORDER*) message_dup(notify_icon_state, sizeof(NOTIFY_ICON_STATE_ORDER));
+	message_copy_unicode_string(&copy->toolTip, &notify_icon_state->toolTip);
+	message_copy_unicode_string(&copy->infoTip.text, &notify_icon_state->infoTip.text);
+	message_copy_unicode_string(&copy->infoTip.title, &notify_icon_state->infoTip.title);
+	copy->icon.bitsMask = (uint8*) message_dup(icon->bitsMask, icon->cbBitsMask);
+	copy->icon.colorTable = (uint8*) message_dup(icon->colorTable, icon->cbColorTable);
+	copy->icon.bitsColor = (uint8*) message_dup(icon->bitsColor, icon->cbBitsColor);
+
+	return copy;
+}
+
+static void message_NotifyIconCreate(rdpContext* context, WINDOW_ORDER_INFO* orderInfo, NOTIFY_ICON_STATE_ORDER* notify_icon_state)
+{
+	message_post(context, MSG_NOTIFY_ICON_CREATE, message_dup(orderInfo, sizeof(WINDOW_ORDER_INFO)),
+			message_copy_notify_icon_state(notify_icon_state));
+}
+
+static void message_NotifyIconUpdate(rdpContext* context, WINDOW_ORDER_INFO* orderInfo, NOTIFY_ICON_STATE_ORDER* notify_icon_state)
+{
+	message_post(context, MSG_NOTIFY_ICON_UPDATE, message_dup(orderInfo, sizeof(WINDOW_ORDER_INFO)),
+			message_copy_notify_icon_state(notify_icon_state));
+}
+
+static void message_NotifyIconDelete(rdpContext* context, WINDOW_ORDER_INFO* orderInfo)
+{
+	message_post(context, MSG_NOTIFY_ICON_DELETE, message_dup(orderInfo, sizeof(WINDOW_ORDER_INFO)), NULL);
+}
+
+static void message_MonitoredDesktop(rdpContext* context, WINDOW_ORDER_INFO* orderInfo, MONITORED_DESKTOP_ORDER* monitored_desktop)
+{
+	MONITORED_DESKTOP_ORDER* lParam;
+
+	lParam = (MONITORED_DESKTOP_ORDER*) message_dup(monitored_desktop, sizeof(MONITORED_DESKTOP_ORDER));
+	lParam->windowIds = (uint32*) message_dup(monitored_desktop->windowIds, monitored_desktop->numWindowIds * 4);
+
+	message_post(context, MSG_MONITORED_DESKTOP, message_dup(orderInfo, sizeof(WINDOW_ORDER_INFO)), lParam);
+}
+
+static void message_NonMonitoredDesktop(rdpContext* context, WINDOW_ORDER_INFO* orderInfo)
+{
+	message_post(context, MSG_NON_MONITORED_DESKTOP, message_dup(orderInfo, sizeof(WINDOW_ORDER_INFO)), NULL);
+}
+
+/* Pointer Update */
+
+/**
+ * Pointer masks are allocated for every update and owned by the pointer
+ * cache afterwards, so pointer updates are copied as they are.
+ */
+
+static void message_PointerPosition(rdpContext* context, POINTER_POSITION_UPDATE* pointer_position)
+{
+	message_post(context, MSG_POINTER_POSITION, message_dup(pointer_position, sizeof(POINTER_POSITION_UPDATE)), NULL);
+}
+
+static void message_PointerSystem(rdpContext* context, POINTER_SYSTEM_UPDATE* pointer_system)
+{
+	message_post(context, MSG_POINTER_SYSTEM, message_dup(pointer_system, sizeof(POINTER_SYSTEM_UPDATE)), NULL);
+}
+
+static void message_PointerColor(rdpContext* context, POINTER_COLOR_UPDATE* pointer_color)
+{
+	message_post(context, MSG_POINTER_COLOR, message_dup(pointer_color, sizeof(POINTER_COLOR_UPDATE)), NULL);
+}
+
+static void message_PointerNew(rdpContext* context, POINTER_NEW_UPDATE* pointer_new)
+{
+	message_post(context, MSG_POINTER_NEW, message_dup(pointer_new, sizeof(POINTER_NEW_UPDATE)), NULL);
+}
+
+static void message_PointerCached(rdpContext* context, POINTER_CACHED_UPDATE* pointer_cached)
+{
+	message_post(context, MSG_POINTER_CACHED, message_dup(pointer_cached, sizeof(POINTER_CACHED_UPDATE)), NULL);
+}
+
+/**
+ * Execute a message against the callbacks registered before the queue.
+ */
+
+static void message_process(rdpMessageQueue* queue, rdpMessage* message)
+{
+	void* wParam = message->wParam;
+	void* lParam = message->lParam;
+	rdpContext* context = queue->update->context;
+
+	switch (message->id)
+	{
+		case MSG_BEGIN_PAINT:
+			IFCALL(queue->saved_update.BeginPaint, context);
+			break;
+
+		case MSG_END_PAINT:
+			IFCALL(queue->saved_update.EndPaint, context);
+			break;
+
+		case MSG_SET_BOUNDS:
+			IFCALL(queue->saved_update.SetBounds, context, (rdpBounds*) wParam);
+			break;
+
+		case MSG_SYNCHRONIZE:
+			IFCALL(queue->saved_update.Synchronize, context);
+			break;
+
+		case MSG_DESKTOP_RESIZE:
+			IFCALL(queue->saved_update.DesktopResize, context);
+			break;
+
+		case MSG_BITMAP_UPDATE:
+			IFCALL(queue->saved_update.BitmapUpdate, context, (BITMAP_UPDATE*) wParam);
+			break;
+
+		case MSG_PALETTE:
+			IFCALL(queue->saved_update.Palette, context, (PALETTE_UPDATE*) wParam);
+			break;
+
+		case MSG_PLAY_SOUND:
+			IFCALL(queue->saved_update.PlaySound, context, (PLAY_SOUND_UPDATE*) wParam);
+			break;
+
+		case MSG_RESET_STATE:
+			IFCALL(queue->saved_update.ResetState, context);
+			break;
+
+		case MSG_SURFACE_BITS:
+			IFCALL(queue->saved_update.SurfaceBits, context, (SURFACE_BITS_COMMAND*) wParam);
+			break;
+
+		case MSG_SURFACE_FRAME_MARKER:
+			IFCALL(queue->saved_update.SurfaceFrameMarker, context, (SURFACE_FRAME_MARKER*) wParam);
+			update_frame_acknowledge(queue->update, (SURFACE_FRAME_MARKER*) wParam);
+			break;
+
+		case MSG_DSTBLT:
+			IFCALL(queue->saved_primary.DstBlt, context, (DSTBLT_ORDER*) wParam);
+			break;
+
+		case MSG_PATBLT:
+			IFCALL(queue->saved_primary.PatBlt, context, (PATBLT_ORDER*) wParam);
+			break;
+
+		case MSG_SCRBLT:
+			IFCALL(queue->saved_primary.ScrBlt, context, (SCRBLT_ORDER*) wParam);
+			break;
+
+		case MSG_OPAQUE_RECT:
+			IFCALL(queue->saved_primary.OpaqueRect, context, (OPAQUE_RECT_ORDER*) wParam);
+			break;
+
+		case MSG_DRAW_NINE_GRID:
+			IFCALL(queue->saved_primary.DrawNineGrid, context, (DRAW_NINE_GRID_ORDER*) wParam);
+			break;
+
+		case MSG_MULTI_DSTBLT:
+			IFCALL(queue->saved_primary.MultiDstBlt, context, (MULTI_DSTBLT_ORDER*) wParam);
+			break;
+
+		case MSG_MULTI_PATBLT:
+			IFCALL(queue->saved_primary.MultiPatBlt, context, (MULTI_PATBLT_ORDER*) wParam);
+			break;
+
+		case MSG_MULTI_SCRBLT:
+			IFCALL(queue->saved_primary.MultiScrBlt, context, (MULTI_SCRBLT_ORDER*) wParam);
+			break;
+
+		case MSG_MULTI_OPAQUE_RECT:
+			IFCALL(queue->saved_primary.MultiOpaqueRect, context, (MULTI_OPAQUE_RECT_ORDER*) wParam);
+			break;
+
+		case MSG_MULTI_DRAW_NINE_GRID:
+			IFCALL(queue->saved_primary.MultiDrawNineGrid, context, (MULTI_DRAW_NINE_GRID_ORDER*) wParam);
+			break;
+
+		case MSG_LINE_TO:
+			IFCALL(queue->saved_primary.LineTo, context, (LINE_TO_ORDER*) wParam);
+			break;
+
+		case MSG_POLYLINE:
+			IFCALL(queue->saved_primary.Polyline, context, (POLYLINE_ORDER*) wParam);
+			break;
+
+		case MSG_MEMBLT:
+			IFCALL(queue->saved_primary.MemBlt, context, (MEMBLT_ORDER*) wParam);
+			break;
+
+		case MSG_MEM3BLT:
+			IFCALL(queue->saved_primary.Mem3Blt, context, (MEM3BLT_ORDER*) wParam);
+			break;
+
+		case MSG_SAVE_BITMAP:
+			IFCALL(queue->saved_primary.SaveBitmap, context, (SAVE_BITMAP_ORDER*) wParam);
+			break;
+
+		case MSG_GLYPH_INDEX:
+			IFCALL(queue->saved_primary.GlyphIndex, context, (GLYPH_INDEX_ORDER*) wParam);
+			break;
+
+		case MSG_FAST_INDEX:
+			IFCALL(queue->saved_primary.FastIndex, context, (FAST_INDEX_ORDER*) wParam);
+			break;
+
+		case MSG_FAST_GLYPH:
+			IFCALL(queue->saved_primary.FastGlyph, context, (FAST_GLYPH_ORDER*) wParam);
+			break;
+
+		case MSG_POLYGON_SC:
+			IFCALL(queue->saved_primary.PolygonSC, context, (POLYGON_SC_ORDER*) wParam);
+			break;
+
+		case MSG_POLYGON_CB:
+			IFCALL(queue->saved_primary.PolygonCB, context, (POLYGON_CB_ORDER*) wParam);
+			break;
+
+		case MSG_ELLIPSE_SC:
+			IFCALL(queue->saved_primary.EllipseSC, context, (ELLIPSE_SC_ORDER*) wParam);
+			break;
+
+		case MSG_ELLIPSE_CB:
+			IFCALL(queue->saved_primary.EllipseCB, context, (ELLIPSE_CB_ORDER*) wParam);
+			break;
+
+		case MSG_CACHE_BITMAP:
+			IFCALL(queue->saved_secondary.CacheBitmap, context, (CACHE_BITMAP_ORDER*) wParam);
+			break;
+
+		case MSG_CACHE_BITMAP_V2:
+			IFCALL(queue->saved_secondary.CacheBitmapV2, context, (CACHE_BITMAP_V2_ORDER*) wParam);
+			break;
+
+		case MSG_CACHE_BITMAP_V3:
+			IFCALL(queue->saved_secondary.CacheBitmapV3, context, (CACHE_BITMAP_V3_ORDER*) wParam);
+			break;
+
+		case MSG_CACHE_COLOR_TABLE:
+			IFCALL(queue->saved_secondary.CacheColorTable, context, (CACHE_COLOR_TABLE_ORDER*) wParam);
+			break;
+
+		case MSG_CACHE_GLYPH:
+			IFCALL(queue->saved_secondary.CacheGlyph, context, (CACHE_GLYPH_ORDER*) wParam);
+			break;
+
+		case MSG_CACHE_GLYPH_V2:
+			IFCALL(queue->saved_secondary.CacheGlyphV2, context, (CACHE_GLYPH_V2_ORDER*) wParam);
+			break;
+
+		case MSG_CACHE_BRUSH:
+			IFCALL(queue->saved_secondary.CacheBrush, context, (CACHE_BRUSH_ORDER*) wParam);
+			break;
+
+		case MSG_CREATE_OFFSCREEN_BITMAP:
+			IFCALL(queue->saved_altsec.CreateOffscreenBitmap, context, (CREATE_OFFSCREEN_BITMAP_ORDER*) wParam);
+			break;
+
+		case MSG_SWITCH_SURFACE:
+			IFCALL(queue->saved_altsec.SwitchSurface, context, (SWITCH_SURFACE_ORDER*) wParam);
+			break;
+
+		case MSG_CREATE_NINE_GRID_BITMAP:
+			IFCALL(queue->saved_altsec.CreateNineGridBitmap, context, (CREATE_NINE_GRID_BITMAP_ORDER*) wParam);
+			break;
+
+		case MSG_FRAME_MARKER:
+			IFCALL(queue->saved_altsec.FrameMarker, context, (FRAME_MARKER_ORDER*) wParam);
+			break;
+
+		case MSG_STREAM_BITMAP_FIRST:
+			IFCALL(queue->saved_altsec.StreamBitmapFirst, context, (STREAM_BITMAP_FIRST_ORDER*) wParam);
+			break;
+
+		case MSG_STREAM_BITMAP_NEXT:
+			IFCALL(queue->saved_altsec.StreamBitmapNext, context, (STREAM_BITMAP_FIRST_ORDER*) wParam);
+			break;
+
+		case MSG_DRAW_GDIPLUS_FIRST:
+			IFCALL(queue->saved_altsec.DrawGdiPlusFirst, context, (DRAW_GDIPLUS_FIRST_ORDER*) wParam);
+			break;
+
+		case MSG_DRAW_GDIPLUS_NEXT:
+			IFCALL(queue->saved_altsec.DrawGdiPlusNext, context, (DRAW_GDIPLUS_NEXT_ORDER*) wParam);
+			break;
+
+		case MSG_DRAW_GDIPLUS_END:
+			IFCALL(queue->saved_altsec.DrawGdiPlusEnd, context, (DRAW_GDIPLUS_END_ORDER*) wParam);
+			break;
+
+		case MSG_DRAW_GDIPLUS_CACHE_FIRST:
+			IFCALL(queue->saved_altsec.DrawGdiPlusCacheFirst, context, (DRAW_GDIPLUS_CACHE_FIRST_ORDER*) wParam);
+			break;
+
+		case MSG_DRAW_GDIPLUS_CACHE_NEXT:
+			IFCALL(queue->saved_altsec.DrawGdiPlusCacheNext, context, (DRAW_GDIPLUS_CACHE_NEXT_ORDER*) wParam);
+			break;
+
+		case MSG_DRAW_GDIPLUS_CACHE_END:
+			IFCALL(queue->saved_altsec.DrawGdiPlusCacheEnd, context, (DRAW_GDIPLUS_CACHE_END_ORDER*) wParam);
+			break;
+
+		case MSG_WINDOW_CREATE:
+			IFCALL(queue->saved_window.WindowCreate, context, (WINDOW_ORDER_INFO*) wParam, (WINDOW_STATE_ORDER*) lParam);
+			break;
+
+		case MSG_WINDOW_UPDATE:
+			IFCALL(queue->saved_window.WindowUpdate, context, (WINDOW_ORDER_INFO*) wParam, (WINDOW_STATE_ORDER*) lParam);
+			break;
+
+		case MSG_WINDOW_ICON:
+			IFCALL(queue->saved_window.WindowIcon, context, (WINDOW_ORDER_INFO*) wParam, (WINDOW_ICON_ORDER*) lParam);
+			break;
+
+		case MSG_WINDOW_CACHED_ICON:
+			IFCALL(queue->saved_window.WindowCachedIcon, context, (WINDOW_ORDER_INFO*) wParam, (WINDOW_CACHED_ICON_ORDER*) lParam);
+			break;
+
+		case MSG_WINDOW_DELETE:
+			IFCALL(queue->saved_window.WindowDelete, context, (WINDOW_ORDER_INFO*) wParam);
+			break;
+
+		case MSG_NOTIFY_ICON_CREATE:
+			IFCALL(queue->saved_window.NotifyIconCreate, context, (WINDOW_ORDER_INFO*) wParam, (NOTIFY_ICON_STATE_ORDER*) lParam);
+			break;
+
+		case MSG_NOTIFY_ICON_UPDATE:
+			IFCALL(queue->saved_window.NotifyIconUpdate, context, (WINDOW_ORDER_INFO*) wParam, (NOTIFY_ICON_STATE_ORDER*) lParam);
+			break;
+
+		case MSG_NOTIFY_ICON_DELETE:
+			IFCALL(queue->saved_window.NotifyIconDelete, context, (WINDOW_ORDER_INFO*) wParam);
+			break;
+
+		case MSG_MONITORED_DESKTOP:
+			IFCALL(queue->saved_window.MonitoredDesktop, context, (WINDOW_ORDER_INFO*) wParam, (MONITORED_DESKTOP_ORDER*) lParam);
+			break;
+
+		case MSG_NON_MONITORED_DESKTOP:
+			IFCALL(queue->saved_window.NonMonitoredDesktop, context, (WINDOW_ORDER_INFO*) wParam);
+			break;
+
+		case MSG_POINTER_POSITION:
+			IFCALL(queue->saved_pointer.PointerPosition, context, (POINTER_POSITION_UPDATE*) wParam);
+			break;
+
+		case MSG_POINTER_SYSTEM:
+			IFCALL(queue->saved_pointer.PointerSystem, context, (POINTER_SYSTEM_UPDATE*) wParam);
+			break;
+
+		case MSG_POINTER_COLOR:
+			IFCALL(queue->saved_pointer.PointerColor, context, (POINTER_COLOR_UPDATE*) wParam);
+			break;
+
+		case MSG_POINTER_NEW:
+			IFCALL(queue->saved_pointer.PointerNew, context, (POINTER_NEW_UPDATE*) wParam);
+			break;
+
+		case MSG_POINTER_CACHED:
+			IFCALL(queue->saved_pointer.PointerCached, context, (POINTER_CACHED_UPDATE*) wParam);
+			break;
+
+		default:
+			break;
+	}
+}
+
+static void message_free_glyph(uint8* aj, void* glyph)
+{
+	if (glyph == NULL)
+		return;
+
+	xfree(aj);
+	xfree(glyph);
+}
+
+static void message_free(rdpMessage* message)
+{
+	int i;
+	void* wParam = message->wParam;
+	void* lParam = message->lParam;
+
+	switch (message->id)
+	{
+		case MSG_BITMAP_UPDATE:
+			{
+				BITMAP_UPDATE* bitmap = (BITMAP_UPDATE*) wParam;
+
+				for (i = 0; i < (int) bitmap->count; i++)
+					xfree(bitmap->rectangles[i].bitmapDataStream);
+
+				xfree(bitmap->rectangles);
+			}
+			break;
+
+		case MSG_SURFACE_BITS:
+			xfree(((SURFACE_BITS_COMMAND*) wParam)->bitmapData);
+			break;
+
+		case MSG_POLYLINE:
+			xfree(((POLYLINE_ORDER*) wParam)->points);
+			break;
+
+		case MSG_POLYGON_SC:
+			xfree(((POLYGON_SC_ORDER*) wParam)->points);
+			break;
+
+		case MSG_POLYGON_CB:
+			xfree(((POLYGON_CB_ORDER*) wParam)->points);
+			break;
+
+		case MSG_FAST_GLYPH:
+			{
+				GLYPH_DATA_V2* glyph = (GLYPH_DATA_V2*) ((FAST_GLYPH_ORDER*) wParam)->glyph_data;
+
+				if (glyph != NULL)
+					message_free_glyph(glyph->aj, glyph);
+			}
+			break;
+
+		case MSG_CACHE_BITMAP:
+			xfree(((CACHE_BITMAP_ORDER*) wParam)->bitmapDataStream);
+			break;
+
+		case MSG_CACHE_BITMAP_V2:
+			xfree(((CACHE_BITMAP_V2_ORDER*) wParam)->bitmapDataStream);
+			break;
+
+		case MSG_CACHE_BITMAP_V3:
+			xfree(((CACHE_BITMAP_V3_ORDER*) wParam)->bitmapData.data);
+			break;
+
+		case MSG_CACHE_GLYPH:
+			{
+				CACHE_GLYPH_ORDER* cache_glyph = (CACHE_GLYPH_ORDER*) wParam;
+
+				/* glyphs taken over by the glyph cache have been reset */
+				for (i = 0; i < (int) cache_glyph->cGlyphs; i++)
+				{
+					if (cache_glyph->glyphData[i] != NULL)
+						message_free_glyph(cache_glyph->glyphData[i]->aj, cache_glyph->glyphData[i]);
+				}
+			}
+			break;
+
+		case MSG_CACHE_GLYPH_V2:
+			{
+				CACHE_GLYPH_V2_ORDER* cache_glyph_v2 = (CACHE_GLYPH_V2_ORDER*) wParam;
+
+				for (i = 0; i < (int) cache_glyph_v2->cGlyphs; i++)
+				{
+					if (cache_glyph_v2->glyphData[i] != NULL)
+						message_free_glyph(cache_glyph_v2->glyphData[i]->aj, cache_glyph_v2->glyphData[i]);
+				}
+			}
+			break;
+
+		case MSG_CREATE_OFFSCREEN_BITMAP:
+			xfree(((CREATE_OFFSCREEN_BITMAP_ORDER*) wParam)->deleteList.indices);
+			break;
+
+		case MSG_WINDOW_CREATE:
+		case MSG_WINDOW_UPDATE:
+			xfree(((WINDOW_STATE_ORDER*) lParam)->titleInfo.string);
+			break;
+
+		case MSG_NOTIFY_ICON_CREATE:
+		case MSG_NOTIFY_ICON_UPDATE:
+			{
+				NOTIFY_ICON_STATE_ORDER* notify_icon_state = (NOTIFY_ICON_STATE_ORDER*) lParam;
+
+				xfree(notify_icon_state->toolTip.string);
+				xfree(notify_icon_state->infoTip.text.string);
+				xfree(notify_icon_state->infoTip.title.string);
+				xfree(notify_icon_state->icon.bitsMask);
+				xfree(notify_icon_state->icon.colorTable);
+				xfree(notify_icon_state->icon.bitsColor);
+			}
+			break;
+
+		case MSG_MONITORED_DESKTOP:
+			xfree(((MONITORED_DESKTOP_ORDER*) lParam)->windowIds);
+			break;
+
+		default:
+			break;
+	}
+
+	xfree(wParam);
+	xfree(lParam);
+	xfree(message);
+}
+
+static void message_queue_attach(rdpMessageQueue* queue)
+{
+	rdpUpdate* update = queue->update;
+	rdpPrimaryUpdate* primary = update->primary;
+	rdpSecondaryUpdate* secondary = update->secondary;
+	rdpAltSecUpdate* altsec = update->altsec;
+	rdpWindowUpdate* window = update->window;
+	rdpPointerUpdate* pointer = update->pointer;
+
+	memcpy(&queue->saved_update, update, sizeof(rdpUpdate));
+	memcpy(&queue->saved_primary, primary, sizeof(rdpPrimaryUpdate));
+	memcpy(&queue->saved_secondary, secondary, sizeof(rdpSecondaryUpdate));
+	memcpy(&queue->saved_altsec, altsec, sizeof(rdpAltSecUpdate));
+	memcpy(&queue->saved_window, window, sizeof(rdpWindowUpdate));
+	memcpy(&queue->saved_pointer, pointer, sizeof(rdpPointerUpdate));
+
+	update->queue = queue;
+
+	/* callbacks nobody registered stay unset, so the parser keeps skipping them */
+
+	if (update->BeginPaint) update->BeginPaint = message_BeginPaint;
+	if (update->EndPaint) update->EndPaint = message_EndPaint;
+	if (update->SetBounds) update->SetBounds = message_SetBounds;
+	if (update->Synchronize) update->Synchronize = message_Synchronize;
+	if (update->DesktopResize) update->DesktopResize = message_DesktopResize;
+	if (update->BitmapUpdate) update->BitmapUpdate = message_BitmapUpdate;
+	if (update->Palette) update->Palette = message_Palette;
+	if (update->PlaySound) update->PlaySound = message_PlaySound;
+	if (update->ResetState) update->ResetState = message_ResetState;
+	if (update->SurfaceBits) update->SurfaceBits = message_SurfaceBits;
+	if (update->SurfaceFrameMarker) update->SurfaceFrameMarker = message_SurfaceFrameMarker;
+
+	if (primary->DstBlt) primary->DstBlt = message_DstBlt;
+	if (primary->PatBlt) primary->PatBlt = message_PatBlt;
+	if (primary->ScrBlt) primary->ScrBlt = message_ScrBlt;
+	if (primary->OpaqueRect) primary->OpaqueRect = message_OpaqueRect;
+	if (primary->DrawNineGrid) primary->DrawNineGrid = message_DrawNineGrid;
+	if (primary->MultiDstBlt) primary->MultiDstBlt = message_MultiDstBlt;
+	if (primary->MultiPatBlt) primary->MultiPatBlt = message_MultiPatBlt;
+	if (primary->MultiScrBlt) primary->MultiScrBlt = message_MultiScrBlt;
+	if (primary->MultiOpaqueRect) primary->MultiOpaqueRect = message_MultiOpaqueRect;
+	if (primary->MultiDrawNineGrid) primary->MultiDrawNineGrid = message_MultiDrawNineGrid;
+	if (primary->LineTo) primary->LineTo = message_LineTo;
+	if (primary->Polyline) primary->Polyline = message_Polyline;
+	if (primary->MemBlt) primary->MemBlt = message_MemBlt;
+	if (primary->Mem3Blt) primary->Mem3Blt = message_Mem3Blt;
+	if (primary->SaveBitmap) primary->SaveBitmap = message_SaveBitmap;
+	if (primary->GlyphIndex) primary->GlyphIndex = message_GlyphIndex;
+	if (primary->FastIndex) primary->FastIndex = message_FastIndex;
+	if (primary->FastGlyph) primary->FastGlyph = message_FastGlyph;
+	if (primary->PolygonSC) primary->PolygonSC = message_PolygonSC;
+	if (primary->PolygonCB) primary->PolygonCB = message_PolygonCB;
+	if (primary->EllipseSC) primary->EllipseSC = message_EllipseSC;
+	if (primary->EllipseCB) primary->EllipseCB = message_EllipseCB;
+
+	if (secondary->CacheBitmap) secondary->CacheBitmap = message_CacheBitmap;
+	if (secondary->CacheBitmapV2) secondary->CacheBitmapV2 = message_CacheBitmapV2;
+	if (secondary->CacheBitmapV3) secondary->CacheBitmapV3 = message_CacheBitmapV3;
+	if (secondary->CacheColorTable) secondary->CacheColorTable = message_CacheColorTable;
+	if (secondary->CacheGlyph) secondary->CacheGlyph = message_CacheGlyph;
+	if (secondary->CacheGlyphV2) secondary->CacheGlyphV2 = message_CacheGlyphV2;
+	if (secondary->CacheBrush) secondary->CacheBrush = message_CacheBrush;
+
+	if (altsec->CreateOffscreenBitmap) altsec->CreateOffscreenBitmap = message_CreateOffscreenBitmap;
+	if (altsec->SwitchSurface) altsec->SwitchSurface = message_SwitchSurface;
+	if (altsec->CreateNineGridBitmap) altsec->CreateNineGridBitmap = message_CreateNineGridBitmap;
+	if (altsec->FrameMarker) altsec->FrameMarker = message_FrameMarker;
+	if (altsec->StreamBitmapFirst) altsec->StreamBitmapFirst = message_StreamBitmapFirst;
+	if (altsec->StreamBitmapNext) altsec->StreamBitmapNext = message_StreamBitmapNext;
+	if (altsec->DrawGdiPlusFirst) altsec->DrawGdiPlusFirst = message_DrawGdiPlusFirst;
+	if (altsec->DrawGdiPlusNext) altsec->DrawGdiPlusNext = message_DrawGdiPlusNext;
+	if (altsec->DrawGdiPlusEnd) altsec->DrawGdiPlusEnd = message_DrawGdiPlusEnd;
+	if (altsec->DrawGdiPlusCacheFirst) altsec->DrawGdiPlusCacheFirst = message_DrawGdiPlusCacheFirst;
+	if (altsec->DrawGdiPlusCacheNext) altsec->DrawGdiPlusCacheNext = message_DrawGdiPlusCacheNext;
+	if (altsec->DrawGdiPlusCacheEnd) altsec->DrawGdiPlusCacheEnd = message_DrawGdiPlusCacheEnd;
+
+	if (window->WindowCreate) window->WindowCreate = message_WindowCreate;
+	if (window->WindowUpdate) window->WindowUpdate = message_WindowUpdate;
+	if (window->WindowIcon) window->WindowIcon = message_WindowIcon;
+	if (window->WindowCachedIcon) window->WindowCachedIcon = message_WindowCachedIcon;
+	if (window->WindowDelete) window->WindowDelete = message_WindowDelete;
+	if (window->NotifyIconCreate) window->NotifyIconCreate = message_NotifyIconCreate;
+	if (window->NotifyIconUpdate) window->NotifyIconUpdate = message_NotifyIconUpdate;
+	if (window->NotifyIconDelete) window->NotifyIconDelete = message_NotifyIconDelete;
+	if (window->MonitoredDesktop) window->MonitoredDesktop = message_MonitoredDesktop;
+	if (window->NonMonitoredDesktop) window->NonMonitoredDesktop = message_NonMonitoredDesktop;
+
+	if (pointer->PointerPosition) pointer->PointerPosition = message_PointerPosition;
+	if (pointer->PointerSystem) pointer->PointerSystem = message_PointerSystem;
+	if (pointer->PointerColor) pointer->PointerColor = message_PointerColor;
+	if (pointer->PointerNew) pointer->PointerNew = message_PointerNew;
+	if (pointer->PointerCached) pointer->PointerCached = message_PointerCached;
+}
+
+static void message_queue_detach(rdpMessageQueue* queue)
+{
+	rdpUpdate* update = queue->update;
+	rdpPrimaryUpdate* primary = update->primary;
+	rdpSecondaryUpdate* secondary = update->secondary;
+	rdpAltSecUpdate* altsec = update->altsec;
+	rdpWindowUpdate* window = update->window;
+	rdpPointerUpdate* pointer = update->pointer;
+
+	update->BeginPaint = queue->saved_update.BeginPaint;
+	update->EndPaint = queue->saved_update.EndPaint;
+	update->SetBounds = queue->saved_update.SetBounds;
+	update->Synchronize = queue->saved_update.Synchronize;
+	update->DesktopResize = queue->saved_update.DesktopResize;
+	update->BitmapUpdate = queue->saved_update.BitmapUpdate;
+	update->Palette = queue->saved_update.Palette;
+	update->PlaySound = queue->saved_update.PlaySound;
+	update->ResetState = queue->saved_update.ResetState;
+	update->SurfaceBits = queue->saved_update.SurfaceBits;
+	update->SurfaceFrameMarker = queue->saved_update.SurfaceFrameMarker;
+
+	/* the other interfaces only have callbacks up to their second padding */
+
+	memcpy(&primary->DstBlt, &queue->saved_primary.DstBlt,
+			(uint8*) &primary->paddingB - (uint8*) &primary->DstBlt);
+	memcpy(&secondary->CacheBitmap, &queue->saved_secondary.CacheBitmap,
+			(uint8*) &secondary->paddingE - (uint8*) &secondary->CacheBitmap);
+	memcpy(&altsec->CreateOffscreenBitmap, &queue->saved_altsec.CreateOffscreenBitmap,
+			(uint8*) &altsec->paddingB - (uint8*) &altsec->CreateOffscreenBitmap);
+	memcpy(&window->WindowCreate, &queue->saved_window.WindowCreate,
+			(uint8*) &window->paddingB - (uint8*) &window->WindowCreate);
+	memcpy(&pointer->PointerPosition, &queue->saved_pointer.PointerPosition,
+			(uint8*) &pointer->paddingB - (uint8*) &pointer->PointerPosition);
+
+	update->queue = NULL;
+}
+
+/**
+ * Create a message queue and attach it to the update interface.
+ * @param update update interface with all callbacks registered
+ * @param max_size number of pending messages above which
+ * freerdp_message_queue_wait blocks
+ */
+
+rdpMessageQueue* freerdp_message_queue_new(rdpUpdate* update, int max_size)
+{
+	rdpMessageQueue* queue;
+
+	queue = xnew(rdpMessageQueue);
+
+	if (queue != NULL)
+	{
+		queue->update = update;
+		queue->max_size = (max_size > 1) ? max_size : MESSAGE_QUEUE_DEFAULT_SIZE;
+		queue->messages = list_new();
+		queue->mutex = freerdp_mutex_new();
+		queue->event = wait_obj_new();
+		queue->space = wait_obj_new();
+		wait_obj_set(queue->space);
+
+		message_queue_attach(queue);
+	}
+
+	return queue;
+}
+
+/**
+ * Detach a message queue from the update interface and free it. Messages
+ * still pending are discarded without being executed.
+ */
+
+void freerdp_message_queue_free(rdpMessageQueue* queue)
+{
+	rdpMessage* message;
+
+	if (queue == NULL)
+		return;
+
+	message_queue_detach(queue);
+
+	while ((message = (rdpMessage*) list_dequeue(queue->messages)) != NULL)
+		message_free(message);
+
+	list_free(queue->messages);
+	freerdp_mutex_free(queue->mutex);
+	wait_obj_free(queue->event);
+	wait_obj_free(queue->space);
+
+	xfree(queue);
+}
+
+/**
+ * Get the file descriptor signalled while messages are pending.
+ */
+
+void freerdp_message_queue_get_fds(rdpMessageQueue* queue, void** rfds, int* rcount)
+{
+	wait_obj_get_fds(queue->event, rfds, rcount);
+}
+
+/**
+ * Execute the messages pending on entry, in the order they were queued.
+ * Messages queued meanwhile are left for the next call, with the event still
+ * set, so that a busy producer cannot starve input and channel processing.
+ */
+
+boolean freerdp_message_queue_check_fds(rdpMessageQueue* queue)
+{
+	int pending;
+	rdpMessage* message;
+
+	freerdp_mutex_lock(queue->mutex);
+	pending = queue->messages->count;
+	freerdp_mutex_unlock(queue->mutex);
+
+	while (pending-- > 0)
+	{
+		freerdp_mutex_lock(queue->mutex);
+
+		message = (rdpMessage*) list_dequeue(queue->messages);
+
+		if (message == NULL)
+		{
+			freerdp_mutex_unlock(queue->mutex);
+			break;
+		}
+
+		if (message_is_frame_end(message))
+			queue->frames--;
+
+		if (queue->messages->count == queue->max_size / 2)
+			wait_obj_set(queue->space);
+
+		freerdp_mutex_unlock(queue->mutex);
+
+		message_process(queue, message);
+		message_free(message);
+	}
+
+	freerdp_mutex_lock(queue->mutex);
+
+	if (queue->messages->count == 0)
+		wait_obj_clear(queue->event);
+
+	freerdp_mutex_unlock(queue->mutex);
+
+	return true;
+}
+
+/**
+ * Get the number of complete surface frames still waiting to be executed.
+ * While a frame end marker is being executed, only the frames which follow
+ * it are counted, so a non-zero value tells the client that the frame it is
+ * about to present is already outdated.
+ */
+
+int freerdp_message_queue_pending_frames(rdpMessageQueue* queue)
+{
+	int frames;
+
+	freerdp_mutex_lock(queue->mutex);
+	frames = queue->frames;
+	freerdp_mutex_unlock(queue->mutex);
+
+	return frames;
+}
+
+/**
+ * Block the decoding side while the queue is full, until enough messages
+ * have been executed or abort is set.
+ */
+
+void freerdp_message_queue_wait(rdpMessageQueue* queue, struct wait_obj* abort)
+{
+	struct wait_obj* objs[2];
+
+	objs[0] = queue->space;
+	objs[1] = abort;
+
+	while (!wait_obj_is_set(queue->space) && !wait_obj_is_set(abort))
+		wait_obj_select(objs, 2, -1);
+}
@@ -137,6 +137,12 @@ static const uint8 CBR23_BPP[] =
 		0, 0, 0, 8, 16, 24, 32
 };
 
+static const uint8 BPP_CBR2[] =
+{
+		0, 0, 0, 0, 0, 0, 0, 0, 3, 0, 0, 0, 0, 0, 0, 4,
+		4, 0, 0, 0, 0, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 6
+};
+
 static const uint8 BMF_BPP[] =
 {
 		0, 1, 0, 8, 16, 24, 32
@@ -1234,7 +1240,7 @@ void update_read_cache_bitmap_v2_order(STREAM* s, CACHE_BITMAP_V2_ORDER* cache_b
 {
 	uint8 bitsPerPixelId;
 
-	cache_bitmap_v2_order->cacheId = flags & 0x0003;
+	cache_bitmap_v2_order->cacheId = flags & 0x0007;
 	cache_bitmap_v2_order->flags = (flags & 0xFF80) >> 7;
 
 	bitsPerPixelId = (flags & 0x0078) >> 3;
@@ -1290,7 +1296,7 @@ void update_read_cache_bitmap_v3_order(STREAM* s, CACHE_BITMAP_V3_ORDER* cache_b
 	uint8 bitsPerPixelId;
 	BITMAP_DATA_EX* bitmapData;
 
-	cache_bitmap_v3_order->cacheId = flags & 0x00000003;
+	cache_bitmap_v3_order->cacheId = flags & 0x00000007;
 	cache_bitmap_v3_order->flags = (flags & 0x0000FF80) >> 7;
 
 	bitsPerPixelId = (flags & 0x00000078) >> 3;
@@ -2046,3 +2052,860 @@ boolean update_recv_order(rdpUpdate* update, STREAM* s)
 
 	return true;
 }
+
+/* Primary Drawing Order Encoding */
+
+static INLINE boolean update_fits_delta(sint32 value, sint32 previous)
+{
+	return ((value - previous >= -128) && (value - previous <= 127)) ? true : false;
+}
+
+static INLINE void update_write_coord(STREAM* s, sint32 coord, sint32 previous, boolean delta)
+{
+	if (delta)
+		stream_write_uint8(s, (uint8) (coord - previous));
+	else
+		stream_write_uint16(s, (uint16) coord);
+}
+
+static INLINE void update_write_color(STREAM* s, uint32 color)
+{
+	stream_write_uint8(s, color & 0xFF);
+	stream_write_uint8(s, (color >> 8) & 0xFF);
+	stream_write_uint8(s, (color >> 16) & 0xFF);
+}
+
+static INLINE void update_write_delta(STREAM* s, sint32 value)
+{
+	if ((value >= -64) && (value <= 63))
+	{
+		stream_write_uint8(s, value & 0x7F);
+	}
+	else
+	{
+		stream_write_uint8(s, ((value >> 8) & 0x7F) | 0x80);
+		stream_write_uint8(s, value & 0xFF);
+	}
+}
+
+static INLINE void update_write_brush(STREAM* s, rdpBrush* brush, uint8 fieldFlags)
+{
+	uint8* data;
+
+	if (fieldFlags & ORDER_FIELD_01)
+		stream_write_uint8(s, brush->x);
+
+	if (fieldFlags & ORDER_FIELD_02)
+		stream_write_uint8(s, brush->y);
+
+	if (fieldFlags & ORDER_FIELD_03)
+		stream_write_uint8(s, brush->style);
+
+	if (fieldFlags & ORDER_FIELD_04)
+		stream_write_uint8(s, brush->hatch);
+
+	if (fieldFlags & ORDER_FIELD_05)
+	{
+		data = (brush->data != NULL) ? brush->data : brush->p8x8;
+		stream_write_uint8(s, data[7]);
+		stream_write_uint8(s, data[6]);
+		stream_write_uint8(s, data[5]);
+		stream_write_uint8(s, data[4]);
+		stream_write_uint8(s, data[3]);
+		stream_write_uint8(s, data[2]);
+		stream_write_uint8(s, data[1]);
+	}
+}
+
+static INLINE void update_write_delta_rects(STREAM* s, DELTA_RECT* rectangles, int number)
+{
+	int i;
+	uint8 flags;
+	uint8* zeroBits;
+	int zeroBitsSize;
+	DELTA_RECT previous;
+
+	zeroBitsSize = ((number + 1) / 2);
+
+	stream_check_size(s, zeroBitsSize + number * 8);
+	stream_get_mark(s, zeroBits);
+	stream_write_zero(s, zeroBitsSize);
+
+	memset(&previous, 0, sizeof(DELTA_RECT));
+
+	for (i = 1; i < number + 1; i++)
+	{
+		flags = 0;
+
+		if (rectangles[i].left == previous.left)
+			flags |= 0x80;
+		else
+			update_write_delta(s, rectangles[i].left - previous.left);
+
+		if (rectangles[i].top == previous.top)
+			flags |= 0x40;
+		else
+			update_write_delta(s, rectangles[i].top - previous.top);
+
+		if (rectangles[i].width == previous.width)
+			flags |= 0x20;
+		else
+			update_write_delta(s, rectangles[i].width);
+
+		if (rectangles[i].height == previous.height)
+			flags |= 0x10;
+		else
+			update_write_delta(s, rectangles[i].height);
+
+		zeroBits[(i - 1) / 2] |= ((i - 1) % 2 == 0) ? flags : (flags >> 4);
+
+		previous = rectangles[i];
+	}
+}
+
+static INLINE uint8 update_prepare_brush(rdpBrush* brush, rdpBrush* previous)
+{
+	uint8 fieldFlags = 0;
+	uint8* data = (brush->data != NULL) ? brush->data : brush->p8x8;
+
+	if (brush->x != previous->x)
+		fieldFlags |= ORDER_FIELD_01;
+
+	if (brush->y != previous->y)
+		fieldFlags |= ORDER_FIELD_02;
+
+	if (brush->style != previous->style)
+		fieldFlags |= ORDER_FIELD_03;
+
+	if (brush->hatch != previous->hatch)
+		fieldFlags |= ORDER_FIELD_04;
+
+	if (memcmp(&data[1], &previous->p8x8[1], 7) != 0)
+		fieldFlags |= ORDER_FIELD_05;
+
+	return fieldFlags;
+}
+
+static INLINE void update_save_brush(rdpBrush* previous, rdpBrush* brush)
+{
+	memmove(previous->p8x8, (brush->data != NULL) ? brush->data : brush->p8x8, 8);
+	previous->data = previous->p8x8;
+}
+
+static INLINE void update_prepare_coord(ORDER_INFO* orderInfo, uint32 field, sint32 coord, sint32 previous)
+{
+	if (coord != previous)
+	{
+		orderInfo->fieldFlags |= field;
+
+		if (!update_fits_delta(coord, previous))
+			orderInfo->deltaCoordinates = false;
+	}
+}
+
+static INLINE void update_prepare_field(ORDER_INFO* orderInfo, uint32 field, uint32 value, uint32 previous)
+{
+	if (value != previous)
+		orderInfo->fieldFlags |= field;
+}
+
+static void update_prepare_dstblt_order(ORDER_INFO* orderInfo, DSTBLT_ORDER* dstblt, DSTBLT_ORDER* previous)
+{
+	update_prepare_coord(orderInfo, ORDER_FIELD_01, dstblt->nLeftRect, previous->nLeftRect);
+	update_prepare_coord(orderInfo, ORDER_FIELD_02, dstblt->nTopRect, previous->nTopRect);
+	update_prepare_coord(orderInfo, ORDER_FIELD_03, dstblt->nWidth, previous->nWidth);
+	update_prepare_coord(orderInfo, ORDER_FIELD_04, dstblt->nHeight, previous->nHeight);
+	update_prepare_field(orderInfo, ORDER_FIELD_05, dstblt->bRop, previous->bRop);
+}
+
+static void update_prepare_patblt_order(ORDER_INFO* orderInfo, PATBLT_ORDER* patblt, PATBLT_ORDER* previous)
+{
+	update_prepare_coord(orderInfo, ORDER_FIELD_01, patblt->nLeftRect, previous->nLeftRect);
+	update_prepare_coord(orderInfo, ORDER_FIELD_02, patblt->nTopRect, previous->nTopRect);
+	update_prepare_coord(orderInfo, ORDER_FIELD_03, patblt->nWidth, previous->nWidth);
+	update_prepare_coord(orderInfo, ORDER_FIELD_04, patblt->nHeight, previous->nHeight);
+	update_prepare_field(orderInfo, ORDER_FIELD_05, patblt->bRop, previous->bRop);
+	update_prepare_field(orderInfo, ORDER_FIELD_06, patblt->backColor, previous->backColor);
+	update_prepare_field(orderInfo, ORDER_FIELD_07, patblt->foreColor, previous->foreColor);
+	orderInfo->fieldFlags |= update_prepare_brush(&patblt->brush, &previous->brush) << 7;
+}
+
+static void update_prepare_scrblt_order(ORDER_INFO* orderInfo, SCRBLT_ORDER* scrblt, SCRBLT_ORDER* previous)
+{
+	update_prepare_coord(orderInfo, ORDER_FIELD_01, scrblt->nLeftRect, previous->nLeftRect);
+	update_prepare_coord(orderInfo, ORDER_FIELD_02, scrblt->nTopRect, previous->nTopRect);
+	update_prepare_coord(orderInfo, ORDER_FIELD_03, scrblt->nWidth, previous->nWidth);
+	update_prepare_coord(orderInfo, ORDER_FIELD_04, scrblt->nHeight, previous->nHeight);
+	update_prepare_field(orderInfo, ORDER_FIELD_05, scrblt->bRop, previous->bRop);
+	update_prepare_coord(orderInfo, ORDER_FIELD_06, scrblt->nXSrc, previous->nXSrc);
+	update_prepare_coord(orderInfo, ORDER_FIELD_07, scrblt->nYSrc, previous->nYSrc);
+}
+
+static void update_prepare_opaque_rect_order(ORDER_INFO* orderInfo, OPAQUE_RECT_ORDER* opaque_rect, OPAQUE_RECT_ORDER* previous)
+{
+	update_prepare_coord(orderInfo, ORDER_FIELD_01, opaque_rect->nLeftRect, previous->nLeftRect);
+	update_prepare_coord(orderInfo, ORDER_FIELD_02, opaque_rect->nTopRect, previous->nTopRect);
+	update_prepare_coord(orderInfo, ORDER_FIELD_03, opaque_rect->nWidth, previous->nWidth);
+	update_prepare_coord(orderInfo, ORDER_FIELD_04, opaque_rect->nHeight, previous->nHeight);
+	update_prepare_field(orderInfo, ORDER_FIELD_05, opaque_rect->color & 0xFF, previous->color & 0xFF);
+	update_prepare_field(orderInfo, ORDER_FIELD_06, opaque_rect->color & 0xFF00, previous->color & 0xFF00);
+	update_prepare_field(orderInfo, ORDER_FIELD_07, opaque_rect->color & 0xFF0000, previous->color & 0xFF0000);
+}
+
+static void update_prepare_multi_opaque_rect_order(ORDER_INFO* orderInfo, MULTI_OPAQUE_RECT_ORDER* multi_opaque_rect, MULTI_OPAQUE_RECT_ORDER* previous)
+{
+	update_prepare_coord(orderInfo, ORDER_FIELD_01, multi_opaque_rect->nLeftRect, previous->nLeftRect);
+	update_prepare_coord(orderInfo, ORDER_FIELD_02, multi_opaque_rect->nTopRect, previous->nTopRect);
+	update_prepare_coord(orderInfo, ORDER_FIELD_03, multi_opaque_rect->nWidth, previous->nWidth);
+	update_prepare_coord(orderInfo, ORDER_FIELD_04, multi_opaque_rect->nHeight, previous->nHeight);
+	update_prepare_field(orderInfo, ORDER_FIELD_05, multi_opaque_rect->color & 0xFF, previous->color & 0xFF);
+	update_prepare_field(orderInfo, ORDER_FIELD_06, multi_opaque_rect->color & 0xFF00, previous->color & 0xFF00);
+	update_prepare_field(orderInfo, ORDER_FIELD_07, multi_opaque_rect->color & 0xFF0000, previous->color & 0xFF0000);
+	update_prepare_field(orderInfo, ORDER_FIELD_08, multi_opaque_rect->numRectangles, previous->numRectangles);
+
+	if ((multi_opaque_rect->numRectangles != previous->numRectangles) ||
+		(memcmp(&multi_opaque_rect->rectangles[1], &previous->rectangles[1],
+			sizeof(DELTA_RECT) * MIN(multi_opaque_rect->numRectangles, 44)) != 0))
+	{
+		orderInfo->fieldFlags |= ORDER_FIELD_09;
+	}
+}
+
+static void update_prepare_line_to_order(ORDER_INFO* orderInfo, LINE_TO_ORDER* line_to, LINE_TO_ORDER* previous)
+{
+	update_prepare_field(orderInfo, ORDER_FIELD_01, line_to->backMode, previous->backMode);
+	update_prepare_coord(orderInfo, ORDER_FIELD_02, line_to->nXStart, previous->nXStart);
+	update_prepare_coord(orderInfo, ORDER_FIELD_03, line_to->nYStart, previous->nYStart);
+	update_prepare_coord(orderInfo, ORDER_FIELD_04, line_to->nXEnd, previous->nXEnd);
+	update_prepare_coord(orderInfo, ORDER_FIELD_05, line_to->nYEnd, previous->nYEnd);
+	update_prepare_field(orderInfo, ORDER_FIELD_06, line_to->backColor, previous->backColor);
+	update_prepare_field(orderInfo, ORDER_FIELD_07, line_to->bRop2, previous->bRop2);
+	update_prepare_field(orderInfo, ORDER_FIELD_08, line_to->penStyle, previous->penStyle);
+	update_prepare_field(orderInfo, ORDER_FIELD_09, line_to->penWidth, previous->penWidth);
+	update_prepare_field(orderInfo, ORDER_FIELD_10, line_to->penColor, previous->penColor);
+}
+
+static void update_prepare_memblt_order(ORDER_INFO* orderInfo, MEMBLT_ORDER* memblt, MEMBLT_ORDER* previous)
+{
+	if ((memblt->cacheId != previous->cacheId) || (memblt->colorIndex != previous->colorIndex))
+		orderInfo->fieldFlags |= ORDER_FIELD_01;
+
+	update_prepare_coord(orderInfo, ORDER_FIELD_02, memblt->nLeftRect, previous->nLeftRect);
+	update_prepare_coord(orderInfo, ORDER_FIELD_03, memblt->nTopRect, previous->nTopRect);
+	update_prepare_coord(orderInfo, ORDER_FIELD_04, memblt->nWidth, previous->nWidth);
+	update_prepare_coord(orderInfo, ORDER_FIELD_05, memblt->nHeight, previous->nHeight);
+	update_prepare_field(orderInfo, ORDER_FIELD_06, memblt->bRop, previous->bRop);
+	update_prepare_coord(orderInfo, ORDER_FIELD_07, memblt->nXSrc, previous->nXSrc);
+	update_prepare_coord(orderInfo, ORDER_FIELD_08, memblt->nYSrc, previous->nYSrc);
+	update_prepare_field(orderInfo, ORDER_FIELD_09, memblt->cacheIndex, previous->cacheIndex);
+}
+
+static void update_prepare_glyph_index_order(ORDER_INFO* orderInfo, GLYPH_INDEX_ORDER* glyph_index, GLYPH_INDEX_ORDER* previous)
+{
+	update_prepare_field(orderInfo, ORDER_FIELD_01, glyph_index->cacheId, previous->cacheId);
+	update_prepare_field(orderInfo, ORDER_FIELD_02, glyph_index->flAccel, previous->flAccel);
+	update_prepare_field(orderInfo, ORDER_FIELD_03, glyph_index->ulCharInc, previous->ulCharInc);
+	update_prepare_field(orderInfo, ORDER_FIELD_04, glyph_index->fOpRedundant, previous->fOpRedundant);
+	update_prepare_field(orderInfo, ORDER_FIELD_05, glyph_index->backColor, previous->backColor);
+	update_prepare_field(orderInfo, ORDER_FIELD_06, glyph_index->foreColor, previous->foreColor);
+	update_prepare_field(orderInfo, ORDER_FIELD_07, glyph_index->bkLeft, previous->bkLeft);
+	update_prepare_field(orderInfo, ORDER_FIELD_08, glyph_index->bkTop, previous->bkTop);
+	update_prepare_field(orderInfo, ORDER_FIELD_09, glyph_index->bkRight, previous->bkRight);
+	update_prepare_field(orderInfo, ORDER_FIELD_10, glyph_index->bkBottom, previous->bkBottom);
+	update_prepare_field(orderInfo, ORDER_FIELD_11, glyph_index->opLeft, previous->opLeft);
+	update_prepare_field(orderInfo, ORDER_FIELD_12, glyph_index->opTop, previous->opTop);
+	update_prepare_field(orderInfo, ORDER_FIELD_13, glyph_index->opRight, previous->opRight);
+	update_prepare_field(orderInfo, ORDER_FIELD_14, glyph_index->opBottom, previous->opBottom);
+	orderInfo->fieldFlags |= update_prepare_brush(&glyph_index->brush, &previous->brush) << 14;
+	update_prepare_field(orderInfo, ORDER_FIELD_20, glyph_index->x, previous->x);
+	update_prepare_field(orderInfo, ORDER_FIELD_21, glyph_index->y, previous->y);
+
+	if ((glyph_index->cbData != previous->cbData) ||
+		(memcmp(glyph_index->data, previous->data, glyph_index->cbData) != 0))
+	{
+		orderInfo->fieldFlags |= ORDER_FIELD_22;
+	}
+}
+
+void update_write_dstblt_order(STREAM* s, ORDER_INFO* orderInfo, DSTBLT_ORDER* dstblt, DSTBLT_ORDER* previous)
+{
+	if (orderInfo->fieldFlags & ORDER_FIELD_01)
+		update_write_coord(s, dstblt->nLeftRect, previous->nLeftRect, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_02)
+		update_write_coord(s, dstblt->nTopRect, previous->nTopRect, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_03)
+		update_write_coord(s, dstblt->nWidth, previous->nWidth, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_04)
+		update_write_coord(s, dstblt->nHeight, previous->nHeight, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_05)
+		stream_write_uint8(s, dstblt->bRop);
+}
+
+void update_write_patblt_order(STREAM* s, ORDER_INFO* orderInfo, PATBLT_ORDER* patblt, PATBLT_ORDER* previous)
+{
+	if (orderInfo->fieldFlags & ORDER_FIELD_01)
+		update_write_coord(s, patblt->nLeftRect, previous->nLeftRect, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_02)
+		update_write_coord(s, patblt->nTopRect, previous->nTopRect, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_03)
+		update_write_coord(s, patblt->nWidth, previous->nWidth, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_04)
+		update_write_coord(s, patblt->nHeight, previous->nHeight, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_05)
+		stream_write_uint8(s, patblt->bRop);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_06)
+		update_write_color(s, patblt->backColor);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_07)
+		update_write_color(s, patblt->foreColor);
+
+	update_write_brush(s, &patblt->brush, orderInfo->fieldFlags >> 7);
+}
+
+void update_write_scrblt_order(STREAM* s, ORDER_INFO* orderInfo, SCRBLT_ORDER* scrblt, SCRBLT_ORDER* previous)
+{
+	if (orderInfo->fieldFlags & ORDER_FIELD_01)
+		update_write_coord(s, scrblt->nLeftRect, previous->nLeftRect, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_02)
+		update_write_coord(s, scrblt->nTopRect, previous->nTopRect, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_03)
+		update_write_coord(s, scrblt->nWidth, previous->nWidth, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_04)
+		update_write_coord(s, scrblt->nHeight, previous->nHeight, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_05)
+		stream_write_uint8(s, scrblt->bRop);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_06)
+		update_write_coord(s, scrblt->nXSrc, previous->nXSrc, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_07)
+		update_write_coord(s, scrblt->nYSrc, previous->nYSrc, orderInfo->deltaCoordinates);
+}
+
+void update_write_opaque_rect_order(STREAM* s, ORDER_INFO* orderInfo, OPAQUE_RECT_ORDER* opaque_rect, OPAQUE_RECT_ORDER* previous)
+{
+	if (orderInfo->fieldFlags & ORDER_FIELD_01)
+		update_write_coord(s, opaque_rect->nLeftRect, previous->nLeftRect, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_02)
+		update_write_coord(s, opaque_rect->nTopRect, previous->nTopRect, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_03)
+		update_write_coord(s, opaque_rect->nWidth, previous->nWidth, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_04)
+		update_write_coord(s, opaque_rect->nHeight, previous->nHeight, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_05)
+		stream_write_uint8(s, opaque_rect->color & 0xFF);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_06)
+		stream_write_uint8(s, (opaque_rect->color >> 8) & 0xFF);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_07)
+		stream_write_uint8(s, (opaque_rect->color >> 16) & 0xFF);
+}
+
+void update_write_multi_opaque_rect_order(STREAM* s, ORDER_INFO* orderInfo, MULTI_OPAQUE_RECT_ORDER* multi_opaque_rect, MULTI_OPAQUE_RECT_ORDER* previous)
+{
+	int start;
+	int cbData;
+	int numRectangles;
+
+	/* the rectangles are one-based, leaving room for 44 of them */
+	numRectangles = MIN(multi_opaque_rect->numRectangles, 44);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_01)
+		update_write_coord(s, multi_opaque_rect->nLeftRect, previous->nLeftRect, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_02)
+		update_write_coord(s, multi_opaque_rect->nTopRect, previous->nTopRect, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_03)
+		update_write_coord(s, multi_opaque_rect->nWidth, previous->nWidth, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_04)
+		update_write_coord(s, multi_opaque_rect->nHeight, previous->nHeight, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_05)
+		stream_write_uint8(s, multi_opaque_rect->color & 0xFF);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_06)
+		stream_write_uint8(s, (multi_opaque_rect->color >> 8) & 0xFF);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_07)
+		stream_write_uint8(s, (multi_opaque_rect->color >> 16) & 0xFF);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_08)
+		stream_write_uint8(s, numRectangles);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_09)
+	{
+		start = stream_get_pos(s);
+		stream_seek_uint16(s); /* cbData (2 bytes) */
+		update_write_delta_rects(s, multi_opaque_rect->rectangles, numRectangles);
+
+		cbData = stream_get_pos(s) - start - 2;
+		multi_opaque_rect->cbData = cbData;
+
+		stream_set_pos(s, start);
+		stream_write_uint16(s, cbData);
+		stream_seek(s, cbData);
+	}
+}
+
+void update_write_line_to_order(STREAM* s, ORDER_INFO* orderInfo, LINE_TO_ORDER* line_to, LINE_TO_ORDER* previous)
+{
+	if (orderInfo->fieldFlags & ORDER_FIELD_01)
+		stream_write_uint16(s, line_to->backMode);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_02)
+		update_write_coord(s, line_to->nXStart, previous->nXStart, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_03)
+		update_write_coord(s, line_to->nYStart, previous->nYStart, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_04)
+		update_write_coord(s, line_to->nXEnd, previous->nXEnd, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_05)
+		update_write_coord(s, line_to->nYEnd, previous->nYEnd, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_06)
+		update_write_color(s, line_to->backColor);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_07)
+		stream_write_uint8(s, line_to->bRop2);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_08)
+		stream_write_uint8(s, line_to->penStyle);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_09)
+		stream_write_uint8(s, line_to->penWidth);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_10)
+		update_write_color(s, line_to->penColor);
+}
+
+void update_write_memblt_order(STREAM* s, ORDER_INFO* orderInfo, MEMBLT_ORDER* memblt, MEMBLT_ORDER* previous)
+{
+	if (orderInfo->fieldFlags & ORDER_FIELD_01)
+		stream_write_uint16(s, (memblt->colorIndex << 8) | (memblt->cacheId & 0xFF));
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_02)
+		update_write_coord(s, memblt->nLeftRect, previous->nLeftRect, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_03)
+		update_write_coord(s, memblt->nTopRect, previous->nTopRect, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_04)
+		update_write_coord(s, memblt->nWidth, previous->nWidth, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_05)
+		update_write_coord(s, memblt->nHeight, previous->nHeight, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_06)
+		stream_write_uint8(s, memblt->bRop);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_07)
+		update_write_coord(s, memblt->nXSrc, previous->nXSrc, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_08)
+		update_write_coord(s, memblt->nYSrc, previous->nYSrc, orderInfo->deltaCoordinates);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_09)
+		stream_write_uint16(s, memblt->cacheIndex);
+}
+
+void update_write_glyph_index_order(STREAM* s, ORDER_INFO* orderInfo, GLYPH_INDEX_ORDER* glyph_index, GLYPH_INDEX_ORDER* previous)
+{
+	if (orderInfo->fieldFlags & ORDER_FIELD_01)
+		stream_write_uint8(s, glyph_index->cacheId);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_02)
+		stream_write_uint8(s, glyph_index->flAccel);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_03)
+		stream_write_uint8(s, glyph_index->ulCharInc);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_04)
+		stream_write_uint8(s, glyph_index->fOpRedundant);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_05)
+		update_write_color(s, glyph_index->backColor);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_06)
+		update_write_color(s, glyph_index->foreColor);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_07)
+		stream_write_uint16(s, glyph_index->bkLeft);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_08)
+		stream_write_uint16(s, glyph_index->bkTop);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_09)
+		stream_write_uint16(s, glyph_index->bkRight);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_10)
+		stream_write_uint16(s, glyph_index->bkBottom);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_11)
+		stream_write_uint16(s, glyph_index->opLeft);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_12)
+		stream_write_uint16(s, glyph_index->opTop);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_13)
+		stream_write_uint16(s, glyph_index->opRight);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_14)
+		stream_write_uint16(s, glyph_index->opBottom);
+
+	update_write_brush(s, &glyph_index->brush, orderInfo->fieldFlags >> 14);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_20)
+		stream_write_uint16(s, glyph_index->x);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_21)
+		stream_write_uint16(s, glyph_index->y);
+
+	if (orderInfo->fieldFlags & ORDER_FIELD_22)
+	{
+		stream_write_uint8(s, glyph_index->cbData);
+		stream_write(s, glyph_index->data, glyph_index->cbData);
+	}
+}
+
+void update_write_field_flags(STREAM* s, uint32 fieldFlags, uint8 flags, uint8 fieldBytes)
+{
+	int i;
+
+	if (flags & ORDER_ZERO_FIELD_BYTE_BIT0)
+		fieldBytes--;
+
+	if (flags & ORDER_ZERO_FIELD_BYTE_BIT1)
+	{
+		if (fieldBytes > 1)
+			fieldBytes -= 2;
+		else
+			fieldBytes = 0;
+	}
+
+	for (i = 0; i < fieldBytes; i++)
+		stream_write_uint8(s, (fieldFlags >> (i * 8)) & 0xFF);
+}
+
+static INLINE uint8 update_bound_flag(sint32 bound, sint32 previous, uint8 absolute, uint8 delta)
+{
+	if (bound == previous)
+		return 0;
+
+	return update_fits_delta(bound, previous) ? delta : absolute;
+}
+
+void update_write_bounds(STREAM* s, rdpBounds* bounds, rdpBounds* previous)
+{
+	uint8 flags;
+
+	flags = update_bound_flag(bounds->left, previous->left, BOUND_LEFT, BOUND_DELTA_LEFT);
+	flags |= update_bound_flag(bounds->top, previous->top, BOUND_TOP, BOUND_DELTA_TOP);
+	flags |= update_bound_flag(bounds->right, previous->right, BOUND_RIGHT, BOUND_DELTA_RIGHT);
+	flags |= update_bound_flag(bounds->bottom, previous->bottom, BOUND_BOTTOM, BOUND_DELTA_BOTTOM);
+
+	stream_write_uint8(s, flags); /* field flags */
+
+	if (flags & (BOUND_LEFT | BOUND_DELTA_LEFT))
+		update_write_coord(s, bounds->left, previous->left, (flags & BOUND_DELTA_LEFT) ? true : false);
+
+	if (flags & (BOUND_TOP | BOUND_DELTA_TOP))
+		update_write_coord(s, bounds->top, previous->top, (flags & BOUND_DELTA_TOP) ? true : false);
+
+	if (flags & (BOUND_RIGHT | BOUND_DELTA_RIGHT))
+		update_write_coord(s, bounds->right, previous->right, (flags & BOUND_DELTA_RIGHT) ? true : false);
+
+	if (flags & (BOUND_BOTTOM | BOUND_DELTA_BOTTOM))
+		update_write_coord(s, bounds->bottom, previous->bottom, (flags & BOUND_DELTA_BOTTOM) ? true : false);
+}
+
+/**
+ * Encode a primary drawing order, including its control flags, against the
+ * orders previously encoded with the same state. Only the fields that differ
+ * from the last order of the same type are written, coordinates are sent as
+ * one byte deltas whenever all of them fit, and the order type and bounds are
+ * only repeated when they change. The state must be reset, like the one of
+ * the receiving side, whenever the connection is reactivated. Returns false,
+ * having written nothing, for the order types that cannot be encoded.
+ */
+
+boolean update_write_primary_order(STREAM* s, rdpPrimaryUpdate* primary, uint8 orderType, void* order, rdpBounds* bounds)
+{
+	uint8 fieldBytes;
+	uint8 zeroBytes;
+	uint8 controlFlags;
+	ORDER_INFO* orderInfo;
+
+	orderInfo = &(primary->order_info);
+	orderInfo->fieldFlags = 0;
+	orderInfo->deltaCoordinates = true;
+
+	switch (orderType)
+	{
+		case ORDER_TYPE_DSTBLT:
+			update_prepare_dstblt_order(orderInfo, (DSTBLT_ORDER*) order, &primary->dstblt);
+			break;
+
+		case ORDER_TYPE_PATBLT:
+			update_prepare_patblt_order(orderInfo, (PATBLT_ORDER*) order, &primary->patblt);
+			break;
+
+		case ORDER_TYPE_SCRBLT:
+			update_prepare_scrblt_order(orderInfo, (SCRBLT_ORDER*) order, &primary->scrblt);
+			break;
+
+		case ORDER_TYPE_OPAQUE_RECT:
+			update_prepare_opaque_rect_order(orderInfo, (OPAQUE_RECT_ORDER*) order, &primary->opaque_rect);
+			break;
+
+		case ORDER_TYPE_MULTI_OPAQUE_RECT:
+			update_prepare_multi_opaque_rect_order(orderInfo, (MULTI_OPAQUE_RECT_ORDER*) order, &primary->multi_opaque_rect);
+			break;
+
+		case ORDER_TYPE_LINE_TO:
+			update_prepare_line_to_order(orderInfo, (LINE_TO_ORDER*) order, &primary->line_to);
+			break;
+
+		case ORDER_TYPE_MEMBLT:
+			update_prepare_memblt_order(orderInfo, (MEMBLT_ORDER*) order, &primary->memblt);
+			break;
+
+		case ORDER_TYPE_GLYPH_INDEX:
+			update_prepare_glyph_index_order(orderInfo, (GLYPH_INDEX_ORDER*) order, &primary->glyph_index);
+			break;
+
+		default:
+			return false;
+	}
+
+	stream_check_size(s, 512);
+
+	controlFlags = ORDER_STANDARD;
+
+	if (orderType != orderInfo->orderType)
+		controlFlags |= ORDER_TYPE_CHANGE;
+
+	if (bounds != NULL)
+	{
+		controlFlags |= ORDER_BOUNDS;
+
+		if (memcmp(bounds, &orderInfo->bounds, sizeof(rdpBounds)) == 0)
+			controlFlags |= ORDER_ZERO_BOUNDS_DELTAS;
+	}
+
+	if (orderInfo->deltaCoordinates)
+		controlFlags |= ORDER_DELTA_COORDINATES;
+
+	/* trailing zero field bytes are left out */
+	fieldBytes = PRIMARY_DRAWING_ORDER_FIELD_BYTES[orderType];
+
+	for (zeroBytes = 0; zeroBytes < fieldBytes; zeroBytes++)
+	{
+		if ((orderInfo->fieldFlags >> ((fieldBytes - zeroBytes - 1) * 8)) & 0xFF)
+			break;
+	}
+
+	if (zeroBytes & 1)
+		controlFlags |= ORDER_ZERO_FIELD_BYTE_BIT0;
+
+	if (zeroBytes & 2)
+		controlFlags |= ORDER_ZERO_FIELD_BYTE_BIT1;
+
+	stream_write_uint8(s, controlFlags); /* controlFlags (1 byte) */
+
+	if (controlFlags & ORDER_TYPE_CHANGE)
+		stream_write_uint8(s, orderType); /* orderType (1 byte) */
+
+	update_write_field_flags(s, orderInfo->fieldFlags, controlFlags, fieldBytes);
+
+	if ((controlFlags & ORDER_BOUNDS) && !(controlFlags & ORDER_ZERO_BOUNDS_DELTAS))
+	{
+		update_write_bounds(s, bounds, &orderInfo->bounds);
+		memcpy(&orderInfo->bounds, bounds, sizeof(rdpBounds));
+	}
+
+	orderInfo->orderType = orderType;
+
+	switch (orderType)
+	{
+		case ORDER_TYPE_DSTBLT:
+			update_write_dstblt_order(s, orderInfo, (DSTBLT_ORDER*) order, &primary->dstblt);
+			memcpy(&primary->dstblt, order, sizeof(DSTBLT_ORDER));
+			break;
+
+		case ORDER_TYPE_PATBLT:
+			update_write_patblt_order(s, orderInfo, (PATBLT_ORDER*) order, &primary->patblt);
+			memcpy(&primary->patblt, order, sizeof(PATBLT_ORDER));
+			update_save_brush(&primary->patblt.brush, &((PATBLT_ORDER*) order)->brush);
+			break;
+
+		case ORDER_TYPE_SCRBLT:
+			update_write_scrblt_order(s, orderInfo, (SCRBLT_ORDER*) order, &primary->scrblt);
+			memcpy(&primary->scrblt, order, sizeof(SCRBLT_ORDER));
+			break;
+
+		case ORDER_TYPE_OPAQUE_RECT:
+			update_write_opaque_rect_order(s, orderInfo, (OPAQUE_RECT_ORDER*) order, &primary->opaque_rect);
+			memcpy(&primary->opaque_rect, order, sizeof(OPAQUE_RECT_ORDER));
+			break;
+
+		case ORDER_TYPE_MULTI_OPAQUE_RECT:
+			update_write_multi_opaque_rect_order(s, orderInfo, (MULTI_OPAQUE_RECT_ORDER*) order, &primary->multi_opaque_rect);
+			memcpy(&primary->multi_opaque_rect, order, sizeof(MULTI_OPAQUE_RECT_ORDER));
+			break;
+
+		case ORDER_TYPE_LINE_TO:
+			update_write_line_to_order(s, orderInfo, (LINE_TO_ORDER*) order, &primary->line_to);
+			memcpy(&primary->line_to, order, sizeof(LINE_TO_ORDER));
+			break;
+
+		case ORDER_TYPE_MEMBLT:
+			update_write_memblt_order(s, orderInfo, (MEMBLT_ORDER*) order, &primary->memblt);
+			memcpy(&primary->memblt, order, sizeof(MEMBLT_ORDER));
+			break;
+
+		case ORDER_TYPE_GLYPH_INDEX:
+			update_write_glyph_index_order(s, orderInfo, (GLYPH_INDEX_ORDER*) order, &primary->glyph_index);
+			memcpy(&primary->glyph_index, order, sizeof(GLYPH_INDEX_ORDER));
+			update_save_brush(&primary->glyph_index.brush, &((GLYPH_INDEX_ORDER*) order)->brush);
+			break;
+	}
+
+	return true;
+}
+
+/* Secondary Drawing Order Encoding */
+
+static INLINE void update_write_2byte_unsigned(STREAM* s, uint32 value)
+{
+	if (value > 0x7F)
+	{
+		stream_write_uint8(s, ((value >> 8) & 0x7F) | 0x80);
+		stream_write_uint8(s, value & 0xFF);
+	}
+	else
+	{
+		stream_write_uint8(s, value);
+	}
+}
+
+static INLINE void update_write_4byte_unsigned(STREAM* s, uint32 value)
+{
+	if (value <= 0x3F)
+	{
+		stream_write_uint8(s, value);
+	}
+	else if (value <= 0x3FFF)
+	{
+		stream_write_uint8(s, ((value >> 8) & 0x3F) | 0x40);
+		stream_write_uint8(s, value & 0xFF);
+	}
+	else if (value <= 0x3FFFFF)
+	{
+		stream_write_uint8(s, ((value >> 16) & 0x3F) | 0x80);
+		stream_write_uint8(s, (value >> 8) & 0xFF);
+		stream_write_uint8(s, value & 0xFF);
+	}
+	else
+	{
+		stream_write_uint8(s, ((value >> 24) & 0x3F) | 0xC0);
+		stream_write_uint8(s, (value >> 16) & 0xFF);
+		stream_write_uint8(s, (value >> 8) & 0xFF);
+		stream_write_uint8(s, value & 0xFF);
+	}
+}
+
+void update_write_cache_bitmap_v2_order(STREAM* s, CACHE_BITMAP_V2_ORDER* cache_bitmap_v2_order, boolean compressed, uint16* flags)
+{
+	uint8 bitsPerPixelId;
+	uint32 bitmapLength;
+
+	bitsPerPixelId = BPP_CBR2[MIN(cache_bitmap_v2_order->bitmapBpp, 32)];
+
+	*flags = (cache_bitmap_v2_order->cacheId & 0x0007) |
+			(bitsPerPixelId << 3) | ((cache_bitmap_v2_order->flags << 7) & 0xFF80);
+
+	stream_check_size(s, 32 + cache_bitmap_v2_order->bitmapLength);
+
+	if (cache_bitmap_v2_order->flags & CBR2_PERSISTENT_KEY_PRESENT)
+	{
+		stream_write_uint32(s, cache_bitmap_v2_order->key1); /* key1 (4 bytes) */
+		stream_write_uint32(s, cache_bitmap_v2_order->key2); /* key2 (4 bytes) */
+	}
+
+	if (cache_bitmap_v2_order->flags & CBR2_HEIGHT_SAME_AS_WIDTH)
+	{
+		update_write_2byte_unsigned(s, cache_bitmap_v2_order->bitmapWidth); /* bitmapWidth */
+	}
+	else
+	{
+		update_write_2byte_unsigned(s, cache_bitmap_v2_order->bitmapWidth); /* bitmapWidth */
+		update_write_2byte_unsigned(s, cache_bitmap_v2_order->bitmapHeight); /* bitmapHeight */
+	}
+
+	bitmapLength = cache_bitmap_v2_order->bitmapLength;
+
+	if (compressed && !(cache_bitmap_v2_order->flags & CBR2_NO_BITMAP_COMPRESSION_HDR))
+		bitmapLength += 8;
+
+	update_write_4byte_unsigned(s, bitmapLength); /* bitmapLength */
+	update_write_2byte_unsigned(s, cache_bitmap_v2_order->cacheIndex); /* cacheIndex */
+
+	if (compressed && !(cache_bitmap_v2_order->flags & CBR2_NO_BITMAP_COMPRESSION_HDR))
+	{
+		stream_write_uint16(s, cache_bitmap_v2_order->cbCompFirstRowSize); /* cbCompFirstRowSize (2 bytes) */
+		stream_write_uint16(s, cache_bitmap_v2_order->bitmapLength); /* cbCompMainBodySize (2 bytes) */
+		stream_write_uint16(s, cache_bitmap_v2_order->cbScanWidth); /* cbScanWidth (2 bytes) */
+		stream_write_uint16(s, cache_bitmap_v2_order->cbUncompressedSize); /* cbUncompressedSize (2 bytes) */
+	}
+
+	stream_write(s, cache_bitmap_v2_order->bitmapDataStream, cache_bitmap_v2_order->bitmapLength);
+}
+
+void update_write_cache_bitmap_v3_order(STREAM* s, CACHE_BITMAP_V3_ORDER* cache_bitmap_v3_order, boolean compressed, uint16* flags)
+{
+	uint8 bitsPerPixelId;
+	BITMAP_DATA_EX* bitmapData;
+
+	bitmapData = &cache_bitmap_v3_order->bitmapData;
+	bitsPerPixelId = BPP_CBR2[MIN(cache_bitmap_v3_order->bpp, 32)];
+
+	*flags = (cache_bitmap_v3_order->cacheId & 0x0007) |
+			(bitsPerPixelId << 3) | ((cache_bitmap_v3_order->flags << 7) & 0xFF80);
+
+	stream_check_size(s, 32 + bitmapData->length);
+
+	stream_write_uint16(s, cache_bitmap_v3_order->cacheIndex); /* cacheIndex (2 bytes) */
+	stream_write_uint32(s, cache_bitmap_v3_order->key1); /* key1 (4 bytes) */
+	stream_write_uint32(s, cache_bitmap_v3_order->key2); /* key2 (4 bytes) */
+
+	stream_write_uint8(s, bitmapData->bpp);
+	stream_write_uint8(s, 0); /* reserved1 (1 byte) */
+	stream_write_uint8(s, 0); /* reserved2 (1 byte) */
+	stream_write_uint8(s, bitmapData->codecID); /* codecID (1 byte) */
+	stream_write_uint16(s, bitmapData->width); /* width (2 bytes) */
+	stream_write_uint16(s, bitmapData->height); /* height (2 bytes) */
+	stream_write_uint32(s, bitmapData->length); /* length (4 bytes) */
+	stream_write(s, bitmapData->data, bitmapData->length);
+}
@@ -209,6 +209,22 @@ void update_read_polygon_cb_order(STREAM* s, ORDER_INFO* orderInfo, POLYGON_CB_O
 void update_read_ellipse_sc_order(STREAM* s, ORDER_INFO* orderInfo, ELLIPSE_SC_ORDER* ellipse_sc);
 void update_read_ellipse_cb_order(STREAM* s, ORDER_INFO* orderInfo, ELLIPSE_CB_ORDER* ellipse_cb);
 
+void update_read_field_flags(STREAM* s, uint32* fieldFlags, uint8 flags, uint8 fieldBytes);
+void update_read_bounds(STREAM* s, rdpBounds* bounds);
+
+void update_write_dstblt_order(STREAM* s, ORDER_INFO* orderInfo, DSTBLT_ORDER* dstblt, DSTBLT_ORDER* previous);
+void update_write_patblt_order(STREAM* s, ORDER_INFO* orderInfo, PATBLT_ORDER* patblt, PATBLT_ORDER* previous);
+void update_write_scrblt_order(STREAM* s, ORDER_INFO* orderInfo, SCRBLT_ORDER* scrblt, SCRBLT_ORDER* previous);
+void update_write_opaque_rect_order(STREAM* s, ORDER_INFO* orderInfo, OPAQUE_RECT_ORDER* opaque_rect, OPAQUE_RECT_ORDER* previous);
+void update_write_multi_opaque_rect_order(STREAM* s, ORDER_INFO* orderInfo, MULTI_OPAQUE_RECT_ORDER* multi_opaque_rect, MULTI_OPAQUE_RECT_ORDER* previous);
+void update_write_line_to_order(STREAM* s, ORDER_INFO* orderInfo, LINE_TO_ORDER* line_to, LINE_TO_ORDER* previous);
+void update_write_memblt_order(STREAM* s, ORDER_INFO* orderInfo, MEMBLT_ORDER* memblt, MEMBLT_ORDER* previous);
+void update_write_glyph_index_order(STREAM* s, ORDER_INFO* orderInfo, GLYPH_INDEX_ORDER* glyph_index, GLYPH_INDEX_ORDER* previous);
+
+void update_write_field_flags(STREAM* s, uint32 fieldFlags, uint8 flags, uint8 fieldBytes);
+void update_write_bounds(STREAM* s, rdpBounds* bounds, rdpBounds* previous);
+boolean update_write_primary_order(STREAM* s, rdpPrimaryUpdate* primary, uint8 orderType, void* order, rdpBounds* bounds);
+
 void update_read_cache_bitmap_order(STREAM* s, CACHE_BITMAP_ORDER* cache_bitmap_order, boolean compressed, uint16 flags);
 void update_read_cache_bitmap_v2_order(STREAM* s, CACHE_BITMAP_V2_ORDER* cache_bitmap_v2_order, boolean compressed, uint16 flags);
 void update_read_cache_bitmap_v3_order(STREAM* s, CACHE_BITMAP_V3_ORDER* cache_bitmap_v3_order, boolean compressed, uint16 flags);
@@ -217,6 +233,9 @@ void update_read_cache_glyph_order(STREAM* s, CACHE_GLYPH_ORDER* cache_glyph_ord
 void update_read_cache_glyph_v2_order(STREAM* s, CACHE_GLYPH_V2_ORDER* cache_glyph_v2_order, uint16 flags);
 void update_read_cache_brush_order(STREAM* s, CACHE_BRUSH_ORDER* cache_brush_order, uint16 flags);
 
+void update_write_cache_bitmap_v2_order(STREAM* s, CACHE_BITMAP_V2_ORDER* cache_bitmap_v2_order, boolean compressed, uint16* flags);
+void update_write_cache_bitmap_v3_order(STREAM* s, CACHE_BITMAP_V3_ORDER* cache_bitmap_v3_order, boolean compressed, uint16* flags);
+
 void update_read_create_offscreen_bitmap_order(STREAM* s, CREATE_OFFSCREEN_BITMAP_ORDER* create_offscreen_bitmap);
 void update_read_switch_surface_order(STREAM* s, SWITCH_SURFACE_ORDER* switch_surface);
 void update_read_create_nine_grid_bitmap_order(STREAM* s, CREATE_NINE_GRID_BITMAP_ORDER* create_nine_grid_bitmap);
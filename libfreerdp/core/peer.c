@@ -25,11 +25,12 @@
 #include <freerdp/utils/tcp.h>
 
 #include "peer.h"
+#include "listener.h"
 
 static boolean freerdp_peer_initialize(freerdp_peer* client)
 {
 	client->context->rdp->settings->server_mode = true;
-	client->context->rdp->settings->frame_acknowledge = 0;
+	client->context->rdp->settings->frame_acknowledge = SERVER_MAX_UNACKNOWLEDGED_FRAMES;
 	client->context->rdp->settings->local = client->local;
 	client->context->rdp->state = CONNECTION_STATE_INITIAL;
 
@@ -39,6 +40,16 @@ static boolean freerdp_peer_initialize(freerdp_peer* client)
 		    key_new(client->context->rdp->settings->rdp_key_file);
 	}
 
+	client->context->rdp->transport->send_queue_low_watermark = client->send_queue_low_watermark;
+	client->context->rdp->transport->send_queue_high_watermark = client->send_queue_high_watermark;
+
+	if (client->listener != NULL)
+	{
+		client->context->rdp->settings->tls_context =
+		    freerdp_listener_get_tls_context((rdpListener*) client->listener,
+		    client->context->rdp->settings->cert_file, client->context->rdp->settings->privatekey_file);
+	}
+
 	return true;
 }
 
@@ -50,6 +61,13 @@ static boolean freerdp_peer_get_fds(freerdp_peer* client, void** rfds, int* rcou
 	return true;
 }
 
+static boolean freerdp_peer_get_write_fds(freerdp_peer* client, void** wfds, int* wcount)
+{
+	transport_get_write_fds(client->context->rdp->transport, wfds, wcount);
+
+	return true;
+}
+
 static boolean freerdp_peer_check_fds(freerdp_peer* client)
 {
 	int status;
@@ -65,11 +83,63 @@ static boolean freerdp_peer_check_fds(freerdp_peer* client)
 	return true;
 }
 
+/**
+ * Number of frames sent to the client and not yet acknowledged.
+ * Frame acknowledgement is active only if the client sent the Frame Acknowledge
+ * Capability Set, in which case frame_acknowledge holds the maximum number of
+ * unacknowledged frames it accepts. Otherwise, no frame is ever in flight.
+ */
+
+static uint32 freerdp_peer_get_frames_in_flight(freerdp_peer* client)
+{
+	uint32 frames;
+	rdpSettings* settings = client->context->rdp->settings;
+
+	if (!settings->received_caps[CAPSET_TYPE_FRAME_ACKNOWLEDGE] || settings->frame_acknowledge == 0)
+		return 0;
+
+	freerdp_mutex_lock(client->frame_mutex);
+	frames = client->last_frame_id - client->ack_frame_id;
+	freerdp_mutex_unlock(client->frame_mutex);
+
+	return frames;
+}
+
+static boolean freerdp_peer_is_write_blocked(freerdp_peer* client)
+{
+	return transport_is_write_blocked(client->context->rdp->transport);
+}
+
+static int freerdp_peer_drain_send_queue(freerdp_peer* client)
+{
+	return transport_drain_send_queue(client->context->rdp->transport);
+}
+
+static uint32 freerdp_peer_get_send_queue_depth(freerdp_peer* client)
+{
+	return transport_get_send_queue_depth(client->context->rdp->transport);
+}
+
+static void peer_send_queue_high_callback(rdpTransport* transport, uint32 depth, void* extra)
+{
+	freerdp_peer* client = (freerdp_peer*) extra;
+
+	IFCALL(client->SendQueueHigh, client, depth);
+}
+
+static void peer_send_queue_low_callback(rdpTransport* transport, uint32 depth, void* extra)
+{
+	freerdp_peer* client = (freerdp_peer*) extra;
+
+	IFCALL(client->SendQueueLow, client, depth);
+}
+
 static boolean peer_recv_data_pdu(freerdp_peer* client, STREAM* s)
 {
 	uint8 type;
 	uint16 length;
 	uint32 share_id;
+	uint32 frame_id;
 	uint8 compressed_type;
 	uint16 compressed_len;
 
@@ -129,7 +199,13 @@ static boolean peer_recv_data_pdu(freerdp_peer* client, STREAM* s)
 			return false;
 
 		case DATA_PDU_TYPE_FRAME_ACKNOWLEDGE:
-			stream_read_uint32(s, client->ack_frame_id);
+			if (stream_get_left(s) < 4)
+				return false;
+			stream_read_uint32(s, frame_id);
+			freerdp_mutex_lock(client->frame_mutex);
+			client->ack_frame_id = frame_id;
+			freerdp_mutex_unlock(client->frame_mutex);
+			IFCALL(client->update->SurfaceFrameAcknowledge, client->update->context, frame_id);
 			break;
 
 		case DATA_PDU_TYPE_REFRESH_RECT:
@@ -360,6 +436,8 @@ void freerdp_peer_context_new(freerdp_peer* client)
 
 	rdp->transport->recv_callback = peer_recv_callback;
 	rdp->transport->recv_extra = client;
+	rdp->transport->send_queue_low_callback = peer_send_queue_low_callback;
+	rdp->transport->send_queue_high_callback = peer_send_queue_high_callback;
 	transport_set_blocking_mode(rdp->transport, false);
 
 	IFCALL(client->ContextNew, client, client->context);
@@ -384,10 +462,18 @@ freerdp_peer* freerdp_peer_new(int sockfd)
 		client->context_size = sizeof(rdpContext);
 		client->Initialize = freerdp_peer_initialize;
 		client->GetFileDescriptor = freerdp_peer_get_fds;
+		client->GetWriteFileDescriptor = freerdp_peer_get_write_fds;
 		client->CheckFileDescriptor = freerdp_peer_check_fds;
 		client->Close = freerdp_peer_close;
 		client->Disconnect = freerdp_peer_disconnect;
+		client->GetFramesInFlight = freerdp_peer_get_frames_in_flight;
+		client->IsWriteBlocked = freerdp_peer_is_write_blocked;
+		client->DrainSendQueue = freerdp_peer_drain_send_queue;
+		client->GetSendQueueDepth = freerdp_peer_get_send_queue_depth;
+		client->send_queue_low_watermark = TRANSPORT_SEND_QUEUE_LOW_WATERMARK;
+		client->send_queue_high_watermark = TRANSPORT_SEND_QUEUE_HIGH_WATERMARK;
 		client->SendChannelData = freerdp_peer_send_channel_data;
+		client->frame_mutex = freerdp_mutex_new();
 	}
 
 	return client;
@@ -398,6 +484,7 @@ void freerdp_peer_free(freerdp_peer* client)
 	if (client)
 	{
 		rdp_free(client->context->rdp);
+		freerdp_mutex_free(client->frame_mutex);
 		xfree(client->context);
 		xfree(client);
 	}
@@ -23,5 +23,8 @@
 #include "rdp.h"
 #include <freerdp/peer.h>
 
+/* maximum number of unacknowledged frames advertised to the client */
+#define SERVER_MAX_UNACKNOWLEDGED_FRAMES	2
+
 #endif /* __PEER */
 
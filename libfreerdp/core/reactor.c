@@ -0,0 +1,622 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol client.
+ * Server Event Loop
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <freerdp/reactor.h>
+#include <freerdp/utils/memory.h>
+#include <freerdp/utils/mutex.h>
+
+#ifdef HAVE_SYS_EPOLL_H
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+
+#include "rdp.h"
+
+/**
+ * Every source owns an epoll set holding its own file descriptors. The reactor
+ * set holds the epoll descriptor of each source with EPOLLONESHOT: when any
+ * descriptor of a source becomes ready, exactly one worker thread picks the
+ * source up, and it is re-armed only once that thread is done with it.
+ */
+
+typedef struct rdp_reactor_fd rdpReactorFd;
+typedef struct rdp_reactor_source rdpReactorSource;
+
+/**
+ * A descriptor closed by a callback is dropped from the epoll sets, and its
+ * number may be given to a new descriptor before the next update. The file it
+ * refers to tells the new descriptor apart, so that it gets added again.
+ */
+
+struct rdp_reactor_fd
+{
+	int fd;
+	uint32 events;
+	dev_t dev;
+	ino_t ino;
+};
+
+struct rdp_reactor_source
+{
+	rdpReactor* reactor;
+
+	void* data;
+	psReactorGetFileDescriptor GetFileDescriptor;
+	psReactorCheckFileDescriptor CheckFileDescriptor;
+	psReactorSourceClosed Closed;
+
+	int epfd;
+	int count;
+	rdpReactorFd fds[REACTOR_MAX_SOURCE_FDS * 2];
+
+	rdpReactorSource* prev;
+	rdpReactorSource* next;
+};
+
+struct rdp_reactor
+{
+	int epfd;
+	int wakeup[2];
+	boolean running;
+
+	int num_threads;
+	pthread_t* threads;
+
+	freerdp_mutex mutex;
+	rdpReactorSource* sources;
+};
+
+struct rdp_reactor_peer
+{
+	freerdp_peer* client;
+	psReactorPeerGetFileDescriptor GetFileDescriptor;
+	psReactorPeerCheckFileDescriptor CheckFileDescriptor;
+	psReactorPeerClosed Closed;
+};
+typedef struct rdp_reactor_peer rdpReactorPeer;
+
+static void reactor_fd_list_add(rdpReactorFd* fds, int* count, int fd, uint32 mask)
+{
+	int i;
+	struct stat st;
+
+	for (i = 0; i < *count; i++)
+	{
+		if (fds[i].fd == fd)
+		{
+			fds[i].events |= mask;
+			return;
+		}
+	}
+
+	memset(&fds[*count], 0, sizeof(rdpReactorFd));
+	fds[*count].fd = fd;
+	fds[*count].events = mask;
+
+	if (fstat(fd, &st) == 0)
+	{
+		fds[*count].dev = st.st_dev;
+		fds[*count].ino = st.st_ino;
+	}
+
+	(*count)++;
+}
+
+static int reactor_fd_list_find(rdpReactorFd* fds, int count, rdpReactorFd* fd)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		if ((fds[i].fd == fd->fd) && (fds[i].dev == fd->dev) && (fds[i].ino == fd->ino))
+			return i;
+	}
+
+	return -1;
+}
+
+/**
+ * Query the file descriptors of a source and bring its epoll set up to date.
+ * Peers gain and lose descriptors during their lifetime, for instance when
+ * channels are opened or when the send queue fills up.
+ */
+
+static boolean reactor_source_update_fds(rdpReactorSource* source)
+{
+	int i, j;
+	int rcount = 0;
+	int wcount = 0;
+	int count = 0;
+	void* rfds[REACTOR_MAX_SOURCE_FDS];
+	void* wfds[REACTOR_MAX_SOURCE_FDS];
+	rdpReactorFd fds[REACTOR_MAX_SOURCE_FDS * 2];
+	struct epoll_event event;
+
+	if (source->GetFileDescriptor(source->data, rfds, &rcount, wfds, &wcount) != true)
+		return false;
+
+	for (i = 0; i < rcount; i++)
+		reactor_fd_list_add(fds, &count, (int)(long)(rfds[i]), EPOLLIN);
+
+	for (i = 0; i < wcount; i++)
+		reactor_fd_list_add(fds, &count, (int)(long)(wfds[i]), EPOLLOUT);
+
+	/* this fails for the descriptors which were closed, epoll dropped them already */
+	for (i = 0; i < source->count; i++)
+	{
+		if (reactor_fd_list_find(fds, count, &source->fds[i]) < 0)
+			epoll_ctl(source->epfd, EPOLL_CTL_DEL, source->fds[i].fd, &event);
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		memset(&event, 0, sizeof(event));
+		event.events = fds[i].events;
+		event.data.fd = fds[i].fd;
+
+		j = reactor_fd_list_find(source->fds, source->count, &fds[i]);
+
+		if (j < 0)
+		{
+			if (epoll_ctl(source->epfd, EPOLL_CTL_ADD, fds[i].fd, &event) != 0)
+			{
+				perror("epoll_ctl");
+				return false;
+			}
+		}
+		else if (source->fds[j].events != fds[i].events)
+		{
+			if (epoll_ctl(source->epfd, EPOLL_CTL_MOD, fds[i].fd, &event) != 0)
+			{
+				perror("epoll_ctl");
+				return false;
+			}
+		}
+	}
+
+	memcpy(source->fds, fds, count * sizeof(rdpReactorFd));
+	source->count = count;
+
+	return true;
+}
+
+static boolean reactor_source_arm(rdpReactorSource* source, int op)
+{
+	struct epoll_event event;
+
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN | EPOLLONESHOT;
+	event.data.ptr = source;
+
+	if (epoll_ctl(source->reactor->epfd, op, source->epfd, &event) != 0)
+	{
+		perror("epoll_ctl");
+		return false;
+	}
+
+	return true;
+}
+
+static void reactor_source_free(rdpReactorSource* source)
+{
+	close(source->epfd);
+	IFCALL(source->Closed, source->data);
+	xfree(source);
+}
+
+static void reactor_source_remove(rdpReactorSource* source)
+{
+	struct epoll_event event;
+	rdpReactor* reactor = source->reactor;
+
+	epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, source->epfd, &event);
+
+	freerdp_mutex_lock(reactor->mutex);
+
+	if (source->prev != NULL)
+		source->prev->next = source->next;
+	else
+		reactor->sources = source->next;
+
+	if (source->next != NULL)
+		source->next->prev = source->prev;
+
+	freerdp_mutex_unlock(reactor->mutex);
+
+	reactor_source_free(source);
+}
+
+static void reactor_source_dispatch(rdpReactorSource* source)
+{
+	boolean status;
+	struct epoll_event events[REACTOR_MAX_SOURCE_FDS * 2];
+
+	/* clear the ready list of the source, the callbacks check every descriptor anyway */
+	epoll_wait(source->epfd, events, REACTOR_MAX_SOURCE_FDS * 2, 0);
+
+	status = source->CheckFileDescriptor(source->data);
+
+	if (status == true)
+		status = reactor_source_update_fds(source);
+
+	if (status == true)
+		status = reactor_source_arm(source, EPOLL_CTL_MOD);
+
+	if (status != true)
+		reactor_source_remove(source);
+}
+
+static void* reactor_thread(void* arg)
+{
+	int status;
+	struct epoll_event event;
+	rdpReactor* reactor = (rdpReactor*) arg;
+
+	while (1)
+	{
+		status = epoll_wait(reactor->epfd, &event, 1, -1);
+
+		if (status < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			perror("epoll_wait");
+			break;
+		}
+
+		if (status == 0)
+			continue;
+
+		/* the wakeup pipe stays readable, so that every worker sees it */
+		if (event.data.ptr == NULL)
+			break;
+
+		reactor_source_dispatch((rdpReactorSource*) event.data.ptr);
+	}
+
+	return NULL;
+}
+
+boolean freerdp_reactor_add_source(rdpReactor* reactor, void* data,
+		psReactorGetFileDescriptor GetFileDescriptor,
+		psReactorCheckFileDescriptor CheckFileDescriptor,
+		psReactorSourceClosed Closed)
+{
+	rdpReactorSource* source;
+
+	source = xnew(rdpReactorSource);
+	source->reactor = reactor;
+	source->data = data;
+	source->GetFileDescriptor = GetFileDescriptor;
+	source->CheckFileDescriptor = CheckFileDescriptor;
+	source->Closed = Closed;
+
+	source->epfd = epoll_create(REACTOR_MAX_SOURCE_FDS);
+
+	if (source->epfd < 0)
+	{
+		perror("epoll_create");
+		xfree(source);
+		return false;
+	}
+
+	fcntl(source->epfd, F_SETFD, FD_CLOEXEC);
+
+	if (reactor_source_update_fds(source) != true)
+	{
+		close(source->epfd);
+		xfree(source);
+		return false;
+	}
+
+	freerdp_mutex_lock(reactor->mutex);
+
+	source->next = reactor->sources;
+
+	if (reactor->sources != NULL)
+		reactor->sources->prev = source;
+
+	reactor->sources = source;
+
+	freerdp_mutex_unlock(reactor->mutex);
+
+	/* from here on the source may be dispatched, and even freed, by a worker */
+	if (reactor_source_arm(source, EPOLL_CTL_ADD) != true)
+	{
+		reactor_source_remove(source);
+		return false;
+	}
+
+	return true;
+}
+
+static boolean reactor_listener_get_fds(void* data, void** rfds, int* rcount, void** wfds, int* wcount)
+{
+	freerdp_listener* instance = (freerdp_listener*) data;
+
+	return instance->GetFileDescriptor(instance, rfds, rcount);
+}
+
+static boolean reactor_listener_check_fds(void* data)
+{
+	freerdp_listener* instance = (freerdp_listener*) data;
+
+	return instance->CheckFileDescriptor(instance);
+}
+
+/**
+ * Register a listener. PeerAccepted is called from a worker thread and would
+ * normally hand the new peer over to freerdp_reactor_add_peer. The listener
+ * remains owned by the caller.
+ */
+
+boolean freerdp_reactor_add_listener(rdpReactor* reactor, freerdp_listener* instance)
+{
+	return freerdp_reactor_add_source(reactor, (void*) instance,
+			reactor_listener_get_fds, reactor_listener_check_fds, NULL);
+}
+
+static boolean reactor_peer_get_fds(void* data, void** rfds, int* rcount, void** wfds, int* wcount)
+{
+	rdpReactorPeer* peer = (rdpReactorPeer*) data;
+	freerdp_peer* client = peer->client;
+
+	if (client->GetFileDescriptor(client, rfds, rcount) != true)
+		return false;
+
+	/* wait for the socket to become writable while the send queue is backed up */
+	if (client->IsWriteBlocked(client))
+	{
+		wfds[*wcount] = (void*)(long)(client->context->rdp->transport->tcp->sockfd);
+		(*wcount)++;
+	}
+
+	if (peer->GetFileDescriptor != NULL)
+		return peer->GetFileDescriptor(client, rfds, rcount);
+
+	return true;
+}
+
+static boolean reactor_peer_check_fds(void* data)
+{
+	rdpReactorPeer* peer = (rdpReactorPeer*) data;
+	freerdp_peer* client = peer->client;
+
+	if (client->IsWriteBlocked(client) && (client->DrainSendQueue(client) < 0))
+		return false;
+
+	if (client->CheckFileDescriptor(client) != true)
+		return false;
+
+	if (peer->CheckFileDescriptor != NULL)
+		return peer->CheckFileDescriptor(client);
+
+	return true;
+}
+
+static void reactor_peer_closed(void* data)
+{
+	rdpReactorPeer* peer = (rdpReactorPeer*) data;
+
+	IFCALL(peer->Closed, peer->client);
+	xfree(peer);
+}
+
+/**
+ * Register a peer, which must already be initialized.
+ * The optional GetFileDescriptor and CheckFileDescriptor callbacks add the
+ * descriptors of the application for this peer, typically those of its
+ * WTSVirtualChannelManager, and are dispatched together with the peer.
+ * Once the connection is closed or a callback fails, the peer is removed and
+ * Closed is called, where the application disconnects and frees it.
+ */
+
+boolean freerdp_reactor_add_peer(rdpReactor* reactor, freerdp_peer* client,
+		psReactorPeerGetFileDescriptor GetFileDescriptor,
+		psReactorPeerCheckFileDescriptor CheckFileDescriptor,
+		psReactorPeerClosed Closed)
+{
+	rdpReactorPeer* peer;
+
+	peer = xnew(rdpReactorPeer);
+	peer->client = client;
+	peer->GetFileDescriptor = GetFileDescriptor;
+	peer->CheckFileDescriptor = CheckFileDescriptor;
+	peer->Closed = Closed;
+
+	if (freerdp_reactor_add_source(reactor, (void*) peer,
+			reactor_peer_get_fds, reactor_peer_check_fds, reactor_peer_closed) != true)
+	{
+		xfree(peer);
+		return false;
+	}
+
+	return true;
+}
+
+boolean freerdp_reactor_start(rdpReactor* reactor)
+{
+	int i;
+	uint8 byte;
+
+	if (reactor->running)
+		return true;
+
+	/* consume a wakeup left over from a previous stop */
+	while (read(reactor->wakeup[0], &byte, 1) > 0);
+
+	for (i = 0; i < reactor->num_threads; i++)
+	{
+		if (pthread_create(&reactor->threads[i], 0, reactor_thread, (void*) reactor) != 0)
+		{
+			printf("freerdp_reactor_start: failed to create worker thread\n");
+			reactor->num_threads = i;
+			break;
+		}
+	}
+
+	reactor->running = true;
+
+	return (reactor->num_threads > 0) ? true : false;
+}
+
+void freerdp_reactor_stop(rdpReactor* reactor)
+{
+	int i;
+	uint8 byte = 0;
+
+	if (!reactor->running)
+		return;
+
+	if (write(reactor->wakeup[1], &byte, 1) != 1)
+		perror("write");
+
+	for (i = 0; i < reactor->num_threads; i++)
+		pthread_join(reactor->threads[i], NULL);
+
+	reactor->running = false;
+}
+
+rdpReactor* freerdp_reactor_new(int num_threads)
+{
+	rdpReactor* reactor;
+	struct epoll_event event;
+
+	if (num_threads < 1)
+		num_threads = REACTOR_DEFAULT_THREADS;
+
+	reactor = xnew(rdpReactor);
+
+	reactor->epfd = epoll_create(64);
+
+	if (reactor->epfd < 0)
+	{
+		perror("epoll_create");
+		xfree(reactor);
+		return NULL;
+	}
+
+	if (pipe(reactor->wakeup) != 0)
+	{
+		perror("pipe");
+		close(reactor->epfd);
+		xfree(reactor);
+		return NULL;
+	}
+
+	fcntl(reactor->epfd, F_SETFD, FD_CLOEXEC);
+	fcntl(reactor->wakeup[0], F_SETFL, O_NONBLOCK);
+
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.ptr = NULL;
+	epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, reactor->wakeup[0], &event);
+
+	reactor->num_threads = num_threads;
+	reactor->threads = (pthread_t*) xzalloc(sizeof(pthread_t) * num_threads);
+	reactor->mutex = freerdp_mutex_new();
+
+	return reactor;
+}
+
+/**
+ * Stop the reactor and close every source still registered.
+ */
+
+void freerdp_reactor_free(rdpReactor* reactor)
+{
+	rdpReactorSource* source;
+
+	if (reactor == NULL)
+		return;
+
+	freerdp_reactor_stop(reactor);
+
+	while (reactor->sources != NULL)
+	{
+		source = reactor->sources;
+		reactor->sources = source->next;
+		reactor_source_free(source);
+	}
+
+	close(reactor->wakeup[0]);
+	close(reactor->wakeup[1]);
+	close(reactor->epfd);
+
+	freerdp_mutex_free(reactor->mutex);
+	xfree(reactor->threads);
+	xfree(reactor);
+}
+
+#else
+
+rdpReactor* freerdp_reactor_new(int num_threads)
+{
+	printf("freerdp_reactor_new: epoll is not available on this platform\n");
+	return NULL;
+}
+
+void freerdp_reactor_free(rdpReactor* reactor)
+{
+
+}
+
+boolean freerdp_reactor_start(rdpReactor* reactor)
+{
+	return false;
+}
+
+void freerdp_reactor_stop(rdpReactor* reactor)
+{
+
+}
+
+boolean freerdp_reactor_add_source(rdpReactor* reactor, void* data,
+		psReactorGetFileDescriptor GetFileDescriptor,
+		psReactorCheckFileDescriptor CheckFileDescriptor,
+		psReactorSourceClosed Closed)
+{
+	return false;
+}
+
+boolean freerdp_reactor_add_listener(rdpReactor* reactor, freerdp_listener* instance)
+{
+	return false;
+}
+
+boolean freerdp_reactor_add_peer(rdpReactor* reactor, freerdp_peer* client,
+		psReactorPeerGetFileDescriptor GetFileDescriptor,
+		psReactorPeerCheckFileDescriptor CheckFileDescriptor,
+		psReactorPeerClosed Closed)
+{
+	return false;
+}
+
+#endif /* HAVE_SYS_EPOLL_H */
@@ -205,6 +205,7 @@ rdpSettings* settings_new(void* instance)
 		settings->color_pointer = true;
 		settings->large_pointer = true;
 		settings->pointer_cache_size = 20;
+		settings->new_pointer = true;
 		settings->sound_beeps = true;
 		settings->disable_wallpaper = false;
 		settings->disable_full_window_drag = false;
@@ -220,6 +221,7 @@ rdpSettings* settings_new(void* instance)
 		settings->bitmap_cache = true;
 		settings->persistent_bitmap_cache = false;
 		settings->bitmapCacheV2CellInfo = xzalloc(sizeof(BITMAP_CACHE_V2_CELL_INFO) * 6);
+		settings->cache_idle_timeout = 300;
 
 		settings->refresh_rect = true;
 		settings->suppress_output = true;
@@ -269,6 +271,7 @@ rdpSettings* settings_new(void* instance)
 
 		settings->fastpath_input = true;
 		settings->fastpath_output = true;
+		settings->input_batching = true;
 
 		settings->frame_acknowledge = 2;
 
@@ -321,6 +324,7 @@ void settings_free(rdpSettings* settings)
 		xfree(settings->server_auto_reconnect_cookie);
 		xfree(settings->client_time_zone);
 		xfree(settings->bitmapCacheV2CellInfo);
+		xfree(settings->bitmap_cache_persist_file);
 		xfree(settings->glyphCache);
 		xfree(settings->fragCache);
 		key_free(settings->server_key);
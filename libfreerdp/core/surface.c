@@ -59,6 +59,23 @@ static void update_send_frame_acknowledge(rdpRdp* rdp, uint32 frameId)
 	rdp_send_data_pdu(rdp, s, DATA_PDU_TYPE_FRAME_ACKNOWLEDGE, rdp->mcs->user_id);
 }
 
+/**
+ * Acknowledge a frame once its end marker has been executed. When updates
+ * go through a message queue, this happens when the queue executes the
+ * marker rather than when it is received, so that the server paces its
+ * frames on the ones actually presented.
+ */
+
+void update_frame_acknowledge(rdpUpdate* update, SURFACE_FRAME_MARKER* marker)
+{
+	rdpSettings* settings = update->context->rdp->settings;
+
+	if (settings->received_caps[CAPSET_TYPE_FRAME_ACKNOWLEDGE] && settings->frame_acknowledge > 0 && marker->frameAction == SURFACECMD_FRAMEACTION_END)
+	{
+		update_send_frame_acknowledge(update->context->rdp, marker->frameId);
+	}
+}
+
 static int update_recv_surfcmd_frame_marker(rdpUpdate* update, STREAM* s)
 {
 	SURFACE_FRAME_MARKER* marker = &update->surface_frame_marker;
@@ -68,10 +85,8 @@ static int update_recv_surfcmd_frame_marker(rdpUpdate* update, STREAM* s)
 
 	IFCALL(update->SurfaceFrameMarker, update->context, marker);
 
-	if (update->context->rdp->settings->received_caps[CAPSET_TYPE_FRAME_ACKNOWLEDGE] && update->context->rdp->settings->frame_acknowledge > 0 && marker->frameAction == SURFACECMD_FRAMEACTION_END)
-	{
-		update_send_frame_acknowledge(update->context->rdp, marker->frameId);
-	}
+	if (update->queue == NULL)
+		update_frame_acknowledge(update, marker);
 
 	return 6;
 }
@@ -34,6 +34,7 @@ enum SURFCMD_CMDTYPE
 };
 
 boolean update_recv_surfcmds(rdpUpdate* update, uint32 size, STREAM* s);
+void update_frame_acknowledge(rdpUpdate* update, SURFACE_FRAME_MARKER* marker);
 
 void update_write_surfcmd_surface_bits_header(STREAM* s, SURFACE_BITS_COMMAND* cmd);
 void update_write_surfcmd_frame_marker(STREAM* s, uint16 frameAction, uint32 frameId);
@@ -38,6 +38,7 @@
 
 #ifndef _WIN32
 #include <netdb.h>
+#include <sys/select.h>
 #include <sys/socket.h>
 #endif
 
@@ -72,6 +73,10 @@ void transport_attach(rdpTransport* transport, int sockfd)
 
 boolean transport_disconnect(rdpTransport* transport)
 {
+	/* try not to drop what is still queued, such as a disconnect provider ultimatum */
+	if (transport_is_write_blocked(transport))
+		transport_drain_send_queue(transport);
+
 	if (transport->layer == TRANSPORT_LAYER_TLS)
 		tls_disconnect(transport->tls);
 
@@ -316,6 +321,200 @@ static int transport_read_nonblocking(rdpTransport* transport)
 	return status;
 }
 
+static int transport_write_layer(rdpTransport* transport, uint8* data, int length)
+{
+	int status = -1;
+
+	if (transport->layer == TRANSPORT_LAYER_TLS)
+		status = tls_write(transport->tls, data, length);
+	else if (transport->layer == TRANSPORT_LAYER_TCP)
+		status = tcp_write(transport->tcp, data, length);
+	else if (transport->layer == TRANSPORT_LAYER_TSG)
+		status = tsg_write(transport->tsg, data, length);
+
+	return status;
+}
+
+uint32 transport_get_send_queue_depth(rdpTransport* transport)
+{
+	if (transport->send_queue == NULL)
+		return 0;
+
+	return stream_get_pos(transport->send_queue) - transport->send_queue_offset;
+}
+
+boolean transport_is_write_blocked(rdpTransport* transport)
+{
+	return (transport_get_send_queue_depth(transport) > 0) ? true : false;
+}
+
+static void transport_check_send_queue_watermarks(rdpTransport* transport)
+{
+	uint32 depth;
+
+	depth = transport_get_send_queue_depth(transport);
+
+	if (!transport->send_queue_high && depth >= transport->send_queue_high_watermark)
+	{
+		transport->send_queue_high = true;
+		IFCALL(transport->send_queue_high_callback, transport, depth, transport->recv_extra);
+	}
+	else if (transport->send_queue_high && depth <= transport->send_queue_low_watermark)
+	{
+		transport->send_queue_high = false;
+		IFCALL(transport->send_queue_low_callback, transport, depth, transport->recv_extra);
+	}
+}
+
+/**
+ * Write as much of the send queue as the socket accepts without blocking.
+ * @return number of bytes still queued, or -1 on error
+ */
+
+int transport_drain_send_queue(rdpTransport* transport)
+{
+	int status;
+	uint32 depth;
+	STREAM* queue = transport->send_queue;
+
+	depth = transport_get_send_queue_depth(transport);
+
+	while (depth > 0)
+	{
+		status = transport_write_layer(transport, stream_get_head(queue) + transport->send_queue_offset, depth);
+
+		if (status < 0)
+		{
+			/* A write error indicates that the peer has dropped the connection */
+			transport->layer = TRANSPORT_LAYER_CLOSED;
+			return -1;
+		}
+
+		if (status == 0)
+			break;
+
+		transport->send_queue_offset += status;
+		depth -= status;
+	}
+
+	if (depth == 0 && queue != NULL)
+	{
+		stream_set_pos(queue, 0);
+		transport->send_queue_offset = 0;
+	}
+
+	transport_check_send_queue_watermarks(transport);
+
+	return depth;
+}
+
+static void transport_wait_writable(rdpTransport* transport)
+{
+	fd_set wfds;
+	struct timeval timeout;
+	int sockfd = transport->tcp->sockfd;
+
+	FD_ZERO(&wfds);
+	FD_SET(sockfd, &wfds);
+
+	timeout.tv_sec = 0;
+	timeout.tv_usec = 100000;
+
+	select(sockfd + 1, NULL, &wfds, NULL, &timeout);
+}
+
+static int transport_flush_send_queue(rdpTransport* transport)
+{
+	int status;
+
+	while ((status = transport_drain_send_queue(transport)) > 0)
+	{
+		transport_wait_writable(transport);
+
+		/* while waiting for the socket, the receiving buffer should be checked */
+		if (transport_read_nonblocking(transport) > 0)
+			wait_obj_set(transport->recv_event);
+	}
+
+	return status;
+}
+
+static boolean transport_use_send_queue(rdpTransport* transport)
+{
+	if (transport->blocking || !transport->settings->server_mode)
+		return false;
+
+	return (transport->layer == TRANSPORT_LAYER_TLS || transport->layer == TRANSPORT_LAYER_TCP) ? true : false;
+}
+
+/**
+ * Non-blocking write for server peers.
+ * Whatever the socket does not accept right away is appended to the send queue,
+ * which is drained from transport_check_fds or by the application when the socket
+ * becomes writable. The queue is bounded: when it is full, wait for the client.
+ */
+
+static int transport_write_queued(rdpTransport* transport, STREAM* s, int length)
+{
+	int status;
+	int depth;
+	STREAM* queue;
+	int total = length;
+
+	if (transport->send_queue == NULL)
+		transport->send_queue = stream_new(BUFFER_SIZE);
+
+	queue = transport->send_queue;
+
+	/* data must be sent in order, so write directly only if nothing is pending */
+	depth = transport_drain_send_queue(transport);
+
+	if (depth < 0)
+		return -1;
+
+	while (depth == 0 && length > 0)
+	{
+		status = transport_write_layer(transport, stream_get_tail(s), length);
+
+		if (status < 0)
+		{
+			transport->layer = TRANSPORT_LAYER_CLOSED;
+			return -1;
+		}
+
+		if (status == 0)
+			break;
+
+		length -= status;
+		stream_seek(s, status);
+	}
+
+	if (length > 0)
+	{
+		if (transport_get_send_queue_depth(transport) + length > transport->send_queue_max_size)
+		{
+			if (transport_flush_send_queue(transport) < 0)
+				return -1;
+		}
+
+		/* reclaim the space already sent before growing the queue */
+		if (transport->send_queue_offset > 0 && stream_get_left(queue) < length)
+		{
+			depth = transport_get_send_queue_depth(transport);
+			memmove(stream_get_head(queue), stream_get_head(queue) + transport->send_queue_offset, depth);
+			stream_set_pos(queue, depth);
+			transport->send_queue_offset = 0;
+		}
+
+		stream_check_size(queue, length);
+		stream_write(queue, stream_get_tail(s), length);
+
+		transport_check_send_queue_watermarks(transport);
+	}
+
+	return total;
+}
+
 int transport_write(rdpTransport* transport, STREAM* s)
 {
 	int status = -1;
@@ -332,14 +531,12 @@ int transport_write(rdpTransport* transport, STREAM* s)
 	}
 #endif
 
+	if (transport_use_send_queue(transport))
+		return transport_write_queued(transport, s, length);
+
 	while (length > 0)
 	{
-		if (transport->layer == TRANSPORT_LAYER_TLS)
-			status = tls_write(transport->tls, stream_get_tail(s), length);
-		else if (transport->layer == TRANSPORT_LAYER_TCP)
-			status = tcp_write(transport->tcp, stream_get_tail(s), length);
-		else if (transport->layer == TRANSPORT_LAYER_TSG)
-			status = tsg_write(transport->tsg, stream_get_tail(s), length);
+		status = transport_write_layer(transport, stream_get_tail(s), length);
 
 		if (status < 0)
 			break; /* error occurred */
@@ -378,6 +575,17 @@ void transport_get_fds(rdpTransport* transport, void** rfds, int* rcount)
 	wait_obj_get_fds(transport->recv_event, rfds, rcount);
 }
 
+/**
+ * Get the descriptor to wait on for the socket to become writable, while
+ * the send queue is backed up.
+ */
+
+void transport_get_write_fds(rdpTransport* transport, void** wfds, int* wcount)
+{
+	wfds[*wcount] = (void*)(long)(transport->tcp->sockfd);
+	(*wcount)++;
+}
+
 int transport_check_fds(rdpTransport** ptransport)
 {
 	int pos;
@@ -388,6 +596,12 @@ int transport_check_fds(rdpTransport** ptransport)
 
 	wait_obj_clear(transport->recv_event);
 
+	if (transport_is_write_blocked(transport))
+	{
+		if (transport_drain_send_queue(transport) < 0)
+			return -1;
+	}
+
 	status = transport_read_nonblocking(transport);
 
 	if (status < 0)
@@ -482,6 +696,10 @@ int transport_check_fds(rdpTransport** ptransport)
 
 boolean transport_set_blocking_mode(rdpTransport* transport, boolean blocking)
 {
+	/* queued data must go out before anything written in blocking mode */
+	if (blocking && transport_is_write_blocked(transport))
+		transport_flush_send_queue(transport);
+
 	transport->blocking = blocking;
 	return tcp_set_blocking_mode(transport->tcp, blocking);
 }
@@ -512,6 +730,11 @@ rdpTransport* transport_new(rdpSettings* settings)
 
 		transport->blocking = true;
 
+		/* send queue limits for non-blocking writes */
+		transport->send_queue_max_size = TRANSPORT_SEND_QUEUE_MAX_SIZE;
+		transport->send_queue_low_watermark = TRANSPORT_SEND_QUEUE_LOW_WATERMARK;
+		transport->send_queue_high_watermark = TRANSPORT_SEND_QUEUE_HIGH_WATERMARK;
+
 		transport->layer = TRANSPORT_LAYER_TCP;
 	}
 
@@ -527,6 +750,9 @@ void transport_free(rdpTransport* transport)
 		stream_free(transport->send_stream);
 		wait_obj_free(transport->recv_event);
 
+		if (transport->send_queue)
+			stream_free(transport->send_queue);
+
 		if (transport->tls)
 			tls_free(transport->tls);
 
@@ -42,7 +42,13 @@ typedef struct rdp_transport rdpTransport;
 #include <freerdp/utils/stream.h>
 #include <freerdp/utils/wait_obj.h>
 
+/* default send queue limits, in bytes */
+#define TRANSPORT_SEND_QUEUE_HIGH_WATERMARK	(256 * 1024)
+#define TRANSPORT_SEND_QUEUE_LOW_WATERMARK	(64 * 1024)
+#define TRANSPORT_SEND_QUEUE_MAX_SIZE		(4 * 1024 * 1024)
+
 typedef boolean (*TransportRecv) (rdpTransport* transport, STREAM* stream, void* extra);
+typedef void (*TransportSendQueue) (rdpTransport* transport, uint32 depth, void* extra);
 
 struct rdp_transport
 {
@@ -65,6 +71,14 @@ struct rdp_transport
 	struct wait_obj* recv_event;
 	boolean blocking;
 	boolean process_single_pdu; /* process single pdu in transport_check_fds */
+	STREAM* send_queue;
+	int send_queue_offset;
+	boolean send_queue_high;
+	uint32 send_queue_max_size;
+	uint32 send_queue_low_watermark;
+	uint32 send_queue_high_watermark;
+	TransportSendQueue send_queue_low_callback;
+	TransportSendQueue send_queue_high_callback;
 };
 
 STREAM* transport_recv_stream_init(rdpTransport* transport, int size);
@@ -81,7 +95,11 @@ boolean transport_accept_tls(rdpTransport* transport);
 boolean transport_accept_nla(rdpTransport* transport);
 int transport_read(rdpTransport* transport, STREAM* s);
 int transport_write(rdpTransport* transport, STREAM* s);
+uint32 transport_get_send_queue_depth(rdpTransport* transport);
+boolean transport_is_write_blocked(rdpTransport* transport);
+int transport_drain_send_queue(rdpTransport* transport);
 void transport_get_fds(rdpTransport* transport, void** rfds, int* rcount);
+void transport_get_write_fds(rdpTransport* transport, void** wfds, int* wcount);
 int transport_check_fds(rdpTransport** ptransport);
 boolean transport_set_blocking_mode(rdpTransport* transport, boolean blocking);
 rdpTransport* transport_new(rdpSettings* settings);
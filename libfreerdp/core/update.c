@@ -23,6 +23,7 @@
 
 #include "update.h"
 #include "surface.h"
+#include <freerdp/peer.h>
 #include <freerdp/utils/rect.h>
 #include <freerdp/codec/bitmap.h>
 
@@ -335,16 +336,23 @@ void update_reset_state(rdpUpdate* update)
 	primary->order_info.orderType = ORDER_TYPE_PATBLT;
 	altsec->switch_surface.bitmapId = SCREEN_BITMAP_SURFACE;
 	IFCALL(altsec->SwitchSurface, update->context, &(altsec->switch_surface));
+
+	/* nothing cached during a previous activation is referred to again */
+	IFCALL(update->ResetState, update->context);
 }
 
 static void update_begin_paint(rdpContext* context)
 {
-
+	/* orders are batched until the end of the paint */
+	context->rdp->fastpath->batchOrders = true;
 }
 
 static void update_end_paint(rdpContext* context)
 {
+	rdpFastPath* fastpath = context->rdp->fastpath;
 
+	fastpath->batchOrders = false;
+	fastpath_flush_orders(fastpath);
 }
 
 static void update_write_refresh_rect(STREAM* s, uint8 count, RECTANGLE_16* areas)
@@ -426,6 +434,14 @@ static void update_send_surface_frame_marker(rdpContext* context, SURFACE_FRAME_
 	s = fastpath_update_pdu_init(rdp->fastpath);
 	update_write_surfcmd_frame_marker(s, surface_frame_marker->frameAction, surface_frame_marker->frameId);
 	fastpath_send_update_pdu(rdp->fastpath, FASTPATH_UPDATETYPE_SURFCMDS, s);
+
+	/* frames in flight are counted from the end markers the client will acknowledge */
+	if (surface_frame_marker->frameAction == SURFACECMD_FRAMEACTION_END && context->peer != NULL)
+	{
+		freerdp_mutex_lock(context->peer->frame_mutex);
+		context->peer->last_frame_id = surface_frame_marker->frameId;
+		freerdp_mutex_unlock(context->peer->frame_mutex);
+	}
 }
 
 static void update_send_synchronize(rdpContext* context)
@@ -440,30 +456,141 @@ static void update_send_synchronize(rdpContext* context)
 
 static void update_send_desktop_resize(rdpContext* context)
 {
+	/* pending orders were encoded against the state the reactivation resets */
+	fastpath_flush_orders(context->rdp->fastpath);
+
 	rdp_server_reactivate(context->rdp);
 }
 
+static void update_send_set_bounds(rdpContext* context, rdpBounds* bounds)
+{
+	rdpUpdate* update = context->rdp->update;
+
+	if (bounds != NULL)
+	{
+		update->bounded = true;
+		memcpy(&update->bounds, bounds, sizeof(rdpBounds));
+	}
+	else
+	{
+		update->bounded = false;
+	}
+}
+
+static void update_send_primary_order(rdpContext* context, uint8 orderType, void* order)
+{
+	STREAM* s;
+	rdpUpdate* update = context->rdp->update;
+	rdpFastPath* fastpath = context->rdp->fastpath;
+
+	s = fastpath_order_init(fastpath);
+
+	if (!update_write_primary_order(s, update->primary, orderType, order, update->bounded ? &update->bounds : NULL))
+	{
+		/* take back the order counted by fastpath_order_init */
+		fastpath->numberOrders--;
+		return;
+	}
+
+	if (!fastpath->batchOrders)
+		fastpath_flush_orders(fastpath);
+}
+
+static void update_send_dstblt(rdpContext* context, DSTBLT_ORDER* dstblt)
+{
+	update_send_primary_order(context, ORDER_TYPE_DSTBLT, dstblt);
+}
+
+static void update_send_patblt(rdpContext* context, PATBLT_ORDER* patblt)
+{
+	update_send_primary_order(context, ORDER_TYPE_PATBLT, patblt);
+}
+
 static void update_send_scrblt(rdpContext* context, SCRBLT_ORDER* scrblt)
+{
+	update_send_primary_order(context, ORDER_TYPE_SCRBLT, scrblt);
+}
+
+static void update_send_opaque_rect(rdpContext* context, OPAQUE_RECT_ORDER* opaque_rect)
+{
+	update_send_primary_order(context, ORDER_TYPE_OPAQUE_RECT, opaque_rect);
+}
+
+static void update_send_multi_opaque_rect(rdpContext* context, MULTI_OPAQUE_RECT_ORDER* multi_opaque_rect)
+{
+	update_send_primary_order(context, ORDER_TYPE_MULTI_OPAQUE_RECT, multi_opaque_rect);
+}
+
+static void update_send_line_to(rdpContext* context, LINE_TO_ORDER* line_to)
+{
+	update_send_primary_order(context, ORDER_TYPE_LINE_TO, line_to);
+}
+
+static void update_send_memblt(rdpContext* context, MEMBLT_ORDER* memblt)
+{
+	update_send_primary_order(context, ORDER_TYPE_MEMBLT, memblt);
+}
+
+static void update_send_glyph_index(rdpContext* context, GLYPH_INDEX_ORDER* glyph_index)
+{
+	update_send_primary_order(context, ORDER_TYPE_GLYPH_INDEX, glyph_index);
+}
+
+static STREAM* update_secondary_order_init(rdpFastPath* fastpath, int* offset)
 {
 	STREAM* s;
-	rdpRdp* rdp = context->rdp;
 
-	s = fastpath_update_pdu_init(rdp->fastpath);
+	s = fastpath_order_init(fastpath);
+	*offset = stream_get_pos(s);
+
+	stream_check_size(s, 6);
+	stream_seek(s, 6); /* controlFlags, orderLength, extraFlags and orderType */
 
-	stream_write_uint16(s, 1); /* numberOrders (2 bytes) */
-	stream_write_uint8(s, ORDER_STANDARD | ORDER_TYPE_CHANGE); /* controlFlags (1 byte) */
-	stream_write_uint8(s, ORDER_TYPE_SCRBLT); /* orderType (1 byte) */
-	stream_write_uint8(s, 0x7F); /* fieldFlags (variable) */
+	return s;
+}
+
+static void update_send_secondary_order(rdpFastPath* fastpath, STREAM* s, int offset, uint8 orderType, uint16 extraFlags)
+{
+	int length;
+
+	length = stream_get_pos(s) - offset;
+
+	stream_set_pos(s, offset);
+	stream_write_uint8(s, ORDER_STANDARD | ORDER_SECONDARY); /* controlFlags (1 byte) */
+	stream_write_uint16(s, length - 13); /* orderLength (2 bytes) */
+	stream_write_uint16(s, extraFlags); /* extraFlags (2 bytes) */
+	stream_write_uint8(s, orderType); /* orderType (1 byte) */
+	stream_set_pos(s, offset + length);
+
+	if (!fastpath->batchOrders)
+		fastpath_flush_orders(fastpath);
+}
+
+static void update_send_cache_bitmap_v2(rdpContext* context, CACHE_BITMAP_V2_ORDER* cache_bitmap_v2)
+{
+	STREAM* s;
+	int offset;
+	uint16 extraFlags;
+	rdpFastPath* fastpath = context->rdp->fastpath;
+
+	s = update_secondary_order_init(fastpath, &offset);
+	update_write_cache_bitmap_v2_order(s, cache_bitmap_v2, cache_bitmap_v2->compressed, &extraFlags);
+
+	update_send_secondary_order(fastpath, s, offset, cache_bitmap_v2->compressed ?
+			ORDER_TYPE_BITMAP_COMPRESSED_V2 : ORDER_TYPE_BITMAP_UNCOMPRESSED_V2, extraFlags);
+}
+
+static void update_send_cache_bitmap_v3(rdpContext* context, CACHE_BITMAP_V3_ORDER* cache_bitmap_v3)
+{
+	STREAM* s;
+	int offset;
+	uint16 extraFlags;
+	rdpFastPath* fastpath = context->rdp->fastpath;
 
-	stream_write_uint16(s, scrblt->nLeftRect);
-	stream_write_uint16(s, scrblt->nTopRect);
-	stream_write_uint16(s, scrblt->nWidth);
-	stream_write_uint16(s, scrblt->nHeight);
-	stream_write_uint8(s, scrblt->bRop);
-	stream_write_uint16(s, scrblt->nXSrc);
-	stream_write_uint16(s, scrblt->nYSrc);
+	s = update_secondary_order_init(fastpath, &offset);
+	update_write_cache_bitmap_v3_order(s, cache_bitmap_v3, true, &extraFlags);
 
-	fastpath_send_update_pdu(rdp->fastpath, FASTPATH_UPDATETYPE_ORDERS, s);
+	update_send_secondary_order(fastpath, s, offset, ORDER_TYPE_BITMAP_COMPRESSED_V3, extraFlags);
 }
 
 static void update_send_pointer_system(rdpContext* context, POINTER_SYSTEM_UPDATE* pointer_system)
@@ -572,7 +699,17 @@ void update_register_server_callbacks(rdpUpdate* update)
 	update->SurfaceBits = update_send_surface_bits;
 	update->SurfaceFrameMarker = update_send_surface_frame_marker;
 	update->SurfaceCommand = update_send_surface_command;
+	update->SetBounds = update_send_set_bounds;
+	update->primary->DstBlt = update_send_dstblt;
+	update->primary->PatBlt = update_send_patblt;
 	update->primary->ScrBlt = update_send_scrblt;
+	update->primary->OpaqueRect = update_send_opaque_rect;
+	update->primary->MultiOpaqueRect = update_send_multi_opaque_rect;
+	update->primary->LineTo = update_send_line_to;
+	update->primary->MemBlt = update_send_memblt;
+	update->primary->GlyphIndex = update_send_glyph_index;
+	update->secondary->CacheBitmapV2 = update_send_cache_bitmap_v2;
+	update->secondary->CacheBitmapV3 = update_send_cache_bitmap_v3;
 	update->pointer->PointerSystem = update_send_pointer_system;
 	update->pointer->PointerColor = update_send_pointer_color;
 	update->pointer->PointerNew = update_send_pointer_new;
@@ -154,18 +154,20 @@ boolean tls_connect(rdpTls* tls)
 	return true;
 }
 
-boolean tls_accept(rdpTls* tls, const char* cert_file, const char* privatekey_file)
+SSL_CTX* tls_server_context_new(const char* cert_file, const char* privatekey_file)
 {
-	CryptoCert cert;
+	SSL_CTX* ctx;
 	long options = 0;
-	int connection_status;
 
-	tls->ctx = SSL_CTX_new(SSLv23_server_method());
+	SSL_load_error_strings();
+	SSL_library_init();
 
-	if (tls->ctx == NULL)
+	ctx = SSL_CTX_new(SSLv23_server_method());
+
+	if (ctx == NULL)
 	{
 		printf("SSL_CTX_new failed\n");
-		return false;
+		return NULL;
 	}
 
 	/*
@@ -205,28 +207,81 @@ boolean tls_accept(rdpTls* tls, const char* cert_file, const char* privatekey_fi
 	 */
 	options |= SSL_OP_DONT_INSERT_EMPTY_FRAGMENTS;
 
-	SSL_CTX_set_options(tls->ctx, options);
+	SSL_CTX_set_options(ctx, options);
 
-	if (SSL_CTX_use_RSAPrivateKey_file(tls->ctx, privatekey_file, SSL_FILETYPE_PEM) <= 0)
+	/**
+	 * Session resumption:
+	 *
+	 * Reconnecting clients can resume a previous session either from the
+	 * server-side session cache or from a session ticket, skipping the
+	 * full handshake and its private key operation.
+	 */
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+	SSL_CTX_set_session_id_context(ctx, (const unsigned char*) TLS_SESSION_ID_CONTEXT,
+			sizeof(TLS_SESSION_ID_CONTEXT) - 1);
+	SSL_CTX_sess_set_cache_size(ctx, TLS_SESSION_CACHE_SIZE);
+#ifdef SSL_OP_NO_TICKET
+	SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+#endif
+
+	if (SSL_CTX_use_RSAPrivateKey_file(ctx, privatekey_file, SSL_FILETYPE_PEM) <= 0)
 	{
 		printf("SSL_CTX_use_RSAPrivateKey_file failed\n");
-		return false;
+		SSL_CTX_free(ctx);
+		return NULL;
 	}
 
-	tls->ssl = SSL_new(tls->ctx);
+	if (SSL_CTX_use_certificate_file(ctx, cert_file, SSL_FILETYPE_PEM) <= 0)
+	{
+		printf("SSL_CTX_use_certificate_file failed\n");
+		SSL_CTX_free(ctx);
+		return NULL;
+	}
 
-	if (tls->ssl == NULL)
+	return ctx;
+}
+
+void tls_server_context_free(SSL_CTX* ctx)
+{
+	if (ctx != NULL)
+		SSL_CTX_free(ctx);
+}
+
+boolean tls_accept(rdpTls* tls, const char* cert_file, const char* privatekey_file)
+{
+	SSL_CTX* ctx;
+	CryptoCert cert;
+	int connection_status;
+
+	/* use the context shared by the listener if there is one */
+	ctx = (SSL_CTX*) tls->settings->tls_context;
+
+	if (ctx == NULL)
 	{
-		printf("SSL_new failed\n");
-		return false;
+		tls->ctx = tls_server_context_new(cert_file, privatekey_file);
+
+		if (tls->ctx == NULL)
+			return false;
+
+		ctx = tls->ctx;
 	}
 
-	if (SSL_use_certificate_file(tls->ssl, cert_file, SSL_FILETYPE_PEM) <= 0)
+	tls->ssl = SSL_new(ctx);
+
+	if (tls->ssl == NULL)
 	{
-		printf("SSL_use_certificate_file failed\n");
+		printf("SSL_new failed\n");
 		return false;
 	}
 
+	/**
+	 * SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER:
+	 *
+	 * Data the socket does not accept right away is moved to the
+	 * transport send queue, from where the write is retried.
+	 */
+	SSL_set_mode(tls->ssl, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
 	cert = tls_get_certificate(tls, false);
 
 	if (cert == NULL)
@@ -275,7 +330,10 @@ boolean tls_accept(rdpTls* tls, const char* cert_file, const char* privatekey_fi
 		}
 	}
 
-	printf("TLS connection accepted\n");
+	if (SSL_session_reused(tls->ssl))
+		printf("TLS session resumed\n");
+	else
+		printf("TLS connection accepted\n");
 
 	return true;
 }
@@ -91,6 +91,54 @@ int FillRect_32bpp(HGDI_DC hdc, HGDI_RECT rect, HGDI_BRUSH hbr)
 	return 0;
 }
 
+/**
+ * Draw glyph masks in a solid color, clipped to the given rectangle:
+ * D = (S & P) | (~S & D), with S taken from the masks.
+ */
+
+int GlyphRun_32bpp(HGDI_DC hdc, HGDI_RECT clip, GDI_GLYPH_MASK* masks, int count, GDI_COLOR color)
+{
+	int i, x, y;
+	int left, top;
+	int right, bottom;
+	uint8* maskp;
+	uint32* dstp;
+	uint32 color32;
+	GDI_GLYPH_MASK* mask;
+
+	color32 = gdi_get_color_32bpp(hdc, color);
+
+	for (i = 0; i < count; i++)
+	{
+		mask = &masks[i];
+
+		left = MAX(mask->x, clip->left);
+		top = MAX(mask->y, clip->top);
+		right = MIN(mask->x + mask->width - 1, clip->right);
+		bottom = MIN(mask->y + mask->height - 1, clip->bottom);
+
+		for (y = top; y <= bottom; y++)
+		{
+			maskp = &mask->data[(y - mask->y) * mask->width + (left - mask->x)];
+			dstp = (uint32*) gdi_get_bitmap_pointer(hdc, left, y);
+
+			if (dstp != 0)
+			{
+				for (x = left; x <= right; x++)
+				{
+					if (*maskp)
+						*dstp = color32;
+
+					maskp++;
+					dstp++;
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
 static int BitBlt_BLACKNESS_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight)
 {
 	if (hdcDest->alpha)
@@ -83,6 +83,7 @@ HGDI_DC gdi_CreateDC(HCLRCONV clrconv, int bpp)
 	hDC->hwnd->count = 32;
 	hDC->hwnd->cinvalid = (HGDI_RGN) xmalloc(sizeof(GDI_RGN) * hDC->hwnd->count);
 	hDC->hwnd->ninvalid = 0;
+	hDC->hwnd->maxinvalid = GDI_MAX_INVALID_RECTS;
 
 	return hDC;
 }
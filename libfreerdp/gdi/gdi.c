@@ -850,6 +850,7 @@ void gdi_init_primary(rdpGdi* gdi)
 	gdi->primary->hdc->hwnd->count = 32;
 	gdi->primary->hdc->hwnd->cinvalid = (HGDI_RGN) xmalloc(sizeof(GDI_RGN) * gdi->primary->hdc->hwnd->count);
 	gdi->primary->hdc->hwnd->ninvalid = 0;
+	gdi->primary->hdc->hwnd->maxinvalid = GDI_MAX_INVALID_RECTS;
 }
 
 void gdi_resize(rdpGdi* gdi, int width, int height)
@@ -864,6 +865,9 @@ void gdi_resize(rdpGdi* gdi, int width, int height)
 			gdi->width = width;
 			gdi->height = height;
 			gdi_bitmap_free_ex(gdi->primary);
+
+			/* the old buffer was released with the primary bitmap */
+			gdi->primary_buffer = NULL;
 			gdi_init_primary(gdi);
 		}
 	}
@@ -953,6 +957,7 @@ int gdi_init(freerdp* instance, uint32 flags, uint8* buffer)
 
 	gdi_register_update_callbacks(instance->update);
 
+	cache_register_callbacks(instance->update);
 	brush_cache_register_callbacks(instance->update);
 	glyph_cache_register_callbacks(instance->update);
 	bitmap_cache_register_callbacks(instance->update);
@@ -978,6 +983,7 @@ void gdi_free(freerdp* instance)
 		gdi_bitmap_free_ex(gdi->image);
 		gdi_DeleteDC(gdi->hdc);
 		rfx_context_free((RFX_CONTEXT*)gdi->rfx_context);
+		xfree(gdi->glyph_run);
 		free(gdi->clrconv);
 		free(gdi);
 	}
@@ -186,24 +186,19 @@ void gdi_Bitmap_SetSurface(rdpContext* context, rdpBitmap* bitmap, boolean prima
 
 /* Glyph Class */
 
+/**
+ * Glyphs are kept expanded to one byte per pixel, and the glyphs drawn
+ * between BeginDraw and EndDraw are collected into a run which is rendered
+ * at once by EndDraw.
+ */
+
 void gdi_Glyph_New(rdpContext* context, rdpGlyph* glyph)
 {
-	uint8* data;
 	gdiGlyph* gdi_glyph;
 
 	gdi_glyph = (gdiGlyph*) glyph;
 
-	gdi_glyph->hdc = gdi_GetDC();
-	gdi_glyph->hdc->bytesPerPixel = 1;
-	gdi_glyph->hdc->bitsPerPixel = 1;
-
-	data = freerdp_glyph_convert(glyph->cx, glyph->cy, glyph->aj);
-	gdi_glyph->bitmap = gdi_CreateBitmap(glyph->cx, glyph->cy, 1, data);
-	gdi_glyph->bitmap->bytesPerPixel = 1;
-	gdi_glyph->bitmap->bitsPerPixel = 1;
-
-	gdi_SelectObject(gdi_glyph->hdc, (HGDIOBJECT) gdi_glyph->bitmap);
-	gdi_glyph->org_bitmap = NULL;
+	gdi_glyph->mask = freerdp_glyph_convert(glyph->cx, glyph->cy, glyph->aj);
 }
 
 void gdi_Glyph_Free(rdpContext* context, rdpGlyph* glyph)
@@ -213,22 +208,33 @@ void gdi_Glyph_Free(rdpContext* context, rdpGlyph* glyph)
 	gdi_glyph = (gdiGlyph*) glyph;
 
 	if (gdi_glyph != 0)
-	{
-		gdi_SelectObject(gdi_glyph->hdc, (HGDIOBJECT) gdi_glyph->org_bitmap);
-		gdi_DeleteObject((HGDIOBJECT) gdi_glyph->bitmap);
-		gdi_DeleteDC(gdi_glyph->hdc);
-	}
+		xfree(gdi_glyph->mask);
 }
 
 void gdi_Glyph_Draw(rdpContext* context, rdpGlyph* glyph, int x, int y)
 {
 	gdiGlyph* gdi_glyph;
+	GDI_GLYPH_MASK* mask;
 	rdpGdi* gdi = context->gdi;
 
 	gdi_glyph = (gdiGlyph*) glyph;
 
-	gdi_BitBlt(gdi->drawing->hdc, x, y, gdi_glyph->bitmap->width,
-			gdi_glyph->bitmap->height, gdi_glyph->hdc, 0, 0, GDI_DSPDxax);
+	if (gdi_glyph->mask == NULL)
+		return;
+
+	if (gdi->glyph_run_count >= gdi->glyph_run_size)
+	{
+		gdi->glyph_run_size = (gdi->glyph_run_size > 0) ? gdi->glyph_run_size * 2 : 64;
+		gdi->glyph_run = (GDI_GLYPH_MASK*) xrealloc(gdi->glyph_run, sizeof(GDI_GLYPH_MASK) * gdi->glyph_run_size);
+	}
+
+	mask = &gdi->glyph_run[gdi->glyph_run_count++];
+
+	mask->x = x;
+	mask->y = y;
+	mask->width = glyph->cx;
+	mask->height = glyph->cy;
+	mask->data = gdi_glyph->mask;
 }
 
 void gdi_Glyph_BeginDraw(rdpContext* context, int x, int y, int width, int height, uint32 bgcolor, uint32 fgcolor)
@@ -246,7 +252,10 @@ void gdi_Glyph_BeginDraw(rdpContext* context, int x, int y, int width, int heigh
 
 	gdi_FillRect(gdi->drawing->hdc, &rect, brush);
 
+	gdi_DeleteObject((HGDIOBJECT) brush);
+
 	gdi->textColor = gdi_SetTextColor(gdi->drawing->hdc, bgcolor);
+	gdi->glyph_run_count = 0;
 }
 
 void gdi_Glyph_EndDraw(rdpContext* context, int x, int y, int width, int height, uint32 bgcolor, uint32 fgcolor)
@@ -254,6 +263,10 @@ void gdi_Glyph_EndDraw(rdpContext* context, int x, int y, int width, int height,
 	rdpGdi* gdi = context->gdi;
 
 	bgcolor = freerdp_color_convert_var_bgr(bgcolor, gdi->srcBpp, 32, gdi->clrconv);
+
+	gdi_GlyphRun(gdi->drawing->hdc, gdi->glyph_run, gdi->glyph_run_count, bgcolor);
+	gdi->glyph_run_count = 0;
+
 	gdi->textColor = gdi_SetTextColor(gdi->drawing->hdc, bgcolor);
 }
 
@@ -354,6 +354,317 @@ INLINE int gdi_PtInRect(HGDI_RECT rc, int x, int y)
 	return 0;
 }
 
+/*
+ * Invalid rectangle lists
+ *
+ * The invalid rectangles of a window are kept as a list of non-overlapping
+ * rectangles sorted by top then left edge. Rectangles sharing an edge over
+ * its full length are coalesced, and once the list grows beyond maxinvalid
+ * rectangles, the pair wasting the least area when merged into its bounding
+ * box is merged until the limit is met again.
+ */
+
+static void gdi_WndRgnAppend(HGDI_WND hwnd, int left, int top, int right, int bottom)
+{
+	if (right <= left || bottom <= top)
+		return;
+
+	if (hwnd->ninvalid + 1 > hwnd->count)
+	{
+		hwnd->count = (hwnd->count > 0) ? hwnd->count * 2 : 32;
+		hwnd->cinvalid = (HGDI_RGN) xrealloc(hwnd->cinvalid, sizeof(GDI_RGN) * hwnd->count);
+	}
+
+	gdi_SetRgn(&hwnd->cinvalid[hwnd->ninvalid++], left, top, right - left, bottom - top);
+}
+
+/* remove the rectangles emptied by the operations below */
+static void gdi_WndRgnCompact(HGDI_WND hwnd)
+{
+	int i, n;
+
+	for (i = 0, n = 0; i < hwnd->ninvalid; i++)
+	{
+		if (hwnd->cinvalid[i].w > 0 && hwnd->cinvalid[i].h > 0)
+		{
+			if (i != n)
+				hwnd->cinvalid[n] = hwnd->cinvalid[i];
+
+			n++;
+		}
+	}
+
+	hwnd->ninvalid = n;
+}
+
+static void gdi_WndRgnSubtract(HGDI_WND hwnd, int left, int top, int right, int bottom)
+{
+	int i, count;
+	int el, et, er, eb;
+
+	count = hwnd->ninvalid;
+
+	for (i = 0; i < count; i++)
+	{
+		el = hwnd->cinvalid[i].x;
+		et = hwnd->cinvalid[i].y;
+		er = el + hwnd->cinvalid[i].w;
+		eb = et + hwnd->cinvalid[i].h;
+
+		if (el >= right || er <= left || et >= bottom || eb <= top)
+			continue;
+
+		/* split what is left into bands above, beside and below */
+		hwnd->cinvalid[i].w = 0;
+		gdi_WndRgnAppend(hwnd, el, et, er, top);
+		gdi_WndRgnAppend(hwnd, el, MAX(et, top), left, MIN(eb, bottom));
+		gdi_WndRgnAppend(hwnd, right, MAX(et, top), er, MIN(eb, bottom));
+		gdi_WndRgnAppend(hwnd, el, bottom, er, eb);
+	}
+
+	gdi_WndRgnCompact(hwnd);
+}
+
+static void gdi_WndRgnCoalesce(HGDI_WND hwnd)
+{
+	int i, j;
+	int merged;
+	HGDI_RGN a;
+	HGDI_RGN b;
+
+	do
+	{
+		merged = 0;
+
+		for (i = 0; i < hwnd->ninvalid; i++)
+		{
+			a = &hwnd->cinvalid[i];
+
+			for (j = i + 1; (j < hwnd->ninvalid) && (a->w > 0); j++)
+			{
+				b = &hwnd->cinvalid[j];
+
+				if (b->w <= 0)
+					continue;
+
+				if ((a->y == b->y) && (a->h == b->h) && ((a->x + a->w == b->x) || (b->x + b->w == a->x)))
+				{
+					a->x = MIN(a->x, b->x);
+					a->w += b->w;
+					b->w = 0;
+					merged = 1;
+				}
+				else if ((a->x == b->x) && (a->w == b->w) && ((a->y + a->h == b->y) || (b->y + b->h == a->y)))
+				{
+					a->y = MIN(a->y, b->y);
+					a->h += b->h;
+					b->w = 0;
+					merged = 1;
+				}
+			}
+		}
+
+		gdi_WndRgnCompact(hwnd);
+	}
+	while (merged);
+}
+
+static void gdi_WndRgnLimit(HGDI_WND hwnd)
+{
+	int i, j, k;
+	int best_i, best_j;
+	int left, top, right, bottom;
+	int grown;
+	long waste, best;
+	HGDI_RGN a;
+	HGDI_RGN b;
+
+	while ((hwnd->maxinvalid > 0) && (hwnd->ninvalid > hwnd->maxinvalid))
+	{
+		best_i = 0;
+		best_j = 1;
+		best = -1;
+
+		for (i = 0; i < hwnd->ninvalid; i++)
+		{
+			a = &hwnd->cinvalid[i];
+
+			for (j = i + 1; j < hwnd->ninvalid; j++)
+			{
+				b = &hwnd->cinvalid[j];
+
+				waste = (long) (MAX(a->x + a->w, b->x + b->w) - MIN(a->x, b->x)) *
+						(MAX(a->y + a->h, b->y + b->h) - MIN(a->y, b->y)) -
+						(long) a->w * a->h - (long) b->w * b->h;
+
+				if (best < 0 || waste < best)
+				{
+					best = waste;
+					best_i = i;
+					best_j = j;
+				}
+			}
+		}
+
+		a = &hwnd->cinvalid[best_i];
+		b = &hwnd->cinvalid[best_j];
+
+		left = MIN(a->x, b->x);
+		top = MIN(a->y, b->y);
+		right = MAX(a->x + a->w, b->x + b->w);
+		bottom = MAX(a->y + a->h, b->y + b->h);
+
+		a->w = 0;
+		b->w = 0;
+
+		/* the bounding box absorbs whatever it overlaps, keeping the list disjoint */
+		do
+		{
+			grown = 0;
+
+			for (k = 0; k < hwnd->ninvalid; k++)
+			{
+				a = &hwnd->cinvalid[k];
+
+				if (a->w <= 0 || a->x >= right || a->x + a->w <= left || a->y >= bottom || a->y + a->h <= top)
+					continue;
+
+				left = MIN(left, a->x);
+				top = MIN(top, a->y);
+				right = MAX(right, a->x + a->w);
+				bottom = MAX(bottom, a->y + a->h);
+				a->w = 0;
+				grown = 1;
+			}
+		}
+		while (grown);
+
+		gdi_WndRgnCompact(hwnd);
+		gdi_WndRgnAppend(hwnd, left, top, right, bottom);
+	}
+}
+
+static int gdi_WndRgnCompare(const void* a, const void* b)
+{
+	const GDI_RGN* r1 = (const GDI_RGN*) a;
+	const GDI_RGN* r2 = (const GDI_RGN*) b;
+
+	if (r1->y != r2->y)
+		return (r1->y < r2->y) ? -1 : 1;
+
+	if (r1->x != r2->x)
+		return (r1->x < r2->x) ? -1 : 1;
+
+	return 0;
+}
+
+static void gdi_WndRgnUpdate(HGDI_WND hwnd)
+{
+	gdi_WndRgnCoalesce(hwnd);
+	gdi_WndRgnLimit(hwnd);
+	qsort(hwnd->cinvalid, hwnd->ninvalid, sizeof(GDI_RGN), gdi_WndRgnCompare);
+}
+
+/**
+ * Add a rectangle to the invalid rectangle list of a window.
+ * @param hwnd window
+ * @param x x1
+ * @param y y1
+ * @param w width
+ * @param h height
+ * @return
+ */
+
+int gdi_UnionWndRgn(HGDI_WND hwnd, int x, int y, int w, int h)
+{
+	int i;
+	HGDI_RGN rgn;
+
+	if (x < 0)
+	{
+		w += x;
+		x = 0;
+	}
+
+	if (y < 0)
+	{
+		h += y;
+		y = 0;
+	}
+
+	if (w <= 0 || h <= 0)
+		return 0;
+
+	for (i = 0; i < hwnd->ninvalid; i++)
+	{
+		rgn = &hwnd->cinvalid[i];
+
+		if (x >= rgn->x && y >= rgn->y && x + w <= rgn->x + rgn->w && y + h <= rgn->y + rgn->h)
+			return 0;
+	}
+
+	gdi_WndRgnSubtract(hwnd, x, y, x + w, y + h);
+	gdi_WndRgnAppend(hwnd, x, y, x + w, y + h);
+	gdi_WndRgnUpdate(hwnd);
+
+	return 0;
+}
+
+/**
+ * Clip the invalid rectangle list of a window to a rectangle.
+ * @param hwnd window
+ * @param x x1
+ * @param y y1
+ * @param w width
+ * @param h height
+ * @return
+ */
+
+int gdi_IntersectWndRgn(HGDI_WND hwnd, int x, int y, int w, int h)
+{
+	int i;
+	int left, top;
+	HGDI_RGN rgn;
+
+	for (i = 0; i < hwnd->ninvalid; i++)
+	{
+		rgn = &hwnd->cinvalid[i];
+
+		left = MAX(rgn->x, x);
+		top = MAX(rgn->y, y);
+		rgn->w = MIN(rgn->x + rgn->w, x + w) - left;
+		rgn->h = MIN(rgn->y + rgn->h, y + h) - top;
+		rgn->x = left;
+		rgn->y = top;
+	}
+
+	gdi_WndRgnCompact(hwnd);
+	gdi_WndRgnUpdate(hwnd);
+
+	return 0;
+}
+
+/**
+ * Remove a rectangle from the invalid rectangle list of a window.
+ * @param hwnd window
+ * @param x x1
+ * @param y y1
+ * @param w width
+ * @param h height
+ * @return
+ */
+
+int gdi_SubtractWndRgn(HGDI_WND hwnd, int x, int y, int w, int h)
+{
+	if (w <= 0 || h <= 0)
+		return 0;
+
+	gdi_WndRgnSubtract(hwnd, x, y, x + w, y + h);
+	gdi_WndRgnUpdate(hwnd);
+
+	return 0;
+}
+
 /**
  * Invalidate a given region, such that it is redrawn on the next region update.\n
  * @msdn{dd145003}
@@ -370,7 +681,6 @@ INLINE int gdi_InvalidateRegion(HGDI_DC hdc, int x, int y, int w, int h)
 	GDI_RECT inv;
 	GDI_RECT rgn;
 	HGDI_RGN invalid;
-	HGDI_RGN cinvalid;
 
 	if (hdc->hwnd == NULL)
 		return 0;
@@ -378,16 +688,7 @@ INLINE int gdi_InvalidateRegion(HGDI_DC hdc, int x, int y, int w, int h)
 	if (hdc->hwnd->invalid == NULL)
 		return 0;
 
-	cinvalid = hdc->hwnd->cinvalid;
-
-	if (hdc->hwnd->ninvalid + 1 > hdc->hwnd->count)
-	{
-		hdc->hwnd->count *= 2;
-		cinvalid = (HGDI_RGN) realloc(cinvalid, sizeof(GDI_RGN) * (hdc->hwnd->count));
-	}
-
-	gdi_SetRgn(&cinvalid[hdc->hwnd->ninvalid++], x, y, w, h);
-	hdc->hwnd->cinvalid = cinvalid;
+	gdi_UnionWndRgn(hdc->hwnd, x, y, w, h);
 
 	invalid = hdc->hwnd->invalid;
 
@@ -426,3 +727,55 @@ INLINE int gdi_InvalidateRegion(HGDI_DC hdc, int x, int y, int w, int h)
 
 	return 0;
 }
+
+/**
+ * Validate a given region, such that it is no longer redrawn on the next region update.\n
+ * @msdn{dd145194}
+ * @param hdc device context
+ * @param x x1
+ * @param y y1
+ * @param w width
+ * @param h height
+ * @return
+ */
+
+int gdi_ValidateRegion(HGDI_DC hdc, int x, int y, int w, int h)
+{
+	int i;
+	GDI_RECT inv;
+	HGDI_RGN cinvalid;
+
+	if (hdc->hwnd == NULL)
+		return 0;
+
+	if (hdc->hwnd->invalid == NULL)
+		return 0;
+
+	gdi_SubtractWndRgn(hdc->hwnd, x, y, w, h);
+
+	/* the bounding box shrinks to that of the remaining rectangles */
+	hdc->hwnd->invalid->null = 1;
+	cinvalid = hdc->hwnd->cinvalid;
+
+	for (i = 0; i < hdc->hwnd->ninvalid; i++)
+	{
+		if (i == 0)
+		{
+			gdi_RgnToRect(&cinvalid[0], &inv);
+			continue;
+		}
+
+		inv.left = MIN(inv.left, cinvalid[i].x);
+		inv.top = MIN(inv.top, cinvalid[i].y);
+		inv.right = MAX(inv.right, cinvalid[i].x + cinvalid[i].w - 1);
+		inv.bottom = MAX(inv.bottom, cinvalid[i].y + cinvalid[i].h - 1);
+	}
+
+	if (hdc->hwnd->ninvalid > 0)
+	{
+		gdi_RectToRgn(&inv, hdc->hwnd->invalid);
+		hdc->hwnd->invalid->null = 0;
+	}
+
+	return 0;
+}
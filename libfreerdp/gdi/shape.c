@@ -32,6 +32,7 @@
 #include <freerdp/gdi/16bpp.h>
 #include <freerdp/gdi/32bpp.h>
 #include <freerdp/gdi/bitmap.h>
+#include <freerdp/gdi/region.h>
 
 #include <freerdp/gdi/shape.h>
 
@@ -44,6 +45,15 @@ p_FillRect FillRect_[5] =
 	FillRect_32bpp
 };
 
+p_GlyphRun GlyphRun_[5] =
+{
+	NULL,
+	GlyphRun_8bpp,
+	GlyphRun_16bpp,
+	NULL,
+	GlyphRun_32bpp
+};
+
 static void Ellipse_Bresenham(HGDI_DC hdc, int x1, int y1, int x2, int y2)
 {
 	int i;
@@ -188,6 +198,68 @@ int gdi_FillRect(HGDI_DC hdc, HGDI_RECT rect, HGDI_BRUSH hbr)
 		return 0;
 }
 
+/**
+ * Draw a run of glyph masks in the text color, as the DSPDxax raster
+ * operation does with a monochrome source. The glyphs are drawn with a
+ * single call to the kernel of the color depth, the clipping rectangle is
+ * computed once for the whole run, and the area drawn to is invalidated once.
+ * @param hdc device context
+ * @param masks glyph masks, placed in device coordinates
+ * @param count number of glyph masks
+ * @param color text color
+ * @return
+ */
+
+int gdi_GlyphRun(HGDI_DC hdc, GDI_GLYPH_MASK* masks, int count, GDI_COLOR color)
+{
+	int i;
+	GDI_RECT clip;
+	GDI_RECT bounds;
+	GDI_RECT region;
+	HGDI_BITMAP hBmp;
+	p_GlyphRun _GlyphRun = GlyphRun_[IBPP(hdc->bitsPerPixel)];
+
+	hBmp = (HGDI_BITMAP) hdc->selectedObject;
+
+	if (_GlyphRun == NULL || hBmp == NULL || count < 1)
+		return 0;
+
+	gdi_CRgnToRect(0, 0, hBmp->width, hBmp->height, &clip);
+
+	if (!hdc->clip->null)
+	{
+		gdi_RgnToRect(hdc->clip, &region);
+
+		clip.left = MAX(clip.left, region.left);
+		clip.top = MAX(clip.top, region.top);
+		clip.right = MIN(clip.right, region.right);
+		clip.bottom = MIN(clip.bottom, region.bottom);
+	}
+
+	gdi_CRgnToRect(masks[0].x, masks[0].y, masks[0].width, masks[0].height, &bounds);
+
+	for (i = 1; i < count; i++)
+	{
+		bounds.left = MIN(bounds.left, masks[i].x);
+		bounds.top = MIN(bounds.top, masks[i].y);
+		bounds.right = MAX(bounds.right, masks[i].x + masks[i].width - 1);
+		bounds.bottom = MAX(bounds.bottom, masks[i].y + masks[i].height - 1);
+	}
+
+	bounds.left = MAX(bounds.left, clip.left);
+	bounds.top = MAX(bounds.top, clip.top);
+	bounds.right = MIN(bounds.right, clip.right);
+	bounds.bottom = MIN(bounds.bottom, clip.bottom);
+
+	if (bounds.left > bounds.right || bounds.top > bounds.bottom)
+		return 0;
+
+	gdi_InvalidateRegion(hdc, bounds.left, bounds.top,
+			bounds.right - bounds.left + 1, bounds.bottom - bounds.top + 1);
+
+	return _GlyphRun(hdc, &clip, masks, count, color);
+}
+
 /**
  *
  * @param hdc device context
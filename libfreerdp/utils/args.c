@@ -132,9 +132,16 @@ int freerdp_parse_args(rdpSettings* settings, int argc, char** argv,
 				"  --from-stdin: unspecified username, password, domain and hostname params are prompted\n"
 				"  --no-fastpath: disable fast-path\n"
 				"  --no-motion: don't send mouse motion events\n"
+				"  --async-update: decode updates on a network thread, apart from rendering\n"
 				"  --gdi: graphics rendering (hw, sw)\n"
 				"  --no-osb: disable offscreen bitmaps\n"
 				"  --no-bmp-cache: disable bitmap cache\n"
+				"  --persist-cache: keep the bitmap cache on disk across connections\n"
+				"  --persist-cache-file: file of the persistent bitmap cache, default is per host in the config path\n"
+				"  --bmp-cache-budget: kilobytes of decoded bitmaps kept in the bitmap cache\n"
+				"  --osb-budget: kilobytes of offscreen bitmaps, default is 7680\n"
+				"  --glyph-cache-budget: kilobytes of glyphs kept in the glyph cache\n"
+				"  --cache-idle-timeout: seconds after which unused cache memory is released, default is 300 (disable with 0)\n"
 				"  --bcv3: codec for bitmap cache v3 (rfx, nsc, jpeg)\n"
 				"  --plugin: load a virtual channel plugin\n"
 				"  --rfx: enable RemoteFX\n"
@@ -371,6 +378,66 @@ int freerdp_parse_args(rdpSettings* settings, int argc, char** argv,
 		{
 			settings->from_stdin = true;
 		}
+		else if (strcmp("--persist-cache", argv[index]) == 0)
+		{
+			settings->bitmap_cache_persist_enabled = true;
+		}
+		else if (strcmp("--persist-cache-file", argv[index]) == 0)
+		{
+			index++;
+			if (index == argc)
+			{
+				printf("missing persistent cache file\n");
+				return FREERDP_ARGS_PARSE_FAILURE;
+			}
+
+			settings->bitmap_cache_persist_file = xstrdup(argv[index]);
+			settings->bitmap_cache_persist_enabled = true;
+		}
+		else if (strcmp("--bmp-cache-budget", argv[index]) == 0)
+		{
+			index++;
+			if (index == argc)
+			{
+				printf("missing bitmap cache budget\n");
+				return FREERDP_ARGS_PARSE_FAILURE;
+			}
+
+			settings->bitmap_cache_budget = atoi(argv[index]);
+		}
+		else if (strcmp("--osb-budget", argv[index]) == 0)
+		{
+			index++;
+			if (index == argc)
+			{
+				printf("missing offscreen bitmap cache budget\n");
+				return FREERDP_ARGS_PARSE_FAILURE;
+			}
+
+			settings->offscreen_bitmap_cache_budget = atoi(argv[index]);
+		}
+		else if (strcmp("--glyph-cache-budget", argv[index]) == 0)
+		{
+			index++;
+			if (index == argc)
+			{
+				printf("missing glyph cache budget\n");
+				return FREERDP_ARGS_PARSE_FAILURE;
+			}
+
+			settings->glyph_cache_budget = atoi(argv[index]);
+		}
+		else if (strcmp("--cache-idle-timeout", argv[index]) == 0)
+		{
+			index++;
+			if (index == argc)
+			{
+				printf("missing cache idle timeout\n");
+				return FREERDP_ARGS_PARSE_FAILURE;
+			}
+
+			settings->cache_idle_timeout = atoi(argv[index]);
+		}
 		else if (strcmp("--ignore-certificate", argv[index]) == 0)
 		{
 			settings->ignore_certificate = true;
@@ -563,6 +630,10 @@ int freerdp_parse_args(rdpSettings* settings, int argc, char** argv,
 		{
 			settings->mouse_motion = false;
 		}
+		else if (strcmp("--async-update", argv[index]) == 0)
+		{
+			settings->async_update = true;
+		}
 		else if (strcmp("--app", argv[index]) == 0)
 		{
 			settings->remote_app = true;
@@ -0,0 +1,72 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * X11 Server Input Batching
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "xf_batch.h"
+
+void xf_batch_begin(xfInputBatch* batch)
+{
+	batch->active = true;
+	batch->motion = false;
+}
+
+/**
+ * End a batch. The motion held back, if any, has to be taken first.
+ */
+
+void xf_batch_end(xfInputBatch* batch)
+{
+	batch->active = false;
+	batch->motion = false;
+}
+
+/**
+ * Hold back a motion, replacing the one held so far. Returns false outside
+ * of a batch, in which case the motion is to be injected right away.
+ */
+
+boolean xf_batch_motion(xfInputBatch* batch, int x, int y)
+{
+	if (!batch->active)
+		return false;
+
+	batch->motion = true;
+	batch->x = x;
+	batch->y = y;
+
+	return true;
+}
+
+/**
+ * Take the motion held back, for it to be injected before the next event.
+ * Returns false if there is none.
+ */
+
+boolean xf_batch_take_motion(xfInputBatch* batch, int* x, int* y)
+{
+	if (!batch->motion)
+		return false;
+
+	*x = batch->x;
+	*y = batch->y;
+	batch->motion = false;
+
+	return true;
+}
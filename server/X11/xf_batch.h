@@ -0,0 +1,44 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * X11 Server Input Batching
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __XF_BATCH_H
+#define __XF_BATCH_H
+
+#include <freerdp/types.h>
+
+typedef struct xf_input_batch xfInputBatch;
+
+/**
+ * The input events of a PDU are injected as a batch. Within a batch, a
+ * pointer motion is held back and replaced by the next one, and is only
+ * injected before an event it must come before, or at the end of the batch.
+ */
+
+struct xf_input_batch
+{
+	boolean active;
+	boolean motion;
+	int x;
+	int y;
+};
+
+void xf_batch_begin(xfInputBatch* batch);
+void xf_batch_end(xfInputBatch* batch);
+boolean xf_batch_motion(xfInputBatch* batch, int x, int y);
+boolean xf_batch_take_motion(xfInputBatch* batch, int* x, int* y);
+
+#endif /* __XF_BATCH_H */
@@ -0,0 +1,191 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * X11 Server Damage Tracking
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <freerdp/utils/memory.h>
+
+#include "xf_damage.h"
+
+void xf_damage_add(xfDamage* damage, int x, int y, int width, int height)
+{
+	int tx, ty;
+	int left, top, right, bottom;
+
+	left = MAX(x, 0);
+	top = MAX(y, 0);
+	right = MIN(x + width, damage->width);
+	bottom = MIN(y + height, damage->height);
+
+	if (right <= left || bottom <= top)
+		return;
+
+	left /= XF_DAMAGE_TILE_SIZE;
+	top /= XF_DAMAGE_TILE_SIZE;
+	right = (right - 1) / XF_DAMAGE_TILE_SIZE;
+	bottom = (bottom - 1) / XF_DAMAGE_TILE_SIZE;
+
+	for (ty = top; ty <= bottom; ty++)
+	{
+		for (tx = left; tx <= right; tx++)
+			damage->tiles[ty * damage->tiles_x + tx] = 1;
+	}
+
+	damage->empty = false;
+}
+
+boolean xf_damage_is_empty(xfDamage* damage)
+{
+	return damage->empty;
+}
+
+/**
+ * Turn the damaged tiles into rectangles: runs of damaged tiles on a row of
+ * the grid become one rectangle, which grows downwards as long as the rows
+ * below have a run with the same horizontal extent.
+ * Rectangles are clipped to the screen.
+ */
+
+int xf_damage_get_rects(xfDamage* damage, RFX_RECT** rects)
+{
+	int i;
+	int* swap;
+	int tx, ty;
+	int start;
+	int x, y;
+	int width, height;
+	int num_open = 0;
+	int num_next_open;
+	RFX_RECT* rect;
+
+	damage->num_rects = 0;
+
+	if (damage->empty)
+	{
+		*rects = damage->rects;
+		return 0;
+	}
+
+	for (ty = 0; ty < damage->tiles_y; ty++)
+	{
+		num_next_open = 0;
+		y = ty * XF_DAMAGE_TILE_SIZE;
+		height = MIN(XF_DAMAGE_TILE_SIZE, damage->height - y);
+
+		tx = 0;
+
+		while (tx < damage->tiles_x)
+		{
+			if (!damage->tiles[ty * damage->tiles_x + tx])
+			{
+				tx++;
+				continue;
+			}
+
+			start = tx;
+
+			while (tx < damage->tiles_x && damage->tiles[ty * damage->tiles_x + tx])
+				tx++;
+
+			x = start * XF_DAMAGE_TILE_SIZE;
+			width = MIN(tx * XF_DAMAGE_TILE_SIZE, damage->width) - x;
+
+			rect = NULL;
+
+			for (i = 0; i < num_open; i++)
+			{
+				rect = &damage->rects[damage->open_rects[i]];
+
+				if (rect->x == x && rect->width == width)
+					break;
+
+				rect = NULL;
+			}
+
+			if (rect != NULL)
+			{
+				rect->height += height;
+				damage->next_open_rects[num_next_open++] = damage->open_rects[i];
+			}
+			else
+			{
+				rect = &damage->rects[damage->num_rects];
+				rect->x = x;
+				rect->y = y;
+				rect->width = width;
+				rect->height = height;
+				damage->next_open_rects[num_next_open++] = damage->num_rects++;
+			}
+		}
+
+		swap = damage->open_rects;
+		damage->open_rects = damage->next_open_rects;
+		damage->next_open_rects = swap;
+		num_open = num_next_open;
+	}
+
+	*rects = damage->rects;
+	return damage->num_rects;
+}
+
+void xf_damage_clear(xfDamage* damage)
+{
+	if (damage->empty)
+		return;
+
+	memset(damage->tiles, 0, damage->tiles_x * damage->tiles_y);
+	damage->empty = true;
+}
+
+xfDamage* xf_damage_new(int width, int height)
+{
+	xfDamage* damage;
+
+	damage = xnew(xfDamage);
+
+	damage->width = width;
+	damage->height = height;
+	damage->tiles_x = (width + XF_DAMAGE_TILE_SIZE - 1) / XF_DAMAGE_TILE_SIZE;
+	damage->tiles_y = (height + XF_DAMAGE_TILE_SIZE - 1) / XF_DAMAGE_TILE_SIZE;
+	damage->tiles = (uint8*) xzalloc(damage->tiles_x * damage->tiles_y);
+	damage->empty = true;
+
+	/* there are at most tiles_x / 2 runs per row, each starting at most one rectangle */
+	damage->rects = (RFX_RECT*) xzalloc(sizeof(RFX_RECT) * damage->tiles_x * damage->tiles_y);
+	damage->open_rects = (int*) xzalloc(sizeof(int) * damage->tiles_x);
+	damage->next_open_rects = (int*) xzalloc(sizeof(int) * damage->tiles_x);
+
+	return damage;
+}
+
+void xf_damage_free(xfDamage* damage)
+{
+	if (damage == NULL)
+		return;
+
+	xfree(damage->tiles);
+	xfree(damage->rects);
+	xfree(damage->open_rects);
+	xfree(damage->next_open_rects);
+	xfree(damage);
+}
@@ -0,0 +1,56 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * X11 Server Damage Tracking
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __XF_DAMAGE_H
+#define __XF_DAMAGE_H
+
+#include <freerdp/types.h>
+#include <freerdp/codec/rfx.h>
+
+typedef struct xf_damage xfDamage;
+
+#define XF_DAMAGE_TILE_SIZE	64
+
+/**
+ * Damage is accumulated on a grid of RemoteFX tiles, so that unrelated
+ * changes stay separate instead of growing a single bounding box.
+ */
+
+struct xf_damage
+{
+	int width;
+	int height;
+	int tiles_x;
+	int tiles_y;
+	uint8* tiles;
+	boolean empty;
+
+	int num_rects;
+	RFX_RECT* rects;
+	int* open_rects;
+	int* next_open_rects;
+};
+
+void xf_damage_add(xfDamage* damage, int x, int y, int width, int height);
+boolean xf_damage_is_empty(xfDamage* damage);
+int xf_damage_get_rects(xfDamage* damage, RFX_RECT** rects);
+void xf_damage_clear(xfDamage* damage);
+
+xfDamage* xf_damage_new(int width, int height);
+void xf_damage_free(xfDamage* damage);
+
+#endif /* __XF_DAMAGE_H */
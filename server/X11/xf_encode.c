@@ -21,116 +21,871 @@
 #include "config.h"
 #endif
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/time.h>
 #include <X11/Xlib.h>
+#include <X11/Xutil.h>
 #include <freerdp/utils/sleep.h>
+#include <freerdp/utils/memory.h>
 
 #include "xf_encode.h"
 
-XImage* xf_snapshot(xfPeerContext* xfp, int x, int y, int width, int height)
+/* all the peers of this server view the same display, given by $DISPLAY */
+static xfEncoder* xf_shared_encoder = NULL;
+static pthread_mutex_t xf_shared_encoder_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+int xf_min_fps = XF_DEFAULT_MIN_FPS;
+int xf_max_fps = XF_DEFAULT_MAX_FPS;
+
+uint64 xf_get_time(void)
 {
-	XImage* image;
-	xfInfo* xfi = xfp->info;
+	struct timeval tv;
 
-	if (xfi->use_xshm)
-	{
-		pthread_mutex_lock(&(xfp->mutex));
+	gettimeofday(&tv, NULL);
 
-		XCopyArea(xfi->display, xfi->root_window, xfi->fb_pixmap,
-				xfi->xdamage_gc, x, y, width, height, x, y);
+	return ((uint64) tv.tv_sec) * 1000000 + tv.tv_usec;
+}
 
-		XSync(xfi->display, False);
+/**
+ * Capture the given rectangles into a capture buffer, on the capture display
+ * connection. With XShm, only the rectangles are copied into the shared
+ * image of the buffer, which is returned. Otherwise the full rows from top
+ * to top + height are fetched into a new image.
+ */
 
-		image = xfi->fb_image;
+XImage* xf_snapshot_rects(xfEncoder* encoder, xfCaptureBuffer* buffer, RFX_RECT* rects, int num_rects, int top, int height)
+{
+	int i;
+	XImage* image;
+	xfInfo* xfi = encoder->info;
 
-		pthread_mutex_unlock(&(xfp->mutex));
+	if (buffer->image != NULL)
+	{
+		for (i = 0; i < num_rects; i++)
+		{
+			XCopyArea(encoder->capture_display, xfi->root_window, buffer->pixmap, encoder->capture_gc,
+					rects[i].x, rects[i].y, rects[i].width, rects[i].height, rects[i].x, rects[i].y);
+		}
+
+		XSync(encoder->capture_display, False);
+
+		image = buffer->image;
 	}
 	else
 	{
-		pthread_mutex_lock(&(xfp->mutex));
+		image = XGetImage(encoder->capture_display, xfi->root_window,
+				0, top, xfi->width, height, AllPlanes, ZPixmap);
+	}
+
+	return image;
+}
+
+void xf_encoder_add_damage(xfEncoder* encoder, int x, int y, int width, int height)
+{
+	pthread_mutex_lock(&(encoder->mutex));
+
+	if (xf_damage_is_empty(encoder->damage))
+		pthread_cond_signal(&(encoder->pacing_cond));
+
+	xf_damage_add(encoder->damage, x, y, width, height);
+
+	pthread_mutex_unlock(&(encoder->mutex));
+}
+
+/**
+ * Damage the area of a frame a peer did not get, and the scrolled area with
+ * it. Returns the number of the frame the damage goes into, which does not
+ * scroll: the peer is in sync again once it gets that frame.
+ */
+
+uint32 xf_encoder_redamage_frame(xfEncoder* encoder, xfFrame* frame)
+{
+	int i;
+	uint32 seq;
+
+	pthread_mutex_lock(&(encoder->mutex));
 
-		image = XGetImage(xfi->display, xfi->root_window,
-				x, y, width, height, AllPlanes, ZPixmap);
+	if (xf_damage_is_empty(encoder->damage))
+		pthread_cond_signal(&(encoder->pacing_cond));
 
-		pthread_mutex_unlock(&(xfp->mutex));
+	for (i = 0; i < frame->num_rects; i++)
+	{
+		xf_damage_add(encoder->damage, frame->rects[i].x, frame->rects[i].y,
+				frame->rects[i].width, frame->rects[i].height);
 	}
 
-	return image;
+	if (frame->scroll)
+	{
+		xf_damage_add(encoder->damage, frame->scroll_rect.x, frame->scroll_rect.y,
+				frame->scroll_rect.width, frame->scroll_rect.height);
+	}
+
+	encoder->no_scroll = true;
+	seq = encoder->frame_seq + 1;
+
+	pthread_mutex_unlock(&(encoder->mutex));
+
+	return seq;
 }
 
-void xf_xdamage_subtract_region(xfPeerContext* xfp, int x, int y, int width, int height)
+/**
+ * Damage the whole screen, for a peer that has to get a complete picture.
+ * Returns the number of the frame the damage goes into, as above.
+ */
+
+uint32 xf_encoder_refresh(xfEncoder* encoder)
 {
-	XRectangle region;
-	xfInfo* xfi = xfp->info;
+	uint32 seq;
+
+	pthread_mutex_lock(&(encoder->mutex));
+
+	xf_damage_add(encoder->damage, 0, 0, encoder->info->width, encoder->info->height);
+	pthread_cond_signal(&(encoder->pacing_cond));
 
-	region.x = x;
-	region.y = y;
-	region.width = width;
-	region.height = height;
+	encoder->no_scroll = true;
+	seq = encoder->frame_seq + 1;
+
+	pthread_mutex_unlock(&(encoder->mutex));
+
+	return seq;
+}
 
+void xf_encoder_wakeup(xfEncoder* encoder)
+{
+	pthread_mutex_lock(&(encoder->mutex));
+	pthread_cond_signal(&(encoder->pacing_cond));
+	pthread_mutex_unlock(&(encoder->mutex));
+}
+
+/**
+ * Publish the flow control state of a peer for the encoder to pace frames
+ * with. The state belongs to the peer thread, which calls this after each
+ * pass over its connection; the encoder only reads what was published.
+ */
+
+void xf_encoder_publish_peer(xfEncoder* encoder, freerdp_peer* client, boolean ready, uint32 link_time)
+{
+	boolean was_ready;
+	xfPeerContext* xfp = (xfPeerContext*) client->context;
+
+	pthread_mutex_lock(&(encoder->peers_mutex));
+	was_ready = xfp->ready;
+	xfp->ready = ready;
+	xfp->link_time = link_time;
+	pthread_mutex_unlock(&(encoder->peers_mutex));
+
+	/* a slot may have opened up for the next frame */
+	if (ready && !was_ready)
+		xf_encoder_wakeup(encoder);
+}
+
+xfFrame* xf_frame_ref(xfEncoder* encoder, xfFrame* frame)
+{
+	pthread_mutex_lock(&(encoder->peers_mutex));
+	frame->refcount++;
+	pthread_mutex_unlock(&(encoder->peers_mutex));
+
+	return frame;
+}
+
+void xf_frame_unref(xfEncoder* encoder, xfFrame* frame)
+{
+	int refcount;
+
+	pthread_mutex_lock(&(encoder->peers_mutex));
+	refcount = --frame->refcount;
+	pthread_mutex_unlock(&(encoder->peers_mutex));
+
+	if (refcount > 0)
+		return;
+
+	xfree(frame->rects);
+	xfree(frame->data);
+	xfree(frame);
+}
+
+void xf_cursor_unref(xfEncoder* encoder, xfCursor* cursor)
+{
+	int refcount;
+
+	pthread_mutex_lock(&(encoder->peers_mutex));
+	refcount = --cursor->refcount;
+	pthread_mutex_unlock(&(encoder->peers_mutex));
+
+	if (refcount > 0)
+		return;
+
+	xfree(cursor->xor_mask);
+	xfree(cursor->and_mask);
+	xfree(cursor);
+}
+
+/**
+ * Get a reference to the cursor of the display, unless it is still the one
+ * numbered seq. Returns NULL if there is no new cursor.
+ */
+
+xfCursor* xf_encoder_get_cursor(xfEncoder* encoder, uint32 seq)
+{
+	xfCursor* cursor = NULL;
+
+	pthread_mutex_lock(&(encoder->peers_mutex));
+
+	if ((encoder->cursor != NULL) && (encoder->cursor->seq != seq))
+	{
+		cursor = encoder->cursor;
+		cursor->refcount++;
+	}
+
+	pthread_mutex_unlock(&(encoder->peers_mutex));
+
+	return cursor;
+}
+
+/**
+ * Fetch the current cursor image of the display and wake up the peers to
+ * send it. The caller holds the display lock.
+ */
+
+static void xf_encoder_capture_cursor(xfEncoder* encoder)
+{
 #ifdef WITH_XFIXES
-	pthread_mutex_lock(&(xfp->mutex));
-	XFixesSetRegion(xfi->display, xfi->xdamage_region, &region, 1);
-	XDamageSubtract(xfi->display, xfi->xdamage, xfi->xdamage_region, None);
-	pthread_mutex_unlock(&(xfp->mutex));
+	int i;
+	int x, y;
+	int left, top;
+	uint8* dst;
+	uint32 pixel;
+	xfCursor* cursor;
+	xfCursor* previous;
+	xfPeerContext* xfp;
+	XFixesCursorImage* image;
+	xfInfo* xfi = encoder->info;
+
+	if (!xfi->xfixes_cursor)
+		return;
+
+	image = XFixesGetCursorImage(xfi->display);
+
+	if (image == NULL)
+		return;
+
+	cursor = xnew(xfCursor);
+	cursor->refcount = 1;
+	cursor->width = MIN(image->width, XF_CURSOR_MAX_SIZE);
+	cursor->height = MIN(image->height, XF_CURSOR_MAX_SIZE);
+
+	left = MIN(MAX(image->xhot - XF_CURSOR_MAX_SIZE / 2, 0), image->width - cursor->width);
+	top = MIN(MAX(image->yhot - XF_CURSOR_MAX_SIZE / 2, 0), image->height - cursor->height);
+	cursor->xhot = MIN(image->xhot - left, cursor->width - 1);
+	cursor->yhot = MIN(image->yhot - top, cursor->height - 1);
+
+	/* AND mask rows are padded to 16 bits */
+	cursor->xor_length = cursor->width * 4 * cursor->height;
+	cursor->xor_mask = (uint8*) xmalloc(cursor->xor_length);
+	cursor->and_length = ((cursor->width + 15) / 16) * 2 * cursor->height;
+	cursor->and_mask = (uint8*) xzalloc(cursor->and_length);
+
+	for (y = 0; y < cursor->height; y++)
+	{
+		dst = &cursor->xor_mask[(cursor->height - 1 - y) * cursor->width * 4];
+
+		for (x = 0; x < cursor->width; x++)
+		{
+			/* the pixels are ARGB in the low 32 bits of longs */
+			pixel = (uint32) image->pixels[(y + top) * image->width + x + left];
+
+			*dst++ = pixel & 0xFF;
+			*dst++ = (pixel >> 8) & 0xFF;
+			*dst++ = (pixel >> 16) & 0xFF;
+			*dst++ = (pixel >> 24) & 0xFF;
+		}
+	}
+
+	XFree(image);
+
+	pthread_mutex_lock(&(encoder->peers_mutex));
+
+	previous = encoder->cursor;
+	cursor->seq = ++encoder->cursor_seq;
+	encoder->cursor = cursor;
+
+	for (i = 0; i < encoder->num_peers; i++)
+	{
+		xfp = (xfPeerContext*) encoder->peers[i]->context;
+		xf_event_queue_signal(xfp->event_queue);
+	}
+
+	pthread_mutex_unlock(&(encoder->peers_mutex));
+
+	if (previous != NULL)
+		xf_cursor_unref(encoder, previous);
 #endif
 }
 
-void* xf_frame_rate_thread(void* param)
+/**
+ * Capture the damage accumulated since the last frame into a capture buffer.
+ */
+
+static xfFrame* xf_encoder_capture_frame(xfEncoder* encoder, xfCaptureBuffer* buffer, XImage** image)
 {
-	xfInfo* xfi;
-	xfEvent* event;
+	int i;
+	int bottom;
+	xfFrame* frame;
+	RFX_RECT* rects;
+	int num_rects;
+	xfInfo* xfi = encoder->info;
+
+	pthread_mutex_lock(&(encoder->mutex));
+
+	num_rects = xf_damage_get_rects(encoder->damage, &rects);
+
+	if (num_rects < 1)
+	{
+		pthread_mutex_unlock(&(encoder->mutex));
+		return NULL;
+	}
+
+	frame = xnew(xfFrame);
+	frame->refcount = 1;
+	frame->num_rects = num_rects;
+	frame->rects = (RFX_RECT*) xmalloc(sizeof(RFX_RECT) * num_rects);
+	memcpy(frame->rects, rects, sizeof(RFX_RECT) * num_rects);
+
+	frame->seq = ++encoder->frame_seq;
+	frame->allow_scroll = !encoder->no_scroll;
+	encoder->no_scroll = false;
+
+	xf_damage_clear(encoder->damage);
+
+	pthread_mutex_unlock(&(encoder->mutex));
+
+	frame->top = frame->rects[0].y;
+	bottom = frame->rects[0].y + frame->rects[0].height;
+
+	for (i = 1; i < num_rects; i++)
+	{
+		frame->top = MIN(frame->top, frame->rects[i].y);
+		bottom = MAX(bottom, frame->rects[i].y + frame->rects[i].height);
+	}
+
+	frame->width = xfi->width;
+	frame->height = bottom - frame->top;
+
+	*image = xf_snapshot_rects(encoder, buffer, frame->rects, num_rects, frame->top, frame->height);
+
+	if (*image == NULL)
+	{
+		xf_frame_unref(encoder, frame);
+		return NULL;
+	}
+
+	return frame;
+}
+
+/**
+ * Scrolling frames can only be used if every viewer supports blits.
+ */
+
+static boolean xf_encoder_can_scroll(xfEncoder* encoder)
+{
+	int i;
+	boolean can_scroll;
+
+	pthread_mutex_lock(&(encoder->peers_mutex));
+
+	can_scroll = (encoder->num_peers > 0);
+
+	for (i = 0; i < encoder->num_peers; i++)
+	{
+		if (!encoder->peers[i]->settings->order_support[NEG_SCRBLT_INDEX])
+			can_scroll = false;
+	}
+
+	pthread_mutex_unlock(&(encoder->peers_mutex));
+
+	return can_scroll;
+}
+
+/**
+ * Look for a scrolled area in a frame. Motion detection needs the whole
+ * bounding box of the damage to be up to date in the image, so it is only
+ * done when the damage covers its bounding box. On success, the scrolled
+ * area is taken out of the frame rectangles.
+ */
+
+static void xf_encoder_detect_scroll(xfEncoder* encoder, xfFrame* frame, uint8* data, int scanline)
+{
+	int i, k;
+	int dy;
+	int area = 0;
+	int num_rects = 0;
+	RFX_RECT* rects;
+	RFX_RECT* rect;
+	RFX_RECT bounds;
+	RFX_RECT dest;
+	int left, top, right, bottom;
+
+	left = frame->rects[0].x;
+	top = frame->rects[0].y;
+	right = frame->rects[0].x + frame->rects[0].width;
+	bottom = frame->rects[0].y + frame->rects[0].height;
+
+	for (i = 0; i < frame->num_rects; i++)
+	{
+		rect = &frame->rects[i];
+		left = MIN(left, rect->x);
+		top = MIN(top, rect->y);
+		right = MAX(right, rect->x + rect->width);
+		bottom = MAX(bottom, rect->y + rect->height);
+		area += rect->width * rect->height;
+	}
+
+	if (area != (right - left) * (bottom - top))
+		return;
+
+	bounds.x = left;
+	bounds.y = top;
+	bounds.width = right - left;
+	bounds.height = bottom - top;
+
+	if (!xf_motion_detect(encoder->motion, data, scanline, frame->top, &bounds, &dest, &dy))
+		return;
+
+	/* each rectangle leaves at most four pieces around the scrolled area */
+	rects = (RFX_RECT*) xmalloc(sizeof(RFX_RECT) * 4 * frame->num_rects);
+
+	for (i = 0; i < frame->num_rects; i++)
+	{
+		rect = &frame->rects[i];
+
+		left = MAX(rect->x, dest.x);
+		top = MAX(rect->y, dest.y);
+		right = MIN(rect->x + rect->width, dest.x + dest.width);
+		bottom = MIN(rect->y + rect->height, dest.y + dest.height);
+
+		if ((right <= left) || (bottom <= top))
+		{
+			rects[num_rects++] = *rect;
+			continue;
+		}
+
+		k = num_rects;
+
+		if (rect->y < top)
+		{
+			rects[k].x = rect->x;
+			rects[k].y = rect->y;
+			rects[k].width = rect->width;
+			rects[k].height = top - rect->y;
+			k++;
+		}
+
+		if (bottom < rect->y + rect->height)
+		{
+			rects[k].x = rect->x;
+			rects[k].y = bottom;
+			rects[k].width = rect->width;
+			rects[k].height = rect->y + rect->height - bottom;
+			k++;
+		}
+
+		if (rect->x < left)
+		{
+			rects[k].x = rect->x;
+			rects[k].y = top;
+			rects[k].width = left - rect->x;
+			rects[k].height = bottom - top;
+			k++;
+		}
+
+		if (right < rect->x + rect->width)
+		{
+			rects[k].x = right;
+			rects[k].y = top;
+			rects[k].width = rect->x + rect->width - right;
+			rects[k].height = bottom - top;
+			k++;
+		}
+
+		num_rects = k;
+	}
+
+	xfree(frame->rects);
+	frame->rects = rects;
+	frame->num_rects = num_rects;
+
+	frame->scroll = true;
+	frame->scroll_rect = dest;
+	frame->scroll_dy = dy;
+}
+
+/**
+ * Encode a captured frame. The encoded data is kept in the frame.
+ */
+
+static void xf_encoder_encode_frame(xfEncoder* encoder, xfFrame* frame, XImage* image, boolean shared)
+{
+	int i;
+	uint8* data;
+	RFX_RECT* rects;
+	RFX_RECT* captured;
+	int num_captured;
+
+	data = (uint8*) image->data;
+
+	/**
+	 * The surface starts at the first damaged row, which is tile aligned,
+	 * so the RemoteFX tile grid stays aligned with the damage grid.
+	 */
+	if (shared)
+		data = &data[frame->top * image->bytes_per_line];
+
+	captured = (RFX_RECT*) xmalloc(sizeof(RFX_RECT) * frame->num_rects);
+	memcpy(captured, frame->rects, sizeof(RFX_RECT) * frame->num_rects);
+	num_captured = frame->num_rects;
+
+	if (frame->allow_scroll && xf_encoder_can_scroll(encoder))
+		xf_encoder_detect_scroll(encoder, frame, data, image->bytes_per_line);
+
+	xf_motion_update(encoder->motion, data, image->bytes_per_line, frame->top, captured, num_captured);
+	xfree(captured);
+
+	if (frame->num_rects < 1)
+		return;
+
+	/* region rectangles are relative to the surface */
+	rects = (RFX_RECT*) xmalloc(sizeof(RFX_RECT) * frame->num_rects);
+	memcpy(rects, frame->rects, sizeof(RFX_RECT) * frame->num_rects);
+
+	for (i = 0; i < frame->num_rects; i++)
+		rects[i].y -= frame->top;
+
+	stream_set_pos(encoder->s, 0);
+	rfx_compose_message(encoder->rfx_context, encoder->s, rects, frame->num_rects, data,
+			frame->width, frame->height, image->bytes_per_line);
+
+	xfree(rects);
+
+	frame->length = stream_get_pos(encoder->s);
+	frame->data = (uint8*) xmalloc(frame->length);
+	memcpy(frame->data, stream_get_head(encoder->s), frame->length);
+}
+
+/**
+ * Hand an encoded frame to every peer, each getting its own reference. This
+ * is the only producer of the peer event queues. A peer whose queue is full
+ * misses the frame, whose area is damaged again, and skips the scrolling
+ * frames until it gets that damage. Until the encoder says which frame the
+ * damage goes into, the peer skips all of them.
+ */
+
+#define XF_MISSED_PENDING	0xFFFFFFFF
+
+static void xf_encoder_send_frame(xfEncoder* encoder, xfFrame* frame)
+{
+	int i;
+	uint32 seq;
 	xfPeerContext* xfp;
-	freerdp_peer* client;
-	uint32 wait_interval;
+	boolean missed = false;
+	xfEventFrame* event_frame;
 
-	client = (freerdp_peer*) param;
-	xfp = (xfPeerContext*) client->context;
-	xfi = xfp->info;
+	pthread_mutex_lock(&(encoder->peers_mutex));
+
+	for (i = 0; i < encoder->num_peers; i++)
+	{
+		xfp = (xfPeerContext*) encoder->peers[i]->context;
+
+		frame->refcount++;
+		event_frame = xf_event_frame_new(frame);
+
+		if (!xf_event_push(xfp->event_queue, (xfEvent*) event_frame))
+		{
+			frame->refcount--;
+			xf_event_frame_free(event_frame);
+			xfp->missed_until = XF_MISSED_PENDING;
+			missed = true;
+		}
+	}
+
+	pthread_mutex_unlock(&(encoder->peers_mutex));
+
+	if (!missed)
+		return;
+
+	/* the damage lock must not be taken under the peers lock */
+	seq = xf_encoder_redamage_frame(encoder, frame);
 
-	wait_interval = 1000000 / xfp->fps;
+	pthread_mutex_lock(&(encoder->peers_mutex));
+
+	for (i = 0; i < encoder->num_peers; i++)
+	{
+		xfp = (xfPeerContext*) encoder->peers[i]->context;
+
+		if (xfp->missed_until == XF_MISSED_PENDING)
+			xfp->missed_until = seq;
+	}
+
+	pthread_mutex_unlock(&(encoder->peers_mutex));
+}
+
+/**
+ * Pick the time to wait between frames: no shorter than the maximum frame
+ * rate allows, than encoding takes, or than the fastest viewer takes to
+ * acknowledge a frame, and no longer than the minimum frame rate allows.
+ * Slower viewers skip frames through their own flow control.
+ */
+
+static uint32 xf_encoder_get_frame_interval(xfEncoder* encoder)
+{
+	int i;
+	uint32 interval;
+	uint32 frame_time;
+	uint32 link_time = 0;
+
+	interval = 1000000 / encoder->max_fps;
+	interval = MAX(interval, encoder->encode_time);
+
+	pthread_mutex_lock(&(encoder->peers_mutex));
+
+	for (i = 0; i < encoder->num_peers; i++)
+	{
+		frame_time = ((xfPeerContext*) encoder->peers[i]->context)->link_time;
+
+		if ((i == 0) || (frame_time < link_time))
+			link_time = frame_time;
+	}
+
+	pthread_mutex_unlock(&(encoder->peers_mutex));
+
+	interval = MAX(interval, link_time);
+	interval = MIN(interval, 1000000 / encoder->min_fps);
+
+	return interval;
+}
+
+/**
+ * Whether any viewer can take a frame now, neither waiting for frame
+ * acknowledgements nor for its socket to drain, as last published by the
+ * peer threads.
+ */
+
+static boolean xf_encoder_is_peer_ready(xfEncoder* encoder)
+{
+	int i;
+	boolean ready = false;
+
+	pthread_mutex_lock(&(encoder->peers_mutex));
+
+	for (i = 0; i < encoder->num_peers; i++)
+	{
+		if (((xfPeerContext*) encoder->peers[i]->context)->ready)
+		{
+			ready = true;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&(encoder->peers_mutex));
+
+	return ready;
+}
+
+/**
+ * The peers lock nests inside the damage lock. Adding a peer signals the
+ * pacing condition under the damage lock, once the peer is in the list.
+ */
+
+static boolean xf_encoder_has_peers(xfEncoder* encoder)
+{
+	boolean has_peers;
+
+	pthread_mutex_lock(&(encoder->peers_mutex));
+	has_peers = (encoder->num_peers > 0);
+	pthread_mutex_unlock(&(encoder->peers_mutex));
+
+	return has_peers;
+}
+
+/**
+ * Sleep until there is damage, the frame interval has elapsed since the last
+ * frame and a viewer is ready for a frame. Damage is never held back longer
+ * than the minimum frame rate allows.
+ */
+
+static void xf_encoder_wait_for_frame(xfEncoder* encoder, uint64 next_frame)
+{
+	uint64 now;
+	uint64 wake_time;
+	uint64 max_time;
+	struct timespec ts;
+
+	pthread_mutex_lock(&(encoder->mutex));
+
+	/* idle until there is damage and someone to send it to */
+	while (encoder->running && (xf_damage_is_empty(encoder->damage) || !xf_encoder_has_peers(encoder)))
+		pthread_cond_wait(&(encoder->pacing_cond), &(encoder->mutex));
+
+	max_time = MAX(next_frame, xf_get_time() + 1000000 / encoder->min_fps);
+
+	while (encoder->running)
+	{
+		now = xf_get_time();
+
+		if (now >= max_time)
+			break;
+
+		if ((now >= next_frame) && xf_encoder_is_peer_ready(encoder))
+			break;
+
+		wake_time = (now < next_frame) ? next_frame : max_time;
+
+		ts.tv_sec = wake_time / 1000000;
+		ts.tv_nsec = (wake_time % 1000000) * 1000;
+
+		pthread_cond_timedwait(&(encoder->pacing_cond), &(encoder->mutex), &ts);
+	}
+
+	pthread_mutex_unlock(&(encoder->mutex));
+}
+
+/**
+ * Capture the damage as paced, into the next capture buffer once the
+ * encoder is done with it.
+ */
+
+static void* xf_capture_thread(void* param)
+{
+	XImage* image;
+	xfFrame* frame;
+	uint64 next_frame = 0;
+	xfCaptureBuffer* buffer;
+	xfEncoder* encoder = (xfEncoder*) param;
+
+	while (encoder->running)
+	{
+		xf_encoder_wait_for_frame(encoder, next_frame);
+
+		pthread_mutex_lock(&(encoder->buffers_mutex));
+
+		while (encoder->running && encoder->buffers[encoder->capture_index].captured)
+			pthread_cond_wait(&(encoder->buffers_cond), &(encoder->buffers_mutex));
+
+		buffer = &(encoder->buffers[encoder->capture_index]);
+
+		pthread_mutex_unlock(&(encoder->buffers_mutex));
+
+		if (!encoder->running)
+			break;
+
+		frame = xf_encoder_capture_frame(encoder, buffer, &image);
+
+		if (frame != NULL)
+		{
+			pthread_mutex_lock(&(encoder->buffers_mutex));
+
+			buffer->frame = frame;
+			if (buffer->image == NULL)
+				buffer->image = image;
+			buffer->captured = true;
+			encoder->capture_index = (encoder->capture_index + 1) % XF_CAPTURE_BUFFERS;
+
+			pthread_cond_broadcast(&(encoder->buffers_cond));
+			pthread_mutex_unlock(&(encoder->buffers_mutex));
+		}
+
+		next_frame = xf_get_time() + xf_encoder_get_frame_interval(encoder);
+	}
+
+	return NULL;
+}
+
+/**
+ * Encode the captured frames in order and hand them to the peers.
+ */
+
+static void* xf_encode_thread(void* param)
+{
+	xfFrame* frame;
+	boolean shared;
+	uint64 start_time;
+	uint32 encode_time;
+	xfCaptureBuffer* buffer;
+	xfEncoder* encoder = (xfEncoder*) param;
 
 	while (1)
 	{
-		// check if we should terminate
-		pthread_testcancel();
-		
-		event = xf_event_new(XF_EVENT_TYPE_FRAME_TICK);
-		xf_event_push(xfp->event_queue, (xfEvent*) event);
-		freerdp_usleep(wait_interval);
+		pthread_mutex_lock(&(encoder->buffers_mutex));
+
+		while (encoder->running && !encoder->buffers[encoder->encode_index].captured)
+			pthread_cond_wait(&(encoder->buffers_cond), &(encoder->buffers_mutex));
+
+		buffer = &(encoder->buffers[encoder->encode_index]);
+
+		pthread_mutex_unlock(&(encoder->buffers_mutex));
+
+		if (!encoder->running)
+			break;
+
+		frame = buffer->frame;
+		shared = (buffer->pixmap != 0);
+
+		start_time = xf_get_time();
+		xf_encoder_encode_frame(encoder, frame, buffer->image, shared);
+		encode_time = (uint32) (xf_get_time() - start_time);
+
+		encoder->encode_time = (encoder->encode_time == 0) ? encode_time :
+				(7 * encoder->encode_time + encode_time) / 8;
+
+		pthread_mutex_lock(&(encoder->buffers_mutex));
+
+		if (!shared)
+		{
+			XDestroyImage(buffer->image);
+			buffer->image = NULL;
+		}
+
+		buffer->frame = NULL;
+		buffer->captured = false;
+		encoder->encode_index = (encoder->encode_index + 1) % XF_CAPTURE_BUFFERS;
+
+		pthread_cond_broadcast(&(encoder->buffers_cond));
+		pthread_mutex_unlock(&(encoder->buffers_mutex));
+
+		xf_encoder_send_frame(encoder, frame);
+		xf_frame_unref(encoder, frame);
 	}
+
+	return NULL;
 }
 
-void* xf_monitor_updates(void* param)
+static void* xf_monitor_updates(void* param)
 {
 	int fds;
 	xfInfo* xfi;
 	XEvent xevent;
 	fd_set rfds_set;
+	int num_notify;
+	boolean was_empty;
+	boolean cursor_changed;
 	int select_status;
-	int pending_events;
-	xfPeerContext* xfp;
-	freerdp_peer* client;
+	xfEncoder* encoder;
 	uint32 wait_interval;
 	struct timeval timeout;
-	int x, y, width, height;
 	XDamageNotifyEvent* notify;
-	xfEventRegion* event_region;
 
-	client = (freerdp_peer*) param;
-	xfp = (xfPeerContext*) client->context;
-	xfi = xfp->info;
+	encoder = (xfEncoder*) param;
+	xfi = encoder->info;
 
 	fds = xfi->xfds;
 	wait_interval = (1000000 / 2500);
 	memset(&timeout, 0, sizeof(struct timeval));
 
-	pthread_create(&(xfp->frame_rate_thread), 0, xf_frame_rate_thread, (void*) client);
-
-	while (1)
+	while (encoder->running)
 	{
-		// check if we should terminate
-		pthread_testcancel();
-
 		FD_ZERO(&rfds_set);
 		FD_SET(fds, &rfds_set);
 
@@ -147,33 +902,345 @@ void* xf_monitor_updates(void* param)
 			//printf("select timeout\n");
 		}
 
-		pthread_mutex_lock(&(xfp->mutex));
-		pending_events = XPending(xfi->display);
-		pthread_mutex_unlock(&(xfp->mutex));
+		/**
+		 * Drain all the pending notifications at once, merging their
+		 * rectangles into the damage grid and emptying the server side
+		 * damage once, so that damage storms cost one lock and one request.
+		 */
+		pthread_mutex_lock(&(encoder->mutex));
 
-		if (pending_events > 0)
+		num_notify = 0;
+		cursor_changed = false;
+		was_empty = xf_damage_is_empty(encoder->damage);
+
+		while (XPending(xfi->display) > 0)
 		{
-			pthread_mutex_lock(&(xfp->mutex));
 			memset(&xevent, 0, sizeof(xevent));
 			XNextEvent(xfi->display, &xevent);
-			pthread_mutex_unlock(&(xfp->mutex));
 
 			if (xevent.type == xfi->xdamage_notify_event)
 			{
 				notify = (XDamageNotifyEvent*) &xevent;
 
-				x = notify->area.x;
-				y = notify->area.y;
-				width = notify->area.width;
-				height = notify->area.height;
-
-				xf_xdamage_subtract_region(xfp, x, y, width, height);
+				xf_damage_add(encoder->damage, notify->area.x, notify->area.y,
+						notify->area.width, notify->area.height);
 
-				event_region = xf_event_region_new(x, y, width, height);
-				xf_event_push(xfp->event_queue, (xfEvent*) event_region);
+				num_notify++;
+			}
+#ifdef WITH_XFIXES
+			else if (xfi->xfixes_cursor && (xevent.type == xfi->xfixes_cursor_notify_event))
+			{
+				cursor_changed = true;
 			}
+#endif
 		}
+
+		/* only the last of several cursor changes is of interest */
+		if (cursor_changed)
+			xf_encoder_capture_cursor(encoder);
+
+		if (num_notify > 0)
+		{
+			XDamageSubtract(xfi->display, xfi->xdamage, None, None);
+
+			if (was_empty)
+				pthread_cond_signal(&(encoder->pacing_cond));
+		}
+
+		pthread_mutex_unlock(&(encoder->mutex));
 	}
 
 	return NULL;
 }
+
+/**
+ * Start the encoder threads for the first viewer. Viewers join from their
+ * own threads, so the threads are started under the peers lock.
+ */
+
+static void xf_encoder_start(xfEncoder* encoder)
+{
+	pthread_mutex_lock(&(encoder->peers_mutex));
+
+	if (!encoder->running)
+	{
+		encoder->running = true;
+		pthread_create(&(encoder->monitor_thread), 0, xf_monitor_updates, (void*) encoder);
+		pthread_create(&(encoder->capture_thread), 0, xf_capture_thread, (void*) encoder);
+		pthread_create(&(encoder->encode_thread), 0, xf_encode_thread, (void*) encoder);
+	}
+
+	pthread_mutex_unlock(&(encoder->peers_mutex));
+}
+
+static void xf_encoder_stop(xfEncoder* encoder)
+{
+	if (!encoder->running)
+		return;
+
+	pthread_mutex_lock(&(encoder->buffers_mutex));
+	encoder->running = false;
+	pthread_cond_broadcast(&(encoder->buffers_cond));
+	pthread_mutex_unlock(&(encoder->buffers_mutex));
+
+	xf_encoder_wakeup(encoder);
+
+	pthread_join(encoder->monitor_thread, NULL);
+	pthread_join(encoder->capture_thread, NULL);
+	pthread_join(encoder->encode_thread, NULL);
+}
+
+/**
+ * Start sending frames to a peer. The whole screen is damaged so that the
+ * new viewer gets a complete picture with the next frame.
+ */
+
+void xf_encoder_add_peer(xfEncoder* encoder, freerdp_peer* client)
+{
+	xfPeerContext* xfp;
+
+	pthread_mutex_lock(&(encoder->peers_mutex));
+
+	if (encoder->num_peers >= encoder->max_peers)
+	{
+		encoder->max_peers *= 2;
+		encoder->peers = (freerdp_peer**) xrealloc(encoder->peers, sizeof(freerdp_peer*) * encoder->max_peers);
+	}
+
+	encoder->peers[encoder->num_peers++] = client;
+
+	pthread_mutex_unlock(&(encoder->peers_mutex));
+
+	xfp = (xfPeerContext*) client->context;
+	xfp->dirty_until = xf_encoder_refresh(encoder);
+	xf_encoder_start(encoder);
+}
+
+void xf_encoder_remove_peer(xfEncoder* encoder, freerdp_peer* client)
+{
+	int i;
+
+	pthread_mutex_lock(&(encoder->peers_mutex));
+
+	for (i = 0; i < encoder->num_peers; i++)
+	{
+		if (encoder->peers[i] == client)
+		{
+			encoder->num_peers--;
+			memmove(&encoder->peers[i], &encoder->peers[i + 1], (encoder->num_peers - i) * sizeof(freerdp_peer*));
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&(encoder->peers_mutex));
+}
+
+/**
+ * Set up a shared memory image of the whole screen for a capture buffer.
+ * The buffer is left without an image if XShm is not in use, in which case
+ * each capture fetches a new image.
+ */
+
+static void xf_capture_buffer_init(xfEncoder* encoder, xfCaptureBuffer* buffer)
+{
+	xfInfo* xfi = encoder->info;
+
+	buffer->shm_info.shmid = -1;
+	buffer->shm_info.shmaddr = (char*) -1;
+
+	if (!xfi->use_xshm)
+		return;
+
+	buffer->image = XShmCreateImage(encoder->capture_display, xfi->visual, xfi->depth,
+			ZPixmap, NULL, &(buffer->shm_info), xfi->width, xfi->height);
+
+	if (buffer->image == NULL)
+	{
+		printf("XShmCreateImage failed\n");
+		return;
+	}
+
+	buffer->shm_info.shmid = shmget(IPC_PRIVATE,
+			buffer->image->bytes_per_line * buffer->image->height, IPC_CREAT | 0600);
+
+	if (buffer->shm_info.shmid != -1)
+		buffer->shm_info.shmaddr = shmat(buffer->shm_info.shmid, 0, 0);
+
+	if (buffer->shm_info.shmaddr == ((char*) -1))
+	{
+		printf("failed to allocate shared memory for capture\n");
+		XDestroyImage(buffer->image);
+		buffer->image = NULL;
+		return;
+	}
+
+	buffer->shm_info.readOnly = False;
+	buffer->image->data = buffer->shm_info.shmaddr;
+
+	XShmAttach(encoder->capture_display, &(buffer->shm_info));
+	XSync(encoder->capture_display, False);
+
+	shmctl(buffer->shm_info.shmid, IPC_RMID, 0);
+
+	buffer->pixmap = XShmCreatePixmap(encoder->capture_display,
+			xfi->root_window, buffer->image->data, &(buffer->shm_info),
+			buffer->image->width, buffer->image->height, buffer->image->depth);
+}
+
+static void xf_capture_buffer_uninit(xfEncoder* encoder, xfCaptureBuffer* buffer)
+{
+	if (buffer->frame != NULL)
+		xf_frame_unref(encoder, buffer->frame);
+
+	if (buffer->pixmap != 0)
+		XFreePixmap(encoder->capture_display, buffer->pixmap);
+
+	if (buffer->shm_info.shmaddr != ((char*) -1))
+	{
+		XShmDetach(encoder->capture_display, &(buffer->shm_info));
+		shmdt(buffer->shm_info.shmaddr);
+		buffer->image->data = NULL;
+	}
+
+	if (buffer->image != NULL)
+		XDestroyImage(buffer->image);
+}
+
+static xfEncoder* xf_encoder_new(void)
+{
+	int i;
+	xfInfo* xfi;
+	XGCValues values;
+	xfEncoder* encoder;
+
+	encoder = xnew(xfEncoder);
+
+	encoder->info = xf_info_init();
+	xfi = encoder->info;
+
+	encoder->min_fps = MAX(xf_min_fps, 1);
+	encoder->max_fps = MAX(xf_max_fps, encoder->min_fps);
+
+	pthread_mutex_init(&(encoder->mutex), NULL);
+	pthread_cond_init(&(encoder->pacing_cond), NULL);
+	pthread_mutex_init(&(encoder->peers_mutex), NULL);
+	pthread_mutex_init(&(encoder->buffers_mutex), NULL);
+	pthread_cond_init(&(encoder->buffers_cond), NULL);
+
+	encoder->capture_display = XOpenDisplay(NULL);
+
+	if (encoder->capture_display == NULL)
+	{
+		printf("failed to open capture display: %s\n", XDisplayName(NULL));
+
+		pthread_mutex_destroy(&(encoder->mutex));
+		pthread_cond_destroy(&(encoder->pacing_cond));
+		pthread_mutex_destroy(&(encoder->peers_mutex));
+		pthread_mutex_destroy(&(encoder->buffers_mutex));
+		pthread_cond_destroy(&(encoder->buffers_cond));
+
+		xf_info_free(encoder->info);
+		xfree(encoder);
+
+		return NULL;
+	}
+
+	values.subwindow_mode = IncludeInferiors;
+	encoder->capture_gc = XCreateGC(encoder->capture_display, xfi->root_window, GCSubwindowMode, &values);
+	XSetFunction(encoder->capture_display, encoder->capture_gc, GXcopy);
+
+	for (i = 0; i < XF_CAPTURE_BUFFERS; i++)
+		xf_capture_buffer_init(encoder, &(encoder->buffers[i]));
+
+	encoder->damage = xf_damage_new(xfi->width, xfi->height);
+	encoder->motion = xf_motion_new(xfi->width, xfi->height);
+
+	encoder->rfx_context = rfx_context_new();
+	encoder->rfx_context->mode = RLGR3;
+	encoder->rfx_context->width = xfi->width;
+	encoder->rfx_context->height = xfi->height;
+	rfx_context_set_pixel_format(encoder->rfx_context, RDP_PIXEL_FORMAT_B8G8R8A8);
+
+	/* peers join at any time, so each of them sends the header on its own */
+	encoder->rfx_header = stream_new(64);
+	rfx_compose_message_header(encoder->rfx_context, encoder->rfx_header);
+
+	encoder->s = stream_new(65536);
+
+	encoder->max_peers = 4;
+	encoder->peers = (freerdp_peer**) xzalloc(sizeof(freerdp_peer*) * encoder->max_peers);
+
+	/* cursor notifications only report changes, start from the current cursor */
+	xf_encoder_capture_cursor(encoder);
+
+	return encoder;
+}
+
+static void xf_encoder_free(xfEncoder* encoder)
+{
+	int i;
+
+	xf_encoder_stop(encoder);
+
+	for (i = 0; i < XF_CAPTURE_BUFFERS; i++)
+		xf_capture_buffer_uninit(encoder, &(encoder->buffers[i]));
+
+	XFreeGC(encoder->capture_display, encoder->capture_gc);
+	XCloseDisplay(encoder->capture_display);
+
+	stream_free(encoder->s);
+	stream_free(encoder->rfx_header);
+	rfx_context_free(encoder->rfx_context);
+	xf_damage_free(encoder->damage);
+	xf_motion_free(encoder->motion);
+	xf_info_free(encoder->info);
+
+	if (encoder->cursor != NULL)
+		xf_cursor_unref(encoder, encoder->cursor);
+
+	pthread_mutex_destroy(&(encoder->mutex));
+	pthread_cond_destroy(&(encoder->pacing_cond));
+	pthread_mutex_destroy(&(encoder->peers_mutex));
+	pthread_mutex_destroy(&(encoder->buffers_mutex));
+	pthread_cond_destroy(&(encoder->buffers_cond));
+
+	xfree(encoder->peers);
+	xfree(encoder);
+}
+
+/**
+ * Get the encoder of the display, creating it for the first viewer.
+ * Returns NULL if the display cannot be captured.
+ */
+
+xfEncoder* xf_encoder_acquire(void)
+{
+	xfEncoder* encoder;
+
+	pthread_mutex_lock(&xf_shared_encoder_mutex);
+
+	if (xf_shared_encoder == NULL)
+		xf_shared_encoder = xf_encoder_new();
+
+	encoder = xf_shared_encoder;
+
+	if (encoder != NULL)
+		encoder->refcount++;
+
+	pthread_mutex_unlock(&xf_shared_encoder_mutex);
+
+	return encoder;
+}
+
+void xf_encoder_release(xfEncoder* encoder)
+{
+	pthread_mutex_lock(&xf_shared_encoder_mutex);
+
+	if (--encoder->refcount == 0)
+	{
+		xf_encoder_free(encoder);
+		xf_shared_encoder = NULL;
+	}
+
+	pthread_mutex_unlock(&xf_shared_encoder_mutex);
+}
@@ -20,13 +20,180 @@
 #ifndef __XF_ENCODE_H
 #define __XF_ENCODE_H
 
+typedef struct xf_frame xfFrame;
+typedef struct xf_cursor xfCursor;
+typedef struct xf_encoder xfEncoder;
+typedef struct xf_capture_buffer xfCaptureBuffer;
+
 #include <pthread.h>
 #include "xfreerdp.h"
 
+#include <freerdp/codec/rfx.h>
+#include <freerdp/utils/stream.h>
+
+#include "xf_damage.h"
+#include "xf_motion.h"
 #include "xf_peer.h"
 
-XImage* xf_snapshot(xfPeerContext* xfp, int x, int y, int width, int height);
-void xf_xdamage_subtract_region(xfPeerContext* xfp, int x, int y, int width, int height);
-void* xf_monitor_updates(void* param);
+/**
+ * An encoded RemoteFX frame, shared by all the peers it is sent to.
+ * The surface starts at the first damaged row and spans the screen width.
+ *
+ * A scrolling frame starts with a screen to screen blit of scroll_rect from
+ * scroll_dy rows above, which only works for peers having all the previous
+ * frames, and its rectangles are what the blit leaves to encode.
+ */
+
+struct xf_frame
+{
+	int refcount;
+	uint32 seq;
+
+	boolean allow_scroll;
+	boolean scroll;
+	int scroll_dy;
+	RFX_RECT scroll_rect;
+
+	int top;
+	int width;
+	int height;
+	int num_rects;
+	RFX_RECT* rects;
+
+	uint8* data;
+	uint32 length;
+};
+
+/**
+ * The cursor of the display, as a bottom-up 32 bpp pointer shape with an
+ * alpha channel and an empty AND mask. Cursors larger than the pointers
+ * every client accepts are cropped around their hotspot. Peers only ever
+ * send the latest cursor, so quick successions of changes coalesce.
+ */
+
+#define XF_CURSOR_MAX_SIZE	32
+
+struct xf_cursor
+{
+	int refcount;
+	uint32 seq;
+
+	int width;
+	int height;
+	int xhot;
+	int yhot;
+
+	uint8* xor_mask;
+	uint32 xor_length;
+	uint8* and_mask;
+	uint32 and_length;
+};
+
+/**
+ * A frame captured from the display, waiting to be encoded. With XShm, the
+ * image is a shared memory image of the whole screen, of which only the
+ * damaged rectangles of the frame are up to date.
+ */
+
+#define XF_CAPTURE_BUFFERS	2
+
+struct xf_capture_buffer
+{
+	boolean captured;
+	xfFrame* frame;
+	XImage* image;
+	Pixmap pixmap;
+	XShmSegmentInfo shm_info;
+};
+
+/**
+ * The encoder captures and encodes the display once per frame for all of
+ * its viewers, then hands the encoded frame to each of them. What is left
+ * for the peers is sending the frame and their own flow control.
+ *
+ * Capture and encoding run on their own threads, passing frames through
+ * a ring of capture buffers, so that frame N + 1 is captured while frame N
+ * is being encoded. Capture uses its own display connection, which keeps
+ * the display lock free for input and damage notifications.
+ */
+
+struct xf_encoder
+{
+	int refcount;
+	xfInfo* info;
+
+	boolean running;
+	pthread_t monitor_thread;
+	pthread_t capture_thread;
+	pthread_t encode_thread;
+
+	/* serializes the use of the display and the damage */
+	pthread_mutex_t mutex;
+	xfDamage* damage;
+
+	/* frame pacing, signalled when damage arrives or a viewer acknowledges a frame */
+	pthread_cond_t pacing_cond;
+	int min_fps;
+	int max_fps;
+	uint32 encode_time;
+
+	/**
+	 * Frames are numbered as they are captured. Damage added again for
+	 * peers that missed frames goes in a frame without scrolling, after
+	 * which those peers are in sync again.
+	 */
+	uint32 frame_seq;
+	boolean no_scroll;
+	xfMotion* motion;
+
+	/* only used by the capture thread */
+	Display* capture_display;
+	GC capture_gc;
+
+	pthread_mutex_t buffers_mutex;
+	pthread_cond_t buffers_cond;
+	int capture_index;
+	int encode_index;
+	xfCaptureBuffer buffers[XF_CAPTURE_BUFFERS];
+
+	RFX_CONTEXT* rfx_context;
+	STREAM* rfx_header;
+	STREAM* s;
+
+	/* protects the list of peers, the cursor and the reference counts */
+	pthread_mutex_t peers_mutex;
+	xfCursor* cursor;
+	uint32 cursor_seq;
+	int num_peers;
+	int max_peers;
+	freerdp_peer** peers;
+};
+
+#define XF_DEFAULT_MIN_FPS	5
+#define XF_DEFAULT_MAX_FPS	30
+
+extern int xf_min_fps;
+extern int xf_max_fps;
+
+uint64 xf_get_time(void);
+
+XImage* xf_snapshot_rects(xfEncoder* encoder, xfCaptureBuffer* buffer, RFX_RECT* rects, int num_rects, int top, int height);
+
+void xf_encoder_add_damage(xfEncoder* encoder, int x, int y, int width, int height);
+void xf_encoder_wakeup(xfEncoder* encoder);
+uint32 xf_encoder_redamage_frame(xfEncoder* encoder, xfFrame* frame);
+uint32 xf_encoder_refresh(xfEncoder* encoder);
+void xf_encoder_add_peer(xfEncoder* encoder, freerdp_peer* client);
+void xf_encoder_remove_peer(xfEncoder* encoder, freerdp_peer* client);
+void xf_encoder_publish_peer(xfEncoder* encoder, freerdp_peer* client, boolean ready, uint32 link_time);
+
+xfFrame* xf_frame_ref(xfEncoder* encoder, xfFrame* frame);
+void xf_frame_unref(xfEncoder* encoder, xfFrame* frame);
+
+xfCursor* xf_encoder_get_cursor(xfEncoder* encoder, uint32 seq);
+void xf_cursor_unref(xfEncoder* encoder, xfCursor* cursor);
+
+xfEncoder* xf_encoder_acquire(void);
+void xf_encoder_release(xfEncoder* encoder);
 
 #endif /* __XF_ENCODE_H */
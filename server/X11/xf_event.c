@@ -32,7 +32,7 @@
 
 #include "xf_event.h"
 
-int xf_is_event_set(xfEventQueue* event_queue)
+static int xf_is_event_set(xfEventQueue* event_queue)
 {
 	fd_set rfds;
 	int num_set;
@@ -46,17 +46,7 @@ int xf_is_event_set(xfEventQueue* event_queue)
 	return (num_set == 1);
 }
 
-void xf_signal_event(xfEventQueue* event_queue)
-{
-	int length;
-
-	length = write(event_queue->pipe_fd[1], "sig", 4);
-
-	if (length != 4)
-		printf("xf_signal_event: error\n");
-}
-
-void xf_set_event(xfEventQueue* event_queue)
+static void xf_set_event(xfEventQueue* event_queue)
 {
 	int length;
 
@@ -66,7 +56,7 @@ void xf_set_event(xfEventQueue* event_queue)
 		printf("xf_set_event: error\n");
 }
 
-void xf_clear_events(xfEventQueue* event_queue)
+static void xf_clear_events(xfEventQueue* event_queue)
 {
 	int length;
 
@@ -75,93 +65,95 @@ void xf_clear_events(xfEventQueue* event_queue)
 		length = read(event_queue->pipe_fd[0], &length, 4);
 
 		if (length != 4)
-			printf("xf_clear_event: error\n");
+			printf("xf_clear_events: error\n");
 	}
 }
 
-void xf_clear_event(xfEventQueue* event_queue)
-{
-	int length;
-
-	length = read(event_queue->pipe_fd[0], &length, 4);
-
-	if (length != 4)
-		printf("xf_clear_event: error\n");
-}
+/**
+ * Wake up the consumer, unless it has been already. Unlike pushing events,
+ * this may be done from any thread.
+ */
 
-void xf_event_push(xfEventQueue* event_queue, xfEvent* event)
+void xf_event_queue_signal(xfEventQueue* event_queue)
 {
-	pthread_mutex_lock(&(event_queue->mutex));
-
-	if (event_queue->count >= event_queue->size)
-	{
-		event_queue->size *= 2;
-		event_queue->events = (xfEvent**) xrealloc((void*) event_queue->events, sizeof(xfEvent*) * event_queue->size);
-	}
-
-	event_queue->events[(event_queue->count)++] = event;
-
-	pthread_mutex_unlock(&(event_queue->mutex));
-
-	xf_set_event(event_queue);
+	if (__sync_lock_test_and_set(&(event_queue->signaled), 1) == 0)
+		xf_set_event(event_queue);
 }
 
-xfEvent* xf_event_peek(xfEventQueue* event_queue)
+/**
+ * Push an event from the producer thread. Returns false if the queue is full,
+ * in which case the event still belongs to the caller.
+ */
+
+boolean xf_event_push(xfEventQueue* event_queue, xfEvent* event)
 {
-	xfEvent* event;
+	uint32 tail = event_queue->tail;
 
-	pthread_mutex_lock(&(event_queue->mutex));
+	if (tail - event_queue->head >= XF_EVENT_QUEUE_SIZE)
+		return false;
 
-	if (event_queue->count < 1)
-		event = NULL;
-	else
-		event = event_queue->events[0];
+	event_queue->events[tail & (XF_EVENT_QUEUE_SIZE - 1)] = event;
 
-	pthread_mutex_unlock(&(event_queue->mutex));
+	/* publish the event before the new tail, and the tail before the flag test */
+	__sync_synchronize();
+	event_queue->tail = tail + 1;
+	__sync_synchronize();
 
-	return event;
+	xf_event_queue_signal(event_queue);
+
+	return true;
 }
 
 xfEvent* xf_event_pop(xfEventQueue* event_queue)
 {
 	xfEvent* event;
+	uint32 head = event_queue->head;
 
-	pthread_mutex_lock(&(event_queue->mutex));
-
-	if (event_queue->count < 1)
+	if (head == event_queue->tail)
 		return NULL;
 
-	/* remove event signal */
-	xf_clear_event(event_queue);
+	__sync_synchronize();
 
-	event = event_queue->events[0];
-	(event_queue->count)--;
+	event = event_queue->events[head & (XF_EVENT_QUEUE_SIZE - 1)];
 
-	memmove(&event_queue->events[0], &event_queue->events[1], event_queue->count * sizeof(void*));
-
-	pthread_mutex_unlock(&(event_queue->mutex));
+	/* the slot may only be reused once the event has been read */
+	__sync_synchronize();
+	event_queue->head = head + 1;
 
 	return event;
 }
 
-xfEventRegion* xf_event_region_new(int x, int y, int width, int height)
+/**
+ * Called by the consumer when woken up, before draining the queue. Any event
+ * pushed after this signals the pipe again, so none is left behind.
+ */
+
+void xf_event_queue_rearm(xfEventQueue* event_queue)
+{
+	if (event_queue->signaled)
+	{
+		xf_clear_events(event_queue);
+		event_queue->signaled = 0;
+		__sync_synchronize();
+	}
+}
+
+xfEventFrame* xf_event_frame_new(xfFrame* frame)
 {
-	xfEventRegion* event_region = xnew(xfEventRegion);
+	xfEventFrame* event_frame = xnew(xfEventFrame);
 
-	if (event_region != NULL)
+	if (event_frame != NULL)
 	{
-		event_region->x = x;
-		event_region->y = y;
-		event_region->width = width;
-		event_region->height = height;
+		event_frame->type = XF_EVENT_TYPE_FRAME;
+		event_frame->frame = frame;
 	}
 
-	return event_region;
+	return event_frame;
 }
 
-void xf_event_region_free(xfEventRegion* event_region)
+void xf_event_frame_free(xfEventFrame* event_frame)
 {
-	xfree(event_region);
+	xfree(event_frame);
 }
 
 xfEvent* xf_event_new(int type)
@@ -185,14 +177,8 @@ xfEventQueue* xf_event_queue_new()
 		event_queue->pipe_fd[0] = -1;
 		event_queue->pipe_fd[1] = -1;
 
-		event_queue->size = 16;
-		event_queue->count = 0;
-		event_queue->events = (xfEvent**) xzalloc(sizeof(xfEvent*) * event_queue->size);
-
 		if (pipe(event_queue->pipe_fd) < 0)
 			printf("xf_event_queue_new: pipe failed\n");
-
-		pthread_mutex_init(&(event_queue->mutex), NULL);
 	}
 
 	return event_queue;
@@ -211,6 +197,4 @@ void xf_event_queue_free(xfEventQueue* event_queue)
 		close(event_queue->pipe_fd[1]);
 		event_queue->pipe_fd[1] = -1;
 	}
-
-	pthread_mutex_destroy(&(event_queue->mutex));
 }
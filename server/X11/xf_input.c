@@ -27,6 +27,84 @@
 
 #include "xf_input.h"
 
+#ifdef WITH_XTEST
+
+/**
+ * Take the display for injecting input, unless the events are batched, in
+ * which case it is already taken.
+ */
+
+static void xf_input_lock(xfPeerContext* xfp)
+{
+	if (xfp->input_batch.active)
+		return;
+
+	pthread_mutex_lock(&(xfp->encoder->mutex));
+	XTestGrabControl(xfp->info->display, True);
+}
+
+static void xf_input_unlock(xfPeerContext* xfp)
+{
+	if (xfp->input_batch.active)
+		return;
+
+	XTestGrabControl(xfp->info->display, False);
+	XFlush(xfp->info->display);
+	pthread_mutex_unlock(&(xfp->encoder->mutex));
+}
+
+/**
+ * Inject the motion held back, before any event it must come before.
+ */
+
+static void xf_input_flush_motion(xfPeerContext* xfp)
+{
+	int x, y;
+
+	if (xf_batch_take_motion(&(xfp->input_batch), &x, &y))
+		XTestFakeMotionEvent(xfp->info->display, 0, x, y, CurrentTime);
+}
+
+/**
+ * Move the pointer. In a batch, consecutive motions only move the pointer
+ * to the last position.
+ */
+
+static void xf_input_motion(xfPeerContext* xfp, int x, int y)
+{
+	if (!xf_batch_motion(&(xfp->input_batch), x, y))
+		XTestFakeMotionEvent(xfp->info->display, 0, x, y, CurrentTime);
+}
+
+#endif
+
+/**
+ * The events of an input PDU are injected together, under one display lock
+ * and one grab, the damage monitor waiting once instead of once per event.
+ */
+
+void xf_input_begin(rdpInput* input)
+{
+#ifdef WITH_XTEST
+	xfPeerContext* xfp = (xfPeerContext*) input->context;
+
+	xf_input_lock(xfp);
+	xf_batch_begin(&(xfp->input_batch));
+#endif
+}
+
+void xf_input_end(rdpInput* input)
+{
+#ifdef WITH_XTEST
+	xfPeerContext* xfp = (xfPeerContext*) input->context;
+
+	xf_input_flush_motion(xfp);
+
+	xf_batch_end(&(xfp->input_batch));
+	xf_input_unlock(xfp);
+#endif
+}
+
 void xf_input_synchronize_event(rdpInput* input, uint32 flags)
 {
 	printf("Client sent a synchronize event (flags:0x%X)\n", flags);
@@ -47,18 +125,15 @@ void xf_input_keyboard_event(rdpInput* input, uint16 flags, uint16 code)
 
 	if (keycode != 0)
 	{
-		pthread_mutex_lock(&(xfp->mutex));
-
-		XTestGrabControl(xfi->display, True);
+		xf_input_lock(xfp);
+		xf_input_flush_motion(xfp);
 
 		if (flags & KBD_FLAGS_DOWN)
 			XTestFakeKeyEvent(xfi->display, keycode, True, 0);
 		else if (flags & KBD_FLAGS_RELEASE)
 			XTestFakeKeyEvent(xfi->display, keycode, False, 0);
 
-		XTestGrabControl(xfi->display, False);
-
-		pthread_mutex_unlock(&(xfp->mutex));
+		xf_input_unlock(xfp);
 	}
 #endif
 }
@@ -76,8 +151,7 @@ void xf_input_mouse_event(rdpInput* input, uint16 flags, uint16 x, uint16 y)
 	boolean down = false;
 	xfInfo* xfi = xfp->info;
 
-	pthread_mutex_lock(&(xfp->mutex));
-	XTestGrabControl(xfi->display, True);
+	xf_input_lock(xfp);
 
 	if (flags & PTR_FLAGS_WHEEL)
 	{
@@ -88,13 +162,14 @@ void xf_input_mouse_event(rdpInput* input, uint16 flags, uint16 x, uint16 y)
 
 		button = (negative) ? 5 : 4;
 
+		xf_input_flush_motion(xfp);
 		XTestFakeButtonEvent(xfi->display, button, True, 0);
 		XTestFakeButtonEvent(xfi->display, button, False, 0);
 	}
 	else
 	{
 		if (flags & PTR_FLAGS_MOVE)
-			XTestFakeMotionEvent(xfi->display, 0, x, y, 0);
+			xf_input_motion(xfp, x, y);
 
 		if (flags & PTR_FLAGS_BUTTON1)
 			button = 1;
@@ -107,11 +182,13 @@ void xf_input_mouse_event(rdpInput* input, uint16 flags, uint16 x, uint16 y)
 			down = true;
 
 		if (button != 0)
+		{
+			xf_input_flush_motion(xfp);
 			XTestFakeButtonEvent(xfi->display, button, down, 0);
+		}
 	}
 
-	XTestGrabControl(xfi->display, False);
-	pthread_mutex_unlock(&(xfp->mutex));
+	xf_input_unlock(xfp);
 #endif
 }
 
@@ -119,13 +196,10 @@ void xf_input_extended_mouse_event(rdpInput* input, uint16 flags, uint16 x, uint
 {
 #ifdef WITH_XTEST
 	xfPeerContext* xfp = (xfPeerContext*) input->context;
-	xfInfo* xfi = xfp->info;
 
-	pthread_mutex_lock(&(xfp->mutex));
-	XTestGrabControl(xfi->display, True);
-	XTestFakeMotionEvent(xfi->display, 0, x, y, CurrentTime);
-	XTestGrabControl(xfi->display, False);
-	pthread_mutex_unlock(&(xfp->mutex));
+	xf_input_lock(xfp);
+	xf_input_motion(xfp, x, y);
+	xf_input_unlock(xfp);
 #endif
 }
 
@@ -136,4 +210,6 @@ void xf_input_register_callbacks(rdpInput* input)
 	input->UnicodeKeyboardEvent = xf_input_unicode_keyboard_event;
 	input->MouseEvent = xf_input_mouse_event;
 	input->ExtendedMouseEvent = xf_input_extended_mouse_event;
+	input->BeginInput = xf_input_begin;
+	input->EndInput = xf_input_end;
 }
@@ -24,6 +24,8 @@
 
 #include "xfreerdp.h"
 
+void xf_input_begin(rdpInput* input);
+void xf_input_end(rdpInput* input);
 void xf_input_synchronize_event(rdpInput* input, uint32 flags);
 void xf_input_keyboard_event(rdpInput* input, uint16 flags, uint16 code);
 void xf_input_unicode_keyboard_event(rdpInput* input, uint16 flags, uint16 code);
@@ -0,0 +1,243 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * X11 Server Motion Detection
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <freerdp/utils/memory.h>
+
+#include "xf_motion.h"
+
+#define XF_MOTION_BPP	4
+
+static uint32 xf_motion_hash_row(uint8* row, int length)
+{
+	int i;
+	uint32 hash = 2166136261U;
+
+	for (i = 0; i < length; i++)
+		hash = (hash ^ row[i]) * 16777619U;
+
+	return hash;
+}
+
+static boolean xf_motion_column_matches(xfMotion* motion, uint8* data, int scanline, int top,
+		int x, int start, int end, int dy)
+{
+	int y;
+	uint8* new_pixel;
+	uint8* old_pixel;
+
+	for (y = start; y < end; y++)
+	{
+		new_pixel = &data[(y - top) * scanline + x * XF_MOTION_BPP];
+		old_pixel = &motion->reference[(y - dy) * motion->scanline + x * XF_MOTION_BPP];
+
+		if (memcmp(new_pixel, old_pixel, XF_MOTION_BPP) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Look for a vertical shift of the reference within bounds, the data holding
+ * the new frame with row y at (y - top) * scanline. The rows are hashed over
+ * the middle half of the bounds only, away from borders and scroll bars that
+ * do not move, and each changed row votes for the shifts under which it
+ * matches a row of the reference.
+ *
+ * The longest run of rows matching exactly under the best shift is then
+ * widened to all the columns that moved along. On success, dest is the area
+ * that is the reference shifted by dy rows.
+ */
+
+boolean xf_motion_detect(xfMotion* motion, uint8* data, int scanline, int top,
+		RFX_RECT* bounds, RFX_RECT* dest, int* dy)
+{
+	int i, j;
+	int shift;
+	int best;
+	int start;
+	int end;
+	int run_start;
+	int left, right;
+	int x, width, height;
+	uint8* new_row;
+	uint8* old_row;
+
+	height = bounds->height;
+
+	if ((height < XF_MOTION_MIN_ROWS) || (bounds->width < XF_MOTION_MIN_COLUMNS))
+		return false;
+
+	x = bounds->x + bounds->width / 4;
+	width = bounds->width / 2;
+
+	for (i = 0; i < height; i++)
+	{
+		new_row = &data[(bounds->y + i - top) * scanline + x * XF_MOTION_BPP];
+		old_row = &motion->reference[(bounds->y + i) * motion->scanline + x * XF_MOTION_BPP];
+
+		motion->new_hashes[i] = xf_motion_hash_row(new_row, width * XF_MOTION_BPP);
+		motion->old_hashes[i] = xf_motion_hash_row(old_row, width * XF_MOTION_BPP);
+	}
+
+	memset(motion->votes, 0, sizeof(int) * 2 * height);
+
+	for (i = 0; i < height; i++)
+	{
+		/* unchanged rows say nothing, neither do runs of identical rows */
+		if (motion->new_hashes[i] == motion->old_hashes[i])
+			continue;
+
+		if ((i > 0) && (motion->new_hashes[i] == motion->new_hashes[i - 1]))
+			continue;
+
+		for (j = 0; j < height; j++)
+		{
+			if (motion->old_hashes[j] == motion->new_hashes[i])
+				motion->votes[i - j + height]++;
+		}
+	}
+
+	best = 0;
+
+	for (i = 1; i < 2 * height; i++)
+	{
+		if ((i != height) && (motion->votes[i] > motion->votes[best]))
+			best = i;
+	}
+
+	if (motion->votes[best] < XF_MOTION_MIN_VOTES)
+		return false;
+
+	shift = best - height;
+
+	/* find the longest run of rows matching exactly under the shift */
+	start = end = 0;
+	run_start = -1;
+
+	for (i = MAX(0, shift); i <= MIN(height, height + shift); i++)
+	{
+		j = i - shift;
+
+		if ((i < MIN(height, height + shift)) && (motion->new_hashes[i] == motion->old_hashes[j]))
+		{
+			new_row = &data[(bounds->y + i - top) * scanline + x * XF_MOTION_BPP];
+			old_row = &motion->reference[(bounds->y + j) * motion->scanline + x * XF_MOTION_BPP];
+
+			if (memcmp(new_row, old_row, width * XF_MOTION_BPP) == 0)
+			{
+				if (run_start < 0)
+					run_start = i;
+
+				continue;
+			}
+		}
+
+		if ((run_start >= 0) && (i - run_start > end - start))
+		{
+			start = run_start;
+			end = i;
+		}
+
+		run_start = -1;
+	}
+
+	if (end - start < XF_MOTION_MIN_ROWS)
+		return false;
+
+	start += bounds->y;
+	end += bounds->y;
+
+	/* widen to the columns that moved along */
+	left = x;
+	right = x + width;
+
+	while ((left > bounds->x) && xf_motion_column_matches(motion, data, scanline, top, left - 1, start, end, shift))
+		left--;
+
+	while ((right < bounds->x + bounds->width) && xf_motion_column_matches(motion, data, scanline, top, right, start, end, shift))
+		right++;
+
+	dest->x = left;
+	dest->y = start;
+	dest->width = right - left;
+	dest->height = end - start;
+	*dy = shift;
+
+	return true;
+}
+
+/**
+ * Copy the given rectangles of a new frame into the reference.
+ */
+
+void xf_motion_update(xfMotion* motion, uint8* data, int scanline, int top,
+		RFX_RECT* rects, int num_rects)
+{
+	int i, y;
+
+	for (i = 0; i < num_rects; i++)
+	{
+		for (y = rects[i].y; y < rects[i].y + rects[i].height; y++)
+		{
+			memcpy(&motion->reference[y * motion->scanline + rects[i].x * XF_MOTION_BPP],
+					&data[(y - top) * scanline + rects[i].x * XF_MOTION_BPP],
+					rects[i].width * XF_MOTION_BPP);
+		}
+	}
+}
+
+xfMotion* xf_motion_new(int width, int height)
+{
+	xfMotion* motion;
+
+	motion = xnew(xfMotion);
+
+	if (motion != NULL)
+	{
+		motion->width = width;
+		motion->height = height;
+		motion->scanline = width * XF_MOTION_BPP;
+		motion->reference = (uint8*) xzalloc(motion->scanline * height);
+
+		motion->old_hashes = (uint32*) xmalloc(sizeof(uint32) * height);
+		motion->new_hashes = (uint32*) xmalloc(sizeof(uint32) * height);
+		motion->votes = (int*) xmalloc(sizeof(int) * 2 * height);
+	}
+
+	return motion;
+}
+
+void xf_motion_free(xfMotion* motion)
+{
+	if (motion != NULL)
+	{
+		xfree(motion->reference);
+		xfree(motion->old_hashes);
+		xfree(motion->new_hashes);
+		xfree(motion->votes);
+		xfree(motion);
+	}
+}
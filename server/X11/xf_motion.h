@@ -0,0 +1,57 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * X11 Server Motion Detection
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __XF_MOTION_H
+#define __XF_MOTION_H
+
+#include <freerdp/types.h>
+#include <freerdp/codec/rfx.h>
+
+typedef struct xf_motion xfMotion;
+
+/* a shift has to cover this much to be worth a screen to screen blit */
+#define XF_MOTION_MIN_ROWS	64
+#define XF_MOTION_MIN_COLUMNS	64
+#define XF_MOTION_MIN_VOTES	4
+
+/**
+ * Motion detection keeps a reference copy of the screen as last sent and
+ * looks for areas of a new frame that are the reference shifted vertically,
+ * as when scrolling, by matching row hashes.
+ */
+
+struct xf_motion
+{
+	int width;
+	int height;
+	int scanline;
+	uint8* reference;
+
+	uint32* old_hashes;
+	uint32* new_hashes;
+	int* votes;
+};
+
+boolean xf_motion_detect(xfMotion* motion, uint8* data, int scanline, int top,
+		RFX_RECT* bounds, RFX_RECT* dest, int* dy);
+void xf_motion_update(xfMotion* motion, uint8* data, int scanline, int top,
+		RFX_RECT* rects, int num_rects);
+
+xfMotion* xf_motion_new(int width, int height);
+void xf_motion_free(xfMotion* motion);
+
+#endif /* __XF_MOTION_H */
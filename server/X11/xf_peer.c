@@ -26,8 +26,6 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <sys/ipc.h>
-#include <sys/shm.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <sys/select.h>
@@ -56,7 +54,6 @@ void xf_xdamage_init(xfInfo* xfi)
 	int damage_event;
 	int damage_error;
 	int major, minor;
-	XGCValues values;
 
 	if (XShmQueryExtension(xfi->display) != False)
 	{
@@ -101,69 +98,44 @@ void xf_xdamage_init(xfInfo* xfi)
 		printf("XDamageCreate failed\n");
 		return;
 	}
-
-#ifdef WITH_XFIXES
-	xfi->xdamage_region = XFixesCreateRegion(xfi->display, NULL, 0);
-
-	if (xfi->xdamage_region == None)
-	{
-		printf("XFixesCreateRegion failed\n");
-		XDamageDestroy(xfi->display, xfi->xdamage);
-		xfi->xdamage = None;
-		return;
-	}
-#endif
-
-	values.subwindow_mode = IncludeInferiors;
-	xfi->xdamage_gc = XCreateGC(xfi->display, xfi->root_window, GCSubwindowMode, &values);
-	XSetFunction(xfi->display, xfi->xdamage_gc, GXcopy);
 }
 
 #endif
 
-void xf_xshm_init(xfInfo* xfi)
-{
-	xfi->fb_shm_info.shmid = -1;
-	xfi->fb_shm_info.shmaddr = (char*) -1;
-
-	xfi->fb_image = XShmCreateImage(xfi->display, xfi->visual, xfi->depth,
-			ZPixmap, NULL, &(xfi->fb_shm_info), xfi->width, xfi->height);
+#ifdef WITH_XFIXES
 
-	if (xfi->fb_image == NULL)
-	{
-		printf("XShmCreateImage failed\n");
-		return;
-	}
+/**
+ * Have the display report cursor changes, for the peers to follow them.
+ */
 
-	xfi->fb_shm_info.shmid = shmget(IPC_PRIVATE,
-			xfi->fb_image->bytes_per_line * xfi->fb_image->height, IPC_CREAT | 0600);
+void xf_xfixes_init(xfInfo* xfi)
+{
+	int xfixes_event;
+	int xfixes_error;
+	int major, minor;
 
-	if (xfi->fb_shm_info.shmid == -1)
+	if (XFixesQueryExtension(xfi->display, &xfixes_event, &xfixes_error) == 0)
 	{
-		printf("shmget failed\n");
+		printf("XFixesQueryExtension failed\n");
 		return;
 	}
 
-	xfi->fb_shm_info.readOnly = False;
-	xfi->fb_shm_info.shmaddr = shmat(xfi->fb_shm_info.shmid, 0, 0);
-	xfi->fb_image->data = xfi->fb_shm_info.shmaddr;
+	/* cursor images need version 2 */
+	major = minor = 0;
 
-	if (xfi->fb_shm_info.shmaddr == ((char*) -1))
+	if ((XFixesQueryVersion(xfi->display, &major, &minor) == 0) || (major < 2))
 	{
-		printf("shmat failed\n");
+		printf("XFixesQueryVersion failed: major:%d minor:%d\n", major, minor);
 		return;
 	}
 
-	XShmAttach(xfi->display, &(xfi->fb_shm_info));
-	XSync(xfi->display, False);
-
-	shmctl(xfi->fb_shm_info.shmid, IPC_RMID, 0);
-
-	xfi->fb_pixmap = XShmCreatePixmap(xfi->display,
-			xfi->root_window, xfi->fb_image->data, &(xfi->fb_shm_info),
-			xfi->fb_image->width, xfi->fb_image->height, xfi->fb_image->depth);
+	xfi->xfixes_cursor_notify_event = xfixes_event + XFixesCursorNotify;
+	XFixesSelectCursorInput(xfi->display, xfi->root_window, XFixesDisplayCursorNotifyMask);
+	xfi->xfixes_cursor = true;
 }
 
+#endif
+
 xfInfo* xf_info_init()
 {
 	int i;
@@ -179,10 +151,12 @@ xfInfo* xf_info_init()
 	xfi = xnew(xfInfo);
 
 	//xfi->use_xshm = true;
-	xfi->display = XOpenDisplay(NULL);
 
+	/* the display is used from several threads, this must come first */
 	XInitThreads();
 
+	xfi->display = XOpenDisplay(NULL);
+
 	if (xfi->display == NULL)
 	{
 		printf("failed to open display: %s\n", XDisplayName(NULL));
@@ -250,7 +224,9 @@ xfInfo* xf_info_init()
 	xf_xdamage_init(xfi);
 #endif
 
-	xf_xshm_init(xfi);
+#ifdef WITH_XFIXES
+	xf_xfixes_init(xfi);
+#endif
 
 	xfi->bytesPerPixel = 4;
 
@@ -259,31 +235,64 @@ xfInfo* xf_info_init()
 	return xfi;
 }
 
-void xf_peer_context_new(freerdp_peer* client, xfPeerContext* context)
+void xf_info_free(xfInfo* xfi)
 {
-	context->info = xf_info_init();
-	context->rfx_context = rfx_context_new();
-	context->rfx_context->mode = RLGR3;
-	context->rfx_context->width = context->info->width;
-	context->rfx_context->height = context->info->height;
+	if (xfi == NULL)
+		return;
+
+	freerdp_clrconv_free(xfi->clrconv);
+	XCloseDisplay(xfi->display);
+	xfree(xfi);
+}
 
-	rfx_context_set_pixel_format(context->rfx_context, RDP_PIXEL_FORMAT_B8G8R8A8);
+void xf_peer_context_new(freerdp_peer* client, xfPeerContext* context)
+{
+	/* the display is captured and encoded once for all of its viewers */
+	context->encoder = xf_encoder_acquire();
+	context->info = (context->encoder != NULL) ? context->encoder->info : NULL;
 
 	context->s = stream_new(65536);
+	context->pointer_cache = server_pointer_cache_new((rdpContext*) context);
 }
 
 void xf_peer_context_free(freerdp_peer* client, xfPeerContext* context)
 {
+	xfEvent* event;
+
 	if (context)
 	{
+		if (context->encoder != NULL)
+			xf_encoder_remove_peer(context->encoder, client);
+
+		if (context->event_queue != NULL)
+		{
+			while ((event = xf_event_pop(context->event_queue)) != NULL)
+			{
+				if (event->type == XF_EVENT_TYPE_FRAME)
+				{
+					xf_frame_unref(context->encoder, ((xfEventFrame*) event)->frame);
+					xf_event_frame_free((xfEventFrame*) event);
+				}
+				else
+				{
+					xf_event_free(event);
+				}
+			}
+
+			xf_event_queue_free(context->event_queue);
+			xfree(context->event_queue);
+		}
+
 		stream_free(context->s);
-		rfx_context_free(context->rfx_context);
+		server_pointer_cache_free(context->pointer_cache);
+
+		if (context->encoder != NULL)
+			xf_encoder_release(context->encoder);
 	}
 }
 
 void xf_peer_init(freerdp_peer* client)
 {
-	xfInfo* xfi;
 	xfPeerContext* xfp;
 
 	client->context_size = sizeof(xfPeerContext);
@@ -293,15 +302,10 @@ void xf_peer_init(freerdp_peer* client)
 
 	xfp = (xfPeerContext*) client->context;
 
-	xfp->fps = 24;
-	xfp->thread = 0;
 	xfp->activations = 0;
 	xfp->event_queue = xf_event_queue_new();
 
-	xfi = xfp->info;
-	xfp->hdc = gdi_CreateDC(xfi->clrconv, xfi->bpp);
-
-	pthread_mutex_init(&(xfp->mutex), NULL);
+	client->update->SurfaceFrameAcknowledge = xf_peer_frame_acknowledge;
 }
 
 STREAM* xf_peer_stream_init(xfPeerContext* context)
@@ -315,8 +319,12 @@ void xf_peer_live_rfx(freerdp_peer* client)
 {
 	xfPeerContext* xfp = (xfPeerContext*) client->context;
 
-	if (xfp->activations == 1)
-		pthread_create(&(xfp->thread), 0, xf_monitor_updates, (void*) client);
+	xfp->rfx_header_sent = false;
+
+	if (xfp->activations == 0)
+		xf_encoder_add_peer(xfp->encoder, client);
+	else
+		xfp->dirty_until = xf_encoder_refresh(xfp->encoder);
 }
 
 static boolean xf_peer_sleep_tsdiff(uint32 *old_sec, uint32 *old_usec, uint32 new_sec, uint32 new_usec)
@@ -394,79 +402,179 @@ void xf_peer_dump_rfx(freerdp_peer* client)
 	}
 }
 
-void xf_peer_rfx_update(freerdp_peer* client, int x, int y, int width, int height)
+void xf_peer_begin_frame(freerdp_peer* client)
+{
+	rdpUpdate* update = client->update;
+	SURFACE_FRAME_MARKER* fm = &update->surface_frame_marker;
+	xfPeerContext* xfp = (xfPeerContext*) client->context;
+
+	fm->frameAction = SURFACECMD_FRAMEACTION_BEGIN;
+	fm->frameId = ++xfp->frame_id;
+	update->SurfaceFrameMarker(update->context, fm);
+
+	xfp->frame_sent_time[xfp->frame_id % XF_FRAME_HISTORY] = xf_get_time();
+}
+
+void xf_peer_end_frame(freerdp_peer* client)
+{
+	rdpUpdate* update = client->update;
+	SURFACE_FRAME_MARKER* fm = &update->surface_frame_marker;
+	xfPeerContext* xfp = (xfPeerContext*) client->context;
+
+	fm->frameAction = SURFACECMD_FRAMEACTION_END;
+	fm->frameId = xfp->frame_id;
+	update->SurfaceFrameMarker(update->context, fm);
+}
+
+/**
+ * Returns false when the client has as many unacknowledged frames as it
+ * accepts, in which case the pending damage is kept and merged into the next frame.
+ */
+
+boolean xf_peer_can_send_frame(freerdp_peer* client)
+{
+	uint32 max_frames = client->settings->frame_acknowledge;
+
+	if (max_frames == 0)
+		return true;
+
+	return (client->GetFramesInFlight(client) < max_frames) ? true : false;
+}
+
+/**
+ * Frame acknowledgements measure how long the client takes to receive and
+ * process a frame. With several frames in flight, the client can take one
+ * frame per round trip divided by the number of frames it accepts.
+ */
+
+void xf_peer_frame_acknowledge(rdpContext* context, uint32 frameId)
+{
+	uint64 now;
+	uint32 round_trip;
+	uint32 max_frames;
+	freerdp_peer* client = context->peer;
+	xfPeerContext* xfp = (xfPeerContext*) context;
+
+	if ((frameId == 0) || (xfp->frame_id - frameId >= XF_FRAME_HISTORY))
+		return;
+
+	now = xf_get_time();
+	round_trip = (uint32) (now - xfp->frame_sent_time[frameId % XF_FRAME_HISTORY]);
+	max_frames = MAX(client->settings->frame_acknowledge, 1);
+
+	if (xfp->frame_time == 0)
+		xfp->frame_time = round_trip / max_frames;
+	else
+		xfp->frame_time = (7 * xfp->frame_time + round_trip / max_frames) / 8;
+}
+
+static uint32 xf_peer_get_frame_time(freerdp_peer* client)
+{
+	xfPeerContext* xfp = (xfPeerContext*) client->context;
+
+	if (client->settings->frame_acknowledge == 0)
+		return 0;
+
+	return xfp->frame_time;
+}
+
+/**
+ * Send a frame encoded by the shared encoder, starting with its blit if it
+ * scrolls. The RemoteFX header goes in front of the first frame a peer
+ * receives.
+ */
+
+void xf_peer_send_frame(freerdp_peer* client, xfFrame* frame)
 {
 	STREAM* s;
-	uint8* data;
-	xfInfo* xfi;
-	RFX_RECT rect;
-	XImage* image;
 	rdpUpdate* update;
 	xfPeerContext* xfp;
+	SCRBLT_ORDER scrblt;
 	SURFACE_BITS_COMMAND* cmd;
 
 	update = client->update;
 	xfp = (xfPeerContext*) client->context;
 	cmd = &update->surface_bits_command;
-	xfi = xfp->info;
 
-	if (width * height <= 0)
-		return;
+	cmd->destLeft = 0;
+	cmd->destTop = frame->top;
+	cmd->destRight = frame->width;
+	cmd->destBottom = frame->top + frame->height;
 
-	s = xf_peer_stream_init(xfp);
+	cmd->bpp = 32;
+	cmd->codecID = client->settings->rfx_codec_id;
+	cmd->width = frame->width;
+	cmd->height = frame->height;
 
-	if (xfi->use_xshm)
+	if ((frame->length > 0) && !xfp->rfx_header_sent)
 	{
-		/**
-		 * Passing an offset source rectangle to rfx_compose_message()
-		 * leads to protocol errors, so offset the data pointer instead.
-		 */
-		rect.x = 0;
-		rect.y = 0;
-		rect.width = width;
-		rect.height = height;
-
-		image = xf_snapshot(xfp, x, y, width, height);
-
-		data = (uint8*) image->data;
-		data = &data[(y * image->bytes_per_line) + (x * image->bits_per_pixel / 8)];
-
-		rfx_compose_message(xfp->rfx_context, s, &rect, 1, data,
-				width, height, image->bytes_per_line);
-
-		cmd->destLeft = x;
-		cmd->destTop = y;
-		cmd->destRight = x + width;
-		cmd->destBottom = y + height;
+		s = xf_peer_stream_init(xfp);
+		stream_check_size(s, stream_get_pos(xfp->encoder->rfx_header) + frame->length);
+		stream_write(s, stream_get_head(xfp->encoder->rfx_header), stream_get_pos(xfp->encoder->rfx_header));
+		stream_write(s, frame->data, frame->length);
+
+		cmd->bitmapDataLength = stream_get_pos(s);
+		cmd->bitmapData = stream_get_head(s);
+
+		xfp->rfx_header_sent = true;
 	}
 	else
 	{
-		rect.x = 0;
-		rect.y = 0;
-		rect.width = width;
-		rect.height = height;
+		cmd->bitmapDataLength = frame->length;
+		cmd->bitmapData = frame->data;
+	}
 
-		image = xf_snapshot(xfp, x, y, width, height);
+	xf_peer_begin_frame(client);
 
-		rfx_compose_message(xfp->rfx_context, s, &rect, 1,
-				(uint8*) image->data, width, height, width * xfi->bytesPerPixel);
+	if (frame->scroll)
+	{
+		scrblt.nLeftRect = frame->scroll_rect.x;
+		scrblt.nTopRect = frame->scroll_rect.y;
+		scrblt.nWidth = frame->scroll_rect.width;
+		scrblt.nHeight = frame->scroll_rect.height;
+		scrblt.bRop = 0xCC; /* SRCCOPY */
+		scrblt.nXSrc = frame->scroll_rect.x;
+		scrblt.nYSrc = frame->scroll_rect.y - frame->scroll_dy;
+
+		update->primary->ScrBlt(update->context, &scrblt);
+	}
 
-		cmd->destLeft = x;
-		cmd->destTop = y;
-		cmd->destRight = x + width;
-		cmd->destBottom = y + height;
+	if (frame->length > 0)
+		update->SurfaceBits(update->context, cmd);
 
-		XDestroyImage(image);
-	}
+	xf_peer_end_frame(client);
+}
 
-	cmd->bpp = 32;
-	cmd->codecID = client->settings->rfx_codec_id;
-	cmd->width = width;
-	cmd->height = height;
-	cmd->bitmapDataLength = stream_get_length(s);
-	cmd->bitmapData = stream_get_head(s);
+/**
+ * Send the cursor of the display, if it changed since the peer got one.
+ */
+
+void xf_peer_send_cursor(freerdp_peer* client)
+{
+	xfCursor* cursor;
+	POINTER_NEW_UPDATE pointer_new;
+	xfPeerContext* xfp = (xfPeerContext*) client->context;
 
-	update->SurfaceBits(update->context, cmd);
+	cursor = xf_encoder_get_cursor(xfp->encoder, xfp->cursor_seq);
+
+	if (cursor == NULL)
+		return;
+
+	memset(&pointer_new, 0, sizeof(POINTER_NEW_UPDATE));
+	pointer_new.xorBpp = 32;
+	pointer_new.colorPtrAttr.xPos = cursor->xhot;
+	pointer_new.colorPtrAttr.yPos = cursor->yhot;
+	pointer_new.colorPtrAttr.width = cursor->width;
+	pointer_new.colorPtrAttr.height = cursor->height;
+	pointer_new.colorPtrAttr.lengthXorMask = cursor->xor_length;
+	pointer_new.colorPtrAttr.xorMaskData = cursor->xor_mask;
+	pointer_new.colorPtrAttr.lengthAndMask = cursor->and_length;
+	pointer_new.colorPtrAttr.andMaskData = cursor->and_mask;
+
+	server_pointer_cache_set(xfp->pointer_cache, &pointer_new);
+
+	xfp->cursor_seq = cursor->seq;
+	xf_cursor_unref(xfp->encoder, cursor);
 }
 
 boolean xf_peer_get_fds(freerdp_peer* client, void** rfds, int* rcount)
@@ -484,45 +592,55 @@ boolean xf_peer_get_fds(freerdp_peer* client, void** rfds, int* rcount)
 
 boolean xf_peer_check_fds(freerdp_peer* client)
 {
-	xfInfo* xfi;
 	xfEvent* event;
 	xfPeerContext* xfp;
-	HGDI_RGN invalid_region;
 
 	xfp = (xfPeerContext*) client->context;
-	xfi = xfp->info;
 
-	if (xfp->activated == false)
-		return true;
+	xf_event_queue_rearm(xfp->event_queue);
 
-	event = xf_event_peek(xfp->event_queue);
+	if (xfp->activated)
+		xf_peer_send_cursor(client);
 
-	if (event != NULL)
+	while ((event = xf_event_pop(xfp->event_queue)) != NULL)
 	{
-		if (event->type == XF_EVENT_TYPE_REGION)
-		{
-			xfEventRegion* region = (xfEventRegion*) xf_event_pop(xfp->event_queue);
-			gdi_InvalidateRegion(xfp->hdc, region->x, region->y, region->width, region->height);
-			xf_event_region_free(region);
-		}
-		else if (event->type == XF_EVENT_TYPE_FRAME_TICK)
+		if (event->type == XF_EVENT_TYPE_FRAME)
 		{
-			event = xf_event_pop(xfp->event_queue);
-			invalid_region = xfp->hdc->hwnd->invalid;
+			xfEventFrame* event_frame = (xfEventFrame*) event;
+			xfFrame* frame = event_frame->frame;
 
-			if (invalid_region->null == false)
+			if (xfp->activated == false)
 			{
-				xf_peer_rfx_update(client, invalid_region->x, invalid_region->y,
-					invalid_region->w, invalid_region->h);
+				/* a full refresh follows the activation */
+			}
+			else if (frame->scroll && (frame->seq <= xfp->dirty_until || frame->seq <= xfp->missed_until))
+			{
+				/* the blit would move stale content, wait until in sync */
+				xfp->dirty_until = xf_encoder_redamage_frame(xfp->encoder, frame);
+			}
+			else if (xf_peer_can_send_frame(client))
+			{
+				xf_peer_send_frame(client, frame);
+			}
+			else
+			{
+				/* have the skipped area encoded again in a later frame */
+				xfp->dirty_until = xf_encoder_redamage_frame(xfp->encoder, frame);
 			}
 
-			invalid_region->null = 1;
-			xfp->hdc->hwnd->ninvalid = 0;
-
+			xf_frame_unref(xfp->encoder, frame);
+			xf_event_frame_free(event_frame);
+		}
+		else
+		{
 			xf_event_free(event);
 		}
 	}
 
+	xf_encoder_publish_peer(xfp->encoder, client,
+			xf_peer_can_send_frame(client) && !client->IsWriteBlocked(client),
+			xf_peer_get_frame_time(client));
+
 	return true;
 }
 
@@ -581,9 +699,13 @@ boolean xf_peer_activate(freerdp_peer* client)
 {
 	xfPeerContext* xfp = (xfPeerContext*) client->context;
 
-	rfx_context_reset(xfp->rfx_context);
 	xfp->activated = true;
 
+	/* the client starts over with an empty pointer cache */
+	server_pointer_cache_reset(xfp->pointer_cache);
+	xfp->cursor_seq = 0;
+	xf_peer_send_cursor(client);
+
 	if (xf_pcap_file != NULL)
 	{
 		client->update->dump_rfx = true;
@@ -604,20 +726,34 @@ void* xf_peer_main_loop(void* arg)
 	int fds;
 	int max_fds;
 	int rcount;
+	int wcount;
 	void* rfds[32];
+	void* wfds[32];
 	fd_set rfds_set;
+	fd_set wfds_set;
+	boolean write_blocked;
 	rdpSettings* settings;
 	char* server_file_path;
 	freerdp_peer* client = (freerdp_peer*) arg;
 	xfPeerContext* xfp;
 
 	memset(rfds, 0, sizeof(rfds));
+	memset(wfds, 0, sizeof(wfds));
 
 	printf("We've got a client %s\n", client->hostname);
 
 	xf_peer_init(client);
 	xfp = (xfPeerContext*) client->context;
 
+	if (xfp->encoder == NULL)
+	{
+		printf("Refusing client %s, the display cannot be captured\n", client->hostname);
+		client->Disconnect(client);
+		freerdp_peer_context_free(client);
+		freerdp_peer_free(client);
+		return NULL;
+	}
+
 	settings = client->settings;
 
 	/* Initialize the real server settings here */
@@ -668,6 +804,7 @@ void* xf_peer_main_loop(void* arg)
 
 		max_fds = 0;
 		FD_ZERO(&rfds_set);
+		FD_ZERO(&wfds_set);
 
 		for (i = 0; i < rcount; i++)
 		{
@@ -682,7 +819,31 @@ void* xf_peer_main_loop(void* arg)
 		if (max_fds == 0)
 			break;
 
-		if (select(max_fds + 1, &rfds_set, NULL, NULL, NULL) == -1)
+		/* wait for the socket to become writable while the send queue is backed up */
+		write_blocked = client->IsWriteBlocked(client);
+
+		if (write_blocked)
+		{
+			wcount = 0;
+
+			if (client->GetWriteFileDescriptor(client, wfds, &wcount) != true)
+			{
+				printf("Failed to get FreeRDP write file descriptor\n");
+				break;
+			}
+
+			for (i = 0; i < wcount; i++)
+			{
+				fds = (int)(long)(wfds[i]);
+
+				if (fds > max_fds)
+					max_fds = fds;
+
+				FD_SET(fds, &wfds_set);
+			}
+		}
+
+		if (select(max_fds + 1, &rfds_set, write_blocked ? &wfds_set : NULL, NULL, NULL) == -1)
 		{
 			/* these are not really errors */
 			if (!((errno == EAGAIN) ||
@@ -695,6 +856,12 @@ void* xf_peer_main_loop(void* arg)
 			}
 		}
 
+		if (write_blocked && (client->DrainSendQueue(client) < 0))
+		{
+			printf("Failed to drain send queue\n");
+			break;
+		}
+
 		if (client->CheckFileDescriptor(client) != true)
 		{
 			printf("Failed to check freerdp file descriptor\n");
@@ -711,12 +878,6 @@ void* xf_peer_main_loop(void* arg)
 
 	client->Disconnect(client);
 	
-	pthread_cancel(xfp->thread);
-	pthread_cancel(xfp->frame_rate_thread);
-	
-	pthread_join(xfp->thread, NULL);
-	pthread_join(xfp->frame_rate_thread, NULL);
-	
 	freerdp_peer_context_free(client);
 	freerdp_peer_free(client);
 
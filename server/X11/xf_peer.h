@@ -20,35 +20,61 @@
 #ifndef __XF_PEER_H
 #define __XF_PEER_H
 
-#include <freerdp/gdi/gdi.h>
-#include <freerdp/gdi/dc.h>
-#include <freerdp/gdi/region.h>
 #include <freerdp/codec/rfx.h>
 #include <freerdp/listener.h>
+#include <freerdp/cache/server_pointer.h>
 #include <freerdp/utils/stream.h>
 #include <freerdp/utils/stopwatch.h>
 
 typedef struct xf_peer_context xfPeerContext;
 
+#define XF_FRAME_HISTORY	16
+
 #include "xfreerdp.h"
+#include "xf_encode.h"
+#include "xf_batch.h"
 
 struct xf_peer_context
 {
 	rdpContext _p;
 
-	int fps;
 	STREAM* s;
-	HGDI_DC hdc;
+	uint32 frame_id;
 	xfInfo* info;
 	int activations;
-	pthread_t thread;
 	boolean activated;
-	pthread_mutex_t mutex;
-	RFX_CONTEXT* rfx_context;
+	xfEncoder* encoder;
+	boolean rfx_header_sent;
 	xfEventQueue* event_queue;
-	pthread_t frame_rate_thread;
+
+	/* the peer misses frames before this one, which must not scroll */
+	uint32 dirty_until;
+
+	/* as above, for the frames the encoder could not queue for the peer */
+	volatile uint32 missed_until;
+
+	/* input events of one PDU are injected under one lock and one grab */
+	xfInputBatch input_batch;
+
+	/* the cursor the peer was last sent */
+	uint32 cursor_seq;
+	rdpServerPointerCache* pointer_cache;
+
+	/* time the client takes per frame, from its acknowledgements */
+	uint32 frame_time;
+	uint64 frame_sent_time[XF_FRAME_HISTORY];
+
+	/* published to the encoder under the peers lock */
+	boolean ready;
+	uint32 link_time;
 };
 
+xfInfo* xf_info_init();
+void xf_info_free(xfInfo* xfi);
+
+boolean xf_peer_can_send_frame(freerdp_peer* client);
+void xf_peer_frame_acknowledge(rdpContext* context, uint32 frameId);
+
 void xf_peer_accepted(freerdp_listener* instance, freerdp_peer* client);
 
 #endif /* __XF_PEER_H */
@@ -33,6 +33,7 @@
 #include <freerdp/utils/memory.h>
 
 #include "xf_peer.h"
+#include "xf_encode.h"
 #include "xfreerdp.h"
 
 char* xf_pcap_file = NULL;
@@ -100,6 +101,7 @@ void xf_server_main_loop(freerdp_listener* instance)
 
 int main(int argc, char* argv[])
 {
+	int index;
 	freerdp_listener* instance;
 
 	/* ignore SIGPIPE, otherwise an SSL_write failure could crash the server */
@@ -108,10 +110,25 @@ int main(int argc, char* argv[])
 	instance = freerdp_listener_new();
 	instance->PeerAccepted = xf_peer_accepted;
 
-	if (argc > 1)
-		xf_pcap_file = argv[1];
+	index = 1;
 
-	if (argc > 2 && !strcmp(argv[2], "--fast"))
+	/* bounds for the adaptive frame rate */
+	while (index + 1 < argc)
+	{
+		if (!strcmp(argv[index], "--min-fps"))
+			xf_min_fps = atoi(argv[index + 1]);
+		else if (!strcmp(argv[index], "--max-fps"))
+			xf_max_fps = atoi(argv[index + 1]);
+		else
+			break;
+
+		index += 2;
+	}
+
+	if (argc > index)
+		xf_pcap_file = argv[index];
+
+	if (argc > index + 1 && !strcmp(argv[index + 1], "--fast"))
 		xf_pcap_dump_realtime = false;
 
 	/* Open the server socket and start listening. */
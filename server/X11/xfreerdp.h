@@ -59,16 +59,16 @@ struct xf_info
 	HCLRCONV clrconv;
 	boolean use_xshm;
 
-	XImage* fb_image;
-	Pixmap fb_pixmap;
 	Window root_window;
-	XShmSegmentInfo fb_shm_info;
 
 #ifdef WITH_XDAMAGE
-	GC xdamage_gc;
 	Damage xdamage;
 	int xdamage_notify_event;
-	XserverRegion xdamage_region;
+#endif
+
+#ifdef WITH_XFIXES
+	boolean xfixes_cursor;
+	int xfixes_cursor_notify_event;
 #endif
 };
 
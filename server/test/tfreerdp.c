@@ -36,6 +36,8 @@
 #include <freerdp/utils/thread.h>
 #include <freerdp/codec/rfx.h>
 #include <freerdp/codec/nsc.h>
+#include <freerdp/codec/color.h>
+#include <freerdp/cache/server_bitmap.h>
 #include <freerdp/listener.h>
 #include <freerdp/channels/wtsvc.h>
 #include <freerdp/server/audin.h>
@@ -69,6 +71,8 @@ struct test_peer_context
 
 	RFX_CONTEXT* rfx_context;
 	NSC_CONTEXT* nsc_context;
+	rdpServerBitmapCache* bitmap_cache;
+	uint8* tile_data;
 	STREAM* s;
 	uint8* icon_data;
 	uint8* bg_data;
@@ -86,6 +90,9 @@ struct test_peer_context
 };
 typedef struct test_peer_context testPeerContext;
 
+/* bitmaps sent through the bitmap cache are cut in tiles of that many pixels */
+#define TEST_TILE_SIZE	64
+
 void test_peer_context_new(freerdp_peer* client, testPeerContext* context)
 {
 	context->rfx_context = rfx_context_new();
@@ -97,6 +104,9 @@ void test_peer_context_new(freerdp_peer* client, testPeerContext* context)
 	context->nsc_context = nsc_context_new();
 	nsc_context_set_pixel_format(context->nsc_context, RDP_PIXEL_FORMAT_R8G8B8);
 
+	context->bitmap_cache = server_bitmap_cache_new((rdpContext*) context);
+	context->tile_data = (uint8*) xmalloc(TEST_TILE_SIZE * TEST_TILE_SIZE * 4);
+
 	context->s = stream_new(65536);
 
 	context->icon_x = -1;
@@ -119,6 +129,8 @@ void test_peer_context_free(freerdp_peer* client, testPeerContext* context)
 		xfree(context->bg_data);
 		rfx_context_free(context->rfx_context);
 		nsc_context_free(context->nsc_context);
+		server_bitmap_cache_free(context->bitmap_cache);
+		xfree(context->tile_data);
 		if (context->debug_channel)
 		{
 			WTSVirtualChannelClose(context->debug_channel);
@@ -170,6 +182,70 @@ static void test_peer_end_frame(freerdp_peer* client)
 	context->frame_id++;
 }
 
+/**
+ * Without a bitmap codec, draw RGB data through the client bitmap cache, in
+ * tiles converted to the client color depth: tiles seen before, such as the
+ * uniform background, are drawn from the cache with a MemBlt order alone.
+ */
+
+static void test_peer_draw_cached(freerdp_peer* client, uint8* rgb_data, int x, int y, int width, int height)
+{
+	int i, j;
+	int tx, ty;
+	int tw, th;
+	int bpp;
+	uint8 r, g, b;
+	uint8* src;
+	uint8* dst;
+	uint16 pixel;
+	testPeerContext* context = (testPeerContext*) client->context;
+
+	bpp = client->settings->color_depth;
+
+	if ((bpp != 15) && (bpp != 16) && (bpp != 24) && (bpp != 32))
+		return;
+
+	for (ty = 0; ty < height; ty += TEST_TILE_SIZE)
+	{
+		for (tx = 0; tx < width; tx += TEST_TILE_SIZE)
+		{
+			tw = MIN(TEST_TILE_SIZE, width - tx);
+			th = MIN(TEST_TILE_SIZE, height - ty);
+			dst = context->tile_data;
+
+			for (j = 0; j < th; j++)
+			{
+				src = &rgb_data[((ty + j) * width + tx) * 3];
+
+				for (i = 0; i < tw; i++)
+				{
+					r = *src++;
+					g = *src++;
+					b = *src++;
+
+					if (bpp <= 16)
+					{
+						pixel = (bpp == 15) ? RGB15(r, g, b) : RGB16(r, g, b);
+						*dst++ = pixel & 0xFF;
+						*dst++ = (pixel >> 8) & 0xFF;
+						continue;
+					}
+
+					*dst++ = b;
+					*dst++ = g;
+					*dst++ = r;
+
+					if (bpp == 32)
+						*dst++ = 0xFF;
+				}
+			}
+
+			server_bitmap_cache_draw(context->bitmap_cache, x + tx, y + ty, tw, th,
+				context->tile_data, tw * ((bpp + 7) / 8), bpp);
+		}
+	}
+}
+
 static void test_peer_draw_background(freerdp_peer* client)
 {
 	testPeerContext* context = (testPeerContext*) client->context;
@@ -181,7 +257,16 @@ static void test_peer_draw_background(freerdp_peer* client)
 	int size;
 
 	if (!client->settings->rfx_codec && !client->settings->ns_codec)
+	{
+		size = client->settings->width * client->settings->height * 3;
+		rgb_data = xmalloc(size);
+		memset(rgb_data, 0xA0, size);
+
+		test_peer_draw_cached(client, rgb_data, 0, 0, client->settings->width, client->settings->height);
+
+		xfree(rgb_data);
 		return;
+	}
 
 	test_peer_begin_frame(client);
 
@@ -234,9 +319,6 @@ static void test_peer_load_icon(freerdp_peer* client)
 	uint8* rgb_data;
 	int c;
 
-	if (!client->settings->rfx_codec && !client->settings->ns_codec)
-		return;
-
 	if ((fp = fopen("test_icon.ppm", "r")) == NULL)
 		return;
 
@@ -283,6 +365,21 @@ static void test_peer_draw_icon(freerdp_peer* client, int x, int y)
 	if (context->icon_width < 1 || !context->activated)
 		return;
 
+	if (!client->settings->rfx_codec && !client->settings->ns_codec)
+	{
+		if (context->icon_x >= 0)
+		{
+			test_peer_draw_cached(client, context->bg_data, context->icon_x, context->icon_y,
+				context->icon_width, context->icon_height);
+		}
+
+		test_peer_draw_cached(client, context->icon_data, x, y, context->icon_width, context->icon_height);
+
+		context->icon_x = x;
+		context->icon_y = y;
+		return;
+	}
+
 	test_peer_begin_frame(client);
 
 	rect.x = 0;
@@ -565,6 +662,9 @@ boolean tf_peer_activate(freerdp_peer* client)
 	rfx_context_reset(context->rfx_context);
 	context->activated = true;
 
+	/* the client bitmap caches are empty after the capability exchange */
+	server_bitmap_cache_reset(context->bitmap_cache);
+
 	if (test_pcap_file != NULL)
 	{
 		client->update->dump_rfx = true;